@@ -21,6 +21,9 @@
 /* Use zlib instead of builtin zlib decoder. */
 #cmakedefine ENABLE_ZLIB 1
 
+/* Use zlib to compress streams in saved documents. */
+#cmakedefine ENABLE_ZLIB_ENCODER 1
+
 /* Use cairo for rendering. */
 #cmakedefine HAVE_CAIRO 1
 
@@ -441,6 +441,122 @@ int FoFiTrueType::mapCodeToGID(int i, Guint c) {
   return gid;
 }
 
+void FoFiTrueType::mapCodesToGIDs(int i, Guint nCodes, int *gids) {
+  Guint segCnt, segEnd, segStart, segDelta, segOffset, prevEnd;
+  Guint cmapFirst, cmapLen, c, seg;
+  int pos, gid;
+  GBool ok, segOk, first;
+
+  for (c = 0; c < nCodes; ++c) {
+    gids[c] = 0;
+  }
+  if (i < 0 || i >= nCmaps) {
+    return;
+  }
+  ok = gTrue;
+  pos = cmaps[i].offset;
+  switch (cmaps[i].fmt) {
+  case 0:
+    for (c = 0; c < nCodes && c + 6 < (Guint)cmaps[i].len; ++c) {
+      gids[c] = getU8(pos + 6 + c, &ok);
+    }
+    return;
+  case 4:
+    // the segments must be sorted by end code (as the binary search in
+    // mapCodeToGID assumes), otherwise fall back to code-by-code lookup
+    segCnt = getU16BE(pos + 6, &ok) / 2;
+    if (!ok || segCnt == 0 || !checkRegion(pos + 14, 8 * segCnt + 2)) {
+      break;
+    }
+    prevEnd = 0;
+    first = gTrue;
+    for (seg = 0; seg < segCnt; ++seg) {
+      segEnd = getU16BE(pos + 14 + 2*seg, &ok);
+      if (!ok || (!first && segEnd < prevEnd)) {
+	break;
+      }
+      segOk = gTrue;
+      segStart = getU16BE(pos + 16 + 2*segCnt + 2*seg, &segOk);
+      segDelta = getU16BE(pos + 16 + 4*segCnt + 2*seg, &segOk);
+      segOffset = getU16BE(pos + 16 + 6*segCnt + 2*seg, &segOk);
+      // this segment covers the codes after the previous segment's end
+      c = first ? 0 : prevEnd + 1;
+      if (c < segStart) {
+	c = segStart;
+      }
+      for (; segOk && c <= segEnd && c < nCodes; ++c) {
+	if (segOffset == 0) {
+	  gids[c] = (c + segDelta) & 0xffff;
+	} else {
+	  ok = gTrue;
+	  gid = getU16BE(pos + 16 + 6*segCnt + 2*seg +
+			 segOffset + 2 * (c - segStart), &ok);
+	  if (gid != 0) {
+	    gid = (gid + segDelta) & 0xffff;
+	  }
+	  gids[c] = ok ? gid : 0;
+	}
+      }
+      prevEnd = segEnd;
+      first = gFalse;
+    }
+    if (seg == segCnt) {
+      return;
+    }
+    break;
+  case 6:
+    cmapFirst = getU16BE(pos + 6, &ok);
+    cmapLen = getU16BE(pos + 8, &ok);
+    if (!ok) {
+      return;
+    }
+    for (c = cmapFirst; c < cmapFirst + cmapLen && c < nCodes; ++c) {
+      ok = gTrue;
+      gid = getU16BE(pos + 10 + 2 * (c - cmapFirst), &ok);
+      gids[c] = ok ? gid : 0;
+    }
+    return;
+  case 12:
+    segCnt = getU32BE(pos + 12, &ok);
+    if (!ok || segCnt == 0 || segCnt > (Guint)(len / 12) ||
+	!checkRegion(pos + 16, 12 * segCnt)) {
+      break;
+    }
+    prevEnd = 0;
+    first = gTrue;
+    for (seg = 0; seg < segCnt; ++seg) {
+      segStart = getU32BE(pos + 16 + 12*seg, &ok);
+      segEnd = getU32BE(pos + 16 + 12*seg+4, &ok);
+      segDelta = getU32BE(pos + 16 + 12*seg+8, &ok);
+      if (!ok || (!first && segEnd < prevEnd)) {
+	break;
+      }
+      if (first || prevEnd < 0xffffffff) {
+	c = first ? 0 : prevEnd + 1;
+	if (c < segStart) {
+	  c = segStart;
+	}
+	for (; c <= segEnd && c < nCodes; ++c) {
+	  gids[c] = segDelta + (c - segStart);
+	}
+      }
+      prevEnd = segEnd;
+      first = gFalse;
+    }
+    if (seg == segCnt) {
+      return;
+    }
+    break;
+  default:
+    return;
+  }
+
+  // malformed subtable
+  for (c = 0; c < nCodes; ++c) {
+    gids[c] = mapCodeToGID(i, c);
+  }
+}
+
 int FoFiTrueType::mapNameToGID(char *name) {
   if (!nameToGID) {
     return 0;
@@ -463,6 +579,18 @@ GBool FoFiTrueType::getCFFBlock(char **start, int *length) {
   return gTrue;
 }
 
+GBool FoFiTrueType::getTable(const char *tag, char **start, int *length) {
+  int i;
+
+  if ((i = seekTable(tag)) < 0 ||
+      !checkRegion(tables[i].offset, tables[i].len)) {
+    return gFalse;
+  }
+  *start = (char *)file + tables[i].offset;
+  *length = tables[i].len;
+  return gTrue;
+}
+
 int *FoFiTrueType::getCIDToGIDMap(int *nCIDs) {
   char *start;
   int length;
@@ -563,7 +691,7 @@ void FoFiTrueType::convertToType42(char *psName, char **encoding,
 
 void FoFiTrueType::convertToType1(char *psName, const char **newEncoding,
 				  GBool ascii, FoFiOutputFunc outputFunc,
-				  void *outputStream) {
+				  void *outputStream, char *subset) {
   char *start;
   int length;
   FoFiType1C *ff;
@@ -574,7 +702,8 @@ void FoFiTrueType::convertToType1(char *psName, const char **newEncoding,
   if (!(ff = FoFiType1C::make(start, length))) {
     return;
   }
-  ff->convertToType1(psName, newEncoding, ascii, outputFunc, outputStream);
+  ff->convertToType1(psName, newEncoding, ascii, outputFunc, outputStream,
+		     subset);
   delete ff;
 }
 
@@ -846,6 +975,244 @@ void FoFiTrueType::convertToType0(char *psName, int *cidMap, int nCIDs,
   delete ff;
 }
 
+GBool FoFiTrueType::writeSubsetTTF(char *subset,
+				   FoFiOutputFunc outputFunc,
+				   void *outputStream) {
+  TrueTypeLoca *locaTable;
+  TrueTypeTable *newTables;
+  GooString *buf, *glyfData, *locaData;
+  Guchar headData[54];
+  const char *data;
+  char *glyphs;
+  GBool ok;
+  Guint checksum;
+  int glyfIdx, locaIdx, headIdx, glyfPos, locaPos, glyfTableLen;
+  int newLocaFmt, length, pos, n, i;
+
+  if (openTypeCFF ||
+      (glyfIdx = seekTable("glyf")) < 0 ||
+      (locaIdx = seekTable("loca")) < 0 ||
+      (headIdx = seekTable("head")) < 0 ||
+      !checkRegion(tables[headIdx].offset, 54)) {
+    return gFalse;
+  }
+  glyfPos = tables[glyfIdx].offset;
+  glyfTableLen = tables[glyfIdx].len;
+  locaPos = tables[locaIdx].offset;
+
+  // read the original 'loca' table -- the glyph lengths are computed
+  // from the sorted offsets, as in cvtSfnts
+  locaTable = (TrueTypeLoca *)gmallocn(nGlyphs + 1, sizeof(TrueTypeLoca));
+  ok = gTrue;
+  for (i = 0; i <= nGlyphs; ++i) {
+    locaTable[i].idx = i;
+    if (locaFmt) {
+      locaTable[i].origOffset = (int)getU32BE(locaPos + i*4, &ok);
+    } else {
+      locaTable[i].origOffset = 2 * getU16BE(locaPos + i*2, &ok);
+    }
+    if (locaTable[i].origOffset > glyfTableLen) {
+      locaTable[i].origOffset = glyfTableLen;
+    }
+  }
+  if (!ok) {
+    gfree(locaTable);
+    return gFalse;
+  }
+  std::sort(locaTable, locaTable + nGlyphs + 1,
+	    cmpTrueTypeLocaOffsetFunctor());
+  for (i = 0; i < nGlyphs; ++i) {
+    locaTable[i].len = locaTable[i+1].origOffset - locaTable[i].origOffset;
+  }
+  locaTable[nGlyphs].len = 0;
+  std::sort(locaTable, locaTable + nGlyphs + 1, cmpTrueTypeLocaIdxFunctor());
+
+  // the glyphs to keep
+  glyphs = (char *)gmalloc(nGlyphs > 0 ? nGlyphs : 1);
+  memcpy(glyphs, subset, nGlyphs);
+  if (nGlyphs > 0) {
+    glyphs[0] = 1;
+  }
+  addCompositeGlyphs(glyphs, locaTable, glyfPos);
+
+  // construct the new 'glyf' and 'loca' tables (a bogus loca format
+  // is replaced by the long format)
+  newLocaFmt = (locaFmt == 0) ? 0 : 1;
+  glyfData = new GooString();
+  locaData = new GooString();
+  for (i = 0; i <= nGlyphs; ++i) {
+    pos = glyfData->getLength();
+    if (newLocaFmt) {
+      locaData->append((char)(pos >> 24))->append((char)(pos >> 16))
+	      ->append((char)(pos >> 8))->append((char)pos);
+    } else {
+      locaData->append((char)(pos >> 9))->append((char)(pos >> 1));
+    }
+    if (i < nGlyphs && glyphs[i] && locaTable[i].len > 0 &&
+	checkRegion(glyfPos + locaTable[i].origOffset, locaTable[i].len)) {
+      glyfData->append((char *)file + glyfPos + locaTable[i].origOffset,
+		       locaTable[i].len);
+      while (glyfData->getLength() & 3) {
+	glyfData->append('\0');
+      }
+    }
+  }
+  gfree(glyphs);
+  gfree(locaTable);
+
+  // the 'head' table, with the font checksum zeroed out
+  memcpy(headData, file + tables[headIdx].offset, 54);
+  headData[8] = headData[9] = headData[10] = headData[11] = (Guchar)0;
+  headData[50] = 0;
+  headData[51] = (Guchar)newLocaFmt;
+
+  // construct the new table headers, in tag order
+  newTables = (TrueTypeTable *)gmallocn(nTables, sizeof(TrueTypeTable));
+  memcpy(newTables, tables, nTables * sizeof(TrueTypeTable));
+  std::sort(newTables, newTables + nTables, cmpTrueTypeTableTagFunctor());
+  pos = 12 + nTables * 16;
+  for (i = 0; i < nTables; ++i) {
+    newTables[i].origOffset = newTables[i].offset;
+    if (newTables[i].tag == headTag) {
+      newTables[i].len = 54;
+      newTables[i].checksum = computeTableChecksum(headData, 54);
+    } else if (newTables[i].tag == locaTag) {
+      newTables[i].len = locaData->getLength();
+      newTables[i].checksum =
+	  computeTableChecksum((Guchar *)locaData->getCString(),
+			       locaData->getLength());
+    } else if (newTables[i].tag == glyfTag) {
+      newTables[i].len = glyfData->getLength();
+      newTables[i].checksum =
+	  computeTableChecksum((Guchar *)glyfData->getCString(),
+			       glyfData->getLength());
+    } else {
+      newTables[i].checksum =
+	  computeTableChecksum(file + newTables[i].origOffset,
+			       newTables[i].len);
+    }
+    newTables[i].offset = pos;
+    pos += (newTables[i].len + 3) & ~3;
+  }
+
+  // construct the table directory
+  buf = new GooString();
+  buf->append((char)0)->append((char)1)->append((char)0)->append((char)0);
+  buf->append((char)(nTables >> 8))->append((char)nTables);
+  for (n = 0; (2 << n) <= nTables; ++n) ;
+  buf->append((char)((16 << n) >> 8))->append((char)(16 << n));
+  buf->append((char)(n >> 8))->append((char)n);
+  length = 16 * nTables - (16 << n);
+  buf->append((char)(length >> 8))->append((char)length);
+  for (i = 0; i < nTables; ++i) {
+    buf->append((char)(newTables[i].tag >> 24))
+       ->append((char)(newTables[i].tag >> 16))
+       ->append((char)(newTables[i].tag >> 8))
+       ->append((char)newTables[i].tag);
+    buf->append((char)(newTables[i].checksum >> 24))
+       ->append((char)(newTables[i].checksum >> 16))
+       ->append((char)(newTables[i].checksum >> 8))
+       ->append((char)newTables[i].checksum);
+    buf->append((char)(newTables[i].offset >> 24))
+       ->append((char)(newTables[i].offset >> 16))
+       ->append((char)(newTables[i].offset >> 8))
+       ->append((char)newTables[i].offset);
+    buf->append((char)(newTables[i].len >> 24))
+       ->append((char)(newTables[i].len >> 16))
+       ->append((char)(newTables[i].len >> 8))
+       ->append((char)newTables[i].len);
+  }
+
+  // compute the font checksum and store it in the head table
+  checksum = computeTableChecksum((Guchar *)buf->getCString(),
+				  buf->getLength());
+  for (i = 0; i < nTables; ++i) {
+    checksum += newTables[i].checksum;
+  }
+  checksum = 0xb1b0afba - checksum; // because the TrueType spec says so
+  headData[ 8] = (Guchar)(checksum >> 24);
+  headData[ 9] = (Guchar)(checksum >> 16);
+  headData[10] = (Guchar)(checksum >>  8);
+  headData[11] = (Guchar) checksum;
+
+  // write the tables
+  for (i = 0; i < nTables; ++i) {
+    if (newTables[i].tag == headTag) {
+      data = (const char *)headData;
+    } else if (newTables[i].tag == locaTag) {
+      data = locaData->getCString();
+    } else if (newTables[i].tag == glyfTag) {
+      data = glyfData->getCString();
+    } else {
+      data = (const char *)file + newTables[i].origOffset;
+    }
+    buf->append(data, newTables[i].len);
+    while (buf->getLength() & 3) {
+      buf->append('\0');
+    }
+  }
+  (*outputFunc)(outputStream, buf->getCString(), buf->getLength());
+
+  delete buf;
+  delete glyfData;
+  delete locaData;
+  gfree(newTables);
+  return gTrue;
+}
+
+// Set the flags in <glyphs> for the components of the composite glyphs
+// whose flags are set.
+void FoFiTrueType::addCompositeGlyphs(char *glyphs, TrueTypeLoca *locaTable,
+				      int glyfPos) {
+  GBool ok, more;
+  int gid, pos, end, flags, i;
+
+  // components are usually listed after the glyphs that use them, but
+  // not always, so repeat until nothing changes
+  do {
+    more = gFalse;
+    for (i = 0; i < nGlyphs; ++i) {
+      if (glyphs[i] != 1 || locaTable[i].len < 10) {
+	continue;
+      }
+      glyphs[i] = 2; // done
+      ok = gTrue;
+      pos = glyfPos + locaTable[i].origOffset;
+      end = pos + locaTable[i].len;
+      if (getS16BE(pos, &ok) >= 0) {
+	continue;
+      }
+      pos += 10;
+      do {
+	flags = getU16BE(pos, &ok);
+	gid = getU16BE(pos + 2, &ok);
+	if (!ok || pos + 4 > end) {
+	  break;
+	}
+	if (gid < nGlyphs && !glyphs[gid]) {
+	  glyphs[gid] = 1;
+	  if (gid < i) {
+	    more = gTrue;
+	  }
+	}
+	pos += 4 + ((flags & 0x0001) ? 4 : 2);
+	if (flags & 0x0008) {		// we have a scale
+	  pos += 2;
+	} else if (flags & 0x0040) {	// x and y scale
+	  pos += 4;
+	} else if (flags & 0x0080) {	// two by two
+	  pos += 8;
+	}
+      } while (flags & 0x0020);		// more components
+    }
+  } while (more);
+  for (i = 0; i < nGlyphs; ++i) {
+    if (glyphs[i]) {
+      glyphs[i] = 1;
+    }
+  }
+}
+
 void FoFiTrueType::cvtEncoding(char **encoding,
 			       FoFiOutputFunc outputFunc,
 			       void *outputStream) {
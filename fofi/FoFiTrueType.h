@@ -38,6 +38,7 @@ class GooString;
 class GooHash;
 struct TrueTypeTable;
 struct TrueTypeCmap;
+struct TrueTypeLoca;
 
 //------------------------------------------------------------------------
 // FoFiTrueType
@@ -58,6 +59,9 @@ public:
   // if it's a TrueType font (or OpenType font with TrueType data).
   GBool isOpenTypeCFF() { return openTypeCFF; }
 
+  // Return the number of glyphs.
+  int getNumGlyphs() { return nGlyphs; }
+
   // Return the number of cmaps defined by this font.
   int getNumCmaps();
 
@@ -74,6 +78,11 @@ public:
   // Return the GID corresponding to <c> according to the <i>th cmap.
   int mapCodeToGID(int i, Guint c);
 
+  // Fill in <gids>[c] for all codes c < <nCodes> according to the
+  // <i>th cmap.  Gives the same results as calling mapCodeToGID for
+  // each code, but decodes the cmap subtable in a single pass.
+  void mapCodesToGIDs(int i, Guint nCodes, int *gids);
+
   // map gid to vertical glyph gid if exist.
   //   if not exist return original gid
   Guint mapToVertGID(Guint orgGID);
@@ -117,10 +126,12 @@ public:
   // not NULL, it will be used in place of the encoding in the Type 1C
   // font.  If <ascii> is true the eexec section will be hex-encoded,
   // otherwise it will be left as binary data.  If <psName> is
-  // non-NULL, it will be used as the PostScript font name.  (Only
-  // useful for OpenType CFF fonts.)
+  // non-NULL, it will be used as the PostScript font name.  <subset>
+  // is passed on to FoFiType1C::convertToType1.  (Only useful for
+  // OpenType CFF fonts.)
   void convertToType1(char *psName, const char **newEncoding, GBool ascii,
-		      FoFiOutputFunc outputFunc, void *outputStream);
+		      FoFiOutputFunc outputFunc, void *outputStream,
+		      char *subset = NULL);
 
   // Convert to a Type 2 CIDFont, suitable for embedding in a
   // PostScript file.  <psName> will be used as the PostScript font
@@ -152,11 +163,25 @@ public:
   void convertToType0(char *psName, int *cidMap, int nCIDs,
 		      FoFiOutputFunc outputFunc, void *outputStream);
 
+  // Write a TrueType font file in which the glyphs whose flags in
+  // <subset> (an array of getNumGlyphs() flags) are clear are replaced by
+  // empty glyphs.  The notdef glyph and the components of the composite
+  // glyphs that are kept are always kept.  The glyph IDs and all the
+  // other tables are unchanged.  Returns false, without writing
+  // anything, if the font can't be subset.  (Not useful for OpenType
+  // CFF fonts.)
+  GBool writeSubsetTTF(char *subset,
+		       FoFiOutputFunc outputFunc, void *outputStream);
+
   // Returns a pointer to the CFF font embedded in this OpenType font.
   // If successful, sets *<start> and *<length>, and returns true.
   // Otherwise returns false.  (Only useful for OpenType CFF fonts).
   GBool getCFFBlock(char **start, int *length);
 
+  // Set <start> and <length> to the contents of the <tag> table.
+  // Returns false if there is no such table.
+  GBool getTable(const char *tag, char **start, int *length);
+
   // setup vert/vrt2 GSUB for default lang
   int setupGSUB(const char *scriptName);
 
@@ -180,6 +205,8 @@ private:
   void dumpString(Guchar *s, int length,
 		  FoFiOutputFunc outputFunc,
 		  void *outputStream);
+  void addCompositeGlyphs(char *glyphs, TrueTypeLoca *locaTable,
+			  int glyfPos);
   Guint computeTableChecksum(Guchar *data, int length);
   void parse();
   void readPostTable();
@@ -191,7 +191,7 @@ void FoFiType1C::getFontMatrix(double *mat) {
 
 void FoFiType1C::convertToType1(char *psName, const char **newEncoding, GBool ascii,
 				FoFiOutputFunc outputFunc,
-				void *outputStream) {
+				void *outputStream, char *subset) {
   int psNameLen;
   Type1CEexecBuf eb;
   Type1CIndex subrIdx;
@@ -199,8 +199,9 @@ void FoFiType1C::convertToType1(char *psName, const char **newEncoding, GBool as
   GooString *buf;
   char buf2[256];
   const char **enc;
+  char *glyphs;
   GBool ok;
-  int i;
+  int n, i;
 
   if (psName) {
     psNameLen = strlen(psName);
@@ -457,12 +458,32 @@ void FoFiType1C::convertToType1(char *psName, const char **newEncoding, GBool as
     subrIdx.pos = -1;
   }
 
+  // pick the glyphs to write
+  glyphs = NULL;
+  n = nGlyphs;
+  if (subset) {
+    glyphs = (char *)gmalloc(nGlyphs > 0 ? nGlyphs : 1);
+    memcpy(glyphs, subset, nGlyphs);
+    if (nGlyphs > 0) {
+      glyphs[0] = 1;
+    }
+    addSeacGlyphs(glyphs, &subrIdx);
+    n = 0;
+    for (i = 0; i < nGlyphs; ++i) {
+      if (glyphs[i]) {
+	++n;
+      }
+    }
+  }
+
   // write the CharStrings
-  buf = GooString::format("2 index /CharStrings {0:d} dict dup begin\n",
-			nGlyphs);
+  buf = GooString::format("2 index /CharStrings {0:d} dict dup begin\n", n);
   eexecWrite(&eb, buf->getCString());
   delete buf;
   for (i = 0; i < nGlyphs; ++i) {
+    if (glyphs && !glyphs[i]) {
+      continue;
+    }
     ok = gTrue;
     getIndexVal(&charStringsIdx, i, &val, &ok);
     if (ok && i < charsetLength) {
@@ -472,6 +493,7 @@ void FoFiType1C::convertToType1(char *psName, const char **newEncoding, GBool as
       }
     }
   }
+  gfree(glyphs);
   eexecWrite(&eb, "end\n");
   eexecWrite(&eb, "end\n");
   eexecWrite(&eb, "readonly put\n");
@@ -1166,6 +1188,465 @@ void FoFiType1C::convertToType0(char *psName, int *codeMap, int nCodes,
   gfree(cidMap);
 }
 
+// Indexes into the newVals array of copySubsetDict.
+#define subsetCharset       0
+#define subsetEncoding      1
+#define subsetCharStrings   2
+#define subsetPrivateSize   3
+#define subsetPrivateOffset 4
+#define subsetFDArray       5
+#define subsetFDSelect      6
+#define subsetSubrs         7
+#define subsetNVals         8
+
+static void appendCFFInt32(GooString *out, int x) {
+  out->append((char)29);
+  out->append((char)(x >> 24))->append((char)(x >> 16));
+  out->append((char)(x >> 8))->append((char)x);
+}
+
+static void appendCFFIndexHeader(GooString *out, int count, int *offsets) {
+  int i;
+
+  out->append((char)(count >> 8))->append((char)count);
+  if (count == 0) {
+    return;
+  }
+  out->append((char)4);
+  for (i = 0; i <= count; ++i) {
+    out->append((char)(offsets[i] >> 24))->append((char)(offsets[i] >> 16));
+    out->append((char)(offsets[i] >> 8))->append((char)offsets[i]);
+  }
+}
+
+GBool FoFiType1C::writeSubset(char *subset,
+			      FoFiOutputFunc outputFunc, void *outputStream) {
+  Type1CIndex fdIdx, subrIdx;
+  Type1CIndexVal val;
+  GooString *buf, *topBuf, *fdArrayBuf, *privBuf, *charStringsBuf;
+  char *glyphs;
+  int *privPos, *privLen, *newPrivPos, *newPrivLen, *offsets;
+  int vals[subsetNVals];
+  int charsetLen, encodingLen, fdSelectLen, nPrivs;
+  int charsetPos, encodingPos, fdSelectPos, fdArrayPos, privBase;
+  int charStringsPos, hdrLen, pos, pass, i, j;
+  GBool cid, ok;
+
+  cid = isCIDFont();
+  ok = gTrue;
+  hdrLen = getU8(2, &ok);
+  charsetLen = topDict.charsetOffset > 2 ? getCharsetLength() : 0;
+  encodingLen = (!cid && topDict.encodingOffset > 1) ? getEncodingLength()
+                                                     : 0;
+  fdSelectLen = (cid && topDict.fdSelectOffset > 0) ? getFDSelectLength()
+                                                    : 0;
+  if (!ok || charsetLen < 0 || encodingLen < 0 || fdSelectLen < 0) {
+    return gFalse;
+  }
+
+  // the private dicts: 8-bit fonts have one, CID fonts have one per FD
+  nPrivs = 1;
+  if (cid) {
+    nPrivs = 0;
+    if (topDict.fdArrayOffset > 0) {
+      getIndex(topDict.fdArrayOffset, &fdIdx, &ok);
+      nPrivs = fdIdx.len;
+      if (!ok || nPrivs > nFDs) {
+	return gFalse;
+      }
+    }
+  }
+  privPos = (int *)gmallocn(nPrivs + 1, sizeof(int));
+  privLen = (int *)gmallocn(nPrivs + 1, sizeof(int));
+  newPrivPos = (int *)gmallocn(nPrivs + 1, sizeof(int));
+  newPrivLen = (int *)gmallocn(nPrivs + 1, sizeof(int));
+  if (cid) {
+    buf = new GooString();
+    for (i = 0; ok && i < nPrivs; ++i) {
+      getIndexVal(&fdIdx, i, &val, &ok);
+      for (j = 0; j < subsetNVals; ++j) {
+	vals[j] = -1;
+      }
+      privPos[i] = privLen[i] = 0;
+      ok = ok && copySubsetDict(val.pos, val.len, vals, buf,
+				&privLen[i], &privPos[i]);
+    }
+    delete buf;
+  } else {
+    privPos[0] = topDict.privateOffset;
+    privLen[0] = topDict.privateSize;
+  }
+
+  // the new private dicts, each one followed by its Local Subrs (the
+  // Subrs offset is relative to the start of the private dict, and is
+  // written as a 5-byte integer, so the dict size doesn't depend on it)
+  privBuf = new GooString();
+  buf = new GooString();
+  for (i = 0; ok && i < nPrivs; ++i) {
+    newPrivPos[i] = privBuf->getLength();
+    newPrivLen[i] = 0;
+    if (privLen[i] <= 0) {
+      continue;
+    }
+    for (j = 0; j < subsetNVals; ++j) {
+      vals[j] = -1;
+    }
+    subrIdx.pos = -1;
+    if (privateDicts[i].subrsOffset > 0) {
+      getIndex(privateDicts[i].subrsOffset, &subrIdx, &ok);
+      vals[subsetSubrs] = 0;
+    }
+    for (pass = 0; ok && pass < 2; ++pass) {
+      buf->clear();
+      ok = copySubsetDict(privPos[i], privLen[i], vals, buf, NULL, NULL);
+      if (vals[subsetSubrs] < 0) {
+	break;
+      }
+      vals[subsetSubrs] = buf->getLength();
+    }
+    newPrivLen[i] = buf->getLength();
+    privBuf->append(buf);
+    if (ok && subrIdx.pos >= 0) {
+      privBuf->append((char *)file + subrIdx.pos,
+		      subrIdx.endPos - subrIdx.pos);
+    }
+  }
+  delete buf;
+
+  // the glyphs to keep
+  glyphs = (char *)gmalloc(nGlyphs > 0 ? nGlyphs : 1);
+  memcpy(glyphs, subset, nGlyphs);
+  if (nGlyphs > 0) {
+    glyphs[0] = 1;
+  }
+  if (ok && !cid) {
+    getIndex(privateDicts[0].subrsOffset, &subrIdx, &ok);
+    if (!ok) {
+      subrIdx.pos = -1;
+      ok = gTrue;
+    }
+    addSeacGlyphs(glyphs, &subrIdx);
+  }
+
+  // the new CharStrings INDEX, with an endchar for each glyph that
+  // isn't kept
+  charStringsBuf = new GooString();
+  offsets = (int *)gmallocn(nGlyphs + 1, sizeof(int));
+  offsets[0] = 1;
+  for (i = 0; ok && i < nGlyphs; ++i) {
+    getIndexVal(&charStringsIdx, i, &val, &ok);
+    if (glyphs[i]) {
+      charStringsBuf->append((char *)file + val.pos, val.len);
+    } else {
+      charStringsBuf->append((char)14);
+    }
+    offsets[i + 1] = charStringsBuf->getLength() + 1;
+  }
+  buf = new GooString();
+  appendCFFIndexHeader(buf, nGlyphs, offsets);
+  charStringsBuf->insert(0, buf);
+  delete buf;
+  gfree(offsets);
+  gfree(glyphs);
+
+  // lay out the new font: header, Name INDEX, Top DICT INDEX, String
+  // INDEX, Global Subr INDEX, [Encoding], [charset], [FDSelect],
+  // [FDArray], the private dicts and, last, the CharStrings INDEX --
+  // all offsets in the new dicts are 5-byte integers, so the first
+  // pass gets the sizes and the second one the final offsets
+  topBuf = new GooString();
+  fdArrayBuf = new GooString();
+  charsetPos = encodingPos = fdSelectPos = fdArrayPos = privBase = 0;
+  charStringsPos = 0;
+  offsets = (int *)gmallocn(nPrivs + 1, sizeof(int));
+  for (pass = 0; ok && pass < 2; ++pass) {
+    for (j = 0; j < subsetNVals; ++j) {
+      vals[j] = -1;
+    }
+    if (charsetLen > 0) {
+      vals[subsetCharset] = charsetPos;
+    }
+    if (encodingLen > 0) {
+      vals[subsetEncoding] = encodingPos;
+    }
+    vals[subsetCharStrings] = charStringsPos;
+    if (cid) {
+      if (fdSelectLen > 0) {
+	vals[subsetFDSelect] = fdSelectPos;
+      }
+      if (topDict.fdArrayOffset > 0) {
+	vals[subsetFDArray] = fdArrayPos;
+      }
+    } else if (privLen[0] > 0) {
+      vals[subsetPrivateSize] = newPrivLen[0];
+      vals[subsetPrivateOffset] = privBase + newPrivPos[0];
+    }
+    topBuf->clear();
+    getIndexVal(&topDictIdx, 0, &val, &ok);
+    ok = ok && copySubsetDict(val.pos, val.len, vals, topBuf, NULL, NULL);
+
+    fdArrayBuf->clear();
+    if (cid && topDict.fdArrayOffset > 0) {
+      buf = new GooString();
+      offsets[0] = 1;
+      for (i = 0; ok && i < nPrivs; ++i) {
+	for (j = 0; j < subsetNVals; ++j) {
+	  vals[j] = -1;
+	}
+	if (privLen[i] > 0) {
+	  vals[subsetPrivateSize] = newPrivLen[i];
+	  vals[subsetPrivateOffset] = privBase + newPrivPos[i];
+	}
+	getIndexVal(&fdIdx, i, &val, &ok);
+	ok = ok && copySubsetDict(val.pos, val.len, vals, buf, NULL, NULL);
+	offsets[i + 1] = buf->getLength() + 1;
+      }
+      appendCFFIndexHeader(fdArrayBuf, nPrivs, offsets);
+      fdArrayBuf->append(buf);
+      delete buf;
+    }
+
+    pos = hdrLen + (nameIdx.endPos - nameIdx.pos);
+    pos += 2 + 1 + 2 * 4 + topBuf->getLength();
+    pos += (stringIdx.endPos - stringIdx.pos) + (gsubrIdx.endPos - gsubrIdx.pos);
+    encodingPos = pos;
+    pos += encodingLen;
+    charsetPos = pos;
+    pos += charsetLen;
+    fdSelectPos = pos;
+    pos += fdSelectLen;
+    fdArrayPos = pos;
+    pos += fdArrayBuf->getLength();
+    privBase = pos;
+    pos += privBuf->getLength();
+    charStringsPos = pos;
+  }
+  gfree(offsets);
+
+  // write the font
+  if (ok && checkRegion(0, hdrLen) &&
+      checkRegion(nameIdx.pos, nameIdx.endPos - nameIdx.pos) &&
+      checkRegion(stringIdx.pos, stringIdx.endPos - stringIdx.pos) &&
+      checkRegion(gsubrIdx.pos, gsubrIdx.endPos - gsubrIdx.pos) &&
+      (!encodingLen || checkRegion(topDict.encodingOffset, encodingLen)) &&
+      (!charsetLen || checkRegion(topDict.charsetOffset, charsetLen)) &&
+      (!fdSelectLen || checkRegion(topDict.fdSelectOffset, fdSelectLen))) {
+    buf = new GooString((char *)file, hdrLen);
+    buf->append((char *)file + nameIdx.pos, nameIdx.endPos - nameIdx.pos);
+    offsets = (int *)gmallocn(2, sizeof(int));
+    offsets[0] = 1;
+    offsets[1] = topBuf->getLength() + 1;
+    appendCFFIndexHeader(buf, 1, offsets);
+    gfree(offsets);
+    buf->append(topBuf);
+    buf->append((char *)file + stringIdx.pos,
+		stringIdx.endPos - stringIdx.pos);
+    buf->append((char *)file + gsubrIdx.pos, gsubrIdx.endPos - gsubrIdx.pos);
+    buf->append((char *)file + topDict.encodingOffset, encodingLen);
+    buf->append((char *)file + topDict.charsetOffset, charsetLen);
+    buf->append((char *)file + topDict.fdSelectOffset, fdSelectLen);
+    buf->append(fdArrayBuf);
+    buf->append(privBuf);
+    buf->append(charStringsBuf);
+    (*outputFunc)(outputStream, buf->getCString(), buf->getLength());
+    delete buf;
+  } else {
+    ok = gFalse;
+  }
+
+  delete topBuf;
+  delete fdArrayBuf;
+  delete privBuf;
+  delete charStringsBuf;
+  gfree(privPos);
+  gfree(privLen);
+  gfree(newPrivPos);
+  gfree(newPrivLen);
+  return ok;
+}
+
+// Append the DICT data at <pos>, <length> to <out>, with the operands
+// of the operators that hold offsets (as indexed by the subset*
+// constants) replaced by the non-negative values in <newVals>.  If
+// <privSize> and <privOffset> are not NULL, the original Private
+// operands are returned in them.
+GBool FoFiType1C::copySubsetDict(int pos, int length, int *newVals,
+				 GooString *out,
+				 int *privSize, int *privOffset) {
+  GBool ok;
+  int end, segStart, op, idx;
+
+  if (!checkRegion(pos, length)) {
+    return gFalse;
+  }
+  ok = gTrue;
+  end = pos + length;
+  segStart = pos;
+  nOps = 0;
+  while (pos < end) {
+    pos = getOp(pos, gFalse, &ok);
+    if (!ok) {
+      return gFalse;
+    }
+    if (ops[nOps - 1].isNum) {
+      continue;
+    }
+    op = ops[nOps - 1].op;
+    switch (op) {
+    case 0x000f: idx = subsetCharset; break;
+    case 0x0010: idx = subsetEncoding; break;
+    case 0x0011: idx = subsetCharStrings; break;
+    case 0x0012: idx = subsetPrivateOffset;
+                 if (privSize && privOffset && nOps >= 3) {
+		   *privSize = (int)ops[0].num;
+		   *privOffset = (int)ops[1].num;
+		 }
+		 break;
+    case 0x0013: idx = subsetSubrs; break;
+    case 0x0c24: idx = subsetFDArray; break;
+    case 0x0c25: idx = subsetFDSelect; break;
+    default:     idx = -1; break;
+    }
+    if (idx >= 0 && newVals[idx] >= 0) {
+      if (idx == subsetPrivateOffset) {
+	appendCFFInt32(out, newVals[subsetPrivateSize]);
+      }
+      appendCFFInt32(out, newVals[idx]);
+      if (op & 0x0c00) {
+	out->append((char)12);
+      }
+      out->append((char)(op & 0xff));
+    } else {
+      out->append((char *)file + segStart, pos - segStart);
+    }
+    segStart = pos;
+    nOps = 0;
+  }
+  return gTrue;
+}
+
+// Return the length of the charset data, or -1 if it is invalid.
+int FoFiType1C::getCharsetLength() {
+  GBool ok;
+  int pos, fmt, nLeft, i;
+
+  ok = gTrue;
+  pos = topDict.charsetOffset;
+  fmt = getU8(pos++, &ok);
+  if (fmt == 0) {
+    pos += 2 * (nGlyphs - 1);
+  } else if (fmt == 1 || fmt == 2) {
+    i = 1;
+    while (ok && i < nGlyphs) {
+      if (fmt == 1) {
+	nLeft = getU8(pos + 2, &ok);
+	pos += 3;
+      } else {
+	nLeft = getU16BE(pos + 2, &ok);
+	pos += 4;
+      }
+      i += nLeft + 1;
+    }
+  } else {
+    return -1;
+  }
+  if (!ok) {
+    return -1;
+  }
+  return pos - topDict.charsetOffset;
+}
+
+// Return the length of the (custom) encoding data, or -1 if it is
+// invalid.
+int FoFiType1C::getEncodingLength() {
+  GBool ok;
+  int pos, fmt;
+
+  ok = gTrue;
+  pos = topDict.encodingOffset;
+  fmt = getU8(pos++, &ok);
+  if ((fmt & 0x7f) == 0) {
+    pos += 1 + getU8(pos, &ok);
+  } else if ((fmt & 0x7f) == 1) {
+    pos += 1 + 2 * getU8(pos, &ok);
+  } else {
+    return -1;
+  }
+  if (fmt & 0x80) {
+    pos += 1 + 3 * getU8(pos, &ok);
+  }
+  if (!ok) {
+    return -1;
+  }
+  return pos - topDict.encodingOffset;
+}
+
+// Return the length of the FDSelect data, or -1 if it is invalid.
+int FoFiType1C::getFDSelectLength() {
+  GBool ok;
+  int pos, fmt;
+
+  ok = gTrue;
+  pos = topDict.fdSelectOffset;
+  fmt = getU8(pos++, &ok);
+  if (fmt == 0) {
+    pos += nGlyphs;
+  } else if (fmt == 3) {
+    pos += 2 + 3 * getU16BE(pos, &ok) + 2;
+  } else {
+    return -1;
+  }
+  if (!ok) {
+    return -1;
+  }
+  return pos - topDict.fdSelectOffset;
+}
+
+// Set the flags in <glyphs> for the base and accent glyphs of the
+// accented chars (seac) whose flags are set.
+void FoFiType1C::addSeacGlyphs(char *glyphs, Type1CIndex *subrIdx) {
+  Type1CIndexVal val;
+  GooString *charBuf;
+  char buf[256];
+  const char *name;
+  GBool ok;
+  int codes[2], gid, i, j;
+
+  charBuf = new GooString();
+  for (i = 0; i < nGlyphs; ++i) {
+    if (!glyphs[i]) {
+      continue;
+    }
+    ok = gTrue;
+    getIndexVal(&charStringsIdx, i, &val, &ok);
+    if (!ok) {
+      continue;
+    }
+    charBuf->clear();
+    cvtGlyph(val.pos, val.len, charBuf, subrIdx, &privateDicts[0], gTrue);
+    if (seacBase < 0) {
+      continue;
+    }
+    codes[0] = seacBase;
+    codes[1] = seacAccent;
+    for (j = 0; j < 2; ++j) {
+      if (codes[j] < 0 || codes[j] > 255 ||
+	  !(name = fofiType1StandardEncoding[codes[j]])) {
+	continue;
+      }
+      for (gid = 0; gid < nGlyphs && gid < charsetLength; ++gid) {
+	ok = gTrue;
+	getString(charset[gid], buf, &ok);
+	if (ok && !strcmp(buf, name)) {
+	  glyphs[gid] = 1;
+	  break;
+	}
+      }
+    }
+  }
+  delete charBuf;
+}
+
 void FoFiType1C::eexecCvtGlyph(Type1CEexecBuf *eb, const char *glyphName,
 			       int offset, int nBytes,
 			       Type1CIndex *subrIdx,
@@ -1207,6 +1688,7 @@ void FoFiType1C::cvtGlyph(int offset, int nBytes, GooString *charBuf,
     nHints = 0;
     firstOp = gTrue;
     openPath = gFalse;
+    seacBase = seacAccent = -1;
   }
 
   pos = offset;
@@ -1374,6 +1856,8 @@ void FoFiType1C::cvtGlyph(int offset, int nBytes, GooString *charBuf,
 	  openPath = gFalse;
 	}
 	if (nOps == 4) {
+	  seacBase = (int)ops[2].num;
+	  seacAccent = (int)ops[3].num;
 	  cvtNum(0, gFalse, charBuf);
 	  cvtNum(ops[0].num, ops[0].isFP, charBuf);
 	  cvtNum(ops[1].num, ops[1].isFP, charBuf);
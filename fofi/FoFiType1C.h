@@ -173,14 +173,21 @@ public:
   // Return the font matrix as an array of six numbers.
   void getFontMatrix(double *mat);
 
+  // Returns true if this is a CID-keyed font.
+  GBool isCIDFont() { return topDict.firstOp == 0x0c1e; }
+
   // Convert to a Type 1 font, suitable for embedding in a PostScript
   // file.  This is only useful with 8-bit fonts.  If <newEncoding> is
   // not NULL, it will be used in place of the encoding in the Type 1C
   // font.  If <ascii> is true the eexec section will be hex-encoded,
   // otherwise it will be left as binary data.  If <psName> is non-NULL,
-  // it will be used as the PostScript font name.
+  // it will be used as the PostScript font name.  If <subset> is
+  // non-NULL, it is an array of getNumGlyphs() flags, and only the
+  // glyphs whose flag is set (plus .notdef and any accent/base glyphs
+  // they use) are written.
   void convertToType1(char *psName, const char **newEncoding, GBool ascii,
-		      FoFiOutputFunc outputFunc, void *outputStream);
+		      FoFiOutputFunc outputFunc, void *outputStream,
+		      char *subset = NULL);
 
   // Convert to a Type 0 CIDFont, suitable for embedding in a
   // PostScript file.  <psName> will be used as the PostScript font
@@ -205,9 +212,24 @@ public:
   void convertToType0(char *psName, int *codeMap, int nCodes,
 		      FoFiOutputFunc outputFunc, void *outputStream);
 
+  // Write a CFF font file in which the glyphs whose flags in <subset>
+  // (an array of getNumGlyphs() flags) are clear are replaced by empty
+  // glyphs.  .notdef and, for 8-bit fonts, any accent/base glyphs used
+  // by the glyphs that are kept are always kept.  The glyph IDs, the
+  // charset and the encoding are unchanged.  Returns false, without
+  // writing anything, if the font can't be subset.
+  GBool writeSubset(char *subset,
+		    FoFiOutputFunc outputFunc, void *outputStream);
+
 private:
 
   FoFiType1C(char *fileA, int lenA, GBool freeFileDataA);
+  GBool copySubsetDict(int pos, int length, int *newVals, GooString *out,
+		       int *privSize, int *privOffset);
+  int getCharsetLength();
+  int getEncodingLength();
+  int getFDSelectLength();
+  void addSeacGlyphs(char *glyphs, Type1CIndex *subrIdx);
   void eexecCvtGlyph(Type1CEexecBuf *eb, const char *glyphName,
 		     int offset, int nBytes,
 		     Type1CIndex *subrIdx,
@@ -261,6 +283,9 @@ private:
   int nHints;			// number of hints for the current glyph
   GBool firstOp;		// true if we haven't hit the first op yet
   GBool openPath;		// true if there is an unclosed path
+  int seacBase, seacAccent;	// StandardEncoding codes of the components
+				//   of the current glyph, if it is an
+				//   accented char (seac), or -1
 };
 
 #endif
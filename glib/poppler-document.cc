@@ -41,6 +41,9 @@
 #include "poppler-input-stream.h"
 #include "poppler-cached-file-loader.h"
 
+/* default budget of the parsed page contents cache */
+#define POPPLER_DOCUMENT_CONTENT_CACHE_SIZE (8 * 1024 * 1024)
+
 /**
  * SECTION:poppler-document
  * @short_description: Information about a document
@@ -127,6 +130,9 @@ _poppler_document_new_from_pdfdoc (PDFDoc  *newDoc,
 
   document = (PopplerDocument *) g_object_new (POPPLER_TYPE_DOCUMENT, NULL);
   document->doc = newDoc;
+  /* pages are rendered again and again when zooming; keep their
+   * parsed contents around, see poppler_document_set_content_cache_size() */
+  document->doc->setContentCacheSize (POPPLER_DOCUMENT_CONTENT_CACHE_SIZE);
 
   document->output_dev = new CairoOutputDev ();
   document->output_dev->startDoc(document->doc);
@@ -1102,6 +1108,101 @@ poppler_document_is_linearized (PopplerDocument *document)
   return document->doc->isLinearized ();
 }
 
+/**
+ * poppler_document_is_page_available:
+ * @document: A #PopplerDocument
+ * @index: a page index
+ *
+ * Returns whether all the data needed to render the page at @index has
+ * already been read. This can only be %FALSE for documents created with
+ * poppler_document_new_from_stream() from a non seekable stream, whose
+ * data is read as it is needed.
+ *
+ * Return value: %TRUE if the page at @index is available, %FALSE otherwise
+ *
+ * Since: 0.33
+ **/
+gboolean
+poppler_document_is_page_available (PopplerDocument *document,
+				    int              index)
+{
+  g_return_val_if_fail (POPPLER_IS_DOCUMENT (document), FALSE);
+  g_return_val_if_fail (0 <= index &&
+			index < poppler_document_get_n_pages (document),
+			FALSE);
+
+  return document->doc->isPageAvailable (index + 1);
+}
+
+/**
+ * poppler_document_prefetch_page:
+ * @document: A #PopplerDocument
+ * @index: a page index
+ * @wait: whether to wait until the data has been read
+ *
+ * Requests the data needed to render the page at @index, using the hint
+ * tables of a linearized document to read it in as few requests as
+ * possible. The whole document is read when it is not linearized.
+ * If @wait is %FALSE, the data is read along with the next
+ * request instead of right away. See poppler_document_is_page_available().
+ *
+ * Return value: %FALSE if the data could not be read, %TRUE otherwise
+ *
+ * Since: 0.33
+ **/
+gboolean
+poppler_document_prefetch_page (PopplerDocument *document,
+				int              index,
+				gboolean         wait)
+{
+  g_return_val_if_fail (POPPLER_IS_DOCUMENT (document), FALSE);
+  g_return_val_if_fail (0 <= index &&
+			index < poppler_document_get_n_pages (document),
+			FALSE);
+
+  return document->doc->prefetchPage (index + 1, wait);
+}
+
+/**
+ * poppler_document_set_content_cache_size:
+ * @document: A #PopplerDocument
+ * @size: the memory budget, in bytes, or 0
+ *
+ * Sets how much memory is used to keep the parsed contents of recently
+ * rendered pages, so that rendering a page again, for instance when
+ * zooming, doesn't parse its content streams again. The cache uses up
+ * to 8 MB by default; a @size of 0 disables it and frees the memory.
+ *
+ * Since: 0.33
+ **/
+void
+poppler_document_set_content_cache_size (PopplerDocument *document,
+					 gsize            size)
+{
+  g_return_if_fail (POPPLER_IS_DOCUMENT (document));
+
+  document->doc->setContentCacheSize (MIN (size, (gsize) G_MAXINT));
+}
+
+/**
+ * poppler_document_get_content_cache_size:
+ * @document: A #PopplerDocument
+ *
+ * Returns the memory budget of the cache of parsed page contents, see
+ * poppler_document_set_content_cache_size().
+ *
+ * Return value: the budget, in bytes, or 0 if the cache is disabled
+ *
+ * Since: 0.33
+ **/
+gsize
+poppler_document_get_content_cache_size (PopplerDocument *document)
+{
+  g_return_val_if_fail (POPPLER_IS_DOCUMENT (document), 0);
+
+  return document->doc->getContentCacheSize ();
+}
+
 /**
  * poppler_document_get_page_layout:
  * @document: A #PopplerDocument
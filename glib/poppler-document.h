@@ -209,6 +209,14 @@ gchar             *poppler_document_get_producer           (PopplerDocument *doc
 time_t             poppler_document_get_creation_date      (PopplerDocument *document);
 time_t             poppler_document_get_modification_date  (PopplerDocument *document);
 gboolean           poppler_document_is_linearized          (PopplerDocument *document);
+gboolean           poppler_document_is_page_available      (PopplerDocument *document,
+							    int              index);
+gboolean           poppler_document_prefetch_page          (PopplerDocument *document,
+							    int              index,
+							    gboolean         wait);
+void               poppler_document_set_content_cache_size (PopplerDocument *document,
+							    gsize            size);
+gsize              poppler_document_get_content_cache_size (PopplerDocument *document);
 PopplerPageLayout  poppler_document_get_page_layout        (PopplerDocument *document);
 PopplerPageMode    poppler_document_get_page_mode          (PopplerDocument *document);
 PopplerPermissions poppler_document_get_permissions        (PopplerDocument *document);
@@ -40,6 +40,14 @@
 // gUnlockMutex(&m);
 // ...
 // gDestroyMutex(&m);
+//
+// gAtomicIncrement(&x) and gAtomicDecrement(&x) change an int (such
+// as a reference count) without a mutex, and return its new value.
+//
+// gAtomicStoreRelease(&x, v) sets an int (such as an "initialized"
+// flag) after all the preceding writes, and gAtomicLoadAcquire(&x)
+// reads it before all the following reads: a thread that sees the
+// flag set also sees what was written before setting it.
 
 #ifdef _WIN32
 #ifndef NOMINMAX
@@ -54,6 +62,19 @@ typedef CRITICAL_SECTION GooMutex;
 #define gLockMutex(m) EnterCriticalSection(m)
 #define gUnlockMutex(m) LeaveCriticalSection(m)
 
+inline int gAtomicIncrement(int *x) {
+  return (int)InterlockedIncrement((LONG *)x);
+}
+inline int gAtomicDecrement(int *x) {
+  return (int)InterlockedDecrement((LONG *)x);
+}
+inline int gAtomicLoadAcquire(int *x) {
+  return (int)InterlockedCompareExchange((LONG *)x, 0, 0);
+}
+inline void gAtomicStoreRelease(int *x, int v) {
+  InterlockedExchange((LONG *)x, (LONG)v);
+}
+
 #else // assume pthreads
 
 #include <pthread.h>
@@ -71,6 +92,19 @@ inline void gInitMutex(GooMutex *m) {
 #define gLockMutex(m) pthread_mutex_lock(m)
 #define gUnlockMutex(m) pthread_mutex_unlock(m)
 
+inline int gAtomicIncrement(int *x) {
+  return __sync_add_and_fetch(x, 1);
+}
+inline int gAtomicDecrement(int *x) {
+  return __sync_sub_and_fetch(x, 1);
+}
+inline int gAtomicLoadAcquire(int *x) {
+  return __atomic_load_n(x, __ATOMIC_ACQUIRE);
+}
+inline void gAtomicStoreRelease(int *x, int v) {
+  __atomic_store_n(x, v, __ATOMIC_RELEASE);
+}
+
 #endif
 
 class MutexLocker {
@@ -166,6 +166,12 @@ public:
   // The caller owns the return value
   GooString *sanitizedName(GBool psmode);
 
+  // Format x with prec decimals, the way {0:.<prec>f} (trim = false) and
+  // {0:.<prec>g} (trim = true) do, at the end of buf. *p and *len are
+  // set to the start and length of the result.
+  static void formatDouble(double x, char *buf, int bufSize, int prec,
+			   GBool trim, char **p, int *len);
+
 private:
   GooString(const GooString &other);
   GooString& operator=(const GooString &other);
@@ -201,8 +207,6 @@ private:
 			 GBool zeroFill, int width, int base,
 			 char **p, int *len, GBool upperCase = gFalse);
 #endif
-  static void formatDouble(double x, char *buf, int bufSize, int prec,
-			   GBool trim, char **p, int *len);
   static void formatDoubleSmallAware(double x, char *buf, int bufSize, int prec,
 				     GBool trim, char **p, int *len);
 };
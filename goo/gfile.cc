@@ -619,6 +619,23 @@ Goffset GooFile::size() const {
   return size.QuadPart;
 }
 
+GBool GooFile::getIdentity(GooString *id) const {
+  BY_HANDLE_FILE_INFORMATION info;
+  char buf[128];
+
+  if (!GetFileInformationByHandle(handle, &info)) {
+    return gFalse;
+  }
+  sprintf(buf, "%lx:%lx%08lx:%lx%08lx:%lx%08lx",
+	  (unsigned long)info.dwVolumeSerialNumber,
+	  (unsigned long)info.nFileIndexHigh, (unsigned long)info.nFileIndexLow,
+	  (unsigned long)info.nFileSizeHigh, (unsigned long)info.nFileSizeLow,
+	  (unsigned long)info.ftLastWriteTime.dwHighDateTime,
+	  (unsigned long)info.ftLastWriteTime.dwLowDateTime);
+  id->append(buf);
+  return gTrue;
+}
+
 GooFile* GooFile::open(const GooString *fileName) {
   HANDLE handle = CreateFile(fileName->getCString(),
                               GENERIC_READ,
@@ -659,6 +676,22 @@ Goffset GooFile::size() const {
 #endif
 }
 
+GBool GooFile::getIdentity(GooString *id) const {
+  struct stat st;
+  char buf[128];
+
+  if (fstat(fd, &st) != 0) {
+    return gFalse;
+  }
+  // ctime also catches rewrites that restore the modification time
+  sprintf(buf, "%lx:%lx:%llx:%lx:%lx",
+	  (unsigned long)st.st_dev, (unsigned long)st.st_ino,
+	  (unsigned long long)st.st_size,
+	  (unsigned long)st.st_mtime, (unsigned long)st.st_ctime);
+  id->append(buf);
+  return gTrue;
+}
+
 GooFile* GooFile::open(const GooString *fileName) {
 #ifdef VMS
   int fd = ::open(fileName->getCString(), Q_RDONLY, "ctx=stm");
@@ -137,6 +137,10 @@ class GooFile
 public:
   int read(char *buf, int n, Goffset offset) const;
   Goffset size() const;
+  // Append to id a string that identifies the file and its version: it
+  // changes when the file is modified or replaced. Returns false if this
+  // information isn't available.
+  GBool getIdentity(GooString *id) const;
   
   static GooFile *open(const GooString *fileName);
   
@@ -76,15 +76,19 @@ Object *Array::copy(XRef *xrefA, Object *obj) {
 }
 
 int Array::incRef() {
-  arrayLocker();
-  ++ref;
-  return ref;
+#if MULTITHREADED
+  return gAtomicIncrement(&ref);
+#else
+  return ++ref;
+#endif
 }
 
 int Array::decRef() {
-  arrayLocker();
-  --ref;
-  return ref;
+#if MULTITHREADED
+  return gAtomicDecrement(&ref);
+#else
+  return --ref;
+#endif
 }
 
 void Array::add(Object *elem) {
@@ -35,6 +35,7 @@
 #include "goo/gmem.h"
 #include "goo/gfile.h"
 #include "goo/GooString.h"
+#include "goo/GooList.h"
 #include "Error.h"
 #include "GlobalParams.h"
 #include "PSTokenizer.h"
@@ -43,13 +44,14 @@
 
 //------------------------------------------------------------------------
 
-struct CMapVectorEntry {
-  GBool isVector;
-  union {
-    CMapVectorEntry *vector;
-    CID cid;
-  };
-};
+// The CMap vectors live in one array of Guints, 256 per vector, with
+// the top level vector first.  An entry with cMapVectorFlag set points
+// to the vector with the index in the remaining bits (which is always
+// larger than the index of the vector containing the entry); other
+// entries are CIDs.  This is four times smaller than a tree of
+// separately allocated vectors, which matters for the lookups in
+// getCID().
+#define cMapVectorFlag 0x80000000
 
 //------------------------------------------------------------------------
 
@@ -135,6 +137,7 @@ CMap *CMap::parse(CMapCache *cache, GooString *collectionA, Stream *str) {
 CMap *CMap::parse(CMapCache *cache, GooString *collectionA,
 		  GooString *cMapNameA, Stream *stream) {
   FILE *f = NULL;
+  GooString *fileName = NULL, *compiledName = NULL, *data;
   CMap *cmap;
   PSTokenizer *pst;
   char tok1[256], tok2[256], tok3[256];
@@ -145,7 +148,7 @@ CMap *CMap::parse(CMapCache *cache, GooString *collectionA,
     stream->reset();
     pst = new PSTokenizer(&getCharFromStream, stream);
   } else {
-    if (!(f = globalParams->findCMapFile(collectionA, cMapNameA))) {
+    if (!(fileName = globalParams->findCMapFileName(collectionA, cMapNameA))) {
 
       // Check for an identity CMap.
       if (!cMapNameA->cmp("Identity") || !cMapNameA->cmp("Identity-H")) {
@@ -159,10 +162,42 @@ CMap *CMap::parse(CMapCache *cache, GooString *collectionA,
 	    cMapNameA, collectionA);
       return NULL;
     }
+
+    // use the compiled form of the CMap file if there is an up to
+    // date one
+    if (globalParams->hasDataCacheDir()) {
+      compiledName = GooString::format("{0:t}-{1:t}", collectionA, cMapNameA);
+      cmap = new CMap(collectionA->copy(), cMapNameA->copy());
+      cmap->srcFileNames = new GooList();
+      if ((data = globalParams->loadCompiledData("cMap", compiledName,
+						 fileName,
+						 cmap->srcFileNames))) {
+	if (cmap->readCompiled(data)) {
+	  delete data;
+	  delete compiledName;
+	  delete fileName;
+	  return cmap;
+	}
+	delete data;
+      }
+      cmap->decRefCnt();
+    }
+
+    if (!(f = openFile(fileName->getCString(), "r"))) {
+      error(errIO, -1, "Couldn't open CMap file '{0:t}'", fileName);
+      delete compiledName;
+      delete fileName;
+      return NULL;
+    }
     pst = new PSTokenizer(&getCharFromFile, f);
   }
 
   cmap = new CMap(collectionA->copy(), cMapNameA->copy());
+  if (compiledName) {
+    // the files of CMaps pulled in with usecmap are appended to this
+    cmap->srcFileNames = new GooList();
+    cmap->srcFileNames->append(fileName->copy());
+  }
 
   pst->getToken(tok1, sizeof(tok1), &n1);
   while (pst->getToken(tok2, sizeof(tok2), &n2)) {
@@ -230,6 +265,16 @@ CMap *CMap::parse(CMapCache *cache, GooString *collectionA,
     fclose(f);
   }
 
+  if (compiledName) {
+    if ((data = cmap->writeCompiled())) {
+      globalParams->saveCompiledData("cMap", compiledName,
+				     cmap->srcFileNames, data);
+      delete data;
+    }
+    delete compiledName;
+  }
+  delete fileName;
+
   return cmap;
 }
 
@@ -304,17 +349,14 @@ void CMap::parse2(CMapCache *cache, int (*getCharFunc)(void *), void *data) {
 }
 
 CMap::CMap(GooString *collectionA, GooString *cMapNameA) {
-  int i;
-
   collection = collectionA;
   cMapName = cMapNameA;
   isIdent = gFalse;
   wMode = 0;
-  vector = (CMapVectorEntry *)gmallocn(256, sizeof(CMapVectorEntry));
-  for (i = 0; i < 256; ++i) {
-    vector[i].isVector = gFalse;
-    vector[i].cid = 0;
-  }
+  srcFileNames = NULL;
+  vectors = NULL;
+  nVectors = vectorsSize = 0;
+  newVector();
   refCnt = 1;
 #if MULTITHREADED
   gInitMutex(&mutex);
@@ -326,7 +368,9 @@ CMap::CMap(GooString *collectionA, GooString *cMapNameA, int wModeA) {
   cMapName = cMapNameA;
   isIdent = gTrue;
   wMode = wModeA;
-  vector = NULL;
+  srcFileNames = NULL;
+  vectors = NULL;
+  nVectors = vectorsSize = 0;
   refCnt = 1;
 #if MULTITHREADED
   gInitMutex(&mutex);
@@ -336,6 +380,7 @@ CMap::CMap(GooString *collectionA, GooString *cMapNameA, int wModeA) {
 void CMap::useCMap(CMapCache *cache, char *useName) {
   GooString *useNameStr;
   CMap *subCMap;
+  int i;
 
   useNameStr = new GooString(useName);
   // if cache is non-NULL, we already have a lock, and we can use
@@ -352,8 +397,14 @@ void CMap::useCMap(CMapCache *cache, char *useName) {
     return;
   }
   isIdent = subCMap->isIdent;
-  if (subCMap->vector) {
-    copyVector(vector, subCMap->vector);
+  if (subCMap->vectors) {
+    copyVector(0, subCMap, 0);
+  }
+  if (srcFileNames && subCMap->srcFileNames) {
+    for (i = 0; i < subCMap->srcFileNames->getLength(); ++i) {
+      srcFileNames->append(
+	  ((GooString *)subCMap->srcFileNames->get(i))->copy());
+    }
   }
   subCMap->decRefCnt();
 }
@@ -366,92 +417,141 @@ void CMap::useCMap(CMapCache *cache, Object *obj) {
     return;
   }
   isIdent = subCMap->isIdent;
-  if (subCMap->vector) {
-    copyVector(vector, subCMap->vector);
+  if (subCMap->vectors) {
+    copyVector(0, subCMap, 0);
   }
   subCMap->decRefCnt();
 }
 
-void CMap::copyVector(CMapVectorEntry *dest, CMapVectorEntry *src) {
-  int i, j;
+int CMap::newVector() {
+  if (nVectors == vectorsSize) {
+    vectorsSize = vectorsSize ? 2 * vectorsSize : 4;
+    vectors = (Guint *)greallocn(vectors, vectorsSize * 256, sizeof(Guint));
+  }
+  memset(vectors + nVectors * 256, 0, 256 * sizeof(Guint));
+  return nVectors++;
+}
+
+void CMap::copyVector(int dest, CMap *src, int srcVec) {
+  Guint srcEntry;
+  int i, child;
 
   for (i = 0; i < 256; ++i) {
-    if (src[i].isVector) {
-      if (!dest[i].isVector) {
-	dest[i].isVector = gTrue;
-	dest[i].vector =
-	  (CMapVectorEntry *)gmallocn(256, sizeof(CMapVectorEntry));
-	for (j = 0; j < 256; ++j) {
-	  dest[i].vector[j].isVector = gFalse;
-	  dest[i].vector[j].cid = 0;
-	}
+    srcEntry = src->vectors[srcVec * 256 + i];
+    if (srcEntry & cMapVectorFlag) {
+      if (!(vectors[dest * 256 + i] & cMapVectorFlag)) {
+	child = newVector();
+	vectors[dest * 256 + i] = child | cMapVectorFlag;
       }
-      copyVector(dest[i].vector, src[i].vector);
+      copyVector(vectors[dest * 256 + i] & ~cMapVectorFlag,
+		 src, srcEntry & ~cMapVectorFlag);
     } else {
-      if (dest[i].isVector) {
+      if (vectors[dest * 256 + i] & cMapVectorFlag) {
 	error(errSyntaxError, -1, "Collision in usecmap");
       } else {
-	dest[i].cid = src[i].cid;
+	vectors[dest * 256 + i] = srcEntry;
       }
     }
   }
 }
 
 void CMap::addCIDs(Guint start, Guint end, Guint nBytes, CID firstCID) {
-  CMapVectorEntry *vec;
+  Guint *entry;
   CID cid;
-  int byte;
-  Guint i, j;
+  int vec, child, byte;
+  Guint i;
 
-  vec = vector;
+  vec = 0;
   for (i = nBytes - 1; i >= 1; --i) {
     byte = (start >> (8 * i)) & 0xff;
-    if (!vec[byte].isVector) {
-      vec[byte].isVector = gTrue;
-      vec[byte].vector =
-	  (CMapVectorEntry *)gmallocn(256, sizeof(CMapVectorEntry));
-      for (j = 0; j < 256; ++j) {
-	vec[byte].vector[j].isVector = gFalse;
-	vec[byte].vector[j].cid = 0;
-      }
+    if (!(vectors[vec * 256 + byte] & cMapVectorFlag)) {
+      child = newVector();
+      vectors[vec * 256 + byte] = child | cMapVectorFlag;
     }
-    vec = vec[byte].vector;
+    vec = vectors[vec * 256 + byte] & ~cMapVectorFlag;
   }
   cid = firstCID;
   for (byte = (int)(start & 0xff); byte <= (int)(end & 0xff); ++byte) {
-    if (vec[byte].isVector) {
+    entry = &vectors[vec * 256 + byte];
+    if ((*entry & cMapVectorFlag) || (cid & cMapVectorFlag)) {
       error(errSyntaxError, -1,
 	    "Invalid CID ({0:ux} - {1:ux} [{2:ud} bytes]) in CMap",
 	    start, end, nBytes);
     } else {
-      vec[byte].cid = cid;
+      *entry = cid;
     }
     ++cid;
   }
 }
 
+//------------------------------------------------------------------------
+// compiled CMaps
+//------------------------------------------------------------------------
+
+// The compiled form of a CMap is a list of Guints: wMode, isIdent, the
+// number of vectors, and the vectors themselves.
+
+GooString *CMap::writeCompiled() {
+  GooString *data;
+  Guint hdr[3];
+
+  if (!vectors) {
+    return NULL;
+  }
+  hdr[0] = (Guint)wMode;
+  hdr[1] = (Guint)isIdent;
+  hdr[2] = (Guint)nVectors;
+  data = new GooString((char *)hdr, sizeof(hdr));
+  data->append((char *)vectors, nVectors * 256 * sizeof(Guint));
+  return data;
+}
+
+GBool CMap::readCompiled(GooString *data) {
+  Guint *vectorsA;
+  Guint hdr[3], entry, n, i;
+
+  if (data->getLength() < (int)sizeof(hdr)) {
+    return gFalse;
+  }
+  memcpy(hdr, data->getCString(), sizeof(hdr));
+  n = hdr[2];
+  if (hdr[0] > 1 || hdr[1] > 1 || n == 0 ||
+      n > (Guint)(data->getLength() / (256 * sizeof(Guint))) ||
+      (Guint)data->getLength() != sizeof(hdr) + n * 256 * sizeof(Guint)) {
+    return gFalse;
+  }
+  vectorsA = (Guint *)gmallocn(n * 256, sizeof(Guint));
+  memcpy(vectorsA, data->getCString() + sizeof(hdr), n * 256 * sizeof(Guint));
+  // make sure the vectors form a tree
+  for (i = 0; i < n * 256; ++i) {
+    entry = vectorsA[i];
+    if ((entry & cMapVectorFlag) &&
+	((entry & ~cMapVectorFlag) <= i / 256 ||
+	 (entry & ~cMapVectorFlag) >= n)) {
+      gfree(vectorsA);
+      return gFalse;
+    }
+  }
+  wMode = (int)hdr[0];
+  isIdent = (GBool)hdr[1];
+  gfree(vectors);
+  vectors = vectorsA;
+  nVectors = vectorsSize = (int)n;
+  return gTrue;
+}
+
 CMap::~CMap() {
   delete collection;
   delete cMapName;
-  if (vector) {
-    freeCMapVector(vector);
+  if (srcFileNames) {
+    deleteGooList(srcFileNames, GooString);
   }
+  gfree(vectors);
 #if MULTITHREADED
   gDestroyMutex(&mutex);
 #endif
 }
 
-void CMap::freeCMapVector(CMapVectorEntry *vec) {
-  int i;
-
-  for (i = 0; i < 256; ++i) {
-    if (vec[i].isVector) {
-      freeCMapVector(vec[i].vector);
-    }
-  }
-  gfree(vec);
-}
-
 void CMap::incRefCnt() {
 #if MULTITHREADED
   gLockMutex(&mutex);
@@ -482,22 +582,25 @@ GBool CMap::match(GooString *collectionA, GooString *cMapNameA) {
 }
 
 CID CMap::getCID(char *s, int len, CharCode *c, int *nUsed) {
-  CMapVectorEntry *vec;
+  Guint entry;
   CharCode cc;
-  int n, i;
+  int vec, n, i;
 
-  vec = vector;
   cc = 0;
   n = 0;
-  while (vec && n < len) {
-    i = s[n++] & 0xff;
-    cc = (cc << 8) | i;
-    if (!vec[i].isVector) {
-      *c = cc;
-      *nUsed = n;
-      return vec[i].cid;
+  if (vectors) {
+    vec = 0;
+    while (n < len) {
+      i = s[n++] & 0xff;
+      cc = (cc << 8) | i;
+      entry = vectors[vec * 256 + i];
+      if (!(entry & cMapVectorFlag)) {
+	*c = cc;
+	*nUsed = n;
+	return entry;
+      }
+      vec = entry & ~cMapVectorFlag;
     }
-    vec = vec[i].vector;
   }
   if (isIdent && len >= 2) {
     // identity CMap
@@ -510,17 +613,17 @@ CID CMap::getCID(char *s, int len, CharCode *c, int *nUsed) {
   return 0;
 }
 
-void CMap::setReverseMapVector(Guint startCode, CMapVectorEntry *vec,
+void CMap::setReverseMapVector(Guint startCode, int vec,
  Guint *rmap, Guint rmapSize, Guint ncand) {
   int i;
 
-  if (vec == 0) return;
   for (i = 0;i < 256;i++) {
-    if (vec[i].isVector) {
+    Guint entry = vectors[vec * 256 + i];
+    if (entry & cMapVectorFlag) {
       setReverseMapVector((startCode+i) << 8,
-	  vec[i].vector,rmap,rmapSize,ncand);
+	  entry & ~cMapVectorFlag,rmap,rmapSize,ncand);
     } else {
-      Guint cid = vec[i].cid;
+      Guint cid = entry;
 
       if (cid < rmapSize) {
 	Guint cand;
@@ -541,7 +644,9 @@ void CMap::setReverseMapVector(Guint startCode, CMapVectorEntry *vec,
 }
 
 void CMap::setReverseMap(Guint *rmap, Guint rmapSize, Guint ncand) {
-  setReverseMapVector(0,vector,rmap,rmapSize,ncand);
+  if (vectors) {
+    setReverseMapVector(0,0,rmap,rmapSize,ncand);
+  }
 }
 
 //------------------------------------------------------------------------
@@ -38,8 +38,8 @@
 #endif
 
 class GooString;
+class GooList;
 class Object;
-struct CMapVectorEntry;
 class CMapCache;
 class Stream;
 
@@ -100,19 +100,26 @@ private:
   CMap(GooString *collectionA, GooString *cMapNameA, int wModeA);
   void useCMap(CMapCache *cache, char *useName);
   void useCMap(CMapCache *cache, Object *obj);
-  void copyVector(CMapVectorEntry *dest, CMapVectorEntry *src);
+  int newVector();
+  void copyVector(int dest, CMap *src, int srcVec);
   void addCIDs(Guint start, Guint end, Guint nBytes, CID firstCID);
-  void freeCMapVector(CMapVectorEntry *vec);
-  void setReverseMapVector(Guint startCode, CMapVectorEntry *vec,
+  void setReverseMapVector(Guint startCode, int vec,
           Guint *rmap, Guint rmapSize, Guint ncand);
+  GooString *writeCompiled();
+  GBool readCompiled(GooString *data);
 
   GooString *collection;
   GooString *cMapName;
   GBool isIdent;		// true if this CMap is an identity mapping,
 				//   or is based on one (via usecmap)
   int wMode;			// writing mode (0=horizontal, 1=vertical)
-  CMapVectorEntry *vector;	// vector for first byte (NULL for
-				//   identity CMap)
+  Guint *vectors;		// vectors, 256 entries each, starting
+				//   with the one for the first byte (NULL
+				//   for identity CMap)
+  int nVectors;			// number of vectors
+  int vectorsSize;		// size of the vectors array, in vectors
+  GooList *srcFileNames;	// files this CMap was built from, for
+				//   CMap files [GooString]
   int refCnt;
 #if MULTITHREADED
   GooMutex mutex;
@@ -14,36 +14,61 @@
 #include <config.h>
 #include "CachedFile.h"
 
+#include "goo/gmem.h"
+#include "goo/gfile.h"
+
 //------------------------------------------------------------------------
 // CachedFile
 //------------------------------------------------------------------------
 
-CachedFile::CachedFile(CachedFileLoader *cachedFileLoaderA, GooString *uriA)
+CachedFile::CachedFile(CachedFileLoader *cachedFileLoaderA, GooString *uriA,
+                       size_t chunkSizeA)
 {
   uri = uriA;
   loader = cachedFileLoaderA;
+  chunkSize = chunkSizeA > 0 ? chunkSizeA : CachedFileChunkSize;
 
   streamPos = 0;
-  chunks = new std::vector<Chunk>();
   length = 0;
+  lastReadEnd = (size_t) -1;
+  readAhead = 0;
+  readAheadEnd = 0;
+  maxReadAhead = CachedFileMaxReadAhead;
+  memoryUsed = 0;
+  maxMemory = 0;
+  spillFile = NULL;
 
   length = loader->init(uri, this);
   refCnt = 1;
 
-  if (length != ((size_t) -1)) {
-    chunks->resize(length/CachedFileChunkSize + 1);
-  }
-  else {
+  if (length == ((size_t) -1)) {
     error(errInternal, -1, "Failed to initialize file cache for '{0:t}'.", uri);
-    chunks->resize(0);
+    length = 0;
   }
 }
 
 CachedFile::~CachedFile()
 {
+  finishLoads(gTrue);
   delete uri;
   delete loader;
-  delete chunks;
+  for (ChunkMap::iterator it = chunks.begin(); it != chunks.end(); ++it) {
+    gfree(it->second.data);
+  }
+  if (spillFile) {
+    fclose(spillFile);
+  }
+}
+
+void CachedFile::setMemoryBudget(size_t maxMemoryA, GBool spillToDisk)
+{
+  maxMemory = maxMemoryA;
+  if (spillToDisk && !spillFile) {
+    spillFile = tmpfile();
+    if (!spillFile) {
+      error(errIO, -1, "Couldn't create a spill file for '{0:t}'.", uri);
+    }
+  }
 }
 
 void CachedFile::incRefCnt() {
@@ -77,15 +102,63 @@ int CachedFile::seek(long int offset, int origin)
   return 0;
 }
 
-int CachedFile::cache(const std::vector<ByteRange> &origRanges)
+int CachedFile::cache(const std::vector<ByteRange> &ranges)
+{
+  return cache(ranges, gTrue);
+}
+
+int CachedFile::prefetch(const std::vector<ByteRange> &ranges)
+{
+  if (ranges.empty()) return 0;
+
+  if (!loader->isAsync()) {
+    // Keep only what is still missing, once: the same ranges (e.g. from
+    // the hint tables) are prefetched again on every page visit.
+    std::vector<ByteRange> range(1);
+    size_t n = 0;
+    for (size_t i = 0; i < prefetchRanges.size(); i++) {
+      range[0] = prefetchRanges[i];
+      if (isMissing(range)) {
+        prefetchRanges[n++] = prefetchRanges[i];
+      }
+    }
+    prefetchRanges.resize(n);
+    for (size_t i = 0; i < ranges.size(); i++) {
+      range[0] = ranges[i];
+      if (!isMissing(range)) continue;
+      size_t j;
+      for (j = 0; j < prefetchRanges.size(); j++) {
+        if (prefetchRanges[j].offset == ranges[i].offset &&
+            prefetchRanges[j].length == ranges[i].length)
+          break;
+      }
+      if (j == prefetchRanges.size()) {
+        prefetchRanges.push_back(ranges[i]);
+      }
+    }
+    if (prefetchRanges.size() > CachedFileMaxPrefetchRanges) {
+      prefetchRanges.erase(prefetchRanges.begin(),
+                           prefetchRanges.end() - CachedFileMaxPrefetchRanges);
+    }
+    return 0;
+  }
+
+  return cache(ranges, gFalse);
+}
+
+int CachedFile::cache(const std::vector<ByteRange> &origRanges, GBool wait)
 {
-  std::vector<int> loadChunks;
-  int numChunks = length/CachedFileChunkSize + 1;
-  std::vector<bool> chunkNeeded(numChunks);
+  std::vector<int> loadChunks, required;
+  std::vector<std::vector<int> > runChunks;
+  int numChunks = getNumChunks();
+  int firstChunk, lastChunk;
   int startChunk, endChunk;
   std::vector<ByteRange> chunk_ranges, all;
   ByteRange range;
   const std::vector<ByteRange> *ranges = &origRanges;
+  GBool async = loader->isAsync();
+
+  evictChunks();
 
   if (ranges->empty()) {
     range.offset = 0;
@@ -94,8 +167,35 @@ int CachedFile::cache(const std::vector<ByteRange> &origRanges)
     ranges = &all;
   }
 
-  for (int i = 0; i < numChunks; ++i)
-    chunkNeeded[i] = false;
+  // Ranges passed to prefetch() on a synchronous loader go with
+  // the next blocking request that needs to load something.
+  if (wait && !prefetchRanges.empty() && isMissing(*ranges)) {
+    if (ranges != &all) {
+      all = *ranges;
+      ranges = &all;
+    }
+    all.insert(all.end(), prefetchRanges.begin(), prefetchRanges.end());
+    prefetchRanges.clear();
+  }
+
+  firstChunk = numChunks;
+  lastChunk = -1;
+  for (size_t i = 0; i < ranges->size(); i++) {
+    if ((*ranges)[i].length == 0) continue;
+    if ((*ranges)[i].offset >= length) continue;
+
+    size_t start = (*ranges)[i].offset;
+    size_t end = start + (*ranges)[i].length - 1;
+    if (end >= length) end = length - 1;
+
+    if ((int)(start / chunkSize) < firstChunk)
+      firstChunk = start / chunkSize;
+    if ((int)(end / chunkSize) > lastChunk)
+      lastChunk = end / chunkSize;
+  }
+  if (lastChunk < 0) return 0;
+
+  std::vector<bool> chunkNeeded(lastChunk - firstChunk + 1, false);
   for (size_t i = 0; i < ranges->size(); i++) {
 
     if ((*ranges)[i].length == 0) continue;
@@ -105,42 +205,272 @@ int CachedFile::cache(const std::vector<ByteRange> &origRanges)
     size_t end = start + (*ranges)[i].length - 1;
     if (end >= length) end = length - 1;
 
-    startChunk = start / CachedFileChunkSize;
-    endChunk = end / CachedFileChunkSize;
+    startChunk = start / chunkSize;
+    endChunk = end / chunkSize;
     for (int chunk = startChunk; chunk <= endChunk; chunk++) {
-      if ((*chunks)[chunk].state == chunkStateNew) {
-           chunkNeeded[chunk] = true;
+      if (getChunkState(chunk) == chunkStateNew) {
+           chunkNeeded[chunk - firstChunk] = true;
+      }
+      if (getChunkState(chunk) != chunkStateLoaded) {
+           required.push_back(chunk);
       }
     }
   }
 
-  int chunk = 0;
-  while (chunk < numChunks) {
-    while (!chunkNeeded[chunk] && (++chunk != numChunks)) ;
-    if (chunk == numChunks) break;
-    startChunk = chunk;
-    loadChunks.push_back(chunk);
+  // Group the needed chunks into ranges, bridging short gaps so that
+  // scattered requests do not cost one round trip each.
+  int chunk = firstChunk;
+  while (chunk <= lastChunk) {
+    while (!chunkNeeded[chunk - firstChunk] && (++chunk <= lastChunk)) ;
+    if (chunk > lastChunk) break;
+    startChunk = endChunk = chunk;
+
+    while (++chunk <= lastChunk) {
+      if (chunkNeeded[chunk - firstChunk]) {
+        endChunk = chunk;
+      } else if (chunk - endChunk > CachedFileCoalesceGap ||
+                 getChunkState(chunk) == chunkStatePending) {
+        break;
+      }
+    }
+    chunk = endChunk + 1;
 
-    while ((++chunk != numChunks) && chunkNeeded[chunk]) {
-      loadChunks.push_back(chunk);
+    runChunks.push_back(std::vector<int>());
+    for (int i = startChunk; i <= endChunk; i++) {
+      loadChunks.push_back(i);
+      runChunks.back().push_back(i);
     }
-    endChunk = chunk - 1;
 
-    range.offset = startChunk * CachedFileChunkSize;
-    range.length = (endChunk - startChunk + 1) * CachedFileChunkSize;
+    range.offset = startChunk * chunkSize;
+    range.length = (endChunk - startChunk + 1) * chunkSize;
 
     chunk_ranges.push_back(range);
   }
 
+  if (!async) {
+    if (chunk_ranges.size() > 0) {
+      CachedFileWriter writer =
+          CachedFileWriter(this, &loadChunks);
+      return loader->load(chunk_ranges, &writer);
+    }
+    return 0;
+  }
+
   if (chunk_ranges.size() > 0) {
-    CachedFileWriter writer =
-        CachedFileWriter(this, &loadChunks);
-    return loader->load(chunk_ranges, &writer);
+    std::vector<CachedFileWriter *> writers;
+    for (size_t i = 0; i < runChunks.size(); i++) {
+      for (size_t j = 0; j < runChunks[i].size(); j++) {
+        if (getChunkState(runChunks[i][j]) == chunkStateNew)
+          setChunkState(runChunks[i][j], chunkStatePending);
+      }
+      writers.push_back(new CachedFileWriter(this, runChunks[i]));
+    }
+    pendingWriters.insert(pendingWriters.end(), writers.begin(), writers.end());
+
+    int ret = loader->startLoad(chunk_ranges, writers);
+    if (ret != 0) {
+      finishLoads(gTrue);
+      return ret;
+    }
+  }
+
+  if (wait && !required.empty()) {
+    // Wait for the required chunks only: prefetches started earlier
+    // go on in the background.
+    for (;;) {
+      size_t i;
+      for (i = 0; i < required.size() &&
+                  getChunkState(required[i]) == chunkStateLoaded; i++) ;
+      if (i == required.size() || loader->waitLoadProgress() == 0) break;
+    }
+    finishLoads(gFalse);
+    for (size_t i = 0; i < required.size(); i++) {
+      if (getChunkState(required[i]) != chunkStateLoaded)
+        return 1;
+    }
   }
 
   return 0;
 }
 
+GBool CachedFile::isMissing(const std::vector<ByteRange> &ranges)
+{
+  for (size_t i = 0; i < ranges.size(); i++) {
+    if (ranges[i].length == 0) continue;
+    if (ranges[i].offset >= length) continue;
+
+    size_t start = ranges[i].offset;
+    size_t end = start + ranges[i].length - 1;
+    if (end >= length) end = length - 1;
+
+    for (size_t chunk = start / chunkSize; chunk <= end / chunkSize; chunk++) {
+      if (getChunkState(chunk) != chunkStateLoaded)
+        return gTrue;
+    }
+  }
+  return gFalse;
+}
+
+void CachedFile::finishLoads(GBool wait)
+{
+  if (pendingWriters.empty()) return;
+
+  if (wait) {
+    loader->waitLoads();
+  } else if (loader->pollLoads() > 0) {
+    return;
+  }
+
+  for (size_t i = 0; i < pendingWriters.size(); i++) {
+    // Chunks of failed or short loads can be requested again.
+    std::vector<int> *writerChunks = pendingWriters[i]->chunks;
+    for (size_t j = 0; j < writerChunks->size(); j++) {
+      if (getChunkState((*writerChunks)[j]) == chunkStatePending)
+        setChunkState((*writerChunks)[j], chunkStateNew);
+    }
+    delete pendingWriters[i];
+  }
+  pendingWriters.clear();
+}
+
+CachedFile::ChunkState CachedFile::getChunkState(int chunk)
+{
+  ChunkMap::iterator it = chunks.find(chunk);
+  return it == chunks.end() ? chunkStateNew : it->second.state;
+}
+
+void CachedFile::setChunkState(int chunk, ChunkState state)
+{
+  ChunkMap::iterator it = chunks.find(chunk);
+
+  if (it == chunks.end()) {
+    if (state == chunkStateNew) return;
+    it = newChunk(chunk);
+  }
+  it->second.state = state;
+  if (state != chunkStateLoaded && it->second.inLru) {
+    lru.erase(it->second.lruPos);
+    it->second.inLru = gFalse;
+  }
+  if (state == chunkStateNew) {
+    if (it->second.data) {
+      gfree(it->second.data);
+      memoryUsed -= chunkSize;
+    }
+    chunks.erase(it);
+  }
+}
+
+CachedFile::ChunkMap::iterator CachedFile::newChunk(int chunk)
+{
+  Chunk c;
+
+  c.state = chunkStateNew;
+  c.data = NULL;
+  c.spilled = gFalse;
+  c.reloadable = gTrue;
+  c.inLru = gFalse;
+  return chunks.insert(std::make_pair(chunk, c)).first;
+}
+
+char *CachedFile::getChunkBuffer(int chunk)
+{
+  ChunkMap::iterator it = chunks.find(chunk);
+
+  if (it == chunks.end()) {
+    it = newChunk(chunk);
+  }
+  if (!it->second.data) {
+    it->second.data = (char *)gmalloc(chunkSize);
+    memoryUsed += chunkSize;
+  }
+  return it->second.data;
+}
+
+char *CachedFile::getChunkData(int chunk)
+{
+  ChunkMap::iterator it = chunks.find(chunk);
+
+  if (it == chunks.end() || it->second.state != chunkStateLoaded) {
+    return NULL;
+  }
+
+  Chunk &c = it->second;
+  if (!c.data) {
+    // bring a spilled chunk back into memory
+    c.data = (char *)gmalloc(chunkSize);
+    memoryUsed += chunkSize;
+    if (Gfseek(spillFile, (Goffset)chunk * chunkSize, SEEK_SET) != 0 ||
+        fread(c.data, 1, chunkSize, spillFile) != chunkSize) {
+      error(errIO, -1, "Failed to read back chunk {0:d} of '{1:t}'.", chunk, uri);
+      gfree(c.data);
+      c.data = NULL;
+      memoryUsed -= chunkSize;
+      return NULL;
+    }
+  }
+
+  // most recently used chunks go first
+  if (c.inLru) {
+    lru.splice(lru.begin(), lru, c.lruPos);
+  } else {
+    lru.push_front(chunk);
+    c.lruPos = lru.begin();
+    c.inLru = gTrue;
+  }
+  return c.data;
+}
+
+void CachedFile::chunkLoaded(int chunk, GBool reloadable)
+{
+  ChunkMap::iterator it = chunks.find(chunk);
+
+  it->second.state = chunkStateLoaded;
+  it->second.spilled = gFalse;
+  it->second.reloadable = reloadable;
+  if (it->second.inLru) {
+    lru.splice(lru.begin(), lru, it->second.lruPos);
+  } else {
+    lru.push_front(chunk);
+    it->second.lruPos = lru.begin();
+    it->second.inLru = gTrue;
+  }
+}
+
+void CachedFile::evictChunks()
+{
+  if (maxMemory == 0) return;
+
+  // Evict least recently used chunks first. Chunks that can not be
+  // reloaded are only evicted if they can be spilled to disk.
+  std::list<int>::iterator next = lru.end();
+  while (memoryUsed > maxMemory && next != lru.begin()) {
+    std::list<int>::iterator pos = next;
+    --pos;
+    next = pos;
+
+    Chunk &c = chunks.find(*pos)->second;
+    if (!c.spilled && spillFile) {
+      if (Gfseek(spillFile, (Goffset)*pos * chunkSize, SEEK_SET) == 0 &&
+          fwrite(c.data, 1, chunkSize, spillFile) == chunkSize) {
+        c.spilled = gTrue;
+      }
+    }
+    if (!c.spilled && !c.reloadable) {
+      continue;
+    }
+
+    gfree(c.data);
+    c.data = NULL;
+    memoryUsed -= chunkSize;
+    c.inLru = gFalse;
+    if (!c.spilled) {
+      chunks.erase(*pos);
+    }
+    next = lru.erase(pos);
+  }
+}
+
 size_t CachedFile::read(void *ptr, size_t unitsize, size_t count)
 {
   size_t bytes = unitsize*count;
@@ -150,25 +480,59 @@ size_t CachedFile::read(void *ptr, size_t unitsize, size_t count)
 
   if (bytes == 0) return 0;
 
+  finishLoads(gFalse);
+
+  // Grow the read-ahead window while the reads are sequential
+  if (streamPos == lastReadEnd) {
+    readAhead = readAhead ? 2 * readAhead : chunkSize;
+    if (readAhead > maxReadAhead)
+      readAhead = maxReadAhead;
+    // don't read ahead what would be evicted before being read
+    if (maxMemory > 0 && readAhead > maxMemory / 2)
+      readAhead = maxMemory / 2;
+  } else {
+    readAhead = 0;
+    readAheadEnd = 0;
+  }
+  lastReadEnd = streamPos + bytes;
+
+  // Start a new read-ahead window once the reader has moved past the
+  // previous one and the next chunk is missing.
+  size_t nextChunk = (streamPos + bytes + chunkSize - 1) / chunkSize;
+  if (readAhead > 0 && nextChunk * chunkSize >= readAheadEnd &&
+      nextChunk < (size_t)getNumChunks() && getChunkState(nextChunk) == chunkStateNew) {
+    std::vector<ByteRange> r;
+    ByteRange range;
+    range.offset = nextChunk * chunkSize;
+    range.length = readAhead;
+    r.push_back(range);
+    readAheadEnd = range.offset + range.length;
+    prefetch(r);
+  }
+
   // Load data
   if (cache(streamPos, bytes) != 0) return 0;
 
   // Copy data to buffer
   size_t toCopy = bytes;
   while (toCopy) {
-    int chunk = streamPos / CachedFileChunkSize;
-    int offset = streamPos % CachedFileChunkSize;
-    size_t len = CachedFileChunkSize-offset;
+    int chunk = streamPos / chunkSize;
+    int offset = streamPos % chunkSize;
+    size_t len = chunkSize-offset;
 
     if (len > toCopy)
       len = toCopy;
 
-    memcpy(ptr, (*chunks)[chunk].data + offset, len);
+    char *data = getChunkData(chunk);
+    if (!data) return bytes - toCopy;
+    memcpy(ptr, data + offset, len);
     streamPos += len;
     toCopy -= len;
     ptr = (char*)ptr + len;
   }
 
+  evictChunks();
+
   return bytes;
 }
 
@@ -190,6 +554,7 @@ CachedFileWriter::CachedFileWriter(CachedFile *cachedFileA, std::vector<int> *ch
 {
    cachedFile = cachedFileA;
    chunks = chunksA;
+   ownChunks = gFalse;
 
    if (chunks) {
      offset = 0;
@@ -197,14 +562,26 @@ CachedFileWriter::CachedFileWriter(CachedFile *cachedFileA, std::vector<int> *ch
    }
 }
 
+CachedFileWriter::CachedFileWriter(CachedFile *cachedFileA, const std::vector<int> &chunksA)
+{
+   cachedFile = cachedFileA;
+   chunks = new std::vector<int>(chunksA);
+   ownChunks = gTrue;
+   offset = 0;
+   it = (*chunks).begin();
+}
+
 CachedFileWriter::~CachedFileWriter()
 {
+  if (ownChunks)
+    delete chunks;
 }
 
 size_t CachedFileWriter::write(const char *ptr, size_t size)
 {
   const char *cp = ptr;
   size_t len = size;
+  size_t chunkSize = cachedFile->chunkSize;
   size_t nfree, ncopy;
   size_t written = 0;
   size_t chunk;
@@ -213,24 +590,20 @@ size_t CachedFileWriter::write(const char *ptr, size_t size)
 
   while (len) {
     if (chunks) {
-      if (offset == CachedFileChunkSize) {
+      if (offset == chunkSize) {
          ++it;
          if (it == (*chunks).end()) return written;
          offset = 0;
       }
       chunk = *it;
     } else {
-      offset = cachedFile->length % CachedFileChunkSize;
-      chunk = cachedFile->length / CachedFileChunkSize;
-    }
-
-    if (chunk >= cachedFile->chunks->size()) {
-       cachedFile->chunks->resize(chunk + 1);
+      offset = cachedFile->length % chunkSize;
+      chunk = cachedFile->length / chunkSize;
     }
 
-    nfree = CachedFileChunkSize - offset;
+    nfree = chunkSize - offset;
     ncopy = (len >= nfree) ? nfree : len;
-    memcpy(&((*cachedFile->chunks)[chunk].data[offset]), cp, ncopy);
+    memcpy(cachedFile->getChunkBuffer(chunk) + offset, cp, ncopy);
     len -= ncopy;
     cp += ncopy;
     offset += ncopy;
@@ -240,18 +613,35 @@ size_t CachedFileWriter::write(const char *ptr, size_t size)
       cachedFile->length += ncopy;
     }
 
-    if (offset == CachedFileChunkSize) {
-       (*cachedFile->chunks)[chunk].state = CachedFile::chunkStateLoaded;
+    // Chunks written while the loader initializes can not be loaded again.
+    if (offset == chunkSize) {
+       cachedFile->chunkLoaded(chunk, chunks != NULL);
     }
   }
 
-  if ((chunk == (cachedFile->length / CachedFileChunkSize)) &&
-      (offset == (cachedFile->length % CachedFileChunkSize))) {
-     (*cachedFile->chunks)[chunk].state = CachedFile::chunkStateLoaded;
+  if ((chunk == (cachedFile->length / chunkSize)) &&
+      (offset == (cachedFile->length % chunkSize))) {
+     cachedFile->chunkLoaded(chunk, chunks != NULL);
   }
 
   return written;
 }
 
 //------------------------------------------------------------------------
+// CachedFileLoader
+//------------------------------------------------------------------------
+
+int CachedFileLoader::startLoad(const std::vector<ByteRange> &ranges,
+                                const std::vector<CachedFileWriter *> &writers)
+{
+  std::vector<ByteRange> r(1);
+  for (size_t i = 0; i < ranges.size(); i++) {
+    r[0] = ranges[i];
+    int ret = load(r, writers[i]);
+    if (ret != 0) return ret;
+  }
+  return 0;
+}
+
+//------------------------------------------------------------------------
 
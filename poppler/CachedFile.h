@@ -21,22 +21,41 @@
 #include "Object.h"
 #include "Stream.h"
 
+#include <stdio.h>
+#include <list>
+#include <map>
 #include <vector>
 
 //------------------------------------------------------------------------
 
 #define CachedFileChunkSize 8192 // This should be a multiple of cachedStreamBufSize
 
+// Upper bound for the read-ahead window used on sequential access.
+#define CachedFileMaxReadAhead (32 * CachedFileChunkSize)
+
+// Missing ranges separated by at most this many already loaded chunks
+// are fetched as a single range.
+#define CachedFileCoalesceGap 4
+
+// At most this many ranges passed to prefetch() on a synchronous loader
+// are kept for the next blocking request; the oldest ones are dropped.
+#define CachedFileMaxPrefetchRanges 256
+
 class GooString;
 class CachedFileLoader;
+class CachedFileWriter;
 
 //------------------------------------------------------------------------
 // CachedFile
 //
 // CachedFile gives FILE-like access to a document at a specified URI.
 // In the constructor, you specify a CachedFileLoader that handles loading
-// the data from the document. The CachedFile requests no more data then it
-// needs from the CachedFileLoader.
+// the data from the document, and optionally the size of the chunks the
+// data is loaded and kept in. The CachedFile requests no more data then
+// it needs from the CachedFileLoader, except for the read-ahead window
+// that is added on sequential reads and ranges passed to prefetch().
+// Loaded chunks are kept in a sparse map and can be evicted to stay
+// within a memory budget.
 //------------------------------------------------------------------------
 
 class CachedFile {
@@ -45,15 +64,36 @@ friend class CachedFileWriter;
 
 public:
 
-  CachedFile(CachedFileLoader *cacheLoader, GooString *uri);
+  CachedFile(CachedFileLoader *cacheLoader, GooString *uri,
+             size_t chunkSizeA = CachedFileChunkSize);
 
   Guint getLength() { return length; }
+  size_t getChunkSize() { return chunkSize; }
   long int tell();
   int seek(long int offset, int origin);
   size_t read(void * ptr, size_t unitsize, size_t count);
   size_t write(const char *ptr, size_t size, size_t fromByte);
   int cache(const std::vector<ByteRange> &ranges);
 
+  // Starts loading the given ranges without waiting for them.
+  // If the loader is not asynchronous, the ranges are fetched together
+  // with the next blocking request instead.
+  // Returns 0 on success, anything but 0 on failure.
+  int prefetch(const std::vector<ByteRange> &ranges);
+
+  // Returns true if all the given ranges are already loaded.
+  GBool isCached(const std::vector<ByteRange> &ranges) { return !isMissing(ranges); }
+
+  // Sets the maximum size of the read-ahead window used on sequential
+  // reads. 0 disables read-ahead.
+  void setMaxReadAhead(size_t maxReadAheadA) { maxReadAhead = maxReadAheadA; }
+
+  // Limits the memory used by loaded chunks to about maxMemory bytes,
+  // evicting the least recently used ones. 0 means no limit.
+  // If spillToDisk is true, evicted chunks are written to a temporary
+  // file instead of being loaded again from the loader.
+  void setMemoryBudget(size_t maxMemoryA, GBool spillToDisk);
+
   // Reference counting.
   void incRefCnt();
   void decRefCnt();
@@ -64,23 +104,60 @@ private:
 
   enum ChunkState {
     chunkStateNew = 0,
+    chunkStatePending,  // requested from an asynchronous load
     chunkStateLoaded
   };
 
-  typedef struct {
+  struct Chunk {
     ChunkState state;
-    char data[CachedFileChunkSize];
-  } Chunk;
+    char *data;         // NULL while evicted
+    GBool spilled;      // a copy of the data is in the spill file
+    GBool reloadable;   // the loader can provide the data again
+    GBool inLru;
+    std::list<int>::iterator lruPos;
+  };
+
+  // Only chunks that are not new have an entry.
+  typedef std::map<int, Chunk> ChunkMap;
 
   int cache(size_t offset, size_t length);
+  int cache(const std::vector<ByteRange> &ranges, GBool wait);
+  GBool isMissing(const std::vector<ByteRange> &ranges);
+  void finishLoads(GBool wait);
+
+  int getNumChunks() { return length/chunkSize + 1; }
+  ChunkState getChunkState(int chunk);
+  void setChunkState(int chunk, ChunkState state);
+  ChunkMap::iterator newChunk(int chunk);
+  char *getChunkBuffer(int chunk);
+  char *getChunkData(int chunk);
+  void chunkLoaded(int chunk, GBool reloadable);
+  void evictChunks();
 
   CachedFileLoader *loader;
   GooString *uri;
 
   size_t length;
   size_t streamPos;
+  size_t chunkSize;
 
-  std::vector<Chunk> *chunks;
+  ChunkMap chunks;
+  std::list<int> lru;   // loaded chunks in memory, most recently used first
+  size_t memoryUsed;
+  size_t maxMemory;
+  FILE *spillFile;
+
+  // sequential read detection
+  size_t lastReadEnd;
+  size_t readAhead;
+  size_t readAheadEnd;
+  size_t maxReadAhead;
+
+  // ranges passed to prefetch() on a synchronous loader
+  std::vector<ByteRange> prefetchRanges;
+
+  // writers of loads started asynchronously and not yet finished
+  std::vector<CachedFileWriter *> pendingWriters;
 
   int refCnt;  // reference count
 
@@ -96,12 +173,17 @@ private:
 
 class CachedFileWriter {
 
+friend class CachedFile;
+
 public:
 
   // Construct a CachedFile Writer.
   // The caller is responsible for deleting the cachedFile and chunksA.
   CachedFileWriter(CachedFile *cachedFile, std::vector<int> *chunksA);
 
+  // Construct a CachedFile Writer that owns its chunk list.
+  CachedFileWriter(CachedFile *cachedFile, const std::vector<int> &chunksA);
+
   ~CachedFileWriter();
 
   // Writes size bytes from ptr to cachedFile, returns number of bytes written.
@@ -113,6 +195,7 @@ private:
   std::vector<int> *chunks;
   std::vector<int>::iterator it;
   size_t offset;
+  GBool ownChunks;
 
 };
 
@@ -139,6 +222,32 @@ public:
   // The caller is responsible for deleting the writer.
   virtual int load(const std::vector<ByteRange> &ranges, CachedFileWriter *writer) = 0;
 
+  // Returns true if startLoad() returns before the data has arrived.
+  virtual GBool isAsync() { return gFalse; }
+
+  // Starts loading the specified byte ranges, writers[i] receiving the
+  // data of ranges[i]. Asynchronous loaders may keep several ranges in
+  // flight at once and complete them in any order.
+  // Returns 0 on success, Anything but 0 on failure.
+  // The caller is responsible for deleting the writers, but not before
+  // waitLoads() has returned or pollLoads() has returned 0.
+  // The default implementation loads the ranges one after another.
+  virtual int startLoad(const std::vector<ByteRange> &ranges,
+                        const std::vector<CachedFileWriter *> &writers);
+
+  // Makes progress on the loads started with startLoad() without blocking.
+  // Returns the number of loads still in flight.
+  virtual int pollLoads() { return 0; }
+
+  // Blocks until some of the loads started with startLoad() have made
+  // progress, and returns the number of loads still in flight.
+  // The default implementation calls pollLoads().
+  virtual int waitLoadProgress() { return pollLoads(); }
+
+  // Blocks until all the loads started with startLoad() are finished.
+  // Returns 0 on success, Anything but 0 if any of them failed.
+  virtual int waitLoads() { return 0; }
+
 };
 
 //------------------------------------------------------------------------
@@ -206,6 +206,9 @@ _ft_new_face_uncached (FT_Library lib,
 }
 
 #if CAN_CHECK_OPEN_FACES
+/* Faces opened from the same font data, such as a subset embedded again
+ * on every page, are shared; SplashOutputDev keys its font files on the
+ * font program for the same reason. */
 static struct _ft_face_data {
   struct _ft_face_data *prev, *next, **head;
 
@@ -37,10 +37,12 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
 #include "goo/gmem.h"
 #include "goo/gfile.h"
 #include "goo/GooLikely.h"
 #include "goo/GooString.h"
+#include "goo/GooList.h"
 #include "Error.h"
 #include "GlobalParams.h"
 #include "PSTokenizer.h"
@@ -75,6 +77,22 @@ static int getCharFromFile(void *data) {
   return fgetc((FILE *)data);
 }
 
+// Hash function for sMapHash.
+static inline Guint hashCharCode(CharCode c, int hashSize) {
+  return (Guint)(c * 0x9e3779b1U) & (Guint)(hashSize - 1);
+}
+
+struct ReverseMapEntry {
+  Guint u;
+  Guint c;
+};
+
+struct ReverseMapLessThan {
+  bool operator()(const ReverseMapEntry &a, const ReverseMapEntry &b) const {
+    return a.u < b.u || (a.u == b.u && a.c < b.c);
+  }
+};
+
 //------------------------------------------------------------------------
 
 static int hexCharVals[256] = {
@@ -130,6 +148,27 @@ CharCodeToUnicode *CharCodeToUnicode::parseCIDToUnicode(GooString *fileName,
   char buf[64];
   Unicode u;
   CharCodeToUnicode *ctu;
+  GooString *data;
+  GooList *srcFileNames;
+  GBool useCache;
+
+  // the compiled form of a cidToUnicode file is just the map
+  useCache = globalParams->hasDataCacheDir();
+  if (useCache &&
+      (data = globalParams->loadCompiledData("cidToUnicode", collection,
+					     fileName, NULL))) {
+    if (data->getLength() % sizeof(Unicode) == 0) {
+      mapLenA = data->getLength() / sizeof(Unicode);
+      mapA = (Unicode *)gmallocn(mapLenA, sizeof(Unicode));
+      memcpy(mapA, data->getCString(), mapLenA * sizeof(Unicode));
+      delete data;
+      ctu = new CharCodeToUnicode(collection->copy(), mapA, mapLenA, gTrue,
+				  NULL, 0, 0);
+      gfree(mapA);
+      return ctu;
+    }
+    delete data;
+  }
 
   if (!(f = openFile(fileName->getCString(), "r"))) {
     error(errIO, -1, "Couldn't open cidToUnicode file '{0:t}'",
@@ -157,6 +196,16 @@ CharCodeToUnicode *CharCodeToUnicode::parseCIDToUnicode(GooString *fileName,
   }
   fclose(f);
 
+  if (useCache) {
+    data = new GooString((char *)mapA, mapLenA * sizeof(Unicode));
+    srcFileNames = new GooList();
+    srcFileNames->append(fileName->copy());
+    globalParams->saveCompiledData("cidToUnicode", collection, srcFileNames,
+				   data);
+    deleteGooList(srcFileNames, GooString);
+    delete data;
+  }
+
   ctu = new CharCodeToUnicode(collection->copy(), mapA, mapLenA, gTrue,
 			      NULL, 0, 0);
   gfree(mapA);
@@ -442,6 +491,10 @@ void CharCodeToUnicode::addMapping(CharCode code, char *uStr, int n,
       }
     }
   }
+  if (reverseMap) {
+    gfree(reverseMap);
+    reverseMap = NULL;
+  }
   if (n <= 4) {
     if (!parseHex(uStr, n, &u)) {
       error(errSyntaxWarning, -1, "Illegal entry in ToUnicode CMap");
@@ -471,16 +524,60 @@ void CharCodeToUnicode::addMapping(CharCode code, char *uStr, int n,
     utf16[utf16Len - 1] += offset;
     sMap[sMapLen].len = UTF16toUCS4(utf16, utf16Len, &sMap[sMapLen].u);
     gfree(utf16);
+    addSMapHash(sMapLen);
     ++sMapLen;
   }
 }
 
+// Return the index of the last sMap entry for <c>, or -1.
+inline int CharCodeToUnicode::findSMap(CharCode c) {
+  int i, h;
+
+  if (!sMapHashSize) {
+    return -1;
+  }
+  for (h = hashCharCode(c, sMapHashSize); (i = sMapHash[h]); h = (h + 1) & (sMapHashSize - 1)) {
+    if (sMap[i - 1].c == c) {
+      return i - 1;
+    }
+  }
+  return -1;
+}
+
+// Enter sMap[<idx>] into sMapHash, replacing any earlier entry for the
+// same char code (later entries take precedence).
+void CharCodeToUnicode::addSMapHash(int idx) {
+  int i, h;
+
+  if (2 * (sMapLen + 1) > sMapHashSize) {
+    gfree(sMapHash);
+    sMapHashSize = sMapHashSize ? 2 * sMapHashSize : 64;
+    while (2 * (sMapLen + 1) > sMapHashSize) {
+      sMapHashSize *= 2;
+    }
+    sMapHash = (int *)gmallocn(sMapHashSize, sizeof(int));
+    memset(sMapHash, 0, sMapHashSize * sizeof(int));
+    for (i = 0; i < idx; ++i) {
+      addSMapHash(i);
+    }
+  }
+  for (h = hashCharCode(sMap[idx].c, sMapHashSize); (i = sMapHash[h]); h = (h + 1) & (sMapHashSize - 1)) {
+    if (sMap[i - 1].c == sMap[idx].c) {
+      break;
+    }
+  }
+  sMapHash[h] = idx + 1;
+}
+
 CharCodeToUnicode::CharCodeToUnicode() {
   tag = NULL;
   map = NULL;
   mapLen = 0;
   sMap = NULL;
   sMapLen = sMapSize = 0;
+  sMapHash = NULL;
+  sMapHashSize = 0;
+  reverseMap = NULL;
   refCnt = 1;
   isIdentity = gFalse;
 #if MULTITHREADED
@@ -499,6 +596,9 @@ CharCodeToUnicode::CharCodeToUnicode(GooString *tagA) {
   }
   sMap = NULL;
   sMapLen = sMapSize = 0;
+  sMapHash = NULL;
+  sMapHashSize = 0;
+  reverseMap = NULL;
   refCnt = 1;
   isIdentity = gFalse;
 #if MULTITHREADED
@@ -519,8 +619,15 @@ CharCodeToUnicode::CharCodeToUnicode(GooString *tagA, Unicode *mapA,
     map = mapA;
   }
   sMap = sMapA;
-  sMapLen = sMapLenA;
+  sMapLen = 0;
   sMapSize = sMapSizeA;
+  sMapHash = NULL;
+  sMapHashSize = 0;
+  while (sMapLen < sMapLenA) {
+    addSMapHash(sMapLen);
+    ++sMapLen;
+  }
+  reverseMap = NULL;
   refCnt = 1;
   isIdentity = gFalse;
 #if MULTITHREADED
@@ -537,6 +644,8 @@ CharCodeToUnicode::~CharCodeToUnicode() {
     for (int i = 0; i < sMapLen; ++i) gfree(sMap[i].u);
     gfree(sMap);
   }
+  gfree(sMapHash);
+  gfree(reverseMap);
 #if MULTITHREADED
   gDestroyMutex(&mutex);
 #endif
@@ -577,21 +686,24 @@ void CharCodeToUnicode::setMapping(CharCode c, Unicode *u, int len) {
   if (!map || isIdentity) {
     return;
   }
+  if (reverseMap) {
+    gfree(reverseMap);
+    reverseMap = NULL;
+  }
   if (len == 1) {
     map[c] = u[0];
   } else {
-    for (i = 0; i < sMapLen; ++i) {
-      if (sMap[i].c == c) {
-	gfree(sMap[i].u);
-	break;
-      }
-    }
-    if (i == sMapLen) {
+    if ((i = findSMap(c)) >= 0) {
+      gfree(sMap[i].u);
+    } else {
       if (sMapLen == sMapSize) {
 	sMapSize += 8;
 	sMap = (CharCodeToUnicodeString *)
 	         greallocn(sMap, sMapSize, sizeof(CharCodeToUnicodeString));
       }
+      i = sMapLen;
+      sMap[i].c = c;
+      addSMapHash(i);
       ++sMapLen;
     }
     map[c] = 0;
@@ -623,15 +735,28 @@ int CharCodeToUnicode::mapToUnicode(CharCode c, Unicode **u) {
     *u = &map[c];
     return 1;
   }
-  for (i = sMapLen - 1; i >= 0; --i) { // in reverse so CMap takes precedence
-    if (sMap[i].c == c) {
-      *u = sMap[i].u;
-      return sMap[i].len;
-    }
+  // sMapHash holds the last entry for each code, so that the CMap
+  // takes precedence
+  if ((i = findSMap(c)) >= 0) {
+    *u = sMap[i].u;
+    return sMap[i].len;
   }
   return 0;
 }
 
+void CharCodeToUnicode::buildReverseMap() {
+  ReverseMapEntry *entries;
+  CharCode i;
+
+  entries = (ReverseMapEntry *)gmallocn(mapLen, sizeof(ReverseMapEntry));
+  for (i = 0; i < mapLen; ++i) {
+    entries[i].u = map[i];
+    entries[i].c = i;
+  }
+  std::sort(entries, entries + mapLen, ReverseMapLessThan());
+  reverseMap = (Guint *)entries;
+}
+
 int CharCodeToUnicode::mapToCharCode(Unicode* u, CharCode *c, int usize) {
   //look for charcode in map
   if (usize == 1 || (usize > 1 && !(*u & ~0xff))) {
@@ -639,12 +764,33 @@ int CharCodeToUnicode::mapToCharCode(Unicode* u, CharCode *c, int usize) {
       *c = (CharCode) *u;
       return 1;
     }
-    for (CharCode i=0; i<mapLen; i++) {
-      if (map[i] == *u) {
-        *c = i;
-        return 1;
+    // binary search the reverse map for the lowest code mapping to *u
+#if MULTITHREADED
+    gLockMutex(&mutex);
+#endif
+    if (!reverseMap && mapLen > 0) {
+      buildReverseMap();
+    }
+    ReverseMapEntry *entries = (ReverseMapEntry *)reverseMap;
+    CharCode a = 0, b = mapLen;
+    while (a < b) {
+      CharCode m = (a + b) / 2;
+      if (entries[m].u < *u) {
+        a = m + 1;
+      } else {
+        b = m;
       }
     }
+    GBool found = a < mapLen && entries[a].u == *u;
+    if (found) {
+      *c = entries[a].c;
+    }
+#if MULTITHREADED
+    gUnlockMutex(&mutex);
+#endif
+    if (found) {
+      return 1;
+    }
     *c = 'x';
   } else {
     int i, j;
@@ -656,7 +802,7 @@ int CharCodeToUnicode::mapToCharCode(Unicode* u, CharCode *c, int usize) {
       //compare the string char by char
       for (j=0; j<sMap[i].len; j++) {
         if (sMap[i].u[j] != u[j]) {
-          continue;
+          break;
         }
       }
 
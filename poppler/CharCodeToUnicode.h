@@ -102,6 +102,9 @@ private:
 
   void parseCMap1(int (*getCharFunc)(void *), void *data, int nBits);
   void addMapping(CharCode code, char *uStr, int n, int offset);
+  int findSMap(CharCode c);
+  void addSMapHash(int idx);
+  void buildReverseMap();
   CharCodeToUnicode();
   CharCodeToUnicode(GooString *tagA);
   CharCodeToUnicode(GooString *tagA, Unicode *mapA,
@@ -114,6 +117,13 @@ private:
   CharCode mapLen;
   CharCodeToUnicodeString *sMap;
   int sMapLen, sMapSize;
+  int *sMapHash;		// open addressing hash table mapping char
+				//   codes to (1 + index of the last sMap
+				//   entry for the code); 0 = empty slot
+  int sMapHashSize;		// size of sMapHash (power of 2, or 0)
+  Guint *reverseMap;		// (Unicode, CharCode) pairs for all map
+				//   entries, sorted; built on the first
+				//   mapToCharCode call, or NULL
   int refCnt;
   GBool isIdentity;
 #if MULTITHREADED
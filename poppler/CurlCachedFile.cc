@@ -23,9 +23,16 @@ CurlCachedFileLoader::CurlCachedFileLoader()
   url = NULL;
   cachedFile = NULL;
   curl = NULL;
+  multi = NULL;
+  running = 0;
+  failed = 0;
 }
 
 CurlCachedFileLoader::~CurlCachedFileLoader() {
+  if (multi) {
+    waitLoads();
+    curl_multi_cleanup(multi);
+  }
   curl_easy_cleanup(curl);
 }
 
@@ -95,5 +102,109 @@ int CurlCachedFileLoader::load(const std::vector<ByteRange> &ranges, CachedFileW
   return r;
 }
 
-//------------------------------------------------------------------------
+int CurlCachedFileLoader::startLoad(const std::vector<ByteRange> &ranges,
+                                    const std::vector<CachedFileWriter *> &writers)
+{
+  size_t fromByte, toByte;
+
+  if (!multi) {
+    multi = curl_multi_init();
+    if (!multi) return -1;
+  }
 
+  for (size_t i = 0; i < ranges.size(); i++) {
+
+     fromByte = ranges[i].offset;
+     toByte = fromByte + ranges[i].length - 1;
+     GooString *range = GooString::format("{0:ud}-{1:ud}", fromByte, toByte);
+
+     CURL *handle = curl_easy_init();
+     curl_easy_setopt(handle, CURLOPT_URL, url->getCString());
+     curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, load_cb);
+     curl_easy_setopt(handle, CURLOPT_WRITEDATA, writers[i]);
+     curl_easy_setopt(handle, CURLOPT_RANGE, range->getCString());
+     curl_multi_add_handle(multi, handle);
+     transfers.push_back(handle);
+
+     delete range;
+  }
+
+  curl_multi_perform(multi, &running);
+  finishTransfers();
+  return 0;
+}
+
+int CurlCachedFileLoader::pollLoads()
+{
+  if (!multi) return 0;
+
+  curl_multi_perform(multi, &running);
+  finishTransfers();
+  return running;
+}
+
+int CurlCachedFileLoader::waitLoadProgress()
+{
+  if (!multi) return 0;
+
+  curl_multi_perform(multi, &running);
+  if (running > 0 && curl_multi_wait(multi, NULL, 0, 1000, NULL) == CURLM_OK) {
+    curl_multi_perform(multi, &running);
+  }
+  finishTransfers();
+  return running;
+}
+
+int CurlCachedFileLoader::waitLoads()
+{
+  int r;
+
+  if (!multi) return 0;
+
+  curl_multi_perform(multi, &running);
+  while (running > 0) {
+    if (curl_multi_wait(multi, NULL, 0, 1000, NULL) != CURLM_OK) break;
+    curl_multi_perform(multi, &running);
+  }
+  finishTransfers();
+
+  // The writers go away once we return, so abort anything left over
+  if (!transfers.empty()) {
+    for (size_t i = 0; i < transfers.size(); i++) {
+      curl_multi_remove_handle(multi, transfers[i]);
+      curl_easy_cleanup(transfers[i]);
+    }
+    transfers.clear();
+    running = 0;
+    if (!failed) failed = -1;
+  }
+
+  r = failed;
+  failed = 0;
+  return r;
+}
+
+void CurlCachedFileLoader::finishTransfers()
+{
+  CURLMsg *msg;
+  int left;
+
+  while ((msg = curl_multi_info_read(multi, &left))) {
+    if (msg->msg != CURLMSG_DONE) continue;
+
+    CURL *handle = msg->easy_handle;
+    if (msg->data.result != CURLE_OK && !failed) {
+      failed = msg->data.result;
+    }
+    curl_multi_remove_handle(multi, handle);
+    curl_easy_cleanup(handle);
+    for (size_t i = 0; i < transfers.size(); i++) {
+      if (transfers[i] == handle) {
+        transfers.erase(transfers.begin() + i);
+        break;
+      }
+    }
+  }
+}
+
+//------------------------------------------------------------------------
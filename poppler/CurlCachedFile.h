@@ -17,6 +17,8 @@
 
 #include <curl/curl.h>
 
+#include <vector>
+
 //------------------------------------------------------------------------
 
 class CurlCachedFileLoader : public CachedFileLoader {
@@ -28,12 +30,28 @@ public:
   size_t init(GooString *url, CachedFile* cachedFile);
   int load(const std::vector<ByteRange> &ranges, CachedFileWriter *writer);
 
+  // Each range is fetched by its own request, all of them in flight at
+  // once through a curl multi handle.
+  GBool isAsync() { return gTrue; }
+  int startLoad(const std::vector<ByteRange> &ranges,
+                const std::vector<CachedFileWriter *> &writers);
+  int pollLoads();
+  int waitLoadProgress();
+  int waitLoads();
+
 private:
 
+  void finishTransfers();
+
   GooString *url;
   CachedFile *cachedFile;
   CURL *curl;
 
+  CURLM *multi;
+  std::vector<CURL *> transfers;
+  int running;  // transfers still in flight
+  int failed;   // error of the first failed transfer
+
 };
 
 #endif
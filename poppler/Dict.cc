@@ -33,7 +33,6 @@
 #pragma implementation
 #endif
 
-#include <algorithm>
 #include <stddef.h>
 #include <string.h>
 #include "goo/gmem.h"
@@ -50,37 +49,28 @@
 // Dict
 //------------------------------------------------------------------------
 
-static const int SORT_LENGTH_LOWER_LIMIT = 32;
+// Dictionaries with at least this many entries get a hash index;
+// smaller ones are searched linearly.
+static const int HASH_LENGTH_LOWER_LIMIT = 32;
 
-static inline bool cmpDictEntries(const DictEntry &e1, const DictEntry &e2)
-{
-  return strcmp(e1.key, e2.key) < 0;
-}
+static inline Guint hashKey(const char *key) {
+  Guint h;
 
-static int binarySearch(const char *key, DictEntry *entries, int length)
-{
-  int first = 0;
-  int end = length - 1;
-  while (first <= end) {
-    const int middle = (first + end) / 2;
-    const int res = strcmp(key, entries[middle].key);
-    if (res == 0) {
-      return middle;
-    } else if (res < 0) {
-      end = middle - 1;
-    } else {
-      first = middle + 1;
-    }
+  h = 2166136261U;
+  for (; *key; ++key) {
+    h = (h ^ (Guchar)*key) * 16777619U;
   }
-  return -1;
+  return h;
 }
 
 Dict::Dict(XRef *xrefA) {
   xref = xrefA;
   entries = NULL;
   size = length = 0;
+  hashTab = NULL;
+  hashSize = 0;
+  dupKeys = gFalse;
   ref = 1;
-  sorted = gFalse;
 #if MULTITHREADED
   gInitMutex(&mutex);
 #endif
@@ -94,12 +84,15 @@ Dict::Dict(Dict* dictA) {
   gInitMutex(&mutex);
 #endif
 
-  sorted = dictA->sorted;
   entries = (DictEntry *)gmallocn(size, sizeof(DictEntry));
   for (int i=0; i<length; i++) {
     entries[i].key = copyString(dictA->entries[i].key);
     dictA->entries[i].val.copy(&entries[i].val);
   }
+  hashTab = NULL;
+  hashSize = 0;
+  dupKeys = gFalse;
+  buildHash();
 }
 
 Dict *Dict::copy(XRef *xrefA) {
@@ -127,31 +120,30 @@ Dict::~Dict() {
     entries[i].val.free();
   }
   gfree(entries);
+  gfree(hashTab);
 #if MULTITHREADED
   gDestroyMutex(&mutex);
 #endif
 }
 
 int Dict::incRef() {
-  dictLocker();
-  ++ref;
-  return ref;
+#if MULTITHREADED
+  return gAtomicIncrement(&ref);
+#else
+  return ++ref;
+#endif
 }
 
 int Dict::decRef() {
-  dictLocker();
-  --ref;
-  return ref;
+#if MULTITHREADED
+  return gAtomicDecrement(&ref);
+#else
+  return --ref;
+#endif
 }
 
 void Dict::add(char *key, Object *val) {
   dictLocker();
-  if (sorted) {
-    // We use add on very few occasions so
-    // virtually this will never be hit
-    sorted = gFalse;
-  }
-
   if (length == size) {
     if (length == 0) {
       size = 8;
@@ -163,24 +155,106 @@ void Dict::add(char *key, Object *val) {
   entries[length].key = key;
   entries[length].val = *val;
   ++length;
+  if (length >= HASH_LENGTH_LOWER_LIMIT) {
+    if (2 * length > hashSize) {
+      buildHash();
+    } else {
+      hashEntry(length - 1);
+    }
+  }
 }
 
-inline DictEntry *Dict::find(const char *key) {
-  if (!sorted && length >= SORT_LENGTH_LOWER_LIMIT)
-  {
-      dictLocker();
-      sorted = gTrue;
-      std::sort(entries, entries+length, cmpDictEntries);
+// (Re)build the hash index, if the dictionary is large enough to have
+// one.  The table is kept at most half full.
+void Dict::buildHash() {
+  int i;
+
+  if (length < HASH_LENGTH_LOWER_LIMIT) {
+    gfree(hashTab);
+    hashTab = NULL;
+    hashSize = 0;
+    return;
+  }
+  if (hashSize < 2 * length) {
+    gfree(hashTab);
+    for (hashSize = 2 * HASH_LENGTH_LOWER_LIMIT;
+	 hashSize < 2 * length;
+	 hashSize *= 2) ;
+    hashTab = (int *)gmallocn(hashSize, sizeof(int));
+  }
+  for (i = 0; i < hashSize; ++i) {
+    hashTab[i] = -1;
+  }
+  dupKeys = gFalse;
+  for (i = 0; i < length; ++i) {
+    hashEntry(i);
+  }
+}
+
+// Add entry <i> to the hash index.  A later entry with the same key as
+// an earlier one takes its slot, so that lookups find the last one, as
+// the linear search does.
+void Dict::hashEntry(int i) {
+  int h;
+
+  if (!hashTab) {
+    return;
   }
+  h = (int)(hashKey(entries[i].key) & (hashSize - 1));
+  while (hashTab[h] >= 0 && strcmp(entries[hashTab[h]].key, entries[i].key)) {
+    h = (h + 1) & (hashSize - 1);
+  }
+  if (hashTab[h] >= 0) {
+    dupKeys = gTrue;
+  }
+  hashTab[h] = i;
+}
+
+// Return the slot of <key> in the hash index, or -1.
+int Dict::findSlot(const char *key) {
+  int h, i;
 
-  if (sorted) {
-    const int pos = binarySearch(key, entries, length);
-    if (pos != -1) {
-      return &entries[pos];
+  h = (int)(hashKey(key) & (hashSize - 1));
+  while ((i = hashTab[h]) >= 0) {
+    if (!strcmp(key, entries[i].key)) {
+      return h;
     }
-  } else {
-    int i;
+    h = (h + 1) & (hashSize - 1);
+  }
+  return -1;
+}
 
+// Empty slot <h> of the hash index.  The entries after it in the same
+// probe run are shifted back over it, unless that would put them
+// before their home slot, so that no tombstones are needed.
+void Dict::unhashSlot(int h) {
+  int j, home;
+
+  hashTab[h] = -1;
+  j = h;
+  while (1) {
+    j = (j + 1) & (hashSize - 1);
+    if (hashTab[j] < 0) {
+      break;
+    }
+    home = (int)(hashKey(entries[hashTab[j]].key) & (hashSize - 1));
+    // the entry can move to <h> if its home slot isn't in (h, j]
+    if (((j - home) & (hashSize - 1)) >= ((j - h) & (hashSize - 1))) {
+      hashTab[h] = hashTab[j];
+      hashTab[j] = -1;
+      h = j;
+    }
+  }
+}
+
+inline DictEntry *Dict::find(const char *key) {
+  int h, i;
+
+  if (hashTab) {
+    if ((h = findSlot(key)) >= 0) {
+      return &entries[hashTab[h]];
+    }
+  } else {
     for (i = length - 1; i >=0; --i) {
       if (!strcmp(key, entries[i].key))
         return &entries[i];
@@ -195,41 +269,51 @@ GBool Dict::hasKey(const char *key) {
 
 void Dict::remove(const char *key) {
   dictLocker();
-  if (sorted) {
-    const int pos = binarySearch(key, entries, length);
-    if (pos != -1) {
-      length -= 1;
-      gfree(entries[pos].key);
-      entries[pos].val.free();
-      if (pos != length) {
-        memmove(&entries[pos], &entries[pos + 1], (length - pos) * sizeof(DictEntry));
-      }
-    }
-  } else {
-    int i; 
-    bool found = false;
-    DictEntry tmp;
-    if(length == 0) {
-      return;
-    }
+  int i, h; 
+  bool found = false;
+  DictEntry tmp;
+  if(length == 0) {
+    return;
+  }
 
-    for(i=0; i<length; i++) {
-      if (!strcmp(key, entries[i].key)) {
-        found = true;
-        break;
-      }
-    }
-    if(!found) {
+  // with unique keys, only the slots of the removed entry and of the
+  // entry moved into its place change
+  if (hashTab && !dupKeys) {
+    if ((h = findSlot(key)) < 0) {
       return;
     }
-    //replace the deleted entry with the last entry
+    i = hashTab[h];
+    unhashSlot(h);
     gfree(entries[i].key);
     entries[i].val.free();
     length -= 1;
-    tmp = entries[length];
-    if (i!=length) //don't copy the last entry if it is deleted 
-      entries[i] = tmp;
+    if (i != length) {
+      hashTab[findSlot(entries[length].key)] = i;
+      entries[i] = entries[length];
+    }
+    if (length < HASH_LENGTH_LOWER_LIMIT) {
+      buildHash();
+    }
+    return;
+  }
+
+  for(i=0; i<length; i++) {
+    if (!strcmp(key, entries[i].key)) {
+      found = true;
+      break;
+    }
+  }
+  if(!found) {
+    return;
   }
+  //replace the deleted entry with the last entry
+  gfree(entries[i].key);
+  entries[i].val.free();
+  length -= 1;
+  tmp = entries[length];
+  if (i!=length) //don't copy the last entry if it is deleted 
+    entries[i] = tmp;
+  buildHash();
 }
 
 void Dict::set(const char *key, Object *val) {
@@ -63,7 +63,8 @@ public:
   // Get number of entries.
   int getLength() { return length; }
 
-  // Add an entry.  NB: does not copy key.
+  // Add an entry.  NB: does not copy key.  If <key> is already in the
+  // dictionary, lookups return the new entry.
   void add(char *key, Object *val);
 
   // Update the value of an existing entry, otherwise create it
@@ -96,17 +97,24 @@ public:
 
 private:
 
-  GBool sorted;
   XRef *xref;			// the xref table for this PDF file
   DictEntry *entries;		// array of entries
   int size;			// size of <entries> array
   int length;			// number of entries in dictionary
+  int *hashTab;			// hash index of the entries (indexes into
+				//   <entries>, or -1), for large dicts only
+  int hashSize;			// size of <hashTab> (a power of two), or 0
+  GBool dupKeys;		// some key of a hashed dict occurs twice
   int ref;			// reference count
 #if MULTITHREADED
   GooMutex mutex;
 #endif
 
   DictEntry *find(const char *key);
+  void buildHash();
+  void hashEntry(int i);
+  int findSlot(const char *key);
+  void unhashSlot(int h);
 };
 
 #endif
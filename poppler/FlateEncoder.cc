@@ -0,0 +1,91 @@
+//========================================================================
+//
+// FlateEncoder.cc
+//
+// This file is licensed under the GPLv2 or later
+//
+//========================================================================
+
+#include <config.h>
+
+#include "FlateEncoder.h"
+
+//------------------------------------------------------------------------
+// FlateEncoder
+//------------------------------------------------------------------------
+
+FlateEncoder::FlateEncoder(Stream *strA):
+    FilterStream(strA) {
+  outBufPtr = outBufEnd = outBuf;
+  inBufEof = outBufEof = deflateDone = gFalse;
+  zlibInitialized = gFalse;
+}
+
+FlateEncoder::~FlateEncoder() {
+  if (zlibInitialized) {
+    deflateEnd(&zlibStream);
+  }
+  if (str->isEncoder())
+    delete str;
+}
+
+void FlateEncoder::reset() {
+  str->reset();
+  outBufPtr = outBufEnd = outBuf;
+  inBufEof = outBufEof = deflateDone = gFalse;
+
+  if (zlibInitialized) {
+    deflateEnd(&zlibStream);
+  }
+  zlibStream.zalloc = Z_NULL;
+  zlibStream.zfree = Z_NULL;
+  zlibStream.opaque = Z_NULL;
+  zlibStream.next_in = inBuf;
+  zlibStream.avail_in = 0;
+  zlibInitialized = deflateInit(&zlibStream, Z_DEFAULT_COMPRESSION) == Z_OK;
+  if (!zlibInitialized) {
+    error(errInternal, -1, "Internal: deflateInit() failed in FlateEncoder::reset()");
+    outBufEof = gTrue;
+  }
+}
+
+GBool FlateEncoder::fillBuf() {
+  int n, zlibStatus;
+
+  if (outBufEof || !zlibInitialized) {
+    return gFalse;
+  }
+  if (deflateDone) {
+    outBufEof = gTrue;
+    return gFalse;
+  }
+
+  // deflate until some output is available or the input is exhausted
+  do {
+    if (zlibStream.avail_in == 0 && !inBufEof) {
+      n = str->doGetChars(flateEncoderBufSize, inBuf);
+      if (n == 0) {
+        inBufEof = gTrue;
+      }
+      zlibStream.next_in = inBuf;
+      zlibStream.avail_in = n;
+    }
+
+    zlibStream.next_out = outBuf;
+    zlibStream.avail_out = flateEncoderBufSize;
+    zlibStatus = deflate(&zlibStream, inBufEof ? Z_FINISH : Z_NO_FLUSH);
+    if (zlibStatus == Z_STREAM_ERROR) {
+      error(errInternal, -1, "Internal: deflate() failed in FlateEncoder::fillBuf()");
+      outBufEof = gTrue;
+      return gFalse;
+    }
+    outBufPtr = outBuf;
+    outBufEnd = outBuf + (flateEncoderBufSize - zlibStream.avail_out);
+  } while (outBufEnd == outBuf && zlibStatus != Z_STREAM_END);
+
+  // the last block still has to be returned
+  if (zlibStatus == Z_STREAM_END) {
+    deflateDone = gTrue;
+  }
+  return outBufPtr < outBufEnd;
+}
@@ -0,0 +1,61 @@
+//========================================================================
+//
+// FlateEncoder.h
+//
+// This file is licensed under the GPLv2 or later
+//
+//========================================================================
+
+#ifndef FLATEENCODER_H
+#define FLATEENCODER_H
+
+#include "poppler-config.h"
+#include "goo/gtypes.h"
+#include "Error.h"
+#include "Object.h"
+#include "Stream.h"
+
+extern "C" {
+#include <zlib.h>
+}
+
+//------------------------------------------------------------------------
+// FlateEncoder
+//
+// Deflates the data read from the underlying stream, producing data
+// suitable for a /FlateDecode filter.
+//------------------------------------------------------------------------
+
+#define flateEncoderBufSize 16384
+
+class FlateEncoder: public FilterStream {
+public:
+
+  FlateEncoder(Stream *strA);
+  virtual ~FlateEncoder();
+  virtual StreamKind getKind() { return strWeird; }
+  virtual void reset();
+  virtual int getChar()
+    { return (outBufPtr >= outBufEnd && !fillBuf()) ? EOF : (*outBufPtr++ & 0xff); }
+  virtual int lookChar()
+    { return (outBufPtr >= outBufEnd && !fillBuf()) ? EOF : (*outBufPtr & 0xff); }
+  virtual GooString *getPSFilter(int /*psLevel*/, const char * /*indent*/) { return NULL; }
+  virtual GBool isBinary(GBool /*last = gTrue*/) { return gTrue; }
+  virtual GBool isEncoder() { return gTrue; }
+
+private:
+
+  GBool fillBuf();
+
+  Guchar inBuf[flateEncoderBufSize];
+  Guchar outBuf[flateEncoderBufSize];
+  Guchar *outBufPtr;
+  Guchar *outBufEnd;
+  GBool inBufEof;
+  GBool outBufEof;
+  GBool deflateDone;
+  GBool zlibInitialized;
+  z_stream zlibStream;
+};
+
+#endif
@@ -32,18 +32,102 @@
 #include <stddef.h>
 #include <string.h>
 #include <math.h>
+#include <utility>
+#include <vector>
+#if MULTITHREADED && defined(HAVE_PTHREAD)
+#include <pthread.h>
+#include "goo/GooMutex.h"
+#endif
+#include "goo/gmem.h"
 #include "GlobalParams.h"
 #include "Error.h"
 #include "Object.h"
 #include "Dict.h"
+#include "Lexer.h"
+#include "Parser.h"
 #include "GfxFont.h"
 #include "Annot.h"
 #include "PDFDoc.h"
 #include "FontInfo.h"
 
-FontInfoScanner::FontInfoScanner(PDFDoc *docA, int firstPage) {
+// Get the ID of entry <i> of a Font resource dictionary, inventing
+// one for a direct font dictionary the same way GfxFontDict does.
+static Ref getFontRef(Object *fontObj, int i, Ref *fontDictRef) {
+  Ref r;
+
+  if (fontObj->isRef()) {
+    return fontObj->getRef();
+  }
+  r.num = i;
+  r.gen = fontDictRef ? 100000 + fontDictRef->num : 999999;
+  return r;
+}
+
+static FontInfo *makeFontInfo(XRef *xrefA, const char *tag, Ref r,
+			      Dict *fontDict, GBool fast) {
+  GfxFont *font;
+  FontInfo *info;
+
+  if (fast) {
+    return new FontInfo(r, fontDict, xrefA);
+  }
+  info = NULL;
+  if ((font = GfxFont::makeFont(xrefA, tag, r, fontDict))) {
+    if (font->isOk()) {
+      info = new FontInfo(font, xrefA);
+    }
+    font->decRefCnt();
+  }
+  return info;
+}
+
+// Get the normal appearance stream of an annotation straight from its
+// dictionary.
+static Object *getAppearanceStream(Object *annotObj, Object *ap) {
+  Object apObj, obj1, obj2, stateObj;
+
+  ap->initNull();
+  if (annotObj->dictLookup("AP", &apObj)->isDict()) {
+    apObj.dictLookup("N", &obj1);
+    if (obj1.isStream()) {
+      obj1.copy(ap);
+    } else if (obj1.isDict()) {
+      if (annotObj->dictLookup("AS", &stateObj)->isName()) {
+	if (obj1.dictLookup(stateObj.getName(), &obj2)->isStream()) {
+	  obj2.copy(ap);
+	}
+	obj2.free();
+      }
+      stateObj.free();
+    }
+    obj1.free();
+  }
+  apObj.free();
+  return ap;
+}
+
+//------------------------------------------------------------------------
+// FontInfoScanner
+//------------------------------------------------------------------------
+
+#if MULTITHREADED && defined(HAVE_PTHREAD)
+
+struct FontInfoScanJob {
+  FontInfoScanner *scanner;	// fonts and objects seen by this thread
+  XRef *xref;
+  Page **pages;
+  GooList **pageFonts;		// fonts found on each page
+  int nPages;
+  int *nextPage;
+  GooMutex *mutex;
+};
+
+#endif
+
+FontInfoScanner::FontInfoScanner(PDFDoc *docA, int firstPage, GBool fastA) {
   doc = docA;
   currentPage = firstPage + 1;
+  fast = fastA;
 }
 
 FontInfoScanner::~FontInfoScanner() {
@@ -52,9 +136,6 @@ FontInfoScanner::~FontInfoScanner() {
 GooList *FontInfoScanner::scan(int nPages) {
   GooList *result;
   Page *page;
-  Dict *resDict;
-  Annots *annots;
-  Object obj1;
   int lastPage;
 
   if (currentPage > doc->getNumPages()) {
@@ -72,60 +153,230 @@ GooList *FontInfoScanner::scan(int nPages) {
   for (int pg = currentPage; pg < lastPage; ++pg) {
     page = doc->getPage(pg);
     if (!page) continue;
+    scanPage(xrefA, page, result);
+  }
+
+  currentPage = lastPage;
+
+  delete xrefA;
+  return result;
+}
 
-    if ((resDict = page->getResourceDictCopy(xrefA))) {
-      scanFonts(xrefA, resDict, result);
-      delete resDict;
+// Each thread keeps its own sets of seen fonts and objects and takes
+// the pages in increasing order, so a font turns up in its list no
+// later than on the first page that reaches it.  Merging the lists in
+// page order then gives the same result as a single pass.
+GooList *FontInfoScanner::scan(int nPages, int nThreads) {
+  if (nThreads > nPages) {
+    nThreads = nPages;
+  }
+  if (nThreads <= 1 || currentPage > doc->getNumPages()) {
+    return scan(nPages);
+  }
+
+#if MULTITHREADED && defined(HAVE_PTHREAD)
+  GooList *result, *list;
+  FontInfoScanJob *jobs;
+  FontInfo *info;
+  Page **pages;
+  GooList **pageFonts;
+  pthread_t *threads;
+  GBool *started;
+  GooMutex mutex;
+  int lastPage, n, nextPage, i, j;
+
+  lastPage = currentPage + nPages;
+  if (lastPage > doc->getNumPages() + 1) {
+    lastPage = doc->getNumPages() + 1;
+  }
+  n = lastPage - currentPage;
+
+  // the pages (and their Annot objects) are set up here, the threads
+  // only read them
+  pages = (Page **)gmallocn(n, sizeof(Page *));
+  pageFonts = (GooList **)gmallocn(n, sizeof(GooList *));
+  for (i = 0; i < n; ++i) {
+    pages[i] = doc->getPage(currentPage + i);
+    if (pages[i] && !fast) {
+      pages[i]->getAnnots();
     }
-    annots = page->getAnnots();
-    for (int i = 0; i < annots->getNumAnnots(); ++i) {
-      if (annots->getAnnot(i)->getAppearanceResDict(&obj1)->isDict()) {
-        scanFonts(xrefA, obj1.getDict(), result);
+    pageFonts[i] = NULL;
+  }
+
+  gInitMutex(&mutex);
+  nextPage = 0;
+  jobs = (FontInfoScanJob *)gmallocn(nThreads, sizeof(FontInfoScanJob));
+  threads = (pthread_t *)gmallocn(nThreads, sizeof(pthread_t));
+  started = (GBool *)gmallocn(nThreads, sizeof(GBool));
+  for (i = 0; i < nThreads; ++i) {
+    jobs[i].scanner = new FontInfoScanner(doc, 0, fast);
+    jobs[i].scanner->fonts = fonts;
+    jobs[i].scanner->visitedObjects = visitedObjects;
+    jobs[i].scanner->visitedFontDicts = visitedFontDicts;
+    jobs[i].xref = doc->getXRef()->copy();
+    jobs[i].pages = pages;
+    jobs[i].pageFonts = pageFonts;
+    jobs[i].nPages = n;
+    jobs[i].nextPage = &nextPage;
+    jobs[i].mutex = &mutex;
+  }
+
+  // this thread runs the first job; if a thread can't be started, the
+  // remaining jobs pick up its pages
+  for (i = 1; i < nThreads; ++i) {
+    started[i] = pthread_create(&threads[i], NULL, &scanThread, &jobs[i]) == 0;
+  }
+  scanThread(&jobs[0]);
+  for (i = 1; i < nThreads; ++i) {
+    if (started[i]) {
+      pthread_join(threads[i], NULL);
+    }
+  }
+
+  result = new GooList();
+  for (i = 0; i < n; ++i) {
+    if ((list = pageFonts[i])) {
+      for (j = 0; j < list->getLength(); ++j) {
+	info = (FontInfo *)list->get(j);
+	if (fonts.find(info->getRef().num) == fonts.end()) {
+	  fonts.insert(info->getRef().num);
+	  result->append(info);
+	} else {
+	  delete info;
+	}
       }
-      obj1.free();
+      delete list;
     }
   }
+  for (i = 0; i < nThreads; ++i) {
+    visitedObjects.insert(jobs[i].scanner->visitedObjects.begin(),
+			  jobs[i].scanner->visitedObjects.end());
+    visitedFontDicts.insert(jobs[i].scanner->visitedFontDicts.begin(),
+			    jobs[i].scanner->visitedFontDicts.end());
+    delete jobs[i].scanner;
+    delete jobs[i].xref;
+  }
+  gDestroyMutex(&mutex);
+  gfree(started);
+  gfree(threads);
+  gfree(jobs);
+  gfree(pageFonts);
+  gfree(pages);
 
   currentPage = lastPage;
-
-  delete xrefA;
   return result;
+#else
+  return scan(nPages);
+#endif
+}
+
+#if MULTITHREADED && defined(HAVE_PTHREAD)
+
+void *FontInfoScanner::scanThread(void *arg) {
+  FontInfoScanJob *job = (FontInfoScanJob *)arg;
+  int i;
+
+  while (1) {
+    gLockMutex(job->mutex);
+    i = (*job->nextPage)++;
+    gUnlockMutex(job->mutex);
+    if (i >= job->nPages) {
+      break;
+    }
+    job->pageFonts[i] = new GooList();
+    if (job->pages[i]) {
+      job->scanner->scanPage(job->xref, job->pages[i], job->pageFonts[i]);
+    }
+  }
+  return NULL;
+}
+
+#endif
+
+void FontInfoScanner::scanPage(XRef *xrefA, Page *page, GooList *fontsList) {
+  Dict *resDict;
+  Annots *annots;
+  Object obj1, obj2, obj3, obj4;
+  int i;
+
+  if ((resDict = page->getResourceDictCopy(xrefA))) {
+    scanFonts(xrefA, resDict, fontsList);
+    delete resDict;
+  }
+
+  if (fast) {
+    // read the appearance streams from the annotation dictionaries
+    // instead of building Annot objects
+    if (page->getAnnots(&obj1, xrefA)->isArray()) {
+      for (i = 0; i < obj1.arrayGetLength(); ++i) {
+	if (obj1.arrayGet(i, &obj2)->isDict() &&
+	    getAppearanceStream(&obj2, &obj3)->isStream()) {
+	  if (obj3.streamGetDict()->lookup("Resources", &obj4)->isDict()) {
+	    scanFonts(xrefA, obj4.getDict(), fontsList);
+	  }
+	  obj4.free();
+	}
+	obj3.free();
+	obj2.free();
+      }
+    }
+    obj1.free();
+  } else {
+    annots = page->getAnnots();
+    for (i = 0; i < annots->getNumAnnots(); ++i) {
+      if (annots->getAnnot(i)->getAppearanceResDict(&obj1)->isDict()) {
+	scanFonts(xrefA, obj1.getDict(), fontsList);
+      }
+      obj1.free();
+    }
+  }
 }
 
 void FontInfoScanner::scanFonts(XRef *xrefA, Dict *resDict, GooList *fontsList) {
-  Object obj1, obj2, objDict, resObj;
-  Ref r;
-  GfxFontDict *gfxFontDict;
-  GfxFont *font;
+  Object obj1, obj2, objDict, resObj, fontDictObj, fontObj;
+  Ref r, fontDictRef;
+  Dict *fontDict;
+  FontInfo *info;
   int i;
 
-  // scan the fonts in this resource dictionary
-  gfxFontDict = NULL;
+  // scan the fonts in this resource dictionary -- Font dictionaries
+  // and fonts that were seen before are skipped without building
+  // anything
+  fontDict = NULL;
   resDict->lookupNF("Font", &obj1);
   if (obj1.isRef()) {
-    obj1.fetch(xrefA, &obj2);
-    if (obj2.isDict()) {
-      r = obj1.getRef();
-      gfxFontDict = new GfxFontDict(xrefA, &r, obj2.getDict());
+    fontDictRef = obj1.getRef();
+    if (visitedFontDicts.find(fontDictRef.num) == visitedFontDicts.end()) {
+      visitedFontDicts.insert(fontDictRef.num);
+      if (obj1.fetch(xrefA, &fontDictObj)->isDict()) {
+	fontDict = fontDictObj.getDict();
+      }
     }
-    obj2.free();
   } else if (obj1.isDict()) {
-    gfxFontDict = new GfxFontDict(xrefA, NULL, obj1.getDict());
+    fontDict = obj1.getDict();
   }
-  if (gfxFontDict) {
-    for (i = 0; i < gfxFontDict->getNumFonts(); ++i) {
-      if ((font = gfxFontDict->getFont(i))) {
-        Ref fontRef = *font->getID();
+  if (fontDict) {
+    for (i = 0; i < fontDict->getLength(); ++i) {
+      fontDict->getValNF(i, &fontObj);
+      r = getFontRef(&fontObj, i, obj1.isRef() ? &fontDictRef : NULL);
 
-        // add this font to the list if not already found
-        if (fonts.find(fontRef.num) == fonts.end()) {
-          fontsList->append(new FontInfo(font, xrefA));
-          fonts.insert(fontRef.num);
-        }
+      // add this font to the list if not already found
+      if (fonts.find(r.num) == fonts.end()) {
+	if (fontObj.fetch(xrefA, &obj2)->isDict()) {
+	  if ((info = makeFontInfo(xrefA, fontDict->getKey(i), r,
+				   obj2.getDict(), fast))) {
+	    fontsList->append(info);
+	    fonts.insert(r.num);
+	  }
+	} else {
+	  error(errSyntaxError, -1, "font resource is not a dictionary");
+	}
+	obj2.free();
       }
+      fontObj.free();
     }
-    delete gfxFontDict;
   }
+  fontDictObj.free();
   obj1.free();
 
   // recursively scan any resource dictionaries in objects in this
@@ -164,10 +415,351 @@ void FontInfoScanner::scanFonts(XRef *xrefA, Dict *resDict, GooList *fontsList)
   }
 }
 
+//------------------------------------------------------------------------
+// used fonts
+//------------------------------------------------------------------------
+
+#define usedFontsMaxArgs 33
+#define usedFontsMaxDepth 100
+
+// Resources in effect while scanning a content stream.  As with
+// GfxResources, names not found here are looked up in <next>.
+struct UsedFontsRes {
+  Dict *resDict;
+  Dict *fontDict;
+  Ref fontDictRef;		// num is -1 for a direct Font dictionary
+  UsedFontsRes *next;
+};
+
+// The current font: entry <idx> of the Font dictionary <fontDict>.
+struct UsedFontsSel {
+  Dict *fontDict;
+  Ref fontDictRef;
+  int idx;
+  GBool added;			// already in the list
+};
+
+struct UsedFontsScan {
+  XRef *xref;
+  GBool fast;
+  std::set<std::pair<int, int> > found;
+  std::set<int> openForms;	// forms and patterns being scanned
+  GooList *fonts;
+};
+
+static void scanUsedFontsContent(UsedFontsScan *scan, Object *contents,
+				 UsedFontsRes *res, UsedFontsSel *sel,
+				 int depth);
+
+static void initUsedFontsRes(XRef *xrefA, Dict *resDict, UsedFontsRes *next,
+			     UsedFontsRes *res, Object *fontDictObj) {
+  Object obj1;
+
+  res->resDict = resDict;
+  res->fontDict = NULL;
+  res->fontDictRef.num = res->fontDictRef.gen = -1;
+  res->next = next;
+  fontDictObj->initNull();
+  if (resDict) {
+    if (resDict->lookupNF("Font", &obj1)->isRef()) {
+      res->fontDictRef = obj1.getRef();
+    }
+    if (obj1.fetch(xrefA, fontDictObj)->isDict()) {
+      res->fontDict = fontDictObj->getDict();
+    }
+    obj1.free();
+  }
+}
+
+static void initUsedFontsSel(UsedFontsSel *sel) {
+  sel->fontDict = NULL;
+  sel->fontDictRef.num = sel->fontDictRef.gen = -1;
+  sel->idx = -1;
+  sel->added = gFalse;
+}
+
+// Look up <name> in the <type> resource dictionaries; <obj> gets the
+// entry without resolving it.
+static GBool lookupUsedFontsRes(UsedFontsRes *res, const char *type,
+				const char *name, Object *obj) {
+  Object dictObj;
+
+  for (; res; res = res->next) {
+    if (res->resDict && res->resDict->lookup(type, &dictObj)->isDict()) {
+      if (!dictObj.dictLookupNF(name, obj)->isNull()) {
+	dictObj.free();
+	return gTrue;
+      }
+      obj->free();
+    }
+    dictObj.free();
+  }
+  obj->initNull();
+  return gFalse;
+}
+
+// Tf: like Gfx, an unknown font name leaves no font selected.
+static void selectUsedFont(UsedFontsRes *res, const char *name,
+			   UsedFontsSel *sel) {
+  int i;
+
+  initUsedFontsSel(sel);
+  for (; res; res = res->next) {
+    if (res->fontDict) {
+      for (i = 0; i < res->fontDict->getLength(); ++i) {
+	if (!strcmp(res->fontDict->getKey(i), name)) {
+	  sel->fontDict = res->fontDict;
+	  sel->fontDictRef = res->fontDictRef;
+	  sel->idx = i;
+	  return;
+	}
+      }
+    }
+  }
+}
+
+static void addUsedFont(UsedFontsScan *scan, UsedFontsSel *sel) {
+  Object obj1, obj2;
+  FontInfo *info;
+  Ref r;
+
+  if (!sel->fontDict || sel->added) {
+    return;
+  }
+  sel->added = gTrue;
+  sel->fontDict->getValNF(sel->idx, &obj1);
+  r = getFontRef(&obj1, sel->idx,
+		 sel->fontDictRef.num >= 0 ? &sel->fontDictRef : NULL);
+  if (scan->found.insert(std::make_pair(r.num, r.gen)).second) {
+    if (obj1.fetch(scan->xref, &obj2)->isDict() &&
+	(info = makeFontInfo(scan->xref, sel->fontDict->getKey(sel->idx), r,
+			     obj2.getDict(), scan->fast))) {
+      scan->fonts->append(info);
+    }
+    obj2.free();
+  }
+  obj1.free();
+}
+
+// Scan a form XObject or a tiling pattern.  Forms start with the
+// current font, patterns with none.
+static void scanUsedFontsForm(UsedFontsScan *scan, UsedFontsRes *res,
+			      const char *type, const char *name,
+			      UsedFontsSel *sel, int depth) {
+  Object refObj, obj1, obj2, resObj, fontDictObj;
+  UsedFontsRes formRes;
+  UsedFontsSel formSel;
+  GBool ok;
+  int num;
+
+  if (depth >= usedFontsMaxDepth ||
+      !lookupUsedFontsRes(res, type, name, &refObj)) {
+    return;
+  }
+  num = refObj.isRef() ? refObj.getRefNum() : -1;
+  if (num >= 0 && scan->openForms.find(num) != scan->openForms.end()) {
+    refObj.free();
+    return;
+  }
+  if (refObj.fetch(scan->xref, &obj1)->isStream()) {
+    if (!strcmp(type, "XObject")) {
+      ok = obj1.streamGetDict()->lookup("Subtype", &obj2)->isName("Form");
+      formSel = *sel;
+    } else {
+      ok = obj1.streamGetDict()->lookup("PatternType", &obj2)->isInt() &&
+	   obj2.getInt() == 1;
+      initUsedFontsSel(&formSel);
+    }
+    obj2.free();
+    if (ok) {
+      obj1.streamGetDict()->lookup("Resources", &resObj);
+      initUsedFontsRes(scan->xref, resObj.isDict() ? resObj.getDict() : NULL,
+		       res, &formRes, &fontDictObj);
+      if (num >= 0) {
+	scan->openForms.insert(num);
+      }
+      scanUsedFontsContent(scan, &obj1, &formRes, &formSel, depth + 1);
+      if (num >= 0) {
+	scan->openForms.erase(num);
+      }
+      fontDictObj.free();
+      resObj.free();
+    }
+  }
+  obj1.free();
+  refObj.free();
+}
+
+// Skip an inline image: its dictionary, then the data up to an 'EI'
+// between white space.
+static void skipInlineImage(Parser *parser) {
+  Object obj;
+  Stream *str;
+  int c, c1, c2, c3;
+
+  parser->getObj(&obj);
+  while (!obj.isCmd("ID") && !obj.isEOF()) {
+    obj.free();
+    parser->getObj(&obj);
+  }
+  if (obj.isEOF() || !(str = parser->getStream())) {
+    obj.free();
+    return;
+  }
+  obj.free();
+  c1 = c2 = c3 = ' ';
+  do {
+    c = str->getChar();
+    if (c1 == 'I' && c2 == 'E' && Lexer::isSpace(c3) &&
+	(c == EOF || Lexer::isSpace(c))) {
+      break;
+    }
+    c3 = c2;
+    c2 = c1;
+    c1 = c;
+  } while (c != EOF);
+}
+
+static void scanUsedFontsContent(UsedFontsScan *scan, Object *contents,
+				 UsedFontsRes *res, UsedFontsSel *selA,
+				 int depth) {
+  std::vector<UsedFontsSel> saved;
+  UsedFontsSel sel;
+  Parser *parser;
+  Object obj, args[usedFontsMaxArgs];
+  char *cmd;
+  int numArgs, i;
+
+  sel = *selA;
+  parser = new Parser(scan->xref, new Lexer(scan->xref, contents), gFalse);
+  numArgs = 0;
+  parser->getObj(&obj);
+  while (!obj.isEOF()) {
+    if (obj.isCmd()) {
+      cmd = obj.getCmd();
+      if (!strcmp(cmd, "Tf")) {
+	if (numArgs >= 2 && args[numArgs - 2].isName()) {
+	  selectUsedFont(res, args[numArgs - 2].getName(), &sel);
+	}
+      } else if (!strcmp(cmd, "Tj") || !strcmp(cmd, "TJ") ||
+		 !strcmp(cmd, "'") || !strcmp(cmd, "\"")) {
+	if (numArgs >= 1) {
+	  addUsedFont(scan, &sel);
+	}
+      } else if (!strcmp(cmd, "q")) {
+	saved.push_back(sel);
+      } else if (!strcmp(cmd, "Q")) {
+	if (!saved.empty()) {
+	  sel = saved.back();
+	  saved.pop_back();
+	}
+      } else if (!strcmp(cmd, "Do")) {
+	if (numArgs >= 1 && args[numArgs - 1].isName()) {
+	  scanUsedFontsForm(scan, res, "XObject", args[numArgs - 1].getName(),
+			    &sel, depth);
+	}
+      } else if (!strcmp(cmd, "scn") || !strcmp(cmd, "SCN")) {
+	if (numArgs >= 1 && args[numArgs - 1].isName()) {
+	  scanUsedFontsForm(scan, res, "Pattern", args[numArgs - 1].getName(),
+			    &sel, depth);
+	}
+      } else if (!strcmp(cmd, "BI")) {
+	skipInlineImage(parser);
+      }
+      for (i = 0; i < numArgs; ++i) {
+	args[i].free();
+      }
+      numArgs = 0;
+      obj.free();
+    } else if (numArgs < usedFontsMaxArgs) {
+      args[numArgs++] = obj;
+    } else {
+      obj.free();
+    }
+    parser->getObj(&obj);
+  }
+  obj.free();
+  for (i = 0; i < numArgs; ++i) {
+    args[i].free();
+  }
+  delete parser;
+}
+
+GooList *FontInfoScanner::scanUsedFonts(int pg) {
+  UsedFontsScan scan;
+  UsedFontsRes pageRes, apRes;
+  UsedFontsSel sel;
+  Page *page;
+  Object contents, fontDictObj, annotsObj, annotObj, apObj, resObj;
+  Object apFontDictObj, obj1;
+  int i;
+
+  if (pg < 1 || pg > doc->getNumPages() || !(page = doc->getPage(pg))) {
+    return NULL;
+  }
+
+  scan.xref = doc->getXRef();
+  scan.fast = fast;
+  scan.fonts = new GooList();
+  initUsedFontsRes(scan.xref, page->getResourceDict(), NULL,
+		   &pageRes, &fontDictObj);
+
+  page->getContents(&contents);
+  if (contents.isStream() || contents.isArray()) {
+    initUsedFontsSel(&sel);
+    scanUsedFontsContent(&scan, &contents, &pageRes, &sel, 0);
+  }
+  contents.free();
+
+  // annotation appearances are drawn on top of the page resources
+  if (page->getAnnots(&annotsObj)->isArray()) {
+    for (i = 0; i < annotsObj.arrayGetLength(); ++i) {
+      if (annotsObj.arrayGet(i, &annotObj)->isDict() &&
+	  !(annotObj.dictLookup("F", &obj1)->isInt() &&
+	    (obj1.getInt() & Annot::flagHidden)) &&
+	  getAppearanceStream(&annotObj, &apObj)->isStream()) {
+	apObj.streamGetDict()->lookup("Resources", &resObj);
+	initUsedFontsRes(scan.xref, resObj.isDict() ? resObj.getDict() : NULL,
+			 &pageRes, &apRes, &apFontDictObj);
+	initUsedFontsSel(&sel);
+	scanUsedFontsContent(&scan, &apObj, &apRes, &sel, 1);
+	apFontDictObj.free();
+	resObj.free();
+      }
+      apObj.free();
+      obj1.free();
+      annotObj.free();
+    }
+  }
+  annotsObj.free();
+  fontDictObj.free();
+
+  return scan.fonts;
+}
+
+//------------------------------------------------------------------------
+// FontInfo
+//------------------------------------------------------------------------
+
+// Check for a font subset name: capital letters followed by a '+'
+// sign.
+static GBool isSubsetName(GooString *name) {
+  int i;
+
+  if (!name) {
+    return gFalse;
+  }
+  for (i = 0; i < name->getLength(); ++i) {
+    if (name->getChar(i) < 'A' || name->getChar(i) > 'Z') {
+      break;
+    }
+  }
+  return i > 0 && i < name->getLength() && name->getChar(i) == '+';
+}
+
 FontInfo::FontInfo(GfxFont *font, XRef *xref) {
   GooString *origName;
   Object fontObj, toUnicodeObj;
-  int i;
 
   fontRef = *font->getID();
 
@@ -210,17 +802,82 @@ FontInfo::FontInfo(GfxFont *font, XRef *xref) {
   }
   fontObj.free();
 
-  // check for a font subset name: capital letters followed by a '+'
-  // sign
-  subset = gFalse;
-  if (name) {
-    for (i = 0; i < name->getLength(); ++i) {
-      if (name->getChar(i) < 'A' || name->getChar(i) > 'Z') {
-	break;
-      }
+  subset = isSubsetName(name);
+}
+
+FontInfo::FontInfo(Ref fontRefA, Dict *fontDict, XRef *xref) {
+  Object obj1, obj2, obj3;
+  GfxFontType fontType;
+
+  fontRef = fontRefA;
+
+  // font name
+  if (fontDict->lookup("BaseFont", &obj1)->isName()) {
+    name = new GooString(obj1.getName());
+  } else {
+    name = NULL;
+  }
+  obj1.free();
+
+  // font type, as given by the dictionaries
+  fontType = GfxFont::getFontType(xref, fontDict, &embRef, gFalse);
+  type = (FontInfo::Type)fontType;
+  emb = fontType == fontType3 || embRef.num >= 0;
+
+  file = NULL;
+  substituteName = NULL;
+
+  // encoding, following Gfx8BitFont and GfxCIDFont as far as that is
+  // possible without the font file
+  if (fontType >= fontCIDType0) {
+    fontDict->lookup("Encoding", &obj1);
+    if (obj1.isName()) {
+      encoding = new GooString(obj1.getName());
+    } else if (obj1.isStream() &&
+	       obj1.streamGetDict()->lookup("CMapName", &obj2)->isName()) {
+      encoding = new GooString(obj2.getName());
+    } else {
+      encoding = new GooString("Custom");
+    }
+    obj2.free();
+    obj1.free();
+  } else {
+    fontDict->lookup("Encoding", &obj1);
+    if (obj1.isDict()) {
+      obj1.dictLookup("BaseEncoding", &obj2);
+    } else {
+      obj1.copy(&obj2);
     }
-    subset = i > 0 && i < name->getLength() && name->getChar(i) == '+';
+    if (obj1.isDict() && obj1.dictLookup("Differences", &obj3)->isArray()) {
+      encoding = new GooString("Custom");
+    } else if (obj2.isName("WinAnsiEncoding")) {
+      encoding = new GooString("WinAnsi");
+    } else if (obj2.isName("MacRomanEncoding")) {
+      encoding = new GooString("MacRoman");
+    } else if (obj2.isName("MacExpertEncoding")) {
+      encoding = new GooString("MacExpert");
+    } else if (embRef.num >= 0 &&
+	       (fontType == fontType1 || fontType == fontType1C)) {
+      encoding = new GooString("Builtin");
+    } else if (embRef.num < 0 && name && !name->cmp("Symbol")) {
+      encoding = new GooString("Symbol");
+    } else if (embRef.num < 0 && name && !name->cmp("ZapfDingbats")) {
+      encoding = new GooString("ZapfDingbats");
+    } else if (fontType == fontTrueType) {
+      encoding = new GooString("WinAnsi");
+    } else {
+      encoding = new GooString("Standard");
+    }
+    obj3.free();
+    obj2.free();
+    obj1.free();
   }
+
+  // look for a ToUnicode map
+  hasToUnicode = fontDict->lookup("ToUnicode", &obj1)->isStream();
+  obj1.free();
+
+  subset = isSubsetName(name);
 }
 
 FontInfo::FontInfo(FontInfo& f) {
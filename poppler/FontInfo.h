@@ -25,12 +25,14 @@
 #ifndef FONT_INFO_H
 #define FONT_INFO_H
 
+#include <set>
 #include "Object.h"
 #include "goo/gtypes.h"
 #include "goo/GooList.h"
 
 class GfxFont;
 class PDFDoc;
+class Page;
 
 class FontInfo {
 public:
@@ -51,6 +53,9 @@ public:
     
   // Constructor.
   FontInfo(GfxFont *fontA, XRef *xrefA);
+  // Build from the font dictionary alone, without reading the
+  // embedded font file or looking for a substitute.
+  FontInfo(Ref fontRefA, Dict *fontDict, XRef *xrefA);
   // Copy constructor
   FontInfo(FontInfo& f);
   // Destructor.
@@ -83,21 +88,41 @@ private:
 class FontInfoScanner {
 public:
 
-  // Constructor.
-  FontInfoScanner(PDFDoc *doc, int firstPage = 0);
+  // Constructor.  In <fast> mode the fonts are described from their
+  // dictionaries only: no GfxFont is created, embedded font files are
+  // not read, substitutes are not looked up, and annotation appearances
+  // are taken from the file as they are.
+  FontInfoScanner(PDFDoc *doc, int firstPage = 0, GBool fastA = gFalse);
   // Destructor.
   ~FontInfoScanner();
 
+  // Scan the next <nPages> pages and return the fonts not reported
+  // by an earlier call.
   GooList *scan(int nPages);
 
+  // Same as scan(nPages), with the pages spread over up to <nThreads>
+  // threads.  The result is the same as that of scan(nPages).
+  GooList *scan(int nPages, int nThreads);
+
+  // Return the fonts that text is actually shown with on page <pg>
+  // (1-based), in order of first use.  Only font selection, text
+  // showing, q/Q, form XObjects, tiling patterns and the appearance
+  // streams of visible annotations are looked at.  Returns NULL if
+  // the page does not exist.
+  GooList *scanUsedFonts(int pg);
+
 private:
 
   PDFDoc *doc;
   int currentPage;
+  GBool fast;
   std::set<int> fonts;
   std::set<int> visitedObjects;
+  std::set<int> visitedFontDicts;
 
+  void scanPage(XRef *xrefA, Page *page, GooList *fontsList);
   void scanFonts(XRef *xrefA, Dict *resDict, GooList *fontsList);
+  static void *scanThread(void *arg);
 };
 
 #endif
@@ -311,6 +311,32 @@ Operator Gfx::opTab[] = {
 
 #define numOps (sizeof(opTab) / sizeof(Operator))
 
+// Operator names are at most three chars long.  Packed into an int
+// (first char in the low byte), they are spread over 256 slots with no
+// collisions by opHash(); opHashTab[h] is the index in opTab of the
+// operator whose name hashes to h, or -1.  The table has to be rebuilt
+// whenever an operator is added to opTab.
+#define opHash(key) ((Guint)((key) * 0x7094dda5U) >> 24)
+
+static const signed char opHashTab[256] = {
+  -1, -1, -1, -1, -1, -1,  2, 64, -1, -1, -1, -1, 69, -1, 58, -1,   // 0x
+  -1, -1, -1, -1, -1, -1, -1, 33, 43, -1, -1, -1, -1, -1, -1, -1,   // 1x
+  13, -1, 31, 39, 67, -1,  1, -1, -1, -1, -1, 54, -1, 56, -1, -1,   // 2x
+  14, 65,  8, -1, -1, -1, 72, -1, -1, 17, -1, 37, -1, -1, -1, -1,   // 3x
+  -1, 34, 41, -1, -1, -1, -1, 52, -1, -1, -1, 53, -1, -1, -1, -1,   // 4x
+  -1, -1, -1, 36, -1, 71, -1, -1, -1, 24, -1, -1, -1, 28, -1, 61,   // 5x
+  -1, 68, 22, -1, -1, -1, -1, -1, -1, 47, -1, -1, 10, -1, -1, -1,   // 6x
+  -1, -1,  3, 11, -1, -1, 26, -1, 50,  5, -1, 29, -1, -1, 59, -1,   // 7x
+  25, -1, 32, -1, 15, 44, -1, -1, -1, 45, -1, 19, -1, -1, -1, -1,   // 8x
+  -1, -1, 66,  4, 35, -1, -1, -1, -1, -1, -1, -1, -1, 57, -1, 23,   // 9x
+  -1, -1, -1, -1, -1, 18, -1, -1, -1, -1, -1, -1, -1, -1, 42, -1,   // ax
+  -1, 62, -1, -1, -1, -1, -1, -1, -1, -1,  9, -1, 55, -1, -1, -1,   // bx
+  -1, -1, -1, -1, -1, -1, -1, -1, 16, -1, -1, 12, -1, -1, -1,  6,   // cx
+  38, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 51, 21, 63, -1,  7,   // dx
+  -1, -1, 40, 49, 70, -1, -1, -1, -1, -1, -1, 46, -1, -1, -1, 60,   // ex
+  -1, -1, -1,  0, -1, -1, -1, -1, 30, -1, 48, 20, -1, -1, 27, -1    // fx
+};
+
 static inline GBool isSameGfxColor(const GfxColor &colorA, const GfxColor &colorB, Guint nComps, double delta) {
   for (Guint k = 0; k < nComps; ++k) {
     if (abs(colorA.c[k] - colorB.c[k]) > delta) {
@@ -530,6 +556,514 @@ GBool GfxResources::lookupGStateNF(char *name, Object *obj) {
   return gFalse;
 }
 
+//------------------------------------------------------------------------
+// GfxOpList
+//------------------------------------------------------------------------
+
+// Each operator is encoded as a header byte (the number of operands,
+// plus gfxOpListImage if inline image data follows the operands, and
+// gfxOpListArgsChecked if the operands were found to fit the operator
+// when it was recorded), the operator's index in Gfx::opTab (or
+// gfxOpListUnknownOp followed by the nul-terminated name of an
+// unknown operator), and the operands.  Each operand is a tag byte
+// followed by its value.
+#define gfxOpListNumArgs      0x3f
+#define gfxOpListArgsChecked  0x40
+#define gfxOpListImage        0x80
+#define gfxOpListUnknownOp    0xff
+
+enum GfxOpListTag {
+  gfxOpListInt8,		// 1-byte int
+  gfxOpListInt16,		// 2-byte int
+  gfxOpListInt,			// 4-byte int
+  gfxOpListInt64,		// 8-byte int
+  gfxOpListDecimal16,		// real: number of decimals, 2-byte mantissa
+  gfxOpListDecimal,		// real: number of decimals, 4-byte mantissa
+  gfxOpListFloat,		// real that is exactly a float
+  gfxOpListReal,		// double
+  gfxOpListFalse,
+  gfxOpListTrue,
+  gfxOpListNull,
+  gfxOpListName,		// nul-terminated name
+  gfxOpListString,		// int length, then the bytes
+  gfxOpListArray,		// int length, then the elements
+  gfxOpListDict,		// int length, then the entries (each a
+				//   nul-terminated key and a value)
+  gfxOpListRef,			// two ints
+  gfxOpListError
+};
+
+static const int gfxOpListPow10[] = {
+  1, 10, 100, 1000, 10000, 100000
+};
+#define gfxOpListMaxDecimals 5
+
+// Build the real with mantissa <m> and <d> decimals, the same way
+// the lexer builds it from its digits.
+static double gfxOpListDecimalValue(int m, int d) {
+  unsigned int a, frac;
+  double xf, scale;
+  int i;
+
+  a = m < 0 ? -(unsigned int)m : (unsigned int)m;
+  frac = a % gfxOpListPow10[d];
+  xf = (int)(a / gfxOpListPow10[d]);
+  scale = 0.1;
+  for (i = d - 1; i >= 0; --i) {
+    xf = xf + scale * (int)((frac / gfxOpListPow10[i]) % 10);
+    scale *= 0.1;
+  }
+  return m < 0 ? -xf : xf;
+}
+
+GfxOpList::GfxOpList() {
+  data = NULL;
+  dataLen = dataSize = 0;
+  lastOp = -1;
+  nOps = 0;
+  complete = gFalse;
+  ok = gTrue;
+  refCnt = 0;
+}
+
+GfxOpList::~GfxOpList() {
+  gfree(data);
+}
+
+void GfxOpList::append(int op, char *name, Object args[], int numArgs,
+		       GBool argsChecked) {
+  Guchar hdr;
+  int i;
+
+  lastOp = dataLen;
+  hdr = (Guchar)numArgs;
+  if (argsChecked) {
+    hdr |= gfxOpListArgsChecked;
+  }
+  appendBytes(&hdr, 1);
+  if (op >= 0) {
+    hdr = (Guchar)op;
+    appendBytes(&hdr, 1);
+  } else {
+    hdr = gfxOpListUnknownOp;
+    appendBytes(&hdr, 1);
+    appendBytes(name, strlen(name) + 1);
+  }
+  for (i = 0; i < numArgs; ++i) {
+    appendObj(&args[i]);
+  }
+  ++nOps;
+}
+
+// Attach inline image data (the image dictionary, and the raw data
+// between the ID and EI tags) to the last operator.
+void GfxOpList::appendImage(Dict *dict, char *buf, int len) {
+  Object obj;
+
+  if (lastOp < 0) {
+    return;
+  }
+  data[lastOp] |= gfxOpListImage;
+  obj.initDict(dict);
+  appendObj(&obj);
+  obj.free();
+  appendInt(len);
+  appendBytes(buf, len);
+}
+
+void GfxOpList::appendObj(Object *obj) {
+  Guchar tag;
+  int x, d, i;
+  short x16;
+  long long x64;
+  float f;
+  double r;
+  char *key;
+  Object obj2;
+
+  switch (obj->getType()) {
+  case objInt:
+    x = obj->getInt();
+    if (x >= -128 && x < 128) {
+      tag = gfxOpListInt8;
+      appendBytes(&tag, 1);
+      tag = (Guchar)(x & 0xff);
+      appendBytes(&tag, 1);
+    } else if (x >= -32768 && x < 32768) {
+      tag = gfxOpListInt16;
+      appendBytes(&tag, 1);
+      x16 = (short)x;
+      appendBytes(&x16, sizeof(x16));
+    } else {
+      tag = gfxOpListInt;
+      appendBytes(&tag, 1);
+      appendInt(x);
+    }
+    break;
+  case objInt64:
+    tag = gfxOpListInt64;
+    appendBytes(&tag, 1);
+    x64 = obj->getInt64();
+    appendBytes(&x64, sizeof(x64));
+    break;
+  case objReal:
+    // most reals in content streams have a few decimals; look for the
+    // shortest mantissa that gives back exactly the same value
+    r = obj->getReal();
+    if (r != 0 && fabs(r) < 20000) {
+      for (d = 1; d <= gfxOpListMaxDecimals; ++d) {
+	x = (int)floor(fabs(r) * gfxOpListPow10[d] + 0.5);
+	if (r < 0) {
+	  x = -x;
+	}
+	if (gfxOpListDecimalValue(x, d) == r) {
+	  break;
+	}
+      }
+      if (d <= gfxOpListMaxDecimals) {
+	tag = x >= -32768 && x < 32768 ? gfxOpListDecimal16 : gfxOpListDecimal;
+	appendBytes(&tag, 1);
+	tag = (Guchar)d;
+	appendBytes(&tag, 1);
+	if (x >= -32768 && x < 32768) {
+	  x16 = (short)x;
+	  appendBytes(&x16, sizeof(x16));
+	} else {
+	  appendInt(x);
+	}
+	break;
+      }
+    }
+    f = (float)r;
+    if ((double)f == r) {
+      tag = gfxOpListFloat;
+      appendBytes(&tag, 1);
+      appendBytes(&f, sizeof(f));
+    } else {
+      tag = gfxOpListReal;
+      appendBytes(&tag, 1);
+      appendBytes(&r, sizeof(r));
+    }
+    break;
+  case objBool:
+    tag = obj->getBool() ? gfxOpListTrue : gfxOpListFalse;
+    appendBytes(&tag, 1);
+    break;
+  case objNull:
+    tag = gfxOpListNull;
+    appendBytes(&tag, 1);
+    break;
+  case objName:
+    tag = gfxOpListName;
+    appendBytes(&tag, 1);
+    appendBytes(obj->getName(), strlen(obj->getName()) + 1);
+    break;
+  case objString:
+    tag = gfxOpListString;
+    appendBytes(&tag, 1);
+    appendInt(obj->getString()->getLength());
+    appendBytes(obj->getString()->getCString(),
+		obj->getString()->getLength());
+    break;
+  case objArray:
+    tag = gfxOpListArray;
+    appendBytes(&tag, 1);
+    appendInt(obj->arrayGetLength());
+    for (i = 0; i < obj->arrayGetLength(); ++i) {
+      appendObj(obj->arrayGetNF(i, &obj2));
+      obj2.free();
+    }
+    break;
+  case objDict:
+    tag = gfxOpListDict;
+    appendBytes(&tag, 1);
+    appendInt(obj->dictGetLength());
+    for (i = 0; i < obj->dictGetLength(); ++i) {
+      key = obj->dictGetKey(i);
+      appendBytes(key, strlen(key) + 1);
+      appendObj(obj->dictGetValNF(i, &obj2));
+      obj2.free();
+    }
+    break;
+  case objRef:
+    tag = gfxOpListRef;
+    appendBytes(&tag, 1);
+    appendInt(obj->getRefNum());
+    appendInt(obj->getRefGen());
+    break;
+  case objError:
+    tag = gfxOpListError;
+    appendBytes(&tag, 1);
+    break;
+  default:
+    // streams, commands, etc. can't be operands
+    ok = gFalse;
+    break;
+  }
+}
+
+// Mark the list as complete, and give back the unused space.
+void GfxOpList::finish() {
+  complete = gTrue;
+  if (dataSize > dataLen) {
+    data = (Guchar *)greallocn(data, dataLen > 0 ? dataLen : 1, 1);
+    dataSize = dataLen;
+  }
+}
+
+void GfxOpList::appendBytes(const void *p, int n) {
+  if (dataLen + n > dataSize) {
+    dataSize = dataSize ? 2 * dataSize : 256;
+    if (dataSize < dataLen + n) {
+      dataSize = dataLen + n;
+    }
+    data = (Guchar *)grealloc(data, dataSize);
+  }
+  memcpy(data + dataLen, p, n);
+  dataLen += n;
+}
+
+void GfxOpList::appendInt(int x) {
+  appendBytes(&x, sizeof(x));
+}
+
+// Decode the operand at <p> into <obj>, and return the position
+// following it.
+Guchar *GfxOpList::getObj(Guchar *p, XRef *xref, Object *obj) {
+  int x, gen, d, n, i;
+  short x16;
+  long long x64;
+  float f;
+  double r;
+  char *key;
+  Object obj2;
+
+  switch (*p++) {
+  case gfxOpListInt8:
+    obj->initInt((int)(signed char)*p++);
+    break;
+  case gfxOpListInt16:
+    memcpy(&x16, p, sizeof(x16));
+    p += sizeof(x16);
+    obj->initInt(x16);
+    break;
+  case gfxOpListInt:
+    p = getInt(p, &x);
+    obj->initInt(x);
+    break;
+  case gfxOpListInt64:
+    memcpy(&x64, p, sizeof(x64));
+    p += sizeof(x64);
+    obj->initInt64(x64);
+    break;
+  case gfxOpListDecimal16:
+    d = *p++;
+    memcpy(&x16, p, sizeof(x16));
+    p += sizeof(x16);
+    obj->initReal(gfxOpListDecimalValue(x16, d));
+    break;
+  case gfxOpListDecimal:
+    d = *p++;
+    p = getInt(p, &x);
+    obj->initReal(gfxOpListDecimalValue(x, d));
+    break;
+  case gfxOpListFloat:
+    memcpy(&f, p, sizeof(f));
+    p += sizeof(f);
+    obj->initReal(f);
+    break;
+  case gfxOpListReal:
+    memcpy(&r, p, sizeof(r));
+    p += sizeof(r);
+    obj->initReal(r);
+    break;
+  case gfxOpListFalse:
+    obj->initBool(gFalse);
+    break;
+  case gfxOpListTrue:
+    obj->initBool(gTrue);
+    break;
+  case gfxOpListNull:
+    obj->initNull();
+    break;
+  case gfxOpListName:
+    obj->initName((char *)p);
+    p += strlen((char *)p) + 1;
+    break;
+  case gfxOpListString:
+    p = getInt(p, &n);
+    obj->initString(new GooString((char *)p, n));
+    p += n;
+    break;
+  case gfxOpListArray:
+    p = getInt(p, &n);
+    obj->initArray(xref);
+    for (i = 0; i < n; ++i) {
+      p = getObj(p, xref, &obj2);
+      obj->arrayAdd(&obj2);
+    }
+    break;
+  case gfxOpListDict:
+    p = getInt(p, &n);
+    obj->initDict(xref);
+    for (i = 0; i < n; ++i) {
+      key = copyString((char *)p);
+      p += strlen((char *)p) + 1;
+      p = getObj(p, xref, &obj2);
+      obj->dictAdd(key, &obj2);
+    }
+    break;
+  case gfxOpListRef:
+    p = getInt(p, &x);
+    p = getInt(p, &gen);
+    obj->initRef(x, gen);
+    break;
+  case gfxOpListError:
+  default:
+    obj->initError();
+    break;
+  }
+  return p;
+}
+
+Guchar *GfxOpList::getInt(Guchar *p, int *x) {
+  memcpy(x, p, sizeof(int));
+  return p + sizeof(int);
+}
+
+//------------------------------------------------------------------------
+// GfxOpListCache
+//------------------------------------------------------------------------
+
+struct GfxOpListCacheEntry {
+  int pg;
+  GfxOpList *ops;
+  GfxOpListCacheEntry *prev, *next;
+};
+
+#if MULTITHREADED
+#  define opListCacheLocker()   MutexLocker locker(&mutex)
+#else
+#  define opListCacheLocker()
+#endif
+
+GfxOpListCache::GfxOpListCache(int maxSizeA) {
+  first = last = NULL;
+  size = 0;
+  maxSize = maxSizeA;
+#if MULTITHREADED
+  gInitMutex(&mutex);
+#endif
+}
+
+GfxOpListCache::~GfxOpListCache() {
+  shrink(0);
+#if MULTITHREADED
+  gDestroyMutex(&mutex);
+#endif
+}
+
+void GfxOpListCache::setMaxSize(int maxSizeA) {
+  opListCacheLocker();
+  maxSize = maxSizeA;
+  shrink(maxSize);
+}
+
+int GfxOpListCache::getMaxSize() {
+  opListCacheLocker();
+  return maxSize;
+}
+
+GfxOpList *GfxOpListCache::lookup(int pg) {
+  GfxOpListCacheEntry *entry;
+
+  opListCacheLocker();
+  for (entry = first; entry; entry = entry->next) {
+    if (entry->pg == pg) {
+      // move it to the front of the list
+      if (entry != first) {
+	entry->prev->next = entry->next;
+	if (entry->next) {
+	  entry->next->prev = entry->prev;
+	} else {
+	  last = entry->prev;
+	}
+	entry->prev = NULL;
+	entry->next = first;
+	first->prev = entry;
+	first = entry;
+      }
+      ++entry->ops->refCnt;
+      return entry->ops;
+    }
+  }
+  return NULL;
+}
+
+void GfxOpListCache::release(GfxOpList *ops) {
+  opListCacheLocker();
+  unref(ops);
+}
+
+void GfxOpListCache::add(int pg, GfxOpList *ops) {
+  GfxOpListCacheEntry *entry;
+  int opsSize;
+
+  opListCacheLocker();
+  opsSize = ops->getSize();
+  for (entry = first; entry; entry = entry->next) {
+    if (entry->pg == pg) {
+      // another thread got there first
+      delete ops;
+      return;
+    }
+  }
+  if (opsSize > maxSize) {
+    delete ops;
+    return;
+  }
+  shrink(maxSize - opsSize);
+  entry = new GfxOpListCacheEntry;
+  entry->pg = pg;
+  entry->ops = ops;
+  ops->refCnt = 1;
+  entry->prev = NULL;
+  entry->next = first;
+  if (first) {
+    first->prev = entry;
+  } else {
+    last = entry;
+  }
+  first = entry;
+  size += opsSize;
+}
+
+// Drop the least recently used pages until the cache uses no more
+// than <maxSizeA> bytes.  Lists still in use by a caller of lookup()
+// are deleted when they are released.
+void GfxOpListCache::shrink(int maxSizeA) {
+  GfxOpListCacheEntry *entry;
+
+  while (last && size > maxSizeA) {
+    entry = last;
+    last = entry->prev;
+    if (last) {
+      last->next = NULL;
+    } else {
+      first = NULL;
+    }
+    size -= entry->ops->getSize();
+    unref(entry->ops);
+    delete entry;
+  }
+}
+
+void GfxOpListCache::unref(GfxOpList *ops) {
+  if (--ops->refCnt == 0) {
+    delete ops;
+  }
+}
+
 //------------------------------------------------------------------------
 // Gfx
 //------------------------------------------------------------------------
@@ -550,6 +1084,8 @@ Gfx::Gfx(PDFDoc *docA, OutputDev *outA, int pageNum, Dict *resDict,
   profileCommands = globalParams->getProfileCommands();
   mcStack = NULL;
   parser = NULL;
+  recordOps = NULL;
+  inlineImage = NULL;
 
   // start the resource stack
   res = new GfxResources(xref, resDict, NULL);
@@ -605,6 +1141,8 @@ Gfx::Gfx(PDFDoc *docA, OutputDev *outA, Dict *resDict,
   profileCommands = globalParams->getProfileCommands();
   mcStack = NULL;
   parser = NULL;
+  recordOps = NULL;
+  inlineImage = NULL;
 
   // start the resource stack
   res = new GfxResources(xref, resDict, NULL);
@@ -707,7 +1245,8 @@ Gfx::~Gfx() {
   }
 }
 
-void Gfx::display(Object *obj, GBool topLevel) {
+// Check that <obj> is a stream or an array of streams.
+static GBool checkContents(Object *obj) {
   Object obj2;
   int i;
 
@@ -717,25 +1256,118 @@ void Gfx::display(Object *obj, GBool topLevel) {
       if (!obj2.isStream()) {
 	error(errSyntaxError, -1, "Weird page contents");
 	obj2.free();
-	return;
+	return gFalse;
       }
       obj2.free();
     }
   } else if (!obj->isStream()) {
     error(errSyntaxError, -1, "Weird page contents");
+    return gFalse;
+  }
+  return gTrue;
+}
+
+void Gfx::display(Object *obj, GBool topLevel) {
+  GfxOpList *oldRecordOps;
+
+  if (!checkContents(obj)) {
     return;
   }
+  oldRecordOps = recordOps;
+  recordOps = NULL;
+  parser = new Parser(xref, new Lexer(xref, obj), gFalse);
+  go(topLevel);
+  delete parser;
+  parser = NULL;
+  recordOps = oldRecordOps;
+}
+
+GBool Gfx::record(Object *obj, GfxOpList *ops, GBool topLevel) {
+  GfxOpList *oldRecordOps;
+
+  if (!checkContents(obj)) {
+    return gFalse;
+  }
+  oldRecordOps = recordOps;
+  recordOps = ops;
   parser = new Parser(xref, new Lexer(xref, obj), gFalse);
   go(topLevel);
   delete parser;
   parser = NULL;
+  recordOps = oldRecordOps;
+  return ops->complete && ops->ok;
+}
+
+void Gfx::run(GfxOpList *ops, GBool topLevel) {
+  GfxOpList *oldRecordOps;
+  Parser *oldParser;
+  Object args[maxArgs];
+  Object dictObj;
+  Guchar *p, *end;
+  Guchar hdr;
+  char *name;
+  int op, numArgs, len, lastAbortCheck, i;
+  GBool cont;
+
+  oldRecordOps = recordOps;
+  recordOps = NULL;
+  oldParser = parser;
+  parser = NULL;
+  pushStateGuard();
+  updateLevel = 1;
+  lastAbortCheck = 0;
+  p = ops->data;
+  end = ops->data + ops->dataLen;
+  while (p < end) {
+    hdr = *p++;
+    numArgs = hdr & gfxOpListNumArgs;
+    op = *p++;
+    if (op == gfxOpListUnknownOp) {
+      op = -1;
+      name = (char *)p;
+      p += strlen(name) + 1;
+    } else {
+      name = opTab[op].name;
+    }
+    for (i = 0; i < numArgs; ++i) {
+      p = GfxOpList::getObj(p, xref, &args[i]);
+    }
+    if (hdr & gfxOpListImage) {
+      p = GfxOpList::getObj(p, xref, &dictObj);
+      p = GfxOpList::getInt(p, &len);
+      inlineImage = new MemStream((char *)p, 0, len, &dictObj);
+      inlineImage = inlineImage->addFilters(&dictObj);
+      p += len;
+    }
+    cont = runOp(op, name, args, numArgs, hdr & gfxOpListArgsChecked,
+		 &lastAbortCheck);
+    if (inlineImage) {
+      delete inlineImage;
+      inlineImage = NULL;
+    }
+    for (i = 0; i < numArgs; ++i) {
+      args[i].free();
+    }
+    if (!cont) {
+      break;
+    }
+  }
+  popStateGuard();
+  parser = oldParser;
+  recordOps = oldRecordOps;
+
+  // update display
+  if (topLevel && updateLevel > 0) {
+    out->dump();
+  }
 }
 
 void Gfx::go(GBool topLevel) {
   Object obj;
   Object args[maxArgs];
-  int numArgs, i;
+  int op, numArgs, i;
   int lastAbortCheck;
+  GBool cont;
 
   // scan a sequence of objects
   pushStateGuard();
@@ -744,72 +1376,23 @@ void Gfx::go(GBool topLevel) {
   numArgs = 0;
   parser->getObj(&obj);
   while (!obj.isEOF()) {
-    commandAborted = gFalse;
 
     // got a command - execute it
     if (obj.isCmd()) {
-      if (printCommands) {
-	obj.print(stdout);
-	for (i = 0; i < numArgs; ++i) {
-	  printf(" ");
-	  args[i].print(stdout);
-	}
-	printf("\n");
-	fflush(stdout);
-      }
-      GooTimer timer;
-
-      // Run the operation
-      execOp(&obj, args, numArgs);
-
-      // Update the profile information
-      if (profileCommands) {
-	GooHash *hash;
-
-	hash = out->getProfileHash ();
-	if (hash) {
-	  GooString *cmd_g;
-	  ProfileData *data_p;
-
-	  cmd_g = new GooString (obj.getCmd());
-	  data_p = (ProfileData *)hash->lookup (cmd_g);
-	  if (data_p == NULL) {
-	    data_p = new ProfileData();
-	    hash->add (cmd_g, data_p);
-	  }
-	  
-	  data_p->addElement(timer.getElapsed ());
-	}
+      op = findOp(obj.getCmd());
+      if (recordOps) {
+	recordOps->append(op, obj.getCmd(), args, numArgs,
+			  op >= 0 && checkArgs(&opTab[op], args, numArgs));
       }
+      cont = runOp(op, obj.getCmd(), args, numArgs, gFalse, &lastAbortCheck);
       obj.free();
       for (i = 0; i < numArgs; ++i)
 	args[i].free();
       numArgs = 0;
-
-      // periodically update display
-      if (++updateLevel >= 20000) {
-	out->dump();
-	updateLevel = 0;
-      }
-
-      // did the command throw an exception
-      if (commandAborted) {
-	// don't propogate; recursive drawing comes from Form XObjects which
-	// should probably be drawn in a separate context anyway for caching
-	commandAborted = gFalse;
+      if (!cont) {
 	break;
       }
 
-      // check for an abort
-      if (abortCheckCbk) {
-	if (updateLevel - lastAbortCheck > 10) {
-	  if ((*abortCheckCbk)(abortCheckCbkData)) {
-	    break;
-	  }
-	  lastAbortCheck = updateLevel;
-	}
-      }
-
     // got an argument - save it
     } else if (numArgs < maxArgs) {
       args[numArgs++] = obj;
@@ -829,6 +1412,9 @@ void Gfx::go(GBool topLevel) {
     // grab the next object
     parser->getObj(&obj);
   }
+  if (recordOps && obj.isEOF()) {
+    recordOps->finish();
+  }
   obj.free();
 
   // args at end with no command
@@ -855,75 +1441,173 @@ void Gfx::go(GBool topLevel) {
   }
 }
 
-void Gfx::execOp(Object *cmd, Object args[], int numArgs) {
-  Operator *op;
-  char *name;
+// Execute one command: opTab[<op>], or the unknown operator <name>
+// if <op> is -1.  If <argsChecked> is set, the operands are known to
+// fit the operator.  Returns false if drawing should stop (the command
+// aborted, or the abort check callback asked to stop).
+GBool Gfx::runOp(int op, char *name, Object args[], int numArgs,
+		 GBool argsChecked, int *lastAbortCheck) {
+  int i;
+
+  commandAborted = gFalse;
+  if (printCommands) {
+    printf("%s", name);
+    for (i = 0; i < numArgs; ++i) {
+      printf(" ");
+      args[i].print(stdout);
+    }
+    printf("\n");
+    fflush(stdout);
+  }
+  GooTimer timer;
+
+  // Run the operation
+  execOp(op, name, args, numArgs, argsChecked);
+
+  // Update the profile information
+  if (profileCommands) {
+    GooHash *hash;
+
+    hash = out->getProfileHash ();
+    if (hash) {
+      GooString *cmd_g;
+      ProfileData *data_p;
+
+      cmd_g = new GooString (name);
+      data_p = (ProfileData *)hash->lookup (cmd_g);
+      if (data_p == NULL) {
+	data_p = new ProfileData();
+	hash->add (cmd_g, data_p);
+      }
+
+      data_p->addElement(timer.getElapsed ());
+    }
+  }
+
+  // periodically update display
+  if (++updateLevel >= 20000) {
+    out->dump();
+    updateLevel = 0;
+  }
+
+  // did the command throw an exception
+  if (commandAborted) {
+    // don't propogate; recursive drawing comes from Form XObjects which
+    // should probably be drawn in a separate context anyway for caching
+    commandAborted = gFalse;
+    return gFalse;
+  }
+
+  // check for an abort
+  if (abortCheckCbk) {
+    if (updateLevel - *lastAbortCheck > 10) {
+      if ((*abortCheckCbk)(abortCheckCbkData)) {
+	return gFalse;
+      }
+      *lastAbortCheck = updateLevel;
+    }
+  }
+  return gTrue;
+}
+
+void Gfx::execOp(int op, char *name, Object args[], int numArgs,
+		 GBool argsChecked) {
+  Operator *opPtr;
   Object *argPtr;
   int i;
 
   // find operator
-  name = cmd->getCmd();
-  if (!(op = findOp(name))) {
+  if (op < 0) {
     if (ignoreUndef == 0)
       error(errSyntaxError, getPos(), "Unknown operator '{0:s}'", name);
     return;
   }
+  opPtr = &opTab[op];
 
   // type check args
   argPtr = args;
-  if (op->numArgs >= 0) {
-    if (numArgs < op->numArgs) {
-      error(errSyntaxError, getPos(), "Too few ({0:d}) args to '{1:s}' operator", numArgs, name);
-      commandAborted = gTrue;
-      return;
-    }
-    if (numArgs > op->numArgs) {
+  if (opPtr->numArgs >= 0) {
+    if (numArgs > opPtr->numArgs) {
 #if 0
       error(errSyntaxWarning, getPos(),
 	    "Too many ({0:d}) args to '{1:s}' operator", numArgs, name);
 #endif
-      argPtr += numArgs - op->numArgs;
-      numArgs = op->numArgs;
-    }
-  } else {
-    if (numArgs > -op->numArgs) {
-      error(errSyntaxError, getPos(), "Too many ({0:d}) args to '{1:s}' operator",
-	    numArgs, name);
-      return;
+      argPtr += numArgs - opPtr->numArgs;
+      numArgs = opPtr->numArgs;
     }
   }
-  for (i = 0; i < numArgs; ++i) {
-    if (!checkArg(&argPtr[i], op->tchk[i])) {
-      error(errSyntaxError, getPos(), "Arg #{0:d} to '{1:s}' operator is wrong type ({2:s})",
-	    i, name, argPtr[i].getTypeName());
-      return;
+  if (!argsChecked) {
+    if (opPtr->numArgs >= 0) {
+      if (numArgs < opPtr->numArgs) {
+	error(errSyntaxError, getPos(), "Too few ({0:d}) args to '{1:s}' operator", numArgs, name);
+	commandAborted = gTrue;
+	return;
+      }
+    } else {
+      if (numArgs > -opPtr->numArgs) {
+	error(errSyntaxError, getPos(), "Too many ({0:d}) args to '{1:s}' operator",
+	      numArgs, name);
+	return;
+      }
+    }
+    for (i = 0; i < numArgs; ++i) {
+      if (!checkArg(&argPtr[i], opPtr->tchk[i])) {
+	error(errSyntaxError, getPos(), "Arg #{0:d} to '{1:s}' operator is wrong type ({2:s})",
+	      i, name, argPtr[i].getTypeName());
+	return;
+      }
     }
   }
 
   // do it
-  (this->*op->func)(argPtr, numArgs);
-}
-
-Operator *Gfx::findOp(char *name) {
-  int a, b, m, cmp;
-
-  a = -1;
-  b = numOps;
-  cmp = 0; // make gcc happy
-  // invariant: opTab[a] < name < opTab[b]
-  while (b - a > 1) {
-    m = (a + b) / 2;
-    cmp = strcmp(opTab[m].name, name);
-    if (cmp < 0)
-      a = m;
-    else if (cmp > 0)
-      b = m;
-    else
-      a = b = m;
+  (this->*opPtr->func)(argPtr, numArgs);
+}
+
+// Return the index in opTab of the operator <name>, or -1.
+int Gfx::findOp(char *name) {
+  Guint key;
+  int op;
+
+  if (!name[0]) {
+    return -1;
   }
-  if (cmp != 0)
-    return NULL;
-  return &opTab[a];
+  key = (Guchar)name[0];
+  if (name[1]) {
+    key |= (Guchar)name[1] << 8;
+    if (name[2]) {
+      if (name[3]) {
+	return -1;
+      }
+      key |= (Guchar)name[2] << 16;
+    }
+  }
+  op = opHashTab[opHash(key)];
+  if (op < 0 || strcmp(opTab[op].name, name)) {
+    return -1;
+  }
+  return op;
+}
+
+// Check (without reporting anything) that the operands <args> fit the
+// operator <op>, the way execOp() does.
+GBool Gfx::checkArgs(Operator *op, Object args[], int numArgs) {
+  int i;
+
+  if (op->numArgs >= 0) {
+    if (numArgs < op->numArgs) {
+      return gFalse;
+    }
+    args += numArgs - op->numArgs;
+    numArgs = op->numArgs;
+  } else if (numArgs > -op->numArgs) {
+    return gFalse;
+  }
+  for (i = 0; i < numArgs; ++i) {
+    if (!checkArg(&args[i], op->tchk[i])) {
+      return gFalse;
+    }
+  }
+  return gTrue;
 }
 
 GBool Gfx::checkArg(Object *arg, TchkType type) {
@@ -3921,10 +4605,12 @@ void Gfx::doShowText(GooString *s) {
   Unicode *u = NULL;
   double x, y, dx, dy, dx2, dy2, curX, curY, tdx, tdy, ddx, ddy;
   double originX, originY, tOriginX, tOriginY;
+  double fontSize, charSpace, wordSpace, horizScaling;
   double x0, y0, x1, y1;
   double oldCTM[6], newCTM[6];
   double *mat;
   Object charProc;
+  GfxOpList *charProcOps;
   Dict *resDict;
   Parser *oldParser;
   GfxState *savedState;
@@ -4008,20 +4694,31 @@ void Gfx::doShowText(GooString *s) {
       state->transformDelta(dx, dy, &ddx, &ddy);
       if (!out->beginType3Char(state, curX + riseX, curY + riseY, ddx, ddy,
 			       code, u, uLen)) {
-	((Gfx8BitFont *)font)->getCharProc(code, &charProc);
 	if ((resDict = ((Gfx8BitFont *)font)->getResources())) {
 	  pushResources(resDict);
 	}
-	if (charProc.isStream()) {
-	  display(&charProc, gFalse);
+	// the glyph procedure is parsed once; later uses of the same
+	// char replay the recorded operators
+	if ((charProcOps = ((Gfx8BitFont *)font)->getCharProcOps(code))) {
+	  run(charProcOps);
 	} else {
-	  error(errSyntaxError, getPos(), "Missing or bad Type3 CharProc entry");
+	  ((Gfx8BitFont *)font)->getCharProc(code, &charProc);
+	  if (charProc.isStream()) {
+	    charProcOps = new GfxOpList();
+	    if (record(&charProc, charProcOps)) {
+	      ((Gfx8BitFont *)font)->setCharProcOps(code, charProcOps);
+	    } else {
+	      delete charProcOps;
+	    }
+	  } else {
+	    error(errSyntaxError, getPos(), "Missing or bad Type3 CharProc entry");
+	  }
+	  charProc.free();
 	}
 	out->endType3Char(state);
 	if (resDict) {
 	  popResources();
 	}
-	charProc.free();
       }
       restoreStateStack(savedState);
       // GfxState::restore() does *not* restore the current position,
@@ -4035,6 +4732,13 @@ void Gfx::doShowText(GooString *s) {
     parser = oldParser;
 
   } else if (out->useDrawChar()) {
+    // the text state doesn't change within the string, so fetch it
+    // once instead of for every char
+    fontSize = state->getFontSize();
+    charSpace = state->getCharSpace();
+    wordSpace = state->getWordSpace();
+    horizScaling = state->getHorizScaling();
+    mat = state->getTextMat();
     p = s->getCString();
     len = s->getLength();
     while (len > 0) {
@@ -4042,23 +4746,25 @@ void Gfx::doShowText(GooString *s) {
 			    &u, &uLen,
 			    &dx, &dy, &originX, &originY);
       if (wMode) {
-	dx *= state->getFontSize();
-	dy = dy * state->getFontSize() + state->getCharSpace();
+	dx *= fontSize;
+	dy = dy * fontSize + charSpace;
 	if (n == 1 && *p == ' ') {
-	  dy += state->getWordSpace();
+	  dy += wordSpace;
 	}
       } else {
-	dx = dx * state->getFontSize() + state->getCharSpace();
+	dx = dx * fontSize + charSpace;
 	if (n == 1 && *p == ' ') {
-	  dx += state->getWordSpace();
+	  dx += wordSpace;
 	}
-	dx *= state->getHorizScaling();
-	dy *= state->getFontSize();
+	dx *= horizScaling;
+	dy *= fontSize;
       }
-      state->textTransformDelta(dx, dy, &tdx, &tdy);
-      originX *= state->getFontSize();
-      originY *= state->getFontSize();
-      state->textTransformDelta(originX, originY, &tOriginX, &tOriginY);
+      tdx = mat[0] * dx + mat[2] * dy;
+      tdy = mat[1] * dx + mat[3] * dy;
+      originX *= fontSize;
+      originY *= fontSize;
+      tOriginX = mat[0] * originX + mat[2] * originY;
+      tOriginY = mat[1] * originX + mat[3] * originY;
       if (ocState)
         out->drawChar(state, state->getCurX() + riseX, state->getCurY() + riseY,
 		      tdx, tdy, tOriginX, tOriginY, code, n, u, uLen);
@@ -4974,16 +5680,33 @@ void Gfx::drawForm(Object *str, Dict *resDict, double *matrix, double *bbox,
 
 void Gfx::opBeginImage(Object args[], int numArgs) {
   Stream *str;
-  int c1, c2;
+  GooString *data;
+  int c1, c2, len;
 
   // NB: this function is run even if ocState is false -- doImage() is
   // responsible for skipping over the inline image data
 
+  // replaying a recorded op list -- the image data was captured when
+  // the list was recorded
+  if (!parser) {
+    if (inlineImage) {
+      inlineImage->reset();
+      doImage(NULL, inlineImage, gTrue);
+    }
+    return;
+  }
+
   // build dict/stream
   str = buildImageStream();
 
   // display the image
   if (str) {
+    data = NULL;
+    if (recordOps) {
+      data = new GooString();
+      ((EmbedStream *)str->getUndecodedStream())->setRecord(data);
+    }
+
     doImage(NULL, str, gTrue);
   
     // skip 'EI' tag
@@ -4993,6 +5716,18 @@ void Gfx::opBeginImage(Object args[], int numArgs) {
       c1 = c2;
       c2 = str->getUndecodedStream()->getChar();
     }
+
+    // keep the raw image data (minus the 'EI' tag) in the op list
+    // being recorded
+    if (data) {
+      ((EmbedStream *)str->getUndecodedStream())->setRecord(NULL);
+      len = data->getLength();
+      if (c2 != EOF && len >= 2) {
+	len -= 2;
+      }
+      recordOps->appendImage(str->getDict(), data->getCString(), len);
+      delete data;
+    }
     delete str;
   }
 }
@@ -41,6 +41,7 @@
 #include "GfxState.h"
 #include "Object.h"
 #include "PopplerCache.h"
+#include "goo/GooMutex.h"
 
 #include <vector>
 
@@ -137,6 +138,93 @@ private:
   GfxResources *next;
 };
 
+//------------------------------------------------------------------------
+// GfxOpList
+//------------------------------------------------------------------------
+
+// A content stream (a Type 3 CharProc, or the contents of a page)
+// parsed into its operators and operands, so that it can be run again
+// without re-parsing it.  The operators are kept in a compact encoded
+// form, and decoded again one by one when the list is run.
+class GfxOpList {
+public:
+
+  GfxOpList();
+  ~GfxOpList();
+
+  // Number of operators in the list.
+  int getLength() { return nOps; }
+
+  // Memory used by the list, in bytes.
+  int getSize() { return (int)sizeof(GfxOpList) + dataSize; }
+
+private:
+
+  void append(int op, char *name, Object args[], int numArgs,
+	      GBool argsChecked);
+  void appendImage(Dict *dict, char *buf, int len);
+  void appendObj(Object *obj);
+  void appendBytes(const void *p, int n);
+  void appendInt(int x);
+  void finish();
+  static Guchar *getObj(Guchar *p, XRef *xref, Object *obj);
+  static Guchar *getInt(Guchar *p, int *x);
+
+  Guchar *data;			// encoded operators, operands and inline
+  int dataLen, dataSize;	//   image data, in stream order
+  int lastOp;			// offset of the last operator in data
+  int nOps;			// number of operators
+  GBool complete;		// set if the whole stream was recorded
+  GBool ok;			// cleared if an operand couldn't be encoded
+  int refCnt;			// references held through a GfxOpListCache
+
+  friend class Gfx;
+  friend class GfxOpListCache;
+};
+
+//------------------------------------------------------------------------
+// GfxOpListCache
+//------------------------------------------------------------------------
+
+struct GfxOpListCacheEntry;
+
+// The recorded contents of recently displayed pages, kept within a
+// memory budget; the least recently used pages are dropped first.
+class GfxOpListCache {
+public:
+
+  GfxOpListCache(int maxSizeA);
+  ~GfxOpListCache();
+
+  // Change the memory budget, in bytes.
+  void setMaxSize(int maxSizeA);
+  int getMaxSize();
+
+  // Return the list recorded for page <pg>, or NULL.  The list stays
+  // valid until it is given back with release().
+  GfxOpList *lookup(int pg);
+
+  // Give back a list returned by lookup().
+  void release(GfxOpList *ops);
+
+  // Add the list recorded for page <pg>.  The cache takes ownership
+  // of <ops> (and deletes it right away if it doesn't fit the budget).
+  void add(int pg, GfxOpList *ops);
+
+private:
+
+  void shrink(int maxSizeA);
+  void unref(GfxOpList *ops);
+
+  GfxOpListCacheEntry *first;	// most recently used page
+  GfxOpListCacheEntry *last;	// least recently used page
+  int size;			// memory used by the cached lists
+  int maxSize;			// memory budget
+#if MULTITHREADED
+  GooMutex mutex;
+#endif
+};
+
 //------------------------------------------------------------------------
 // Gfx
 //------------------------------------------------------------------------
@@ -166,6 +254,14 @@ public:
   // Interpret a stream or array of streams.
   void display(Object *obj, GBool topLevel = gTrue);
 
+  // Interpret a stream or array of streams, recording its operators
+  // into <ops>.  Returns false if the contents couldn't be run to the
+  // end (in which case <ops> is incomplete).
+  GBool record(Object *obj, GfxOpList *ops, GBool topLevel = gFalse);
+
+  // Run a list of operators recorded by record().
+  void run(GfxOpList *ops, GBool topLevel = gFalse);
+
   // Display an annotation, given its appearance (a Form XObject),
   // border style, and bounding box (in default user space).
   void drawAnnot(Object *str, AnnotBorder *border, AnnotColor *aColor,
@@ -226,6 +322,10 @@ private:
   MarkedContentStack *mcStack;	// current BMC/EMC stack
 
   Parser *parser;		// parser for page content stream(s)
+  GfxOpList *recordOps;		// list the stream run by go() is recorded
+				//   into, or NULL
+  Stream *inlineImage;		// inline image to be drawn by opBeginImage
+				//   when replaying a list
   
   std::set<int> formsDrawing;	// the forms that are being drawn
 
@@ -236,8 +336,12 @@ private:
   static Operator opTab[];	// table of operators
 
   void go(GBool topLevel);
-  void execOp(Object *cmd, Object args[], int numArgs);
-  Operator *findOp(char *name);
+  GBool runOp(int op, char *name, Object args[], int numArgs,
+	      GBool argsChecked, int *lastAbortCheck);
+  void execOp(int op, char *name, Object args[], int numArgs,
+	      GBool argsChecked);
+  int findOp(char *name);
+  GBool checkArgs(Operator *op, Object args[], int numArgs);
   GBool checkArg(Object *arg, TchkType type);
   Goffset getPos();
 
@@ -61,6 +61,8 @@
 #include "FontEncodingTables.h"
 #include "BuiltinFontTables.h"
 #include "UnicodeTypeTable.h"
+#include "Decrypt.h"
+#include "Gfx.h"
 #include <fofi/FoFiIdentifier.h>
 #include <fofi/FoFiType1.h>
 #include <fofi/FoFiType1C.h>
@@ -281,8 +283,9 @@ void GfxFont::decRefCnt() {
 //    if there is one, otherwise equal to the expected font type
 // If the expected and actual font types don't match, a warning
 // message is printed.  The expected font type is not used for
-// anything else.
-GfxFontType GfxFont::getFontType(XRef *xref, Dict *fontDict, Ref *embID) {
+// anything else, unless <examineEmbedded> is false.
+GfxFontType GfxFont::getFontType(XRef *xref, Dict *fontDict, Ref *embID,
+				 GBool examineEmbedded) {
   GfxFontType t, expectedType;
   FoFiIdentifierType fft;
   Dict *fontDict2;
@@ -410,7 +413,7 @@ GfxFontType GfxFont::getFontType(XRef *xref, Dict *fontDict, Ref *embID) {
   fontDesc.free();
 
   t = fontUnknownType;
-  if (embID->num >= 0) {
+  if (embID->num >= 0 && examineEmbedded) {
     obj3.initRef(embID->num, embID->gen);
     obj3.fetch(xref, &obj4);
     if (obj4.isStream()) {
@@ -1053,6 +1056,7 @@ Gfx8BitFont::Gfx8BitFont(XRef *xref, const char *tagA, Ref idA, GooString *nameA
 
   refCnt = 1;
   ctu = NULL;
+  charProcOps = NULL;
 
   // do font name substitution for various aliases of the Base 14 font
   // names
@@ -1539,6 +1543,12 @@ Gfx8BitFont::~Gfx8BitFont() {
   if (resources.isDict()) {
     resources.free();
   }
+  if (charProcOps) {
+    for (i = 0; i < 256; ++i) {
+      delete charProcOps[i];
+    }
+    gfree(charProcOps);
+  }
 }
 
 // This function is in part a derived work of the Adobe Glyph Mapping
@@ -1818,6 +1828,19 @@ Dict *Gfx8BitFont::getResources() {
   return resources.isDict() ? resources.getDict() : (Dict *)NULL;
 }
 
+void Gfx8BitFont::setCharProcOps(int code, GfxOpList *ops) {
+  int i;
+
+  if (!charProcOps) {
+    charProcOps = (GfxOpList **)gmallocn(256, sizeof(GfxOpList *));
+    for (i = 0; i < 256; ++i) {
+      charProcOps[i] = NULL;
+    }
+  }
+  delete charProcOps[code & 0xff];
+  charProcOps[code & 0xff] = ops;
+}
+
 //------------------------------------------------------------------------
 // GfxCIDFont
 //------------------------------------------------------------------------
@@ -1864,6 +1887,9 @@ GfxCIDFont::GfxCIDFont(XRef *xref, const char *tagA, Ref idA, GooString *nameA,
   widths.nExceps = 0;
   widths.excepsV = NULL;
   widths.nExcepsV = 0;
+  widthTable = NULL;
+  widthTableFirst = 0;
+  widthTableLen = 0;
   cidToGID = NULL;
   cidToGIDLen = 0;
 
@@ -2057,6 +2083,7 @@ GfxCIDFont::GfxCIDFont(XRef *xref, const char *tagA, Ref idA, GooString *nameA,
     }
     std::sort(widths.exceps, widths.exceps + widths.nExceps,
 	      cmpWidthExcepFunctor());
+    buildWidthTable();
   }
   obj1.free();
 
@@ -2169,6 +2196,7 @@ GfxCIDFont::~GfxCIDFont() {
   }
   gfree(widths.exceps);
   gfree(widths.excepsV);
+  gfree(widthTable);
   if (cidToGID) {
     gfree(cidToGID);
   }
@@ -2259,9 +2287,10 @@ GooString *GfxCIDFont::getCollection() {
   return cMap ? cMap->getCollection() : (GooString *)NULL;
 }
 
-int GfxCIDFont::mapCodeToGID(FoFiTrueType *ff, int cmapi,
+int GfxCIDFont::mapCodeToGID(FoFiTrueType *ff, int cmapi, int *uniToGID,
   Unicode unicode, GBool wmode) {
-  Gushort gid = ff->mapCodeToGID(cmapi,unicode);
+  Gushort gid = unicode < 0x10000 ? uniToGID[unicode]
+                                  : ff->mapCodeToGID(cmapi,unicode);
   if (wmode) {
     Gushort vgid = ff->mapToVertGID(gid);
     if (vgid != 0) gid = vgid;
@@ -2355,6 +2384,11 @@ int *GfxCIDFont::getCodeToGIDMap(FoFiTrueType *ff, int *mapsizep) {
   Unicode *vumap = 0;
   Unicode *tumap = 0;
   int *codeToGID = 0;
+  int *uniToGID;
+  GooString *key;
+  char *table;
+  int tableLen, len;
+  Guchar digest[16];
   unsigned long n;
   int i;
   unsigned long code;
@@ -2404,6 +2438,29 @@ int *GfxCIDFont::getCodeToGIDMap(FoFiTrueType *ff, int *mapsizep) {
       break;
     }
   }
+
+  /* for the known collections the map only depends on the cmap and
+   * GSUB tables of the font file, so reuse the one built for an
+   * earlier font using the same font file
+   */
+  key = NULL;
+  if (lp->collection != 0) {
+    key = GooString::format("{0:s} {1:d} {2:d} ", lp->collection, wmode, cmap);
+    if (ff->getTable("cmap", &table, &tableLen)) {
+      md5((Guchar *)table, tableLen, digest);
+      key->append((char *)digest, 16);
+    }
+    if (ff->getTable("GSUB", &table, &tableLen)) {
+      md5((Guchar *)table, tableLen, digest);
+      key->append((char *)digest, 16);
+    }
+    if ((codeToGID = globalParams->getCodeToGIDMap(key, &len))) {
+      delete key;
+      *mapsizep = len;
+      return codeToGID;
+    }
+  }
+
   n = 65536;
   tumap = new Unicode[n];
   humap = new Unicode[n*N_UCS_CANDIDATES];
@@ -2463,7 +2520,10 @@ int *GfxCIDFont::getCodeToGIDMap(FoFiTrueType *ff, int *mapsizep) {
       ctu->decRefCnt();
     }
   }
-  // map CID -> Unicode -> GID
+  // map CID -> Unicode -> GID, looking up the BMP in a table decoded
+  // from the cmap in one go
+  uniToGID = (int *)gmallocn(0x10000, sizeof(int));
+  ff->mapCodesToGIDs(cmap, 0x10000, uniToGID);
   codeToGID = (int *)gmallocn(n, sizeof(int));
   for (code = 0; code < n; ++code) {
     Unicode unicode;
@@ -2474,23 +2534,23 @@ int *GfxCIDFont::getCodeToGIDMap(FoFiTrueType *ff, int *mapsizep) {
     if (humap != 0) {
       for (i = 0;i < N_UCS_CANDIDATES
 	&& gid == 0 && (unicode = humap[code*N_UCS_CANDIDATES+i]) != 0;i++) {
-	gid = mapCodeToGID(ff,cmap,unicode,gFalse);
+	gid = mapCodeToGID(ff,cmap,uniToGID,unicode,gFalse);
       }
     }
     if (gid == 0 && vumap != 0) {
       unicode = vumap[code];
       if (unicode != 0) {
-	gid = mapCodeToGID(ff,cmap,unicode,gTrue);
+	gid = mapCodeToGID(ff,cmap,uniToGID,unicode,gTrue);
 	if (gid == 0 && tumap != 0) {
 	  if ((unicode = tumap[code]) != 0) {
-	    gid = mapCodeToGID(ff,cmap,unicode,gTrue);
+	    gid = mapCodeToGID(ff,cmap,uniToGID,unicode,gTrue);
 	  }
 	}
       }
     }
     if (gid == 0 && tumap != 0) {
       if ((unicode = tumap[code]) != 0) {
-	gid = mapCodeToGID(ff,cmap,unicode,gFalse);
+	gid = mapCodeToGID(ff,cmap,uniToGID,unicode,gFalse);
       }
     }
     if (gid == 0) {
@@ -2503,7 +2563,7 @@ int *GfxCIDFont::getCodeToGIDMap(FoFiTrueType *ff, int *mapsizep) {
 	for (p = spaces;*p != 0;p++) {
 	  if (*p == unicode) {
 	    unicode = 0x20;
-	    gid = mapCodeToGID(ff,cmap,unicode,wmode);
+	    gid = mapCodeToGID(ff,cmap,uniToGID,unicode,wmode);
 	    break;
 	  }
 	}
@@ -2512,16 +2572,71 @@ int *GfxCIDFont::getCodeToGIDMap(FoFiTrueType *ff, int *mapsizep) {
     codeToGID[code] = gid;
   }
   *mapsizep = n;
+  gfree(uniToGID);
+  if (key) {
+    globalParams->addCodeToGIDMap(key, codeToGID, n);
+    delete key;
+  }
   if (humap != 0) delete[] humap;
   if (tumap != 0) delete[] tumap;
   if (vumap != 0) delete[] vumap;
   return codeToGID;
 }
 
+// Flatten the (sorted) width exceptions into a table indexed by CID,
+// so getWidth doesn't need a binary search for every character.  This
+// is only done if the table isn't much larger than the W array.
+void GfxCIDFont::buildWidthTable() {
+  CID maxLast, c, end;
+  Guint span;
+  int i;
+
+  if (widths.nExceps == 0) {
+    return;
+  }
+  maxLast = widths.exceps[0].last;
+  for (i = 1; i < widths.nExceps; ++i) {
+    if (widths.exceps[i].last > maxLast) {
+      maxLast = widths.exceps[i].last;
+    }
+  }
+  if (maxLast < widths.exceps[0].first) {
+    return;
+  }
+  span = maxLast - widths.exceps[0].first;
+  if (span >= 0x10000 || span >= 64 * (Guint)widths.nExceps) {
+    return;
+  }
+  widthTableFirst = widths.exceps[0].first;
+  widthTableLen = span + 1;
+  widthTable = (double *)gmallocn(widthTableLen, sizeof(double));
+  for (i = 0; i < widthTableLen; ++i) {
+    widthTable[i] = widths.defWidth;
+  }
+  // getWidth uses the last exception whose first CID is <= cid
+  for (i = 0; i < widths.nExceps; ++i) {
+    end = widths.exceps[i].last;
+    if (i + 1 < widths.nExceps && widths.exceps[i + 1].first <= end) {
+      if (widths.exceps[i + 1].first == widths.exceps[i].first) {
+	continue;
+      }
+      end = widths.exceps[i + 1].first - 1;
+    }
+    for (c = widths.exceps[i].first;
+	 c >= widths.exceps[i].first && c <= end;
+	 ++c) {
+      widthTable[c - widthTableFirst] = widths.exceps[i].width;
+    }
+  }
+}
+
 double GfxCIDFont::getWidth(CID cid) {
   double w;
   int a, b, m;
 
+  if (cid - widthTableFirst < (CID)widthTableLen) {
+    return widthTable[cid - widthTableFirst];
+  }
   w = widths.defWidth;
   if (widths.nExceps > 0 && cid >= widths.exceps[0].first) {
     a = 0;
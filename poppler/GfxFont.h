@@ -44,6 +44,7 @@ class Dict;
 class CMap;
 class CharCodeToUnicode;
 class FoFiTrueType;
+class GfxOpList;
 class PSOutputDev;
 struct GfxFontCIDWidths;
 struct Base14FontMapEntry;
@@ -172,6 +173,13 @@ public:
   // Build a GfxFont object.
   static GfxFont *makeFont(XRef *xref, const char *tagA, Ref idA, Dict *fontDict);
 
+  // Get the font type and the embedded font file ID for a font
+  // dictionary.  If <examineEmbedded> is false, the embedded font
+  // file is not read and the type implied by the dictionaries is
+  // returned.
+  static GfxFontType getFontType(XRef *xref, Dict *fontDict, Ref *embID,
+				 GBool examineEmbedded = gTrue);
+
   GfxFont(const char *tagA, Ref idA, GooString *nameA,
 	  GfxFontType typeA, Ref embFontIDA);
 
@@ -274,7 +282,6 @@ protected:
 
   virtual ~GfxFont();
 
-  static GfxFontType getFontType(XRef *xref, Dict *fontDict, Ref *embID);
   void readFontDescriptor(XRef *xref, Dict *fontDict);
   CharCodeToUnicode *readToUnicodeCMap(Dict *fontDict, int nBits,
 				       CharCodeToUnicode *ctu);
@@ -346,6 +353,15 @@ public:
   // Return the Type 3 Resources dictionary, or NULL if none.
   Dict *getResources();
 
+  // Return the recorded operator list for the Type 3 CharProc
+  // associated with <code>, or NULL if it hasn't been recorded yet.
+  GfxOpList *getCharProcOps(int code)
+    { return charProcOps ? charProcOps[code & 0xff] : (GfxOpList *)NULL; }
+
+  // Store the operator list for the Type 3 CharProc associated with
+  // <code>.  The font takes ownership of <ops>.
+  void setCharProcOps(int code, GfxOpList *ops);
+
 private:
   virtual ~Gfx8BitFont();
 
@@ -359,6 +375,8 @@ private:
   double widths[256];		// character widths
   Object charProcs;		// Type 3 CharProcs dictionary
   Object resources;		// Type 3 Resources dictionary
+  GfxOpList **charProcOps;	// Type 3 recorded CharProcs (allocated
+				//   on first use)
 
   friend class GfxFont;
 };
@@ -400,8 +418,9 @@ public:
 private:
   virtual ~GfxCIDFont();
 
-  int mapCodeToGID(FoFiTrueType *ff, int cmapi,
+  int mapCodeToGID(FoFiTrueType *ff, int cmapi, int *uniToGID,
     Unicode unicode, GBool wmode);
+  void buildWidthTable();
   double getWidth(CID cid);	// Get width of a character.
 
   GooString *collection;		// collection name
@@ -410,6 +429,9 @@ private:
   GBool ctuUsesCharCode;	// true: ctu maps char code to Unicode;
 				//   false: ctu maps CID to Unicode
   GfxFontCIDWidths widths;	// character widths
+  double *widthTable;		// widths of CIDs widthTableFirst ..
+  CID widthTableFirst;		//   widthTableFirst + widthTableLen - 1,
+  int widthTableLen;		//   flattened from widths.exceps
   int *cidToGID;		// CID --> GID mapping (for embedded
 				//   TrueType fonts)
   int cidToGIDLen;
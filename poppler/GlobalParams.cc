@@ -49,6 +49,7 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <ctype.h>
 #ifdef ENABLE_PLUGINS
 #  ifndef _WIN32
@@ -79,12 +80,14 @@
 
 #if WITH_FONTCONFIGURATION_FONTCONFIG
 #include <fontconfig/fontconfig.h>
+#include <sys/stat.h>
 #endif
 
 #ifdef _WIN32
 #  define strcasecmp stricmp
 #else
 #  include <strings.h>
+#  include <unistd.h>
 #endif
 
 #if MULTITHREADED
@@ -554,7 +557,6 @@ Plugin::~Plugin() {
 GlobalParams::GlobalParams(const char *customPopplerDataDir)
   : popplerDataDir(customPopplerDataDir)
 {
-  UnicodeMap *map;
   int i;
 
 #if MULTITHREADED
@@ -589,10 +591,15 @@ GlobalParams::GlobalParams(const char *customPopplerDataDir)
   fontDirs = new GooList();
   ccFontFiles = new GooHash(gTrue);
   sysFonts = new SysFontList();
+  fcSubstCache = new GooHash(gTrue);
+  fcSubstCacheFile = NULL;
+  fcSubstCacheFileOk = gFalse;
   psExpandSmaller = gFalse;
   psShrinkLarger = gTrue;
   psCenter = gTrue;
   psLevel = psLevel2;
+  psCFFPassthrough = gFalse;
+  psSubsetFonts = gFalse;
   psFile = NULL;
   psResidentFonts = new GooHash(gTrue);
   psResidentFonts16 = new GooList();
@@ -628,6 +635,11 @@ GlobalParams::GlobalParams(const char *customPopplerDataDir)
       new CharCodeToUnicodeCache(unicodeToUnicodeCacheSize);
   unicodeMapCache = new UnicodeMapCache();
   cMapCache = new CMapCache();
+  for (i = 0; i < codeToGIDCacheSize; ++i) {
+    codeToGIDKeys[i] = NULL;
+    codeToGIDMaps[i] = NULL;
+    codeToGIDLens[i] = 0;
+  }
 
   baseFontsInitialized = gFalse;
 #ifdef ENABLE_PLUGINS
@@ -635,7 +647,34 @@ GlobalParams::GlobalParams(const char *customPopplerDataDir)
   securityHandlers = new GooList();
 #endif
 
-  // set up the initial nameToUnicode tables
+  // the nameToUnicode tables, the residentUnicodeMaps table and the
+  // encoding dirs are set up on first use, see initNameToUnicode(),
+  // initResidentUnicodeMaps() and scanEncodingDirs()
+  nameToUnicodeInitialized = 0;
+  residentUnicodeMapsInitialized = gFalse;
+  encodingDirsScanned = gFalse;
+  dataCacheDir = NULL;
+}
+
+void GlobalParams::initNameToUnicode() {
+  GDir *dir;
+  GDirEntry *entry;
+  int i;
+
+  // the flag is only set (with release ordering) once the tables are
+  // complete, so a thread that sees it set (with acquire ordering) sees
+  // the tables too, and the lookups don't need to take the lock
+#if MULTITHREADED
+  if (gAtomicLoadAcquire(&nameToUnicodeInitialized)) {
+    return;
+  }
+#endif
+  lockGlobalParams;
+  if (nameToUnicodeInitialized) {
+    unlockGlobalParams;
+    return;
+  }
+
   for (i = 0; nameToUnicodeZapfDingbatsTab[i].name; ++i) {
     nameToUnicodeZapfDingbats->add(nameToUnicodeZapfDingbatsTab[i].name, nameToUnicodeZapfDingbatsTab[i].u);
   }
@@ -644,7 +683,35 @@ GlobalParams::GlobalParams(const char *customPopplerDataDir)
     nameToUnicodeText->add(nameToUnicodeTextTab[i].name, nameToUnicodeTextTab[i].u);
   }
 
-  // set up the residentUnicodeMaps table
+  GooString *dirName = new GooString(popplerDataDir ? popplerDataDir : POPPLER_DATADIR);
+  dirName->append("/nameToUnicode");
+  dir = new GDir(dirName->getCString(), gTrue);
+  while (entry = dir->getNextEntry(), entry != NULL) {
+    if (!entry->isDir()) {
+      parseNameToUnicode(entry->getFullPath());
+    }
+    delete entry;
+  }
+  delete dir;
+  delete dirName;
+#if MULTITHREADED
+  gAtomicStoreRelease(&nameToUnicodeInitialized, 1);
+#else
+  nameToUnicodeInitialized = 1;
+#endif
+  unlockGlobalParams;
+}
+
+void GlobalParams::initResidentUnicodeMaps() {
+  UnicodeMap *map;
+
+  lockGlobalParams;
+  if (residentUnicodeMapsInitialized) {
+    unlockGlobalParams;
+    return;
+  }
+  residentUnicodeMapsInitialized = gTrue;
+
   map = new UnicodeMap("Latin1", gFalse,
 		       latin1UnicodeMapRanges, latin1UnicodeMapLen);
   residentUnicodeMaps->add(map->getEncodingName(), map);
@@ -661,29 +728,25 @@ GlobalParams::GlobalParams(const char *customPopplerDataDir)
   residentUnicodeMaps->add(map->getEncodingName(), map);
   map = new UnicodeMap("UCS-2", gTrue, &mapUCS2);
   residentUnicodeMaps->add(map->getEncodingName(), map);
-
-  scanEncodingDirs();
+  unlockGlobalParams;
 }
 
 void GlobalParams::scanEncodingDirs() {
   GDir *dir;
   GDirEntry *entry;
   const char *dataRoot = popplerDataDir ? popplerDataDir : POPPLER_DATADIR;
+
+  lockGlobalParams;
+  if (encodingDirsScanned) {
+    unlockGlobalParams;
+    return;
+  }
+  encodingDirsScanned = gTrue;
   
-  // allocate buffer large enough to append "/nameToUnicode"
-  size_t bufSize = strlen(dataRoot) + strlen("/nameToUnicode") + 1;
+  // allocate buffer large enough to append "/cidToUnicode"
+  size_t bufSize = strlen(dataRoot) + strlen("/cidToUnicode") + 1;
   char *dataPathBuffer = new char[bufSize];
   
-  snprintf(dataPathBuffer, bufSize, "%s/nameToUnicode", dataRoot);
-  dir = new GDir(dataPathBuffer, gTrue);
-  while (entry = dir->getNextEntry(), entry != NULL) {
-    if (!entry->isDir()) {
-      parseNameToUnicode(entry->getFullPath());
-    }
-    delete entry;
-  }
-  delete dir;
-
   snprintf(dataPathBuffer, bufSize, "%s/cidToUnicode", dataRoot);
   dir = new GDir(dataPathBuffer, gFalse);
   while (entry = dir->getNextEntry(), entry != NULL) {
@@ -710,6 +773,7 @@ void GlobalParams::scanEncodingDirs() {
   delete dir;
   
   delete[] dataPathBuffer;
+  unlockGlobalParams;
 }
 
 void GlobalParams::parseNameToUnicode(GooString *name) {
@@ -783,6 +847,8 @@ GBool GlobalParams::parseYesNo2(const char *token, GBool *flag) {
 }
 
 GlobalParams::~GlobalParams() {
+  int i;
+
   freeBuiltinFontTables();
 
   delete macRomanReverseMap;
@@ -801,6 +867,9 @@ GlobalParams::~GlobalParams() {
   deleteGooHash(substFiles, GooString);
 #endif
   delete sysFonts;
+  deleteGooHash(fcSubstCache, SysFontInfo);
+  delete fcSubstCacheFile;
+  delete dataCacheDir;
   if (psFile) {
     delete psFile;
   }
@@ -823,6 +892,10 @@ GlobalParams::~GlobalParams() {
   delete unicodeToUnicodeCache;
   delete unicodeMapCache;
   delete cMapCache;
+  for (i = 0; i < codeToGIDCacheSize; ++i) {
+    delete codeToGIDKeys[i];
+    gfree(codeToGIDMaps[i]);
+  }
 
 #ifdef ENABLE_PLUGINS
   delete securityHandlers;
@@ -846,7 +919,9 @@ CharCode GlobalParams::getMacRomanCharCode(char *charName) {
 }
 
 Unicode GlobalParams::mapNameToUnicodeAll(const char *charName) {
-  // no need to lock - nameToUnicodeZapfDingbats and nameToUnicodeText are constant
+  // no need to lock - nameToUnicodeZapfDingbats and nameToUnicodeText are
+  // constant once initNameToUnicode() has returned
+  initNameToUnicode();
   Unicode u = nameToUnicodeZapfDingbats->lookup(charName);
   if (!u)
     u = nameToUnicodeText->lookup(charName);
@@ -854,13 +929,16 @@ Unicode GlobalParams::mapNameToUnicodeAll(const char *charName) {
 }
 
 Unicode GlobalParams::mapNameToUnicodeText(const char *charName) {
-  // no need to lock - nameToUnicodeText is constant
+  // no need to lock - nameToUnicodeText is constant once
+  // initNameToUnicode() has returned
+  initNameToUnicode();
   return nameToUnicodeText->lookup(charName);
 }
 
 UnicodeMap *GlobalParams::getResidentUnicodeMap(GooString *encodingName) {
   UnicodeMap *map;
 
+  initResidentUnicodeMaps();
   lockGlobalParams;
   map = (UnicodeMap *)residentUnicodeMaps->lookup(encodingName);
   unlockGlobalParams;
@@ -874,6 +952,7 @@ FILE *GlobalParams::getUnicodeMapFile(GooString *encodingName) {
   GooString *fileName;
   FILE *f;
 
+  scanEncodingDirs();
   lockGlobalParams;
   if ((fileName = (GooString *)unicodeMaps->lookup(encodingName))) {
     f = openFile(fileName->getCString(), "r");
@@ -885,12 +964,26 @@ FILE *GlobalParams::getUnicodeMapFile(GooString *encodingName) {
 }
 
 FILE *GlobalParams::findCMapFile(GooString *collection, GooString *cMapName) {
+  GooString *fileName;
+  FILE *f;
+
+  if (!(fileName = findCMapFileName(collection, cMapName))) {
+    return NULL;
+  }
+  f = openFile(fileName->getCString(), "r");
+  delete fileName;
+  return f;
+}
+
+GooString *GlobalParams::findCMapFileName(GooString *collection,
+					  GooString *cMapName) {
   GooList *list;
   GooString *dir;
   GooString *fileName;
   FILE *f;
   int i;
 
+  scanEncodingDirs();
   lockGlobalParams;
   if (!(list = (GooList *)cMapDirs->lookup(collection))) {
     unlockGlobalParams;
@@ -899,12 +992,12 @@ FILE *GlobalParams::findCMapFile(GooString *collection, GooString *cMapName) {
   for (i = 0; i < list->getLength(); ++i) {
     dir = (GooString *)list->get(i);
     fileName = appendToPath(dir->copy(), cMapName->getCString());
-    f = openFile(fileName->getCString(), "r");
-    delete fileName;
-    if (f) {
+    if ((f = openFile(fileName->getCString(), "r"))) {
+      fclose(f);
       unlockGlobalParams;
-      return f;
+      return fileName;
     }
+    delete fileName;
   }
   unlockGlobalParams;
   return NULL;
@@ -915,6 +1008,7 @@ FILE *GlobalParams::findToUnicodeFile(GooString *name) {
   FILE *f;
   int i;
 
+  scanEncodingDirs();
   lockGlobalParams;
   for (i = 0; i < toUnicodeDirs->getLength(); ++i) {
     dir = (GooString *)toUnicodeDirs->get(i);
@@ -996,8 +1090,10 @@ static FcPattern *buildFcPattern(GfxFont *font, GooString *base14Name)
   const char *start;
   FcPattern *p;
 
-  // this is all heuristics will be overwritten if font had proper info
-  name = (base14Name == NULL) ? font->getName()->getCString() : base14Name->getCString();
+  // this is all heuristics will be overwritten if font had proper info;
+  // work on a copy, the dashes are replaced below
+  GooString nameCopy((base14Name == NULL) ? font->getName() : base14Name);
+  name = nameCopy.getCString();
   
   modifiers = strchr (name, ',');
   if (modifiers == NULL)
@@ -1159,152 +1255,349 @@ GooString *GlobalParams::findBase14FontFile(GooString *base14Name, GfxFont *font
   return findSystemFontFile(font, &type, &fontNum, NULL, base14Name);
 }
 
-GooString *GlobalParams::findSystemFontFile(GfxFont *font,
-					  SysFontType *type,
-					  int *fontNum, GooString *substituteFontName, GooString *base14Name) {
+// Key of the fontconfig substitution cache: everything buildFcPattern
+// and fcFindFont look at, as tab separated fields.
+static GooString *fcSubstKey(GfxFont *font, GooString *base14Name) {
+  GooString *key = new GooString(font->getName());
+  key->append('\t');
+  if (base14Name) {
+    key->append(base14Name);
+  }
+  key->appendf("\t{0:d}{1:d}{2:d}\t{3:d}\t{4:d}\t",
+	       font->isFixedWidth() ? 1 : 0, font->isBold() ? 1 : 0,
+	       font->isItalic() ? 1 : 0,
+	       (int)font->getWeight(), (int)font->getStretch());
+  if (font->getFamily()) {
+    key->append(font->getFamily());
+  }
+  key->append('\t');
+  key->append(getFontLang(font));
+  return key;
+}
+
+#define fcSubstKeyFields 7
+
+// Ask fontconfig for the font to use instead of the non-embedded font.
+// Returns a SysFontInfo with a NULL path if there is none.
+static SysFontInfo *fcFindFont(GfxFont *font, GooString *base14Name) {
   SysFontInfo *fi = NULL;
-  FcPattern *p=0;
-  GooString *path = NULL;
   GooString *fontName = font->getName();
   GooString substituteName;
-  if (!fontName) return NULL;
-  lockGlobalParams;
+  FcPattern *p;
+  FcChar8* s;
+  char * ext;
+  FcResult res;
+  FcFontSet *set;
+  int i;
+  FcLangSet *lb = NULL;
+
+  p = buildFcPattern(font, base14Name);
+  if (!p)
+    goto fin;
+  FcConfigSubstitute(NULL, p, FcMatchPattern);
+  FcDefaultSubstitute(p);
+  set = FcFontSort(NULL, p, FcFalse, NULL, &res);
+  FcPatternDestroy(p);
+  if (!set)
+    goto fin;
 
-  if ((fi = sysFonts->find(fontName, font->isFixedWidth(), gTrue))) {
-    path = fi->path->copy();
-    *type = fi->type;
-    *fontNum = fi->fontNum;
-    substituteName.Set(fi->substituteName->getCString());
-  } else {
-    FcChar8* s;
-    char * ext;
-    FcResult res;
-    FcFontSet *set;
-    int i;
-    FcLangSet *lb = NULL;
-    p = buildFcPattern(font, base14Name);
-
-    if (!p)
-      goto fin;
-    FcConfigSubstitute(NULL, p, FcMatchPattern);
-    FcDefaultSubstitute(p);
-    set = FcFontSort(NULL, p, FcFalse, NULL, &res);
-    if (!set)
-      goto fin;
-
-    // find the language we want the font to support
-    const char *lang = getFontLang(font);
-    if (strcmp(lang,"xx") != 0) {
-      lb = FcLangSetCreate();
-      FcLangSetAdd(lb,(FcChar8 *)lang);
-    }
+  {
+  // find the language we want the font to support
+  const char *lang = getFontLang(font);
+  if (strcmp(lang,"xx") != 0) {
+    lb = FcLangSetCreate();
+    FcLangSetAdd(lb,(FcChar8 *)lang);
+  }
+  }
 
-    /*
-      scan twice.
-      first: fonts support the language
-      second: all fonts (fall back)
-    */
-    while (fi == NULL)
+  /*
+    scan twice.
+    first: fonts support the language
+    second: all fonts (fall back)
+  */
+  while (fi == NULL)
+  {
+    for (i = 0; i < set->nfont; ++i)
     {
-      for (i = 0; i < set->nfont; ++i)
-      {
-	res = FcPatternGetString(set->fonts[i], FC_FILE, 0, &s);
-	if (res != FcResultMatch || !s)
+      res = FcPatternGetString(set->fonts[i], FC_FILE, 0, &s);
+      if (res != FcResultMatch || !s)
+	continue;
+      if (lb != NULL) {
+	FcLangSet *l;
+	res = FcPatternGetLangSet(set->fonts[i], FC_LANG, 0, &l);
+	if (res != FcResultMatch || !FcLangSetContains(l,lb)) {
 	  continue;
-	if (lb != NULL) {
-	  FcLangSet *l;
-	  res = FcPatternGetLangSet(set->fonts[i], FC_LANG, 0, &l);
-	  if (res != FcResultMatch || !FcLangSetContains(l,lb)) {
-	    continue;
-	  }
 	}
-	FcChar8* s2;
-        res = FcPatternGetString(set->fonts[i], FC_FULLNAME, 0, &s2);
+      }
+      FcChar8* s2;
+      res = FcPatternGetString(set->fonts[i], FC_FULLNAME, 0, &s2);
+      if (res == FcResultMatch && s2) {
+        substituteName.Set((char*)s2);
+      } else {
+        // fontconfig does not extract fullname for some fonts
+        // create the fullname from family and style
+        res = FcPatternGetString(set->fonts[i], FC_FAMILY, 0, &s2);
         if (res == FcResultMatch && s2) {
           substituteName.Set((char*)s2);
-        } else {
-          // fontconfig does not extract fullname for some fonts
-          // create the fullname from family and style
-          res = FcPatternGetString(set->fonts[i], FC_FAMILY, 0, &s2);
+          res = FcPatternGetString(set->fonts[i], FC_STYLE, 0, &s2);
           if (res == FcResultMatch && s2) {
-            substituteName.Set((char*)s2);
-            res = FcPatternGetString(set->fonts[i], FC_STYLE, 0, &s2);
-            if (res == FcResultMatch && s2) {
-              GooString *style = new GooString((char*)s2);
-              if (style->cmp("Regular") != 0) {
-                substituteName.append(" ");
-                substituteName.append(style);
-              }
-              delete style;
+            GooString *style = new GooString((char*)s2);
+            if (style->cmp("Regular") != 0) {
+              substituteName.append(" ");
+              substituteName.append(style);
             }
+            delete style;
           }
         }
-	ext = strrchr((char*)s,'.');
-	if (!ext)
-	  continue;
-	if (!strncasecmp(ext,".ttf",4) || !strncasecmp(ext, ".ttc", 4) || !strncasecmp(ext, ".otf", 4))
-	{
-	  int weight, slant;
-	  GBool bold = font->isBold();
-	  GBool italic = font->isItalic();
-	  GBool oblique = gFalse;
-	  FcPatternGetInteger(set->fonts[i], FC_WEIGHT, 0, &weight);
-	  FcPatternGetInteger(set->fonts[i], FC_SLANT, 0, &slant);
-	  if (weight == FC_WEIGHT_DEMIBOLD || weight == FC_WEIGHT_BOLD 
-	      || weight == FC_WEIGHT_EXTRABOLD || weight == FC_WEIGHT_BLACK)
-	  {
-	    bold = gTrue;
-	  }
-	  if (slant == FC_SLANT_ITALIC)
-	    italic = gTrue;
-	  if (slant == FC_SLANT_OBLIQUE)
-	    oblique = gTrue;
-	  *fontNum = 0;
-	  *type = (!strncasecmp(ext,".ttc",4)) ? sysFontTTC : sysFontTTF;
-	  FcPatternGetInteger(set->fonts[i], FC_INDEX, 0, fontNum);
-	  fi = new SysFontInfo(fontName->copy(), bold, italic, oblique, font->isFixedWidth(),
-			       new GooString((char*)s), *type, *fontNum, substituteName.copy());
-	  sysFonts->addFcFont(fi);
-	  path = new GooString((char*)s);
+      }
+      ext = strrchr((char*)s,'.');
+      if (!ext)
+	continue;
+      SysFontType type;
+      if (!strncasecmp(ext,".ttf",4) || !strncasecmp(ext, ".otf", 4))
+	type = sysFontTTF;
+      else if (!strncasecmp(ext, ".ttc", 4))
+	type = sysFontTTC;
+      else if (!strncasecmp(ext,".pfa",4))
+	type = sysFontPFA;
+      else if (!strncasecmp(ext,".pfb",4))
+	type = sysFontPFB;
+      else
+	continue;
+      int weight, slant, fontNum;
+      GBool bold = font->isBold();
+      GBool italic = font->isItalic();
+      GBool oblique = gFalse;
+      FcPatternGetInteger(set->fonts[i], FC_WEIGHT, 0, &weight);
+      FcPatternGetInteger(set->fonts[i], FC_SLANT, 0, &slant);
+      if (weight == FC_WEIGHT_DEMIBOLD || weight == FC_WEIGHT_BOLD 
+	  || weight == FC_WEIGHT_EXTRABOLD || weight == FC_WEIGHT_BLACK)
+      {
+	bold = gTrue;
+      }
+      if (slant == FC_SLANT_ITALIC)
+	italic = gTrue;
+      if (slant == FC_SLANT_OBLIQUE)
+	oblique = gTrue;
+      fontNum = 0;
+      FcPatternGetInteger(set->fonts[i], FC_INDEX, 0, &fontNum);
+      fi = new SysFontInfo(fontName->copy(), bold, italic, oblique, font->isFixedWidth(),
+			   new GooString((char*)s), type, fontNum, substituteName.copy());
+      break;
+    }
+    if (lb != NULL) {
+      FcLangSetDestroy(lb);
+      lb = NULL;
+    } else {
+      /* scan all fonts of the list */
+      break;
+    }
+  }
+  FcFontSetDestroy(set);
+
+fin:
+  if (!fi) {
+    fi = new SysFontInfo(fontName->copy(), font->isBold(), font->isItalic(), gFalse,
+			 font->isFixedWidth(), NULL, sysFontPFA, 0, substituteName.copy());
+  }
+  return fi;
+}
+
+// Stamp of the fontconfig setup the substitutions were computed with:
+// the version, and the number and latest modification time of the font
+// directories.
+static GooString *fcSubstStamp() {
+  FcStrList *dirs;
+  FcChar8 *dir;
+  struct stat st;
+  int n = 0;
+  long mtime = 0;
+
+  dirs = FcConfigGetFontDirs(NULL);
+  if (dirs) {
+    while ((dir = FcStrListNext(dirs))) {
+      if (stat((char *)dir, &st) == 0) {
+	++n;
+	if ((long)st.st_mtime > mtime) {
+	  mtime = (long)st.st_mtime;
+	}
+      }
+    }
+    FcStrListDone(dirs);
+  }
+  return GooString::format("poppler-fcsubst 1 {0:d} {1:d} {2:ld}",
+			   FcGetVersion(), n, mtime);
+}
+
+void GlobalParams::loadFcSubstCache() {
+  GooString *stamp, *line, *key;
+  GooList *fields;
+  SysFontInfo *fi;
+  FILE *f;
+  char buf[1024];
+  int i, j;
+
+  stamp = fcSubstStamp();
+  fcSubstCacheFileOk = gFalse;
+  if (!(f = openFile(fcSubstCacheFile->getCString(), "r"))) {
+    delete stamp;
+    return;
+  }
+  line = new GooString();
+  while (getLine(buf, sizeof(buf), f)) {
+    line->append(buf);
+    if (line->getLength() == 0 || line->getChar(line->getLength() - 1) != '\n') {
+      continue;
+    }
+    line->del(line->getLength() - 1);
+    if (!fcSubstCacheFileOk) {
+      // the first line is the stamp
+      if (line->cmp(stamp)) {
+	break;
+      }
+      fcSubstCacheFileOk = gTrue;
+      line->clear();
+      continue;
+    }
+    fields = new GooList();
+    for (i = 0; i <= line->getLength(); i = j + 1) {
+      for (j = i; j < line->getLength() && line->getChar(j) != '\t'; ++j) ;
+      fields->append(new GooString(line, i, j - i));
+    }
+    if (fields->getLength() == fcSubstKeyFields + 5) {
+      key = ((GooString *)fields->get(0))->copy();
+      for (i = 1; i < fcSubstKeyFields; ++i) {
+	key->append('\t');
+	key->append((GooString *)fields->get(i));
+      }
+      GooString *path = (GooString *)fields->get(fcSubstKeyFields);
+      GooString *flags = (GooString *)fields->get(fcSubstKeyFields + 3);
+      FILE *fontFile;
+      if (flags->getLength() == 4 && !fcSubstCache->lookup(key)) {
+	if (path->getLength() == 0) {
+	  path = NULL;
+	} else if ((fontFile = openFile(path->getCString(), "rb"))) {
+	  fclose(fontFile);
+	  path = path->copy();
+	} else {
+	  // the font has been removed
+	  delete key;
+	  key = NULL;
 	}
-	else if (!strncasecmp(ext,".pfa",4) || !strncasecmp(ext,".pfb",4)) 
-	{
-	  int weight, slant;
-	  GBool bold = font->isBold();
-	  GBool italic = font->isItalic();
-	  GBool oblique = gFalse;
-	  FcPatternGetInteger(set->fonts[i], FC_WEIGHT, 0, &weight);
-	  FcPatternGetInteger(set->fonts[i], FC_SLANT, 0, &slant);
-	  if (weight == FC_WEIGHT_DEMIBOLD || weight == FC_WEIGHT_BOLD 
-	      || weight == FC_WEIGHT_EXTRABOLD || weight == FC_WEIGHT_BLACK)
-	  {
-		bold = gTrue;
+	if (key) {
+	  fi = new SysFontInfo(((GooString *)fields->get(0))->copy(),
+			       flags->getChar(0) == '1', flags->getChar(1) == '1',
+			       flags->getChar(2) == '1', flags->getChar(3) == '1',
+			       path,
+			       (SysFontType)atoi(((GooString *)fields->get(fcSubstKeyFields + 1))->getCString()),
+			       atoi(((GooString *)fields->get(fcSubstKeyFields + 2))->getCString()),
+			       ((GooString *)fields->get(fcSubstKeyFields + 4))->copy());
+	  fcSubstCache->add(key, fi);
+	  if (path) {
+	    sysFonts->addFcFont(new SysFontInfo(fi->name->copy(), fi->bold, fi->italic, fi->oblique,
+						fi->fixedWidth, fi->path->copy(), fi->type,
+						fi->fontNum, fi->substituteName->copy()));
 	  }
-	  if (slant == FC_SLANT_ITALIC)
-	    italic = gTrue;
-	  if (slant == FC_SLANT_OBLIQUE)
-	    oblique = gTrue;
-	  *fontNum = 0;
-	  *type = (!strncasecmp(ext,".pfa",4)) ? sysFontPFA : sysFontPFB;
-	  FcPatternGetInteger(set->fonts[i], FC_INDEX, 0, fontNum);
-	  fi = new SysFontInfo(fontName->copy(), bold, italic, oblique, font->isFixedWidth(),
-			       new GooString((char*)s), *type, *fontNum, substituteName.copy());
-	  sysFonts->addFcFont(fi);
-	  path = new GooString((char*)s);
 	}
-	else
-	  continue;
-	break;
+      } else {
+	delete key;
       }
-      if (lb != NULL) {
-        FcLangSetDestroy(lb);
-        lb = NULL;
+    }
+    deleteGooList(fields, GooString);
+    line->clear();
+  }
+  delete line;
+  fclose(f);
+  delete stamp;
+}
+
+void GlobalParams::saveFcSubst(GooString *key, SysFontInfo *fi) {
+  GooString *line, *stamp;
+  FILE *f;
+  int i;
+
+  // names with line or field separators can't be saved
+  line = key->copy();
+  line->appendf("\t{0:s}\t{1:d}\t{2:d}\t{3:d}{4:d}{5:d}{6:d}\t{7:t}\n",
+		fi->path ? fi->path->getCString() : "", (int)fi->type, fi->fontNum,
+		fi->bold ? 1 : 0, fi->italic ? 1 : 0, fi->oblique ? 1 : 0,
+		fi->fixedWidth ? 1 : 0, fi->substituteName);
+  int tabs = 0;
+  for (i = 0; i < line->getLength() - 1; ++i) {
+    if (line->getChar(i) == '\n' || line->getChar(i) == '\r') {
+      tabs = -1;
+      break;
+    }
+    if (line->getChar(i) == '\t') {
+      ++tabs;
+    }
+  }
+  if (tabs == fcSubstKeyFields + 4) {
+    if (fcSubstCacheFileOk) {
+      f = openFile(fcSubstCacheFile->getCString(), "a");
+    } else if ((f = openFile(fcSubstCacheFile->getCString(), "w"))) {
+      // start a new file
+      stamp = fcSubstStamp();
+      fprintf(f, "%s\n", stamp->getCString());
+      delete stamp;
+      fcSubstCacheFileOk = gTrue;
+    }
+    if (f) {
+      fwrite(line->getCString(), 1, line->getLength(), f);
+      fclose(f);
+    }
+  }
+  delete line;
+}
+
+GooString *GlobalParams::findSystemFontFile(GfxFont *font,
+					  SysFontType *type,
+					  int *fontNum, GooString *substituteFontName, GooString *base14Name) {
+  SysFontInfo *fi = NULL;
+  GooString *path = NULL;
+  GooString *fontName = font->getName();
+  GooString substituteName;
+  GooString *key;
+  if (!fontName) return NULL;
+  lockGlobalParams;
+
+  if ((fi = sysFonts->find(fontName, font->isFixedWidth(), gTrue))) {
+    path = fi->path->copy();
+    *type = fi->type;
+    *fontNum = fi->fontNum;
+    substituteName.Set(fi->substituteName->getCString());
+  } else {
+    key = fcSubstKey(font, base14Name);
+    if (!(fi = (SysFontInfo *)fcSubstCache->lookup(key))) {
+      // Fontconfig calls are the slow part, and fontconfig is thread
+      // safe: don't hold the lock meanwhile
+      unlockGlobalParams;
+      fi = fcFindFont(font, base14Name);
+      lockGlobalParams;
+      SysFontInfo *fi2;
+      if ((fi2 = (SysFontInfo *)fcSubstCache->lookup(key))) {
+	// another thread did the same
+	delete fi;
+	fi = fi2;
       } else {
-        /* scan all fonts of the list */
-        break;
+	fcSubstCache->add(key->copy(), fi);
+	if (fi->path) {
+	  sysFonts->addFcFont(new SysFontInfo(fi->name->copy(), fi->bold, fi->italic, fi->oblique,
+					      fi->fixedWidth, fi->path->copy(), fi->type,
+					      fi->fontNum, fi->substituteName->copy()));
+	}
+	if (fcSubstCacheFile) {
+	  saveFcSubst(key, fi);
+	}
       }
     }
-    FcFontSetDestroy(set);
+    delete key;
+    if (fi->path) {
+      path = fi->path->copy();
+      *type = fi->type;
+      *fontNum = fi->fontNum;
+    }
+    substituteName.Set(fi->substituteName->getCString());
   }
   if (path == NULL && (fi = sysFonts->find(fontName, font->isFixedWidth(), gFalse))) {
     path = fi->path->copy();
@@ -1314,9 +1607,6 @@ GooString *GlobalParams::findSystemFontFile(GfxFont *font,
   if (substituteFontName) {
     substituteFontName->Set(substituteName.getCString());
   }
-fin:
-  if (p)
-    FcPatternDestroy(p);
   unlockGlobalParams;
   return path;
 }
@@ -1472,6 +1762,24 @@ PSLevel GlobalParams::getPSLevel() {
   return level;
 }
 
+GBool GlobalParams::getPSCFFPassthrough() {
+  GBool f;
+
+  lockGlobalParams;
+  f = psCFFPassthrough;
+  unlockGlobalParams;
+  return f;
+}
+
+GBool GlobalParams::getPSSubsetFonts() {
+  GBool f;
+
+  lockGlobalParams;
+  f = psSubsetFonts;
+  unlockGlobalParams;
+  return f;
+}
+
 GooString *GlobalParams::getPSResidentFont(GooString *fontName) {
   GooString *psName;
 
@@ -1696,6 +2004,7 @@ CharCodeToUnicode *GlobalParams::getCIDToUnicode(GooString *collection) {
   GooString *fileName;
   CharCodeToUnicode *ctu;
 
+  scanEncodingDirs();
   lockGlobalParams;
   if (!(ctu = cidToUnicodeCache->getCharCodeToUnicode(collection))) {
     if ((fileName = (GooString *)cidToUnicodes->lookup(collection)) &&
@@ -1767,6 +2076,8 @@ GooList *GlobalParams::getEncodingNames()
   GooHashIter *iter;
   GooString *key;
   void *val;
+  initResidentUnicodeMaps();
+  scanEncodingDirs();
   residentUnicodeMaps->startIter(&iter);
   while (residentUnicodeMaps->getNext(&iter, &key, &val)) {
     result->append(key);
@@ -1780,6 +2091,261 @@ GooList *GlobalParams::getEncodingNames()
   return result;
 }
 
+//------------------------------------------------------------------------
+// compiled data cache
+//------------------------------------------------------------------------
+
+// A compiled data file is the magic line, a line with the kind and
+// name, one line with the name and identity of each source file, an
+// empty line, a Guint byte order marker, the Guint payload length, and
+// the payload.  The payload
+// is written in native byte order, so files from a machine with a
+// different byte order are simply treated as stale.
+#define compiledDataMagic "%poppler-compiled-data-2\n"
+#define compiledDataByteOrder 0x01020304
+
+static GBool appendCompiledDataSource(GooString *stamp,
+				      GooString *srcFileName) {
+  GooFile *srcFile;
+  GBool ok;
+
+  if (!(srcFile = GooFile::open(srcFileName))) {
+    return gFalse;
+  }
+  stamp->append(srcFileName);
+  stamp->append('\t');
+  ok = srcFile->getIdentity(stamp);
+  stamp->append('\n');
+  delete srcFile;
+  return ok;
+}
+
+GooString *GlobalParams::getCompiledDataFileName(const char *kind,
+						 GooString *name) {
+  GooString *baseName, *fileName;
+  int i;
+  char c;
+
+  baseName = new GooString(kind);
+  baseName->append('-');
+  for (i = 0; i < name->getLength(); ++i) {
+    c = name->getChar(i);
+    baseName->append((c == '/' || c == '\\' || c == ':') ? '_' : c);
+  }
+  lockGlobalParams;
+  fileName = dataCacheDir ? appendToPath(dataCacheDir->copy(),
+					 baseName->getCString())
+                          : (GooString *)NULL;
+  unlockGlobalParams;
+  delete baseName;
+  return fileName;
+}
+
+GBool GlobalParams::hasDataCacheDir() {
+  GBool has;
+
+  lockGlobalParams;
+  has = dataCacheDir != NULL;
+  unlockGlobalParams;
+  return has;
+}
+
+GooString *GlobalParams::loadCompiledData(const char *kind, GooString *name,
+					  GooString *srcFileName,
+					  GooList *srcFileNames) {
+  GooString *fileName, *stamp, *src, *data;
+  GooList *srcs;
+  FILE *f;
+  char *buf, *p, *end, *tab;
+  long len;
+  Guint byteOrder, dataLen;
+  GBool ok;
+  int i;
+
+  if (!(fileName = getCompiledDataFileName(kind, name))) {
+    return NULL;
+  }
+  f = openFile(fileName->getCString(), "rb");
+  delete fileName;
+  if (!f) {
+    return NULL;
+  }
+  if (fseek(f, 0, SEEK_END) != 0 || (len = ftell(f)) <= 0 ||
+      fseek(f, 0, SEEK_SET) != 0) {
+    fclose(f);
+    return NULL;
+  }
+  buf = (char *)gmalloc(len);
+  ok = (long)fread(buf, 1, len, f) == len;
+  fclose(f);
+  end = buf + len;
+
+  // check the header
+  stamp = GooString::format("{0:s}{1:s}\t{2:t}\n",
+			    compiledDataMagic, kind, name);
+  ok = ok && len > stamp->getLength() &&
+       !memcmp(buf, stamp->getCString(), stamp->getLength());
+  p = buf + stamp->getLength();
+  delete stamp;
+
+  // check the source files, the first of which must be srcFileName
+  srcs = new GooList();
+  while (ok && p < end && *p != '\n') {
+    for (tab = p; tab < end && *tab != '\t' && *tab != '\n'; ++tab) ;
+    if (tab == end || *tab != '\t') {
+      ok = gFalse;
+      break;
+    }
+    src = new GooString(p, (int)(tab - p));
+    stamp = new GooString();
+    if (appendCompiledDataSource(stamp, src) &&
+	end - p >= stamp->getLength() &&
+	!memcmp(p, stamp->getCString(), stamp->getLength())) {
+      p += stamp->getLength();
+      srcs->append(src);
+    } else {
+      ok = gFalse;
+      delete src;
+    }
+    delete stamp;
+  }
+  ok = ok && p < end && srcs->getLength() > 0 &&
+       !((GooString *)srcs->get(0))->cmp(srcFileName);
+  ++p;
+
+  data = NULL;
+  if (ok && end - p >= 2 * (long)sizeof(Guint)) {
+    memcpy(&byteOrder, p, sizeof(Guint));
+    memcpy(&dataLen, p + sizeof(Guint), sizeof(Guint));
+    p += 2 * sizeof(Guint);
+    if (byteOrder == compiledDataByteOrder && dataLen == (Guint)(end - p)) {
+      data = new GooString(p, (int)(end - p));
+      if (srcFileNames) {
+	for (i = 0; i < srcs->getLength(); ++i) {
+	  srcFileNames->append(((GooString *)srcs->get(i))->copy());
+	}
+      }
+    }
+  }
+  deleteGooList(srcs, GooString);
+  gfree(buf);
+  return data;
+}
+
+void GlobalParams::saveCompiledData(const char *kind, GooString *name,
+				    GooList *srcFileNames, GooString *data) {
+  GooString *fileName, *tmpFileName, *hdr;
+  FILE *f;
+  Guint byteOrder, dataLen;
+  GBool ok;
+  int i;
+
+  if (!(fileName = getCompiledDataFileName(kind, name))) {
+    return;
+  }
+  hdr = GooString::format("{0:s}{1:s}\t{2:t}\n",
+			  compiledDataMagic, kind, name);
+  for (i = 0; i < srcFileNames->getLength(); ++i) {
+    if (!appendCompiledDataSource(hdr, (GooString *)srcFileNames->get(i))) {
+      delete hdr;
+      delete fileName;
+      return;
+    }
+  }
+  hdr->append('\n');
+  byteOrder = compiledDataByteOrder;
+  hdr->append((char *)&byteOrder, sizeof(Guint));
+  dataLen = (Guint)data->getLength();
+  hdr->append((char *)&dataLen, sizeof(Guint));
+
+  // write to a private file and rename it, so that concurrent readers
+  // never see a partial file
+#ifdef _WIN32
+  tmpFileName = GooString::format("{0:t}.{1:d}", fileName,
+				  (int)GetCurrentProcessId());
+#else
+  tmpFileName = GooString::format("{0:t}.{1:d}", fileName, (int)getpid());
+#endif
+  if ((f = openFile(tmpFileName->getCString(), "wb"))) {
+    ok = fwrite(hdr->getCString(), 1, hdr->getLength(), f) ==
+           (size_t)hdr->getLength() &&
+         fwrite(data->getCString(), 1, data->getLength(), f) ==
+           (size_t)data->getLength();
+    if (fclose(f) != 0) {
+      ok = gFalse;
+    }
+#ifdef _WIN32
+    if (ok) {
+      remove(fileName->getCString());
+    }
+#endif
+    if (!ok || rename(tmpFileName->getCString(), fileName->getCString())) {
+      error(errIO, -1, "Couldn't write compiled data file '{0:t}'", fileName);
+      remove(tmpFileName->getCString());
+    }
+  } else {
+    error(errIO, -1, "Couldn't write compiled data file '{0:t}'", fileName);
+  }
+  delete tmpFileName;
+  delete hdr;
+  delete fileName;
+}
+
+int *GlobalParams::getCodeToGIDMap(GooString *key, int *len) {
+  GooString *k;
+  int *map;
+  int i, j, l;
+
+  map = NULL;
+  lockGlobalParams;
+  for (i = 0; i < codeToGIDCacheSize && codeToGIDKeys[i]; ++i) {
+    if (!codeToGIDKeys[i]->cmp(key)) {
+      k = codeToGIDKeys[i];
+      map = codeToGIDMaps[i];
+      l = codeToGIDLens[i];
+      for (j = i; j >= 1; --j) {
+	codeToGIDKeys[j] = codeToGIDKeys[j - 1];
+	codeToGIDMaps[j] = codeToGIDMaps[j - 1];
+	codeToGIDLens[j] = codeToGIDLens[j - 1];
+      }
+      codeToGIDKeys[0] = k;
+      codeToGIDMaps[0] = map;
+      codeToGIDLens[0] = l;
+      map = (int *)gmallocn(l, sizeof(int));
+      memcpy(map, codeToGIDMaps[0], l * sizeof(int));
+      *len = l;
+      break;
+    }
+  }
+  unlockGlobalParams;
+  return map;
+}
+
+void GlobalParams::addCodeToGIDMap(GooString *key, int *map, int len) {
+  int i;
+
+  lockGlobalParams;
+  for (i = 0; i < codeToGIDCacheSize && codeToGIDKeys[i]; ++i) {
+    if (!codeToGIDKeys[i]->cmp(key)) {
+      // another thread got there first
+      unlockGlobalParams;
+      return;
+    }
+  }
+  delete codeToGIDKeys[codeToGIDCacheSize - 1];
+  gfree(codeToGIDMaps[codeToGIDCacheSize - 1]);
+  for (i = codeToGIDCacheSize - 1; i >= 1; --i) {
+    codeToGIDKeys[i] = codeToGIDKeys[i - 1];
+    codeToGIDMaps[i] = codeToGIDMaps[i - 1];
+    codeToGIDLens[i] = codeToGIDLens[i - 1];
+  }
+  codeToGIDKeys[0] = key->copy();
+  codeToGIDMaps[0] = (int *)gmallocn(len, sizeof(int));
+  memcpy(codeToGIDMaps[0], map, len * sizeof(int));
+  codeToGIDLens[0] = len;
+  unlockGlobalParams;
+}
+
 //------------------------------------------------------------------------
 // functions to set parameters
 //------------------------------------------------------------------------
@@ -1790,6 +2356,23 @@ void GlobalParams::addFontFile(GooString *fontName, GooString *path) {
   unlockGlobalParams;
 }
 
+void GlobalParams::setFontSubstCacheFile(char *fileName) {
+  lockGlobalParams;
+  delete fcSubstCacheFile;
+  fcSubstCacheFile = new GooString(fileName);
+#if WITH_FONTCONFIGURATION_FONTCONFIG
+  loadFcSubstCache();
+#endif
+  unlockGlobalParams;
+}
+
+void GlobalParams::setDataCacheDir(char *dir) {
+  lockGlobalParams;
+  delete dataCacheDir;
+  dataCacheDir = new GooString(dir);
+  unlockGlobalParams;
+}
+
 void GlobalParams::setPSFile(char *file) {
   lockGlobalParams;
   if (psFile) {
@@ -1823,6 +2406,18 @@ void GlobalParams::setPSLevel(PSLevel level) {
   unlockGlobalParams;
 }
 
+void GlobalParams::setPSCFFPassthrough(GBool passthrough) {
+  lockGlobalParams;
+  psCFFPassthrough = passthrough;
+  unlockGlobalParams;
+}
+
+void GlobalParams::setPSSubsetFonts(GBool subset) {
+  lockGlobalParams;
+  psSubsetFonts = subset;
+  unlockGlobalParams;
+}
+
 void GlobalParams::setTextEncoding(char *encodingName) {
   lockGlobalParams;
   delete textEncoding;
@@ -64,6 +64,7 @@ class GlobalParams;
 class GfxFont;
 class Stream;
 class SysFontList;
+class SysFontInfo;
 
 //------------------------------------------------------------------------
 
@@ -72,6 +73,10 @@ extern GlobalParams *globalParams;
 
 //------------------------------------------------------------------------
 
+#define codeToGIDCacheSize 4
+
+//------------------------------------------------------------------------
+
 enum SysFontType {
   sysFontPFA,
   sysFontPFB,
@@ -151,6 +156,7 @@ public:
   UnicodeMap *getResidentUnicodeMap(GooString *encodingName);
   FILE *getUnicodeMapFile(GooString *encodingName);
   FILE *findCMapFile(GooString *collection, GooString *cMapName);
+  GooString *findCMapFileName(GooString *collection, GooString *cMapName);
   FILE *findToUnicodeFile(GooString *name);
   GooString *findFontFile(GooString *fontName);
   GooString *findBase14FontFile(GooString *base14Name, GfxFont *font);
@@ -162,6 +168,8 @@ public:
   GBool getPSShrinkLarger();
   GBool getPSCenter();
   PSLevel getPSLevel();
+  GBool getPSCFFPassthrough();
+  GBool getPSSubsetFonts();
   GooString *getPSResidentFont(GooString *fontName);
   GooList *getPSResidentFonts();
   PSFontParam16 *getPSResidentFont16(GooString *fontName, int wMode);
@@ -197,13 +205,47 @@ public:
 
   GooList *getEncodingNames();
 
+  //----- compiled data cache
+
+  // Return true if a data cache dir has been set.
+  GBool hasDataCacheDir();
+  // Return the payload of the compiled form of <name> (of type <kind>)
+  // built from <srcFileName>, or NULL if there is no data cache dir or
+  // the compiled form is missing or stale.  Appends the names of all
+  // the files the compiled form was built from to <srcFileNames>, if
+  // that's non-NULL.
+  GooString *loadCompiledData(const char *kind, GooString *name,
+			      GooString *srcFileName, GooList *srcFileNames);
+  // Store <data> as the compiled form of <name> (of type <kind>) built
+  // from <srcFileNames> [GooString], the first of which is the main
+  // source file.  Does nothing if there is no data cache dir.
+  void saveCompiledData(const char *kind, GooString *name,
+			GooList *srcFileNames, GooString *data);
+
+  //----- code-to-GID map cache
+
+  // Return a copy of the code-to-GID map stored with <key> and set
+  // <len> to its length, or return NULL if there is none.
+  int *getCodeToGIDMap(GooString *key, int *len);
+  // Store a copy of the code-to-GID map <map> with <key>.
+  void addCodeToGIDMap(GooString *key, int *map, int len);
+
   //----- functions to set parameters
   void addFontFile(GooString *fontName, GooString *path);
+  // Keep the fontconfig substitutions for non-embedded fonts in fileName
+  // too, so that other processes don't need to compute them again. The
+  // file is discarded when the fontconfig setup changes.
+  void setFontSubstCacheFile(char *fileName);
+  // Keep compiled (binary) copies of the CMap and cidToUnicode files in
+  // dir, so that later processes don't need to parse the text files.
+  void setDataCacheDir(char *dir);
   void setPSFile(char *file);
   void setPSExpandSmaller(GBool expand);
   void setPSShrinkLarger(GBool shrink);
   void setPSCenter(GBool center);
   void setPSLevel(PSLevel level);
+  void setPSCFFPassthrough(GBool passthrough);
+  void setPSSubsetFonts(GBool subset);
   void setTextEncoding(char *encodingName);
   GBool setTextEOL(char *s);
   void setTextPageBreaks(GBool pageBreaks);
@@ -237,7 +279,12 @@ private:
   void parseNameToUnicode(GooString *name);
   UnicodeMap *getUnicodeMap2(GooString *encodingName);
 
+  void initNameToUnicode();
+  void initResidentUnicodeMaps();
   void scanEncodingDirs();
+  GooString *getCompiledDataFileName(const char *kind, GooString *name);
+  void loadFcSubstCache();
+  void saveFcSubst(GooString *key, SysFontInfo *fi);
   void addCIDToUnicode(GooString *collection, GooString *fileName);
   void addUnicodeMap(GooString *encodingName, GooString *fileName);
   void addCMapDir(GooString *collection, GooString *dir);
@@ -265,6 +312,13 @@ private:
   GooHash *cMapDirs;		// list of CMap dirs, indexed by collection
 				//   name [GooList[GooString]]
   GooList *toUnicodeDirs;		// list of ToUnicode CMap dirs [GooString]
+  int nameToUnicodeInitialized;	// the nameToUnicode tables are set up;
+				//   set and read with gAtomic*
+				//   when MULTITHREADED
+  GBool residentUnicodeMapsInitialized; // residentUnicodeMaps is set up
+  GBool encodingDirsScanned;	// the poppler data dirs have been scanned
+  GooString *dataCacheDir;	// dir for compiled CMap/cidToUnicode files,
+				//   or NULL
   GBool baseFontsInitialized;
 #ifdef _WIN32
   GooHash *substFiles;	// windows font substitutes (for CID fonts)
@@ -275,11 +329,18 @@ private:
   GooHash *ccFontFiles;	// character collection font files:
 				//   collection name  mapped to path [GString]
   SysFontList *sysFonts;	// system fonts
+  GooHash *fcSubstCache;	// fontconfig substitutions: font name, flags
+				//   etc. mapped to result [SysFontInfo]
+  GooString *fcSubstCacheFile;	// file to keep fcSubstCache in, or NULL
+  GBool fcSubstCacheFileOk;	// fcSubstCacheFile has the right stamp
   GooString *psFile;		// PostScript file or command (for xpdf)
   GBool psExpandSmaller;	// expand smaller pages to fill paper
   GBool psShrinkLarger;		// shrink larger pages to fit paper
   GBool psCenter;		// center pages on the paper
   PSLevel psLevel;		// PostScript level to generate
+  GBool psCFFPassthrough;	// embed CFF fonts as-is (Level 3 only)
+  GBool psSubsetFonts;		// embed only the glyphs used on the
+				//   printed pages (CFF fonts only)
   GooHash *psResidentFonts;	// 8-bit fonts resident in printer:
 				//   PDF font name mapped to PS font name
 				//   [GString]
@@ -317,6 +378,9 @@ private:
   CharCodeToUnicodeCache *unicodeToUnicodeCache;
   UnicodeMapCache *unicodeMapCache;
   CMapCache *cMapCache;
+  GooString *codeToGIDKeys[codeToGIDCacheSize];	// code-to-GID maps, most
+  int *codeToGIDMaps[codeToGIDCacheSize];	//   recently used first
+  int codeToGIDLens[codeToGIDCacheSize];
   
 #ifdef ENABLE_PLUGINS
   GooList *plugins;		// list of plugins [Plugin]
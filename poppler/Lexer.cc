@@ -65,6 +65,44 @@ static const char specialChars[256] = {
 static const int IntegerSafeLimit = (INT_MAX - 9) / 10;
 static const long long LongLongSafeLimit = (LLONG_MAX - 9) / 10;
 
+//------------------------------------------------------------------------
+// LexerStream
+//------------------------------------------------------------------------
+
+// The lexer's current stream, as returned by Lexer::getStream().  Reads
+// take the chars in the lexer's buffer first.
+class LexerStream: public Stream {
+public:
+
+  LexerStream(Lexer *lexerA) { lexer = lexerA; }
+  virtual ~LexerStream() {}
+  virtual StreamKind getKind() { return str()->getKind(); }
+  virtual void reset() { lexer->initBuf(); str()->reset(); }
+  virtual void close() { str()->close(); }
+  virtual int getChar() { return lexer->getRawChar(); }
+  virtual int lookChar() { return lexer->lookChar(); }
+  virtual int getUnfilteredChar() { return str()->getUnfilteredChar(); }
+  virtual void unfilteredReset() { str()->unfilteredReset(); }
+  virtual Goffset getPos() { return lexer->getPos(); }
+  virtual void setPos(Goffset pos, int dir = 0) { lexer->setPos(pos, dir); }
+  virtual GooString *getPSFilter(int psLevel, const char *indent)
+    { return str()->getPSFilter(psLevel, indent); }
+  virtual GBool isBinary(GBool last = gTrue) { return str()->isBinary(last); }
+  virtual BaseStream *getBaseStream() { return str()->getBaseStream(); }
+  virtual Stream *getUndecodedStream() { return this; }
+  virtual Dict *getDict() { return str()->getDict(); }
+
+private:
+
+  virtual GBool hasGetChars() { return true; }
+  virtual int getChars(int nChars, Guchar *buffer)
+    { return lexer->getRawChars(nChars, buffer); }
+
+  Stream *str() { return lexer->curStr.getStream(); }
+
+  Lexer *lexer;
+};
+
 //------------------------------------------------------------------------
 // Lexer
 //------------------------------------------------------------------------
@@ -72,8 +110,9 @@ static const long long LongLongSafeLimit = (LLONG_MAX - 9) / 10;
 Lexer::Lexer(XRef *xrefA, Stream *str) {
   Object obj;
 
-  lookCharLastValueCached = LOOK_VALUE_NOT_CACHED;
   xref = xrefA;
+  rawStr = NULL;
+  initBuf();
 
   curStr.initStream(str);
   streams = new Array(xref);
@@ -86,8 +125,9 @@ Lexer::Lexer(XRef *xrefA, Stream *str) {
 Lexer::Lexer(XRef *xrefA, Object *obj) {
   Object obj2;
 
-  lookCharLastValueCached = LOOK_VALUE_NOT_CACHED;
   xref = xrefA;
+  rawStr = NULL;
+  initBuf();
 
   if (obj->isStream()) {
     streams = new Array(xref);
@@ -105,6 +145,7 @@ Lexer::Lexer(XRef *xrefA, Object *obj) {
 }
 
 Lexer::~Lexer() {
+  delete rawStr;
   if (!curStr.isNone()) {
     curStr.streamClose();
     curStr.free();
@@ -114,48 +155,147 @@ Lexer::~Lexer() {
   }
 }
 
-int Lexer::getChar(GBool comesFromLook) {
-  int c;
+void Lexer::initBuf() {
+  bufPtr = bufEnd = buf;
+  bufReadSize = lexBufMinSize;
+}
+
+// Refill the (empty) buffer from the current stream.  The first reads
+// are short, so that parsing a small object does not read far ahead.
+GBool Lexer::fillBuf() {
+  int n;
 
-  if (LOOK_VALUE_NOT_CACHED != lookCharLastValueCached) {
-    c = lookCharLastValueCached;
-    lookCharLastValueCached = LOOK_VALUE_NOT_CACHED;
-    return c;
+  if (!curStr.isStream()) {
+    return gFalse;
   }
+  n = curStr.getStream()->doGetChars(bufReadSize, buf);
+  if (bufReadSize < lexBufSize) {
+    bufReadSize *= 2;
+  }
+  bufPtr = buf;
+  bufEnd = buf + (n > 0 ? n : 0);
+  return n > 0;
+}
 
-  c = EOF;
-  while (!curStr.isNone() && (c = curStr.streamGetChar()) == EOF) {
-    if (comesFromLook == gTrue) {
+int Lexer::getNextChar() {
+  while (!fillBuf()) {
+    if (curStr.isNone()) {
       return EOF;
-    } else {
-      curStr.streamClose();
-      curStr.free();
-      ++strPtr;
-      if (strPtr < streams->getLength()) {
-        streams->get(strPtr, &curStr);
-        curStr.streamReset();
-      }
+    }
+    curStr.streamClose();
+    curStr.free();
+    ++strPtr;
+    if (strPtr < streams->getLength()) {
+      streams->get(strPtr, &curStr);
+      curStr.streamReset();
     }
   }
-  return c;
+  return *bufPtr++;
 }
 
-int Lexer::lookChar() {
-  
-  if (LOOK_VALUE_NOT_CACHED != lookCharLastValueCached) {
-    return lookCharLastValueCached;
+int Lexer::getRawChars(int nChars, Guchar *buffer) {
+  int n, m;
+
+  n = (int)(bufEnd - bufPtr);
+  if (n > nChars) {
+    n = nChars;
   }
-  lookCharLastValueCached = getChar(gTrue);
-  if (lookCharLastValueCached == EOF) {
-    lookCharLastValueCached = LOOK_VALUE_NOT_CACHED;
-    return EOF;
-  } else {
-    return lookCharLastValueCached;
+  memcpy(buffer, bufPtr, n);
+  bufPtr += n;
+  if (n < nChars && curStr.isStream()) {
+    m = curStr.getStream()->doGetChars(nChars - n, buffer + n);
+    if (m > 0) {
+      n += m;
+    }
+  }
+  return n;
+}
+
+Stream *Lexer::getStream() {
+  if (!curStr.isStream()) {
+    return NULL;
+  }
+  if (!rawStr) {
+    rawStr = new LexerStream(this);
+  }
+  return rawStr;
+}
+
+// The position of a filtered stream is that of the undecoded data,
+// which the buffered (decoded) chars can't be taken off.
+Goffset Lexer::getPos() {
+  Stream *str;
+
+  if (!curStr.isStream()) {
+    return -1;
+  }
+  str = curStr.getStream();
+  if (str->getBaseStream() != str) {
+    return str->getPos();
+  }
+  return str->getPos() - (bufEnd - bufPtr);
+}
+
+void Lexer::setPos(Goffset pos, int dir) {
+  initBuf();
+  if (curStr.isStream()) {
+    curStr.streamSetPos(pos, dir);
   }
 }
 
+// Read a number that ends inside the buffer and fits in an int, without
+// the per-char overflow checks.  <c> is the first char of the number.
+// Returns false, without reading anything, if the slow path is needed.
+GBool Lexer::getNumber(int c, Object *obj) {
+  Guchar *p;
+  GBool neg;
+  int xi, nDigits;
+  double xf, scale;
+
+  p = bufPtr;
+  neg = gFalse;
+  xi = 0;
+  nDigits = 0;
+  if (c == '-') {
+    neg = gTrue;
+  } else if (c != '+' && c != '.') {
+    xi = c - '0';
+    nDigits = 1;
+  }
+  if (c != '.') {
+    while (p < bufEnd && *p >= '0' && *p <= '9') {
+      if (++nDigits > 9) {
+	return gFalse;
+      }
+      xi = xi * 10 + (*p++ - '0');
+    }
+    if (p == bufEnd) {
+      return gFalse;
+    }
+    if (*p != '.') {
+      bufPtr = p;
+      obj->initInt(neg ? -xi : xi);
+      return gTrue;
+    }
+    ++p;
+  }
+  xf = xi;
+  scale = 0.1;
+  while (p < bufEnd && *p >= '0' && *p <= '9') {
+    xf = xf + scale * (*p++ - '0');
+    scale *= 0.1;
+  }
+  if (p == bufEnd || *p == '-') {
+    return gFalse;
+  }
+  bufPtr = p;
+  obj->initReal(neg ? -xf : xf);
+  return gTrue;
+}
+
 Object *Lexer::getObj(Object *obj, int objNum) {
   char *p;
+  Guchar *q;
   int c, c2;
   GBool comment, neg, done, overflownInteger, overflownLongLong;
   int numParen;
@@ -188,6 +328,9 @@ Object *Lexer::getObj(Object *obj, int objNum) {
   case '0': case '1': case '2': case '3': case '4':
   case '5': case '6': case '7': case '8': case '9':
   case '+': case '-': case '.':
+    if (getNumber(c, obj)) {
+      break;
+    }
     overflownInteger = gFalse;
     overflownLongLong = gFalse;
     neg = gFalse;
@@ -382,7 +525,7 @@ Object *Lexer::getObj(Object *obj, int objNum) {
 	  // we are growing see if the document is not malformed and we are growing too much
 	  if (objNum > 0 && xref != NULL)
 	  {
-	    int newObjNum = xref->getNumEntry(curStr.streamGetPos());
+	    int newObjNum = xref->getNumEntry(getPos());
 	    if (newObjNum != objNum)
 	    {
 	      error(errSyntaxError, getPos(), "Unterminated string");
@@ -409,6 +552,16 @@ Object *Lexer::getObj(Object *obj, int objNum) {
 
   // name
   case '/':
+    // the whole name is in the buffer and has no escapes
+    for (q = bufPtr; q < bufEnd && !specialChars[*q] && *q != '#'; ++q) ;
+    n = (int)(q - bufPtr);
+    if (q < bufEnd && *q != '#' && n < tokBufSize) {
+      memcpy(tokBuf, bufPtr, n);
+      tokBuf[n] = '\0';
+      bufPtr = q;
+      obj->initName(tokBuf);
+      break;
+    }
     p = tokBuf;
     n = 0;
     s = NULL;
@@ -554,18 +707,28 @@ Object *Lexer::getObj(Object *obj, int objNum) {
 
   // command
   default:
-    p = tokBuf;
-    *p++ = c;
-    n = 1;
-    while ((c = lookChar()) != EOF && !specialChars[c]) {
-      getChar();
-      if (++n == tokBufSize) {
-	error(errSyntaxError, getPos(), "Command token too long");
-	break;
-      }
+    for (q = bufPtr; q < bufEnd && !specialChars[*q]; ++q) ;
+    n = (int)(q - bufPtr) + 1;
+    if (q < bufEnd && n < tokBufSize) {
+      // the whole command is in the buffer
+      tokBuf[0] = c;
+      memcpy(tokBuf + 1, bufPtr, n - 1);
+      tokBuf[n] = '\0';
+      bufPtr = q;
+    } else {
+      p = tokBuf;
       *p++ = c;
+      n = 1;
+      while ((c = lookChar()) != EOF && !specialChars[c]) {
+	getChar();
+	if (++n == tokBufSize) {
+	  error(errSyntaxError, getPos(), "Command token too long");
+	  break;
+	}
+	*p++ = c;
+      }
+      *p = '\0';
     }
-    *p = '\0';
     if (tokBuf[0] == 't' && !strcmp(tokBuf, "true")) {
       obj->initBool(gTrue);
     } else if (tokBuf[0] == 'f' && !strcmp(tokBuf, "false")) {
@@ -34,8 +34,11 @@
 #include "Stream.h"
 
 class XRef;
+class LexerStream;
 
 #define tokBufSize 128		// size of token buffer
+#define lexBufMinSize 256	// size of the first read from a stream
+#define lexBufSize 4096		// size of the input buffer
 
 //------------------------------------------------------------------------
 // Lexer
@@ -65,44 +68,53 @@ public:
   // Skip over one character.
   void skipChar() { getChar(); }
 
-  // Get stream.
-  Stream *getStream()
-    { return curStr.isStream() ? curStr.getStream() : (Stream *)NULL; }
+  // Get the current stream.  Reading from it continues right after the
+  // last character used by the lexer (the lexer's read-ahead buffer is
+  // read first), and the lexer carries on after whatever was read.
+  Stream *getStream();
 
-  // Get current position in file.  This is only used for error
-  // messages.
-  Goffset getPos()
-    { return curStr.isStream() ? curStr.streamGetPos() : -1; }
+  // Get current position in file.
+  Goffset getPos();
 
   // Set position in file.
-  void setPos(Goffset pos, int dir = 0)
-    { if (curStr.isStream()) curStr.streamSetPos(pos, dir); }
+  void setPos(Goffset pos, int dir = 0);
 
   // Returns true if <c> is a whitespace character.
   static GBool isSpace(int c);
 
-
-  // often (e.g. ~30% on PDF Refernce 1.6 pdf file from Adobe site) getChar
-  // is called right after lookChar. In order to avoid expensive re-doing
-  // getChar() of underlying stream, we cache the last value found by
-  // lookChar() in lookCharLastValueCached. A special value 
-  // LOOK_VALUE_NOT_CACHED that should never be part of stream indicates
-  // that no value was cached
-  static const int LOOK_VALUE_NOT_CACHED = -3;
-  int lookCharLastValueCached;
-
 private:
 
-  int getChar(GBool comesFromLook = gFalse);
-  int lookChar();
+  // Get the next char, moving on to the next stream at the end of the
+  // current one.
+  int getChar()
+    { return bufPtr < bufEnd ? *bufPtr++ : getNextChar(); }
+  // Look at the next char of the current stream.
+  int lookChar()
+    { return (bufPtr < bufEnd || fillBuf()) ? *bufPtr : EOF; }
+  // Get the next char of the current stream.
+  int getRawChar()
+    { return (bufPtr < bufEnd || fillBuf()) ? *bufPtr++ : EOF; }
+  int getRawChars(int nChars, Guchar *buffer);
+
+  int getNextChar();
+  GBool fillBuf();
+  void initBuf();
+  GBool getNumber(int c, Object *obj);
 
   Array *streams;		// array of input streams
   int strPtr;			// index of current stream
   Object curStr;		// current stream
   GBool freeArray;		// should lexer free the streams array?
   char tokBuf[tokBufSize];	// temporary token buffer
+  Guchar buf[lexBufSize];	// input buffer
+  Guchar *bufPtr;		// next char in input buffer
+  Guchar *bufEnd;		// end of valid data in input buffer
+  int bufReadSize;		// size of the next read from the stream
+  LexerStream *rawStr;		// stream returned by getStream()
 
   XRef *xref;
+
+  friend class LexerStream;
 };
 
 #endif
@@ -25,10 +25,10 @@ LocalPDFDocBuilder::buildPDFDoc(
   if (uri.cmpN("file://", 7) == 0) {
      GooString *fileName = uri.copy();
      fileName->del(0, 7);
-     return new PDFDoc(fileName, ownerPassword, userPassword, guiDataA);
+     return new PDFDoc(fileName, ownerPassword, userPassword, guiDataA, docCache);
   } else {
      GooString *fileName = uri.copy();
-     return new PDFDoc(fileName, ownerPassword, userPassword, guiDataA);
+     return new PDFDoc(fileName, ownerPassword, userPassword, guiDataA, docCache);
   }
 }
 
@@ -14,20 +14,30 @@
 
 #include "PDFDocBuilder.h"
 
+class PDFDocCache;
+
 //------------------------------------------------------------------------
 // LocalPDFDocBuilder
 //
 // The LocalPDFDocBuilder implements a PDFDocBuilder for local files.
+// With a PDFDocCache, the xref tables of the files are shared with the
+// other documents built from the same cache.
 //------------------------------------------------------------------------
 
 class LocalPDFDocBuilder : public PDFDocBuilder {
 
 public:
 
+  LocalPDFDocBuilder(PDFDocCache *docCacheA = NULL) { docCache = docCacheA; }
+
   PDFDoc *buildPDFDoc(const GooString &uri, GooString *ownerPassword = NULL,
     GooString *userPassword = NULL, void *guiDataA = NULL);
   GBool supports(const GooString &uri);
 
+private:
+
+  PDFDocCache *docCache;
+
 };
 
 #endif /* LOCALPDFDOCBUILDER_H */
@@ -94,7 +94,9 @@ Object *Object::copy(Object *obj) {
     obj->string = string->copy();
     break;
   case objName:
-    obj->name = copyString(name);
+    if (!shortStr) {
+      obj->name = copyString(name);
+    }
     break;
   case objArray:
     array->incRef();
@@ -106,7 +108,9 @@ Object *Object::copy(Object *obj) {
     stream->incRef();
     break;
   case objCmd:
-    obj->cmd = copyString(cmd);
+    if (!shortStr) {
+      obj->cmd = copyString(cmd);
+    }
     break;
   default:
     break;
@@ -128,7 +132,9 @@ void Object::free() {
     delete string;
     break;
   case objName:
-    gfree(name);
+    if (!shortStr) {
+      gfree(name);
+    }
     break;
   case objArray:
     if (!array->decRef()) {
@@ -146,7 +152,9 @@ void Object::free() {
     }
     break;
   case objCmd:
-    gfree(cmd);
+    if (!shortStr) {
+      gfree(cmd);
+    }
     break;
   default:
     break;
@@ -181,7 +189,7 @@ void Object::print(FILE *f) {
     fprintf(f, ")");
     break;
   case objName:
-    fprintf(f, "/%s", name);
+    fprintf(f, "/%s", getStr());
     break;
   case objNull:
     fprintf(f, "null");
@@ -214,7 +222,7 @@ void Object::print(FILE *f) {
     fprintf(f, "%d %d R", ref.num, ref.gen);
     break;
   case objCmd:
-    fprintf(f, "%s", cmd);
+    fprintf(f, "%s", getStr());
     break;
   case objError:
     fprintf(f, "<error>");
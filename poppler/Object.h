@@ -102,6 +102,9 @@ enum ObjType {
 
 #define numObjTypes 15		// total number of object types
 
+// names and commands shorter than this are stored in the Object itself
+#define objShortStrSize 8
+
 //------------------------------------------------------------------------
 // Object
 //------------------------------------------------------------------------
@@ -115,7 +118,7 @@ enum ObjType {
 class Object {
 public:
   // clear the anonymous union as best we can -- clear at least a pointer
-  void zeroUnion() { this->name = NULL; }
+  void zeroUnion() { this->name = NULL; shortStr = gFalse; }
 
   // Default constructor.
   Object():
@@ -131,7 +134,7 @@ public:
   Object *initString(GooString *stringA)
     { initObj(objString); string = stringA; return this; }
   Object *initName(const char *nameA)
-    { initObj(objName); name = copyString(nameA); return this; }
+    { initObj(objName); initStr(nameA); return this; }
   Object *initNull()
     { initObj(objNull); return this; }
   Object *initArray(XRef *xref);
@@ -141,7 +144,7 @@ public:
   Object *initRef(int numA, int genA)
     { initObj(objRef); ref.num = numA; ref.gen = genA; return this; }
   Object *initCmd(char *cmdA)
-    { initObj(objCmd); cmd = copyString(cmdA); return this; }
+    { initObj(objCmd); initStr(cmdA); return this; }
   Object *initError()
     { initObj(objError); return this; }
   Object *initEOF()
@@ -156,6 +159,14 @@ public:
     return obj;
   }
 
+  // Move the object to <obj> (which must not hold anything), leaving
+  // this one null.
+  Object *move(Object *obj) {
+    *obj = *this;
+    initNull();
+    return obj;
+  }
+
   // If object is a Ref, fetch and return the referenced object.
   // Otherwise, return a copy of the object.
   Object *fetch(XRef *xref, Object *obj, int recursion = 0);
@@ -184,11 +195,11 @@ public:
 
   // Special type checking.
   GBool isName(const char *nameA)
-    { return type == objName && !strcmp(name, nameA); }
+    { return type == objName && !strcmp(getStr(), nameA); }
   GBool isDict(const char *dictType);
   GBool isStream(char *dictType);
   GBool isCmd(const char *cmdA)
-    { return type == objCmd && !strcmp(cmd, cmdA); }
+    { return type == objCmd && !strcmp(getStr(), cmdA); }
 
   // Accessors.
   GBool getBool() { OBJECT_TYPE_CHECK(objBool); return booln; }
@@ -204,14 +215,20 @@ public:
   // because the object it's not expected to have a NULL string.
   GooString *takeString() {
     OBJECT_TYPE_CHECK(objString); GooString *s = string; string = NULL; return s; }
-  char *getName() { OBJECT_TYPE_CHECK(objName); return name; }
+  char *getName() { OBJECT_TYPE_CHECK(objName); return getStr(); }
+  // Return the name as a string owned by the caller.  After takeName()
+  // the only method that should be called for the object is free().
+  char *takeName() {
+    OBJECT_TYPE_CHECK(objName);
+    if (shortStr) return copyString(str);
+    char *s = name; name = NULL; return s; }
   Array *getArray() { OBJECT_TYPE_CHECK(objArray); return array; }
   Dict *getDict() { OBJECT_TYPE_CHECK(objDict); return dict; }
   Stream *getStream() { OBJECT_TYPE_CHECK(objStream); return stream; }
   Ref getRef() { OBJECT_TYPE_CHECK(objRef); return ref; }
   int getRefNum() { OBJECT_TYPE_CHECK(objRef); return ref.num; }
   int getRefGen() { OBJECT_TYPE_CHECK(objRef); return ref.gen; }
-  char *getCmd() { OBJECT_TYPE_CHECK(objCmd); return cmd; }
+  char *getCmd() { OBJECT_TYPE_CHECK(objCmd); return getStr(); }
   long long getInt64() { OBJECT_TYPE_CHECK(objInt64); return int64g; }
 
   // Array accessors.
@@ -253,7 +270,21 @@ public:
 
 private:
 
+  // Set the value of a name or command.
+  void initStr(const char *s) {
+    size_t n = strlen(s) + 1;
+    if (n <= objShortStrSize) {
+      memcpy(str, s, n);
+      shortStr = gTrue;
+    } else {
+      name = (char *)gmalloc(n);
+      memcpy(name, s, n);
+    }
+  }
+  char *getStr() { return shortStr ? str : name; }
+
   ObjType type;			// object type
+  GBool shortStr;		// name or command is stored in <str>
   union {			// value for each type:
     GBool booln;		//   boolean
     int intg;			//   integer
@@ -266,6 +297,7 @@ private:
     Stream *stream;		//   stream
     Ref ref;			//   indirect reference
     char *cmd;			//   command
+    char str[objShortStrSize];	//   short name or command
   };
 
 #ifdef DEBUG_MEM
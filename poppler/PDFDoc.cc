@@ -50,7 +50,9 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdarg.h>
 #include <string.h>
+#include <limits.h>
 #include <time.h>
 #include <sys/stat.h>
 #include "goo/gstrtod.h"
@@ -75,7 +77,14 @@
 #include "Outline.h"
 #endif
 #include "PDFDoc.h"
+#include "PDFPageWriter.h"
+#include "PDFDocCache.h"
 #include "Hints.h"
+#include "Gfx.h"
+#include "CachedFile.h"
+#ifdef ENABLE_ZLIB_ENCODER
+#include "FlateEncoder.h"
+#endif
 
 #if MULTITHREADED
 #  define pdfdocLocker()   MutexLocker locker(&mutex)
@@ -96,6 +105,9 @@
 #define xrefSearchSize 1024	// read this many bytes at end of file
 				//   to look for 'startxref'
 
+#define objStmMaxObjects 100	// max number of objects packed into one
+				//   object stream by saveCompressedRewrite
+
 //------------------------------------------------------------------------
 // PDFDoc
 //------------------------------------------------------------------------
@@ -120,6 +132,8 @@ void PDFDoc::init()
   startXRefPos = -1;
   secHdlr = NULL;
   pageCache = NULL;
+  pagePrefetching = gTrue;
+  contentCache = NULL;
 }
 
 PDFDoc::PDFDoc()
@@ -128,7 +142,8 @@ PDFDoc::PDFDoc()
 }
 
 PDFDoc::PDFDoc(GooString *fileNameA, GooString *ownerPassword,
-	       GooString *userPassword, void *guiDataA) {
+	       GooString *userPassword, void *guiDataA,
+	       PDFDocCache *docCache) {
   Object obj;
 #ifdef _WIN32
   int n, i;
@@ -163,7 +178,7 @@ PDFDoc::PDFDoc(GooString *fileNameA, GooString *ownerPassword,
   obj.initNull();
   str = new FileStream(file, 0, gFalse, file->size(), &obj);
 
-  ok = setup(ownerPassword, userPassword);
+  ok = setup(ownerPassword, userPassword, docCache);
 }
 
 #ifdef _WIN32
@@ -237,7 +252,8 @@ PDFDoc::PDFDoc(BaseStream *strA, GooString *ownerPassword,
   ok = setup(ownerPassword, userPassword);
 }
 
-GBool PDFDoc::setup(GooString *ownerPassword, GooString *userPassword) {
+GBool PDFDoc::setup(GooString *ownerPassword, GooString *userPassword,
+		   PDFDocCache *docCache) {
   pdfdocLocker();
   str->setPos(0, -1);
   if (str->getPos() < 0)
@@ -257,24 +273,41 @@ GBool PDFDoc::setup(GooString *ownerPassword, GooString *userPassword) {
 
   GBool wasReconstructed = false;
 
-  // read xref table
-  xref = new XRef(str, getStartXRef(), getMainXRefEntriesOffset(), &wasReconstructed);
-  if (!xref->isOk()) {
-    if (wasReconstructed) {
-      delete xref;
-      startXRefPos = -1;
-      xref = new XRef(str, getStartXRef(gTrue), getMainXRefEntriesOffset(gTrue), &wasReconstructed);
+  // the cache key is the file name and the identity of the opened file
+  GooString *cacheKey = NULL;
+  if (docCache && file && fileName) {
+    cacheKey = fileName->copy();
+    cacheKey->append('\0');
+    if (file->getIdentity(cacheKey)) {
+      xref = docCache->lookupXRef(cacheKey, str);
+    } else {
+      delete cacheKey;
+      cacheKey = NULL;
     }
+  }
+
+  // read xref table, unless the cache had it
+  if (!xref) {
+    xref = new XRef(str, getStartXRef(), getMainXRefEntriesOffset(), &wasReconstructed);
     if (!xref->isOk()) {
-      error(errSyntaxError, -1, "Couldn't read xref table");
-      errCode = xref->getErrorCode();
-      return gFalse;
+      if (wasReconstructed) {
+        delete xref;
+        startXRefPos = -1;
+        xref = new XRef(str, getStartXRef(gTrue), getMainXRefEntriesOffset(gTrue), &wasReconstructed);
+      }
+      if (!xref->isOk()) {
+        error(errSyntaxError, -1, "Couldn't read xref table");
+        errCode = xref->getErrorCode();
+        delete cacheKey;
+        return gFalse;
+      }
     }
   }
 
   // check for encryption
   if (!checkEncryption(ownerPassword, userPassword)) {
     errCode = errEncrypted;
+    delete cacheKey;
     return gFalse;
   }
 
@@ -293,15 +326,24 @@ GBool PDFDoc::setup(GooString *ownerPassword, GooString *userPassword) {
     if (catalog && !catalog->isOk()) {
       error(errSyntaxError, -1, "Couldn't read page catalog");
       errCode = errBadCatalog;
+      delete cacheKey;
       return gFalse;
     }
   }
 
+  // The table is copied before anything can modify it. Encrypted files
+  // aren't cached, as their table holds the decryption key.
+  if (cacheKey && !xref->isEncrypted()) {
+    docCache->putXRef(cacheKey, xref);
+  }
+  delete cacheKey;
+
   // done
   return gTrue;
 }
 
 PDFDoc::~PDFDoc() {
+  delete contentCache;
   if (pageCache) {
     for (int i = 0; i < getNumPages(); i++) {
       if (pageCache[i]) {
@@ -463,6 +505,8 @@ void PDFDoc::displayPage(OutputDev *out, int page,
     printf("***** page %d *****\n", page);
   }
 
+  prefetchForDisplay(page);
+
   if (getPage(page))
     getPage(page)->display(out, hDPI, vDPI,
 				    rotate, useMediaBox, crop, printing,
@@ -495,6 +539,8 @@ void PDFDoc::displayPageSlice(OutputDev *out, int page,
 			      void *abortCheckCbkData,
                               GBool (*annotDisplayDecideCbk)(Annot *annot, void *user_data),
                               void *annotDisplayDecideCbkData, GBool copyXRef) {
+  prefetchForDisplay(page);
+
   if (getPage(page))
     getPage(page)->displaySlice(out, hDPI, vDPI,
 					 rotate, useMediaBox, crop,
@@ -611,13 +657,127 @@ Hints *PDFDoc::getHints()
   return hints;
 }
 
-int PDFDoc::savePageAs(GooString *name, int pageNo) 
+CachedFile *PDFDoc::getCachedFile()
+{
+  if (str->getKind() != strCachedFile) {
+    return NULL;
+  }
+  return ((CachedFileStream *)str)->getCachedFile();
+}
+
+GBool PDFDoc::isPageAvailable(int page)
+{
+  CachedFile *cachedFile;
+  std::vector<ByteRange> *ranges;
+  GBool available;
+
+  if ((page < 1) || page > getNumPages()) return gFalse;
+
+  cachedFile = getCachedFile();
+  if (!cachedFile) {
+    return gTrue;
+  }
+
+  ranges = getPageRanges(page);
+  available = cachedFile->isCached(*ranges);
+  delete ranges;
+  return available;
+}
+
+std::vector<ByteRange> *PDFDoc::getPageRanges(int page)
+{
+  std::vector<ByteRange> *ranges = NULL;
+
+  if (isLinearized()) {
+    ranges = getHints()->getPageRanges(page);
+  }
+  if (!ranges) {
+    // without hint tables the page may need any part of the file
+    ByteRange all;
+    all.offset = 0;
+    all.length = str->getLength();
+    ranges = new std::vector<ByteRange>(1, all);
+  }
+  return ranges;
+}
+
+GBool PDFDoc::prefetchPage(int page, GBool wait)
+{
+  CachedFile *cachedFile;
+  std::vector<ByteRange> *ranges;
+  int r;
+
+  if ((page < 1) || page > getNumPages()) return gFalse;
+
+  cachedFile = getCachedFile();
+  if (!cachedFile) {
+    return gTrue;
+  }
+
+  ranges = getPageRanges(page);
+  if (wait) {
+    r = cachedFile->cache(*ranges);
+  } else {
+    r = cachedFile->prefetch(*ranges);
+  }
+  delete ranges;
+  return r == 0;
+}
+
+void PDFDoc::prefetchForDisplay(int page)
+{
+  if (!pagePrefetching || !getCachedFile() || !isLinearized()) {
+    return;
+  }
+
+  // Queue the next page first so that loaders that can not work in the
+  // background fetch it along with this one.
+  if (page < getNumPages()) {
+    prefetchPage(page + 1, gFalse);
+  }
+  prefetchPage(page, gTrue);
+}
+
+void PDFDoc::setContentCacheSize(int size)
+{
+  pdfdocLocker();
+  if (contentCache) {
+    contentCache->setMaxSize(size);
+  } else if (size > 0) {
+    contentCache = new GfxOpListCache(size);
+  }
+}
+
+int PDFDoc::getContentCacheSize()
+{
+  pdfdocLocker();
+  return contentCache ? contentCache->getMaxSize() : 0;
+}
+
+GfxOpListCache *PDFDoc::getContentCache()
+{
+  // the cache is kept once created, so that pages being displayed can
+  // go on using it after it is disabled
+  pdfdocLocker();
+  if (contentCache && contentCache->getMaxSize() > 0) {
+    return contentCache;
+  }
+  return NULL;
+}
+
+int PDFDoc::savePageAs(GooString *name, int pageNo, GBool subsetFonts, GBool compress)
 {
   FILE *f;
   OutStream *outStr;
   XRef *yRef, *countRef;
   int rootNum = getXRef()->getNumObjects() + 1;
 
+  // Unencrypted documents can be renumbered, and are copied object by
+  // object from the page, leaving this document untouched.
+  if (!isEncrypted()) {
+    return savePageCopyAs(name, pageNo, subsetFonts, compress);
+  }
+
   // Make sure that special flags are set, because we are going to read
   // all objects, including Unencrypted ones.
   xref->scanSpecialFlags();
@@ -778,6 +938,79 @@ int PDFDoc::savePageAs(GooString *name, int pageNo)
   return errNone;
 }
 
+int PDFDoc::savePageCopyAs(GooString *name, int pageNo, GBool subsetFonts, GBool compress)
+{
+  FILE *f;
+  OutStream *outStr;
+  PDFPageWriter *writer;
+  Object catObj, obj1;
+
+  if (pageNo < 1 || pageNo > getNumPages() || !getCatalog()->getPage(pageNo)) {
+    error(errInternal, -1, "Illegal pageNo: {0:d}({1:d})", pageNo, getNumPages() );
+    return errOpenFile;
+  }
+  if (!(f = fopen(name->getCString(), "wb"))) {
+    error(errIO, -1, "Couldn't open file '{0:t}'", name);
+    return errOpenFile;
+  }
+  outStr = new FileOutStream(f,0);
+
+  writer = new PDFPageWriter(outStr, getPDFMajorVersion(), getPDFMinorVersion(), compress);
+  writer->setDocument(this);
+  if (subsetFonts) {
+    std::vector<int> pages(1, pageNo);
+    writer->subsetFonts(pages);
+  }
+  writer->addPage(pageNo);
+  if (!getXRef()->getDocInfoNF(&obj1)->isNull()) {
+    writer->setDocInfo(&obj1);
+  }
+  obj1.free();
+  // keep the catalog, and the form fields of this page, but not the
+  // outlines, structure tree and named destinations: they describe all
+  // the pages, and would pull in the marked content of the other ones
+  if (getXRef()->getCatalog(&catObj)->isDict()) {
+    for (int i = 0; i < catObj.dictGetLength(); i++) {
+      const char *key = catObj.dictGetKey(i);
+      if (!strcmp(key, "AcroForm")) {
+        writer->setAcroForm(catObj.dictGetValNF(i, &obj1));
+        obj1.free();
+      } else if (!strcmp(key, "Names")) {
+        // embedded files, JavaScript, etc. are kept
+        Object names, obj2;
+        if (catObj.dictGetVal(i, &obj1)->isDict()) {
+          names.initDict((XRef *)NULL);
+          for (int j = 0; j < obj1.dictGetLength(); j++) {
+            if (strcmp(obj1.dictGetKey(j), "Dests")) {
+              names.dictAdd(copyString(obj1.dictGetKey(j)),
+                            obj1.dictGetValNF(j, &obj2));
+            }
+          }
+          if (names.dictGetLength() > 0) {
+            writer->setCatalogEntry(key, &names);
+          }
+          names.free();
+        }
+        obj1.free();
+      } else if (strcmp(key, "Type") && strcmp(key, "Pages") &&
+                 strcmp(key, "Dests") && strcmp(key, "Outlines") &&
+                 strcmp(key, "StructTreeRoot")) {
+        writer->setCatalogEntry(key, catObj.dictGetValNF(i, &obj1));
+        obj1.free();
+      }
+    }
+  }
+  catObj.free();
+  writer->finish(name->getCString());
+  delete writer;
+
+  outStr->close();
+  fclose(f);
+  delete outStr;
+
+  return errNone;
+}
+
 int PDFDoc::saveAs(GooString *name, PDFWriteMode mode) {
   FILE *f;
   OutStream *outStr;
@@ -796,20 +1029,15 @@ int PDFDoc::saveAs(GooString *name, PDFWriteMode mode) {
 
 int PDFDoc::saveAs(OutStream *outStr, PDFWriteMode mode) {
 
-  // find if we have updated objects
-  GBool updated = gFalse;
-  for(int i=0; i<xref->getNumObjects(); i++) {
-    if (xref->getEntry(i)->getFlag(XRefEntry::Updated)) {
-      updated = gTrue;
-      break;
-    }
-  }
-
-  if (!updated && mode == writeStandard) {
+  if (!xref->hasUpdatedObjects() && mode == writeStandard) {
     // simply copy the original file
     saveWithoutChangesAs (outStr);
   } else if (mode == writeForceRewrite) {
     saveCompleteRewrite(outStr);
+  } else if (mode == writeForceRewriteCompressed) {
+    saveCompressedRewrite(outStr);
+  } else if (mode == writeForceLinearized) {
+    return saveLinearized(outStr);
   } else {
     saveIncrementalUpdate(outStr);
   }
@@ -836,14 +1064,33 @@ int PDFDoc::saveWithoutChangesAs(GooString *name) {
   return res;
 }
 
+// Copy the data of str, which must have been reset, to outStr in blocks:
+// length bytes, or all of them if length is negative. Returns the number
+// of bytes copied.
+static Goffset copyStreamData(Stream *str, OutStream *outStr, Goffset length)
+{
+  Guchar buf[16384];
+  Goffset copied = 0;
+  int n;
+
+  while (length < 0 || copied < length) {
+    n = sizeof(buf);
+    if (length >= 0 && length - copied < n) {
+      n = (int)(length - copied);
+    }
+    if ((n = str->doGetChars(n, buf)) <= 0) {
+      break;
+    }
+    outStr->write((const char *)buf, n);
+    copied += n;
+  }
+  return copied;
+}
+
 int PDFDoc::saveWithoutChangesAs(OutStream *outStr) {
-  int c;
-  
   BaseStream *copyStr = str->copy();
   copyStr->reset();
-  while ((c = copyStr->getChar()) != EOF) {
-    outStr->put(c);
-  }
+  copyStreamData(copyStr, outStr, -1);
   copyStr->close();
   delete copyStr;
 
@@ -852,14 +1099,10 @@ int PDFDoc::saveWithoutChangesAs(OutStream *outStr) {
 
 void PDFDoc::saveIncrementalUpdate (OutStream* outStr)
 {
-  XRef *uxref;
-  int c;
   //copy the original file
   BaseStream *copyStr = str->copy();
   copyStr->reset();
-  while ((c = copyStr->getChar()) != EOF) {
-    outStr->put(c);
-  }
+  copyStreamData(copyStr, outStr, -1);
   copyStr->close();
   delete copyStr;
 
@@ -868,36 +1111,44 @@ void PDFDoc::saveIncrementalUpdate (OutStream* outStr)
   int keyLength;
   xref->getEncryptionParameters(&fileKey, &encAlgorithm, &keyLength);
 
-  uxref = new XRef();
-  uxref->add(0, 65535, 0, gFalse);
+  // Only the changed objects are visited and put in the new xref section,
+  // so the cost doesn't depend on the size of the document
+  std::vector<int> updated;
+  std::vector<XRefSectionEntry> uxrefEntries;
+  XRefSectionEntry entry;
+  entry.num = 0;
+  entry.gen = 65535;
+  entry.offset = 0;
+  entry.type = xrefEntryFree;
+  uxrefEntries.push_back(entry);
   xref->lock();
-  for(int i=0; i<xref->getNumObjects(); i++) {
-    if ((xref->getEntry(i)->type == xrefEntryFree) && 
-        (xref->getEntry(i)->gen == 0)) //we skip the irrelevant free objects
+  xref->getUpdatedObjects(&updated);
+  for (size_t i = 0; i < updated.size(); i++) {
+    XRefEntry *e = xref->getEntry(updated[i]);
+    if (updated[i] == 0 ||
+        (e->type == xrefEntryFree && e->gen == 0)) //we skip the irrelevant free objects
       continue;
 
-    if (xref->getEntry(i)->getFlag(XRefEntry::Updated)) { //we have an updated object
-      Ref ref;
-      ref.num = i;
-      ref.gen = xref->getEntry(i)->type == xrefEntryCompressed ? 0 : xref->getEntry(i)->gen;
-      if (xref->getEntry(i)->type != xrefEntryFree) {
-        Object obj1;
-        xref->fetch(ref.num, ref.gen, &obj1, 1);
-        Goffset offset = writeObjectHeader(&ref, outStr);
-        writeObject(&obj1, outStr, fileKey, encAlgorithm, keyLength, ref.num, ref.gen);
-        writeObjectFooter(outStr);
-        uxref->add(ref.num, ref.gen, offset, gTrue);
-        obj1.free();
-      } else {
-        uxref->add(ref.num, ref.gen, 0, gFalse);
-      }
+    Ref ref;
+    ref.num = updated[i];
+    ref.gen = e->type == xrefEntryCompressed ? 0 : e->gen;
+    entry.num = ref.num;
+    entry.gen = ref.gen;
+    if (e->type != xrefEntryFree) {
+      Object obj1;
+      xref->fetch(ref.num, ref.gen, &obj1, 1);
+      entry.offset = writeObjectHeader(&ref, outStr);
+      entry.type = xrefEntryUncompressed;
+      writeObject(&obj1, outStr, fileKey, encAlgorithm, keyLength, ref.num, ref.gen);
+      writeObjectFooter(outStr);
+      obj1.free();
+    } else {
+      entry.offset = 0;
+      entry.type = xrefEntryFree;
     }
+    uxrefEntries.push_back(entry);
   }
   xref->unlock();
-  if (uxref->getNumObjects() == 0) { //we have nothing to update
-    delete uxref;
-    return;
-  }
 
   Goffset uxrefOffset = outStr->getPos();
   int numobjects = xref->getNumObjects();
@@ -913,18 +1164,21 @@ void PDFDoc::saveIncrementalUpdate (OutStream* outStr)
     // Append an entry for the xref stream itself
     uxrefStreamRef.num = numobjects++;
     uxrefStreamRef.gen = 0;
-    uxref->add(uxrefStreamRef.num, uxrefStreamRef.gen, uxrefOffset, gTrue);
+    entry.num = uxrefStreamRef.num;
+    entry.gen = uxrefStreamRef.gen;
+    entry.offset = uxrefOffset;
+    entry.type = xrefEntryUncompressed;
+    uxrefEntries.push_back(entry);
   }
 
   Dict *trailerDict = createTrailerDict(numobjects, gTrue, getStartXRef(), &rootRef, getXRef(), fileNameA, uxrefOffset);
   if (xRefStream) {
-    writeXRefStreamTrailer(trailerDict, uxref, &uxrefStreamRef, uxrefOffset, outStr, getXRef());
+    writeXRefStreamTrailer(trailerDict, &uxrefEntries, &uxrefStreamRef, uxrefOffset, outStr, getXRef());
   } else {
-    writeXRefTableTrailer(trailerDict, uxref, gFalse, uxrefOffset, outStr, getXRef());
+    writeXRefTableTrailer(trailerDict, &uxrefEntries, uxrefOffset, outStr, getXRef());
   }
 
   delete trailerDict;
-  delete uxref;
 }
 
 void PDFDoc::saveCompleteRewrite (OutStream* outStr)
@@ -990,29 +1244,940 @@ void PDFDoc::saveCompleteRewrite (OutStream* outStr)
   delete uxref;
 }
 
+void PDFDoc::saveCompressedRewrite (OutStream* outStr)
+{
+  xref->scanSpecialFlags();
+
+  Guchar *fileKey;
+  CryptAlgorithm encAlgorithm;
+  int keyLength;
+  xref->getEncryptionParameters(&fileKey, &encAlgorithm, &keyLength);
+
+  // Objects are encrypted with their own number and generation, which
+  // doesn't work inside object streams, and streams can't be recompressed
+  // without decrypting them, so encrypted documents only get the
+  // xref stream
+  GBool pack = fileKey == NULL;
+
+  // Object and xref streams need PDF 1.5
+  int major = pdfMajorVersion;
+  int minor = pdfMinorVersion;
+  if (major < 1 || (major == 1 && minor < 5)) {
+    major = 1;
+    minor = 5;
+  }
+  writeHeader(outStr, major, minor);
+
+  XRef *uxref = new XRef();
+  uxref->add(0, 65535, 0, gFalse);
+  int nextObjNum = xref->getNumObjects();
+  std::vector<int> objNums;
+  std::vector<Goffset> objOffsets;
+  MemOutStream *objData = new MemOutStream();
+  xref->lock();
+  for(int i=0; i<xref->getNumObjects(); i++) {
+    Object obj1, obj2;
+    Ref ref;
+    XRefEntryType type = xref->getEntry(i)->type;
+    if (type == xrefEntryFree) {
+      ref.num = i;
+      ref.gen = xref->getEntry(i)->gen;
+      if (ref.gen > 0 && ref.num > 0)
+        uxref->add(ref.num, ref.gen, 0, gFalse);
+    } else if (xref->getEntry(i)->getFlag(XRefEntry::DontRewrite)) {
+      ref.num = i;
+      ref.gen = xref->getEntry(i)->gen + 1;
+      uxref->add(ref.num, ref.gen, 0, gFalse);
+    } else {
+      ref.num = i;
+      ref.gen = type == xrefEntryCompressed ? 0 : xref->getEntry(i)->gen;
+      GBool unencrypted = xref->getEntry(i)->getFlag(XRefEntry::Unencrypted);
+      xref->fetch(ref.num, ref.gen, &obj1, 1);
+      if (pack && ref.gen == 0 && !obj1.isStream()) {
+        if ((int)objNums.size() == objStmMaxObjects) {
+          writeObjectStream(nextObjNum++, &objNums, &objOffsets, objData, uxref, outStr);
+        }
+        objNums.push_back(ref.num);
+        objOffsets.push_back(objData->getPos());
+        writeObject(&obj1, objData, NULL, cryptRC4, 0, 0, 0);
+        objData->put('\n');
+        // the entry is made compressed once the object stream is written
+        uxref->add(ref.num, ref.gen, 0, gTrue);
+      } else {
+        Goffset offset = writeObjectHeader(&ref, outStr);
+        if (unencrypted) {
+          writeObject(&obj1, outStr, NULL, cryptRC4, 0, 0, 0);
+        } else if (pack && obj1.isStream() && obj1.streamGetDict()->lookupNF("Filter", &obj2)->isNull()) {
+          // recompress streams stored without any filter
+          GooString data;
+          Stream *stream = obj1.getStream();
+          Dict *dict = stream->getDict()->copy(getXRef());
+          stream->fillGooString(&data);
+          stream->close();
+          dict->remove("DecodeParms");
+          writeCompressedStream(dict, &data, outStr, getXRef());
+          delete dict;
+        } else {
+          writeObject(&obj1, outStr, fileKey, encAlgorithm, keyLength, ref.num, ref.gen);
+        }
+        obj2.free();
+        writeObjectFooter(outStr);
+        uxref->add(ref.num, ref.gen, offset, gTrue);
+      }
+      obj1.free();
+    }
+  }
+  xref->unlock();
+  if (!objNums.empty()) {
+    writeObjectStream(nextObjNum++, &objNums, &objOffsets, objData, uxref, outStr);
+  }
+  delete objData;
+
+  Goffset uxrefOffset = outStr->getPos();
+  const char *fileNameA = fileName ? fileName->getCString() : NULL;
+  Ref rootRef, uxrefStreamRef;
+  rootRef.num = getXRef()->getRootNum();
+  rootRef.gen = getXRef()->getRootGen();
+  uxrefStreamRef.num = nextObjNum++;
+  uxrefStreamRef.gen = 0;
+  uxref->add(uxrefStreamRef.num, uxrefStreamRef.gen, uxrefOffset, gTrue);
+
+  Dict *trailerDict = createTrailerDict(nextObjNum, gFalse, 0, &rootRef, getXRef(), fileNameA, uxrefOffset);
+  writeXRefStreamTrailer(trailerDict, uxref, &uxrefStreamRef, uxrefOffset, outStr, getXRef());
+  delete trailerDict;
+  delete uxref;
+}
+
+void PDFDoc::writeObjectStream (int objStmNum, std::vector<int> *objNums, std::vector<Goffset> *objOffsets,
+                                MemOutStream *objData, XRef *uxref, OutStream* outStr)
+{
+  Object obj1;
+  Ref ref;
+  GooString data;
+
+  for (size_t k = 0; k < objNums->size(); k++) {
+    data.appendf("{0:d} {1:lld} ", (*objNums)[k], (long long)(*objOffsets)[k]);
+  }
+  int first = data.getLength();
+  data.append(objData->getData());
+
+  Dict *dict = new Dict(getXRef());
+  dict->set("Type", obj1.initName("ObjStm"));
+  dict->set("N", obj1.initInt(objNums->size()));
+  dict->set("First", obj1.initInt(first));
+
+  ref.num = objStmNum;
+  ref.gen = 0;
+  Goffset offset = writeObjectHeader(&ref, outStr);
+  writeCompressedStream(dict, &data, outStr, getXRef());
+  writeObjectFooter(outStr);
+  delete dict;
+
+  uxref->add(ref.num, ref.gen, offset, gTrue);
+  for (size_t k = 0; k < objNums->size(); k++) {
+    XRefEntry *e = uxref->getEntry((*objNums)[k]);
+    e->type = xrefEntryCompressed;
+    e->offset = objStmNum;
+    e->gen = k;
+  }
+
+  objNums->clear();
+  objOffsets->clear();
+  objData->getData()->clear();
+}
+
+//------------------------------------------------------------------------
+// linearized output
+//------------------------------------------------------------------------
+
+// Counts the bytes written, to lay out a linearized file before writing it.
+class CountOutStream: public OutStream {
+public:
+
+  CountOutStream() { count = 0; }
+  virtual void close() {}
+  virtual Goffset getPos() { return count; }
+  virtual void put(char c) { count++; }
+  virtual void write(const char *buf, int len) { count += len; }
+  virtual void printf(const char *format, ...);
+
+private:
+
+  Goffset count;
+};
+
+void CountOutStream::printf(const char *format, ...)
+{
+  va_list argptr;
+  int n;
+
+  va_start(argptr, format);
+  n = vsnprintf(NULL, 0, format, argptr);
+  va_end(argptr);
+  if (n > 0) {
+    count += n;
+  }
+}
+
+// Packs the items of the hint tables, most significant bit first.
+class HintsWriter {
+public:
+
+  HintsWriter(GooString *bufA) { buf = bufA; bits = 0; nBits = 0; }
+  void writeBits(Guint value, int n);
+  // Pad with zero bits up to the next byte boundary. Every item of the
+  // per-page and per-group entries starts on a byte boundary, which is
+  // what readers (including ours) expect.
+  void flush() { if (nBits > 0) writeBits(0, 8 - nBits); }
+  // Write values[i] - least with n bits for every entry, then flush.
+  void writeItems(std::vector<Guint> *values, Guint least, int n);
+
+private:
+
+  GooString *buf;
+  Guint bits;
+  int nBits;
+};
+
+void HintsWriter::writeBits(Guint value, int n)
+{
+  for (int i = n - 1; i >= 0; i--) {
+    bits = (bits << 1) | ((value >> i) & 1);
+    if (++nBits == 8) {
+      buf->append((char)bits);
+      bits = 0;
+      nBits = 0;
+    }
+  }
+}
+
+void HintsWriter::writeItems(std::vector<Guint> *values, Guint least, int n)
+{
+  for (size_t i = 0; i < values->size(); i++) {
+    writeBits((*values)[i] - least, n);
+  }
+  flush();
+}
+
+static int bitsNeeded(Guint value)
+{
+  int n = 0;
+  while (value) {
+    n++;
+    value >>= 1;
+  }
+  return n;
+}
+
+static Guint leastValue(std::vector<Guint> *values)
+{
+  Guint least = 0;
+  for (size_t i = 0; i < values->size(); i++) {
+    if (i == 0 || (*values)[i] < least) {
+      least = (*values)[i];
+    }
+  }
+  return least;
+}
+
+static int bitsNeededForDiff(std::vector<Guint> *values, Guint least)
+{
+  Guint greatest = least;
+  for (size_t i = 0; i < values->size(); i++) {
+    if ((*values)[i] > greatest) {
+      greatest = (*values)[i];
+    }
+  }
+  return bitsNeeded(greatest - least);
+}
+
+// Page attributes that may be inherited from the page tree. They are
+// copied into the page objects of linearized files, so a page can be
+// displayed without reading the page tree.
+static const char *inheritedPageAttrs[] = {
+  "Resources", "MediaBox", "CropBox", "Rotate"
+};
+#define nInheritedPageAttrs (sizeof(inheritedPageAttrs) / sizeof(inheritedPageAttrs[0]))
+
+static Object *lookupInheritedPageAttr(Dict *pageDict, const char *key, Object *obj)
+{
+  Object parent, parent2;
+
+  obj->initNull();
+  pageDict->lookup("Parent", &parent);
+  for (int depth = 0; parent.isDict() && depth < 100; depth++) {
+    if (!parent.dictLookupNF(key, obj)->isNull()) {
+      break;
+    }
+    obj->free();
+    obj->initNull();
+    parent.dictLookup("Parent", &parent2);
+    parent.free();
+    parent = parent2;
+  }
+  parent.free();
+  return obj;
+}
+
+static void collectRefs(Object *obj, std::vector<int> *refs);
+
+static void collectDictRefs(Dict *dict, const char *skipKey, std::vector<int> *refs)
+{
+  Object obj1;
+
+  for (int i = 0; i < dict->getLength(); i++) {
+    if (skipKey && !strcmp(dict->getKey(i), skipKey)) {
+      continue;
+    }
+    collectRefs(dict->getValNF(i, &obj1), refs);
+    obj1.free();
+  }
+}
+
+static void collectRefs(Object *obj, std::vector<int> *refs)
+{
+  Object obj1;
+
+  switch (obj->getType()) {
+  case objRef:
+    refs->push_back(obj->getRefNum());
+    break;
+  case objArray:
+    for (int i = 0; i < obj->arrayGetLength(); i++) {
+      collectRefs(obj->arrayGetNF(i, &obj1), refs);
+      obj1.free();
+    }
+    break;
+  case objDict:
+    // the page tree is reached from the catalog, not from the pages
+    collectDictRefs(obj->getDict(), obj->isDict("Page") ? "Parent" : NULL, refs);
+    if (obj->isDict("Page")) {
+      for (size_t i = 0; i < nInheritedPageAttrs; i++) {
+        if (obj->dictLookupNF(inheritedPageAttrs[i], &obj1)->isNull()) {
+          obj1.free();
+          collectRefs(lookupInheritedPageAttr(obj->getDict(), inheritedPageAttrs[i], &obj1), refs);
+        }
+        obj1.free();
+      }
+    }
+    break;
+  case objStream:
+    // the length is written as a direct object
+    collectDictRefs(obj->streamGetDict(), "Length", refs);
+    break;
+  default:
+    break;
+  }
+}
+
+// Deep copy of obj with the references renumbered. References to objects
+// that aren't written become null.
+static void renumberObject(Object *obj, Object *result, std::vector<int> *numMap, XRef *xref)
+{
+  Object obj1, obj2;
+  int num;
+
+  switch (obj->getType()) {
+  case objRef:
+    num = obj->getRefNum();
+    if (num >= 0 && num < (int)numMap->size() && (*numMap)[num] > 0) {
+      result->initRef((*numMap)[num], 0);
+    } else {
+      result->initNull();
+    }
+    break;
+  case objArray:
+    result->initArray(xref);
+    for (int i = 0; i < obj->arrayGetLength(); i++) {
+      renumberObject(obj->arrayGetNF(i, &obj1), &obj2, numMap, xref);
+      obj1.free();
+      result->arrayAdd(&obj2);
+    }
+    break;
+  case objDict:
+    result->initDict(xref);
+    for (int i = 0; i < obj->dictGetLength(); i++) {
+      renumberObject(obj->dictGetValNF(i, &obj1), &obj2, numMap, xref);
+      obj1.free();
+      result->dictAdd(copyString(obj->dictGetKey(i)), &obj2);
+    }
+    break;
+  default:
+    obj->copy(result);
+    break;
+  }
+}
+
+// The values in the linearization dictionary and the first page trailer
+// are written with a fixed width, so their size is known before the
+// values are.
+static void writeLinearizationDict(OutStream *outStr, int num, Goffset fileLength,
+                                   Goffset hintsOffset, Goffset hintsLength, int firstPageNum,
+                                   Goffset endFirst, int nPages, Goffset mainXRefEntriesOffset)
+{
+  outStr->printf("%i 0 obj <</Linearized 1 /L %10lli /H [%10lli %10lli] /O %i /E %10lli /N %i /T %10lli >> endobj\r\n",
+                 num, fileLength, hintsOffset, hintsLength, firstPageNum, endFirst, nPages,
+                 mainXRefEntriesOffset);
+}
+
+static void writeFirstPageXRef(OutStream *outStr, std::vector<Goffset> *offsets, int first,
+                               Dict *trailerDict, XRef *xRef, Goffset mainXRefOffset)
+{
+  Object obj1;
+
+  outStr->printf("xref\r\n%i %i\r\n", first, (int)offsets->size() - first);
+  for (size_t i = first; i < offsets->size(); i++) {
+    outStr->printf("%010lli %05i n\r\n", (*offsets)[i], 0);
+  }
+  outStr->printf("trailer\r\n<</Prev %10lli ", mainXRefOffset);
+  for (int i = 0; i < trailerDict->getLength(); i++) {
+    outStr->printf("/%s ", trailerDict->getKey(i));
+    PDFDoc::writeObject(trailerDict->getValNF(i, &obj1), outStr, xRef, 0, NULL, cryptRC4, 0, 0, 0);
+    obj1.free();
+  }
+  outStr->printf(">>\r\nstartxref\r\n0\r\n%%%%EOF\r\n");
+}
+
+static void writeMainXRef(OutStream *outStr, std::vector<Goffset> *offsets, int size,
+                          Goffset firstPageXRefOffset)
+{
+  outStr->printf("xref\r\n0 %i\r\n", size);
+  outStr->printf("%010lli %05i f\r\n", 0ll, 65535);
+  for (int i = 1; i < size; i++) {
+    outStr->printf("%010lli %05i n\r\n", (*offsets)[i], 0);
+  }
+  outStr->printf("trailer\r\n<</Size %i >>\r\n", size);
+  outStr->printf("startxref\r\n%lli\r\n%%%%EOF\r\n", firstPageXRefOffset);
+}
+
+int PDFDoc::saveLinearized (OutStream* outStr)
+{
+  Guchar *fileKey;
+  CryptAlgorithm encAlgorithm;
+  int keyLength;
+  xref->getEncryptionParameters(&fileKey, &encAlgorithm, &keyLength);
+  if (fileKey) {
+    error(errUnimplemented, -1, "Linearized output of encrypted documents isn't supported");
+    return errEncrypted;
+  }
+
+  // find the page objects
+  int nPages = catalog->getNumPages();
+  int numObjects = xref->getNumObjects();
+  int rootNum = xref->getRootNum();
+  if (nPages < 1 || rootNum <= 0 || rootNum >= numObjects) {
+    error(errSyntaxError, -1, "Can't linearize a document without pages");
+    return errBadCatalog;
+  }
+  std::vector<int> pageNums(nPages);
+  std::vector<GBool> stopAt(numObjects, gFalse);
+  stopAt[rootNum] = gTrue;
+  for (int p = 0; p < nPages; p++) {
+    Ref *pageRef = catalog->getPageRef(p + 1);
+    if (!pageRef || pageRef->num <= 0 || pageRef->num >= numObjects || stopAt[pageRef->num]) {
+      error(errSyntaxError, -1, "Can't linearize a document with an invalid page object for page {0:d}", p + 1);
+      return errBadCatalog;
+    }
+    pageNums[p] = pageRef->num;
+    stopAt[pageRef->num] = gTrue;
+  }
+
+  xref->scanSpecialFlags();
+  xref->lock();
+
+  // Collect the objects used by each page. The ones used by a single
+  // page go to that page's section, the others to the shared objects
+  // section, unless the first page uses them.
+  std::vector<int> marks(numObjects, -1);
+  std::vector<std::vector<int> > pageObjs(nPages);
+  std::vector<int> useCount(numObjects, 0);
+  std::vector<int> firstUse(numObjects, -1);
+  for (int p = 0; p < nPages; p++) {
+    collectLinearizedObjects(pageNums[p], p, &marks, &stopAt, &pageObjs[p]);
+    for (size_t i = 0; i < pageObjs[p].size(); i++) {
+      int num = pageObjs[p][i];
+      useCount[num]++;
+      if (firstUse[num] < 0) {
+        firstUse[num] = p;
+      }
+    }
+  }
+
+  // Objects after the first page section are numbered from 1 in file
+  // order: the other pages, the shared objects, then everything else.
+  std::vector<int> numMap(numObjects, 0);
+  std::vector<int> mainObjs;
+  std::vector<size_t> sectionStart(nPages + 1, 0);
+  for (int p = 1; p < nPages; p++) {
+    sectionStart[p] = mainObjs.size();
+    for (size_t i = 0; i < pageObjs[p].size(); i++) {
+      int num = pageObjs[p][i];
+      if (useCount[num] == 1) {
+        mainObjs.push_back(num);
+        numMap[num] = mainObjs.size();
+      }
+    }
+  }
+  size_t sharedStart = mainObjs.size();
+  sectionStart[nPages] = sharedStart;
+  for (int p = 1; p < nPages; p++) {
+    for (size_t i = 0; i < pageObjs[p].size(); i++) {
+      int num = pageObjs[p][i];
+      if (useCount[num] > 1 && firstUse[num] > 0 && numMap[num] == 0) {
+        mainObjs.push_back(num);
+        numMap[num] = mainObjs.size();
+      }
+    }
+  }
+  size_t sharedEnd = mainObjs.size();
+
+  std::vector<int> otherObjs;
+  Object info;
+  collectLinearizedObjects(rootNum, nPages, &marks, &stopAt, &otherObjs);
+  if (xref->getDocInfoNF(&info)->isRef() && info.getRefNum() > 0 &&
+      info.getRefNum() < numObjects && !stopAt[info.getRefNum()]) {
+    collectLinearizedObjects(info.getRefNum(), nPages, &marks, &stopAt, &otherObjs);
+  }
+  for (size_t i = 0; i < otherObjs.size(); i++) {
+    int num = otherObjs[i];
+    if (num != rootNum && firstUse[num] < 0 && numMap[num] == 0) {
+      mainObjs.push_back(num);
+      numMap[num] = mainObjs.size();
+    }
+  }
+
+  // The first page section is numbered after them: linearization
+  // dictionary, catalog, hint stream, then the first page objects.
+  std::vector<int> *firstObjs = &pageObjs[0];
+  int linNum = mainObjs.size() + 1;
+  int catNum = linNum + 1;
+  int hintNum = linNum + 2;
+  int size = hintNum + 1 + firstObjs->size();
+  numMap[rootNum] = catNum;
+  for (size_t i = 0; i < firstObjs->size(); i++) {
+    numMap[(*firstObjs)[i]] = hintNum + 1 + i;
+  }
+
+  // objects written after the hint stream, in file order
+  std::vector<int> order(*firstObjs);
+  order.insert(order.end(), mainObjs.begin(), mainObjs.end());
+
+  std::vector<Goffset> objLen(size, 0);
+  std::vector<Goffset> offsets(size, 0);
+  {
+    CountOutStream count;
+    writeLinearizedObject(rootNum, &numMap, &count);
+    objLen[catNum] = count.getPos();
+  }
+  for (size_t i = 0; i < order.size(); i++) {
+    CountOutStream count;
+    writeLinearizedObject(order[i], &numMap, &count);
+    objLen[numMap[order[i]]] = count.getPos();
+  }
+
+  const char *fileNameA = fileName ? fileName->getCString() : NULL;
+  Ref rootRef;
+  rootRef.num = catNum;
+  rootRef.gen = 0;
+  Dict *trailerDict = createTrailerDict(size, gFalse, 0, &rootRef, getXRef(), fileNameA, str->getLength());
+  if (info.isRef() && info.getRefNum() > 0 && info.getRefNum() < numObjects &&
+      numMap[info.getRefNum()] > 0) {
+    Object obj1;
+    trailerDict->set("Info", obj1.initRef(numMap[info.getRefNum()], 0));
+  } else {
+    trailerDict->remove("Info");
+  }
+  info.free();
+
+  int major = pdfMajorVersion;
+  int minor = pdfMinorVersion;
+  if (major < 1 || (major == 1 && minor < 2)) {
+    major = 1;
+    minor = 2;
+  }
+
+  // lay out the file up to the hint stream
+  CountOutStream headerCount, linCount, firstXRefCount;
+  writeHeader(&headerCount, major, minor);
+  writeLinearizationDict(&linCount, linNum, 0, 0, 0, numMap[pageNums[0]], 0, nPages, 0);
+  writeFirstPageXRef(&firstXRefCount, &offsets, linNum, trailerDict, getXRef(), 0);
+  offsets[linNum] = headerCount.getPos();
+  Goffset firstXRefOffset = offsets[linNum] + linCount.getPos();
+  offsets[catNum] = firstXRefOffset + firstXRefCount.getPos();
+  Goffset hintsOffset = offsets[catNum] + objLen[catNum];
+  offsets[hintNum] = hintsOffset;
+
+  // Lay out the rest as if there was no hint stream: the hint tables
+  // express offsets that way.
+  Goffset pos = hintsOffset;
+  Goffset endFirst = 0;
+  for (size_t i = 0; i < order.size(); i++) {
+    if (i == firstObjs->size()) {
+      endFirst = pos;
+    }
+    offsets[numMap[order[i]]] = pos;
+    pos += objLen[numMap[order[i]]];
+  }
+  Goffset mainXRefOffset = pos;
+  if (order.size() == firstObjs->size()) {
+    endFirst = pos;
+  }
+
+  // page offset hint table
+  GooString hintData;
+  HintsWriter hintsWriter(&hintData);
+  std::vector<Guint> nObjs(nPages), pageLength(nPages), nShared(nPages, 0);
+  std::vector<Guint> contentOffset(nPages, 0), contentLength(nPages, 0);
+  std::vector<Guint> sharedIds;
+  Guint greatestSharedId = 0;
+  for (int p = 0; p < nPages; p++) {
+    Goffset start, end;
+    int sectionFirstNum, sectionEndNum;
+    if (p == 0) {
+      nObjs[p] = firstObjs->size();
+      start = offsets[numMap[pageNums[0]]];
+      end = endFirst;
+      sectionFirstNum = hintNum + 1;
+      sectionEndNum = size;
+    } else {
+      nObjs[p] = sectionStart[p + 1] - sectionStart[p];
+      start = offsets[numMap[mainObjs[sectionStart[p]]]];
+      end = sectionStart[p + 1] < mainObjs.size() ? offsets[numMap[mainObjs[sectionStart[p + 1]]]] : mainXRefOffset;
+      sectionFirstNum = sectionStart[p] + 1;
+      sectionEndNum = sectionStart[p + 1] + 1;
+      // the first page objects are already there when other pages are
+      // displayed, but are still listed as shared
+      for (size_t i = 0; i < pageObjs[p].size(); i++) {
+        int num = pageObjs[p][i];
+        if (useCount[num] > 1) {
+          Guint id;
+          if (firstUse[num] == 0) {
+            id = numMap[num] - (hintNum + 1);
+          } else {
+            id = firstObjs->size() + numMap[num] - 1 - sharedStart;
+          }
+          sharedIds.push_back(id);
+          if (id > greatestSharedId) {
+            greatestSharedId = id;
+          }
+          nShared[p]++;
+        }
+      }
+    }
+    pageLength[p] = end - start;
+
+    Object page, contents, contentRef;
+    xref->fetch(pageNums[p], xref->getEntry(pageNums[p])->type == xrefEntryCompressed ? 0 : xref->getEntry(pageNums[p])->gen, &page);
+    if (page.isDict()) {
+      page.dictLookupNF("Contents", &contents);
+      if (contents.isArray() && contents.arrayGetLength() > 0) {
+        contents.arrayGetNF(0, &contentRef);
+      } else {
+        contents.copy(&contentRef);
+      }
+      if (contentRef.isRef() && contentRef.getRefNum() > 0 && contentRef.getRefNum() < numObjects) {
+        int num = numMap[contentRef.getRefNum()];
+        if (num >= sectionFirstNum && num < sectionEndNum) {
+          contentOffset[p] = offsets[num] - start;
+          contentLength[p] = objLen[num];
+        }
+      }
+      contentRef.free();
+      contents.free();
+    }
+    page.free();
+  }
+
+  Guint leastObjs = leastValue(&nObjs);
+  Guint leastPageLength = leastValue(&pageLength);
+  Guint leastContentOffset = leastValue(&contentOffset);
+  Guint leastContentLength = leastValue(&contentLength);
+  int nBitsObjs = bitsNeededForDiff(&nObjs, leastObjs);
+  int nBitsPageLength = bitsNeededForDiff(&pageLength, leastPageLength);
+  int nBitsContentOffset = bitsNeededForDiff(&contentOffset, leastContentOffset);
+  int nBitsContentLength = bitsNeededForDiff(&contentLength, leastContentLength);
+  int nBitsNumShared = bitsNeededForDiff(&nShared, 0);
+  int nBitsShared = bitsNeeded(greatestSharedId);
+  hintsWriter.writeBits(leastObjs, 32);
+  hintsWriter.writeBits(offsets[numMap[pageNums[0]]], 32);
+  hintsWriter.writeBits(nBitsObjs, 16);
+  hintsWriter.writeBits(leastPageLength, 32);
+  hintsWriter.writeBits(nBitsPageLength, 16);
+  hintsWriter.writeBits(leastContentOffset, 32);
+  hintsWriter.writeBits(nBitsContentOffset, 16);
+  hintsWriter.writeBits(leastContentLength, 32);
+  hintsWriter.writeBits(nBitsContentLength, 16);
+  hintsWriter.writeBits(nBitsNumShared, 16);
+  hintsWriter.writeBits(nBitsShared, 16);
+  hintsWriter.writeBits(0, 16); // no fractional positions
+  hintsWriter.writeBits(1, 16);
+  hintsWriter.writeItems(&nObjs, leastObjs, nBitsObjs);
+  hintsWriter.writeItems(&pageLength, leastPageLength, nBitsPageLength);
+  hintsWriter.writeItems(&nShared, 0, nBitsNumShared);
+  hintsWriter.writeItems(&sharedIds, 0, nBitsShared);
+  hintsWriter.writeItems(&contentOffset, leastContentOffset, nBitsContentOffset);
+  hintsWriter.writeItems(&contentLength, leastContentLength, nBitsContentLength);
+
+  // shared object hint table, with one group per object: the first page
+  // objects, then the shared objects section
+  int sharedTableOffset = hintData.getLength();
+  std::vector<Guint> groupLength;
+  for (size_t i = 0; i < firstObjs->size(); i++) {
+    groupLength.push_back(objLen[numMap[(*firstObjs)[i]]]);
+  }
+  for (size_t i = sharedStart; i < sharedEnd; i++) {
+    groupLength.push_back(objLen[numMap[mainObjs[i]]]);
+  }
+  Guint leastGroupLength = leastValue(&groupLength);
+  int nBitsGroupLength = bitsNeededForDiff(&groupLength, leastGroupLength);
+  std::vector<Guint> groupSignature(groupLength.size(), 0);
+  hintsWriter.writeBits(sharedEnd > sharedStart ? numMap[mainObjs[sharedStart]] : 0, 32);
+  hintsWriter.writeBits(sharedEnd > sharedStart ? offsets[numMap[mainObjs[sharedStart]]] : 0, 32);
+  hintsWriter.writeBits(firstObjs->size(), 32);
+  hintsWriter.writeBits(groupLength.size(), 32);
+  hintsWriter.writeBits(0, 16); // one object per group
+  hintsWriter.writeBits(leastGroupLength, 32);
+  hintsWriter.writeBits(nBitsGroupLength, 16);
+  hintsWriter.writeItems(&groupLength, leastGroupLength, nBitsGroupLength);
+  hintsWriter.writeItems(&groupSignature, 0, 1);
+
+  // now that the hint stream is known, move everything after it
+  CountOutStream hintsCount, mainXRefCount;
+  writeHintStream(&hintsCount, hintNum, &hintData, sharedTableOffset, getXRef());
+  Goffset hintsLength = hintsCount.getPos();
+  for (size_t i = 0; i < order.size(); i++) {
+    offsets[numMap[order[i]]] += hintsLength;
+  }
+  endFirst += hintsLength;
+  mainXRefOffset += hintsLength;
+  GooString *mainXRefHeader = GooString::format("xref\r\n0 {0:d}\r\n", linNum);
+  Goffset mainXRefEntriesOffset = mainXRefOffset + mainXRefHeader->getLength();
+  delete mainXRefHeader;
+  writeMainXRef(&mainXRefCount, &offsets, linNum, firstXRefOffset);
+  Goffset fileLength = mainXRefOffset + mainXRefCount.getPos();
+
+  int res = errNone;
+  if (fileLength > INT_MAX) {
+    error(errUnimplemented, -1, "Linearized output is limited to 2GB");
+    res = errFileIO;
+  } else {
+    Goffset start = outStr->getPos();
+    writeHeader(outStr, major, minor);
+    writeLinearizationDict(outStr, linNum, fileLength, hintsOffset, hintsLength,
+                           numMap[pageNums[0]], endFirst, nPages, mainXRefEntriesOffset);
+    writeFirstPageXRef(outStr, &offsets, linNum, trailerDict, getXRef(), mainXRefOffset);
+    writeLinearizedObject(rootNum, &numMap, outStr);
+    writeHintStream(outStr, hintNum, &hintData, sharedTableOffset, getXRef());
+    for (size_t i = 0; i < order.size(); i++) {
+      writeLinearizedObject(order[i], &numMap, outStr);
+    }
+    writeMainXRef(outStr, &offsets, linNum, firstXRefOffset);
+    if (outStr->getPos() - start != fileLength) {
+      error(errInternal, -1, "Linearized output has an unexpected length");
+    }
+  }
+  xref->unlock();
+
+  delete trailerDict;
+  return res;
+}
+
+void PDFDoc::collectLinearizedObjects (int num, int mark, std::vector<int> *marks,
+                                       std::vector<GBool> *stopAt, std::vector<int> *objs)
+{
+  std::vector<int> stack, refs;
+  Object obj1;
+
+  stack.push_back(num);
+  while (!stack.empty()) {
+    int n = stack.back();
+    stack.pop_back();
+    if ((*marks)[n] == mark) {
+      continue;
+    }
+    (*marks)[n] = mark;
+    objs->push_back(n);
+
+    XRefEntry *entry = xref->getEntry(n);
+    xref->fetch(n, entry->type == xrefEntryCompressed ? 0 : entry->gen, &obj1);
+    refs.clear();
+    collectRefs(&obj1, &refs);
+    obj1.free();
+    // push in reverse, so objects come in the order they are referenced
+    for (int i = refs.size() - 1; i >= 0; i--) {
+      int r = refs[i];
+      if (r > 0 && r < (int)marks->size() && !(*stopAt)[r] && (*marks)[r] != mark) {
+        entry = xref->getEntry(r);
+        if (entry->type != xrefEntryFree && !entry->getFlag(XRefEntry::DontRewrite)) {
+          stack.push_back(r);
+        }
+      }
+    }
+  }
+}
+
+void PDFDoc::writeLinearizedObject (int num, std::vector<int> *numMap, OutStream* outStr)
+{
+  Object obj1, obj2, obj3;
+  Ref ref;
+
+  XRefEntry *entry = xref->getEntry(num);
+  xref->fetch(num, entry->type == xrefEntryCompressed ? 0 : entry->gen, &obj1);
+  ref.num = (*numMap)[num];
+  ref.gen = 0;
+  writeObjectHeader(&ref, outStr);
+  if (obj1.isStream()) {
+    Stream *stream = obj1.getStream();
+    obj2.initDict(stream->getDict());
+    renumberObject(&obj2, &obj3, numMap, getXRef());
+    obj2.free();
+    Dict *dict = obj3.getDict();
+    if (stream->getKind() == strWeird || stream->getKind() == strCrypt) {
+      // streams created or changed in memory are written decoded
+      GooString data;
+      stream->fillGooString(&data);
+      stream->close();
+      dict->remove("Filter");
+      dict->remove("DecodeParms");
+      writeCompressedStream(dict, &data, outStr, getXRef());
+    } else {
+      Goffset length = 0;
+      Goffset streamEnd;
+      BaseStream *bs = stream->getBaseStream();
+      if (bs && xref->getStreamEnd(bs->getStart(), &streamEnd)) {
+        length = streamEnd - bs->getStart();
+      } else if (stream->getDict()->lookup("Length", &obj2)->isInt()) {
+        length = obj2.getInt();
+      } else if (obj2.isInt64()) {
+        length = obj2.getInt64();
+      }
+      obj2.free();
+      dict->set("Length", obj2.initInt64(length));
+      writeDictionnary(dict, outStr, getXRef(), 0, NULL, cryptRC4, 0, 0, 0);
+      writeRawStream(stream, outStr, length);
+    }
+    obj3.free();
+  } else {
+    renumberObject(&obj1, &obj2, numMap, getXRef());
+    if (obj1.isDict("Page")) {
+      for (size_t i = 0; i < nInheritedPageAttrs; i++) {
+        if (obj1.dictLookupNF(inheritedPageAttrs[i], &obj3)->isNull()) {
+          obj3.free();
+          Object obj4;
+          renumberObject(lookupInheritedPageAttr(obj1.getDict(), inheritedPageAttrs[i], &obj3),
+                         &obj4, numMap, getXRef());
+          if (obj4.isNull()) {
+            obj4.free();
+          } else {
+            obj2.dictAdd(copyString(inheritedPageAttrs[i]), &obj4);
+          }
+        }
+        obj3.free();
+      }
+    }
+    writeObject(&obj2, outStr, getXRef(), 0, NULL, cryptRC4, 0, 0, 0);
+    obj2.free();
+  }
+  writeObjectFooter(outStr);
+  obj1.free();
+}
+
+void PDFDoc::writeHintStream (OutStream* outStr, int num, GooString *data, int sharedOffset, XRef *xRef)
+{
+  Object obj1;
+  Ref ref;
+
+  Dict *dict = new Dict(xRef);
+  dict->set("S", obj1.initInt(sharedOffset));
+  ref.num = num;
+  ref.gen = 0;
+  writeObjectHeader(&ref, outStr);
+  writeCompressedStream(dict, data, outStr, xRef);
+  writeObjectFooter(outStr);
+  delete dict;
+}
+
+// The helpers below format into a local buffer and write it in one go,
+// without going through printf or allocating strings.
+
+// Write x followed by a space.
+static void writeInt(long long x, OutStream* outStr)
+{
+  char buf[24];
+  int i = sizeof(buf);
+  unsigned long long u = x < 0 ? -(unsigned long long)x : (unsigned long long)x;
+
+  buf[--i] = ' ';
+  do {
+    buf[--i] = (char)('0' + u % 10);
+    u /= 10;
+  } while (u);
+  if (x < 0) {
+    buf[--i] = '-';
+  }
+  outStr->write(buf + i, sizeof(buf) - i);
+}
+
+// Write x like "{0:.10g} " does.
+static void writeReal(double x, OutStream* outStr)
+{
+  char buf[66];
+  char *p;
+  int len;
+
+  GooString::formatDouble(x, buf, sizeof(buf) - 1, 10, gTrue, &p, &len);
+  buf[sizeof(buf) - 1] = ' ';
+  outStr->write(p, len + 1);
+}
+
+// Write /name followed by a space, escaping the characters that
+// GooString::sanitizedName escapes.
+static void writeName(const char *name, OutStream* outStr)
+{
+  static const char hex[] = "0123456789abcdef";
+  char buf[256];
+  int n = 0;
+
+  buf[n++] = '/';
+  for (const char *p = name; *p; p++) {
+    if (n > (int)sizeof(buf) - 4) {
+      outStr->write(buf, n);
+      n = 0;
+    }
+    char c = *p;
+    if (c <= (char)0x20 || c >= (char)0x7f ||
+        c == '(' || c == ')' || c == '<' || c == '>' ||
+        c == '[' || c == ']' || c == '{' || c == '}' ||
+        c == '/' || c == '%' || c == '#') {
+      buf[n++] = '#';
+      buf[n++] = hex[(c >> 4) & 0x0f];
+      buf[n++] = hex[c & 0x0f];
+    } else {
+      buf[n++] = c;
+    }
+  }
+  buf[n++] = ' ';
+  outStr->write(buf, n);
+}
+
 void PDFDoc::writeDictionnary (Dict* dict, OutStream* outStr, XRef *xRef, Guint numOffset, Guchar *fileKey,
                                CryptAlgorithm encAlgorithm, int keyLength, int objNum, int objGen)
 {
   Object obj1;
-  outStr->printf("<<");
+  outStr->write("<<", 2);
   for (int i=0; i<dict->getLength(); i++) {
-    GooString keyName(dict->getKey(i));
-    GooString *keyNameToPrint = keyName.sanitizedName(gFalse /* non ps mode */);
-    outStr->printf("/%s ", keyNameToPrint->getCString());
-    delete keyNameToPrint;
+    writeName(dict->getKey(i), outStr);
     writeObject(dict->getValNF(i, &obj1), outStr, xRef, numOffset, fileKey, encAlgorithm, keyLength, objNum, objGen);
     obj1.free();
   }
-  outStr->printf(">> ");
+  outStr->write(">> ", 3);
 }
 
 void PDFDoc::writeStream (Stream* str, OutStream* outStr)
 {
   outStr->printf("stream\r\n");
   str->reset();
-  for (int c=str->getChar(); c!= EOF; c=str->getChar()) {
-    outStr->printf("%c", c);  
-  }
+  copyStreamData(str, outStr, -1);
   outStr->printf("\r\nendstream\r\n");
 }
 
@@ -1032,15 +2197,17 @@ void PDFDoc::writeRawStream (Stream* str, OutStream* outStr)
     length = obj1.getInt64();
   obj1.free();
 
+  writeRawStream(str, outStr, length);
+}
+
+void PDFDoc::writeRawStream (Stream* str, OutStream* outStr, Goffset length)
+{
   outStr->printf("stream\r\n");
-  str->unfilteredReset();
-  for (Goffset i = 0; i < length; i++) {
-    int c = str->getUnfilteredChar();
-    if (unlikely(c == EOF)) {
-      error (errSyntaxError, -1, "PDFDoc::writeRawStream: EOF reading stream");
-      break;
-    }
-    outStr->printf("%c", c);  
+  // the unfiltered data is the data of the base stream
+  BaseStream *bs = str->getBaseStream();
+  bs->unfilteredReset();
+  if (copyStreamData(bs, outStr, length) < length) {
+    error (errSyntaxError, -1, "PDFDoc::writeRawStream: EOF reading stream");
   }
   str->reset();
   outStr->printf("\r\nendstream\r\n");
@@ -1056,48 +2223,42 @@ void PDFDoc::writeString (GooString* s, OutStream* outStr, Guchar *fileKey,
     EncryptStream *enc = new EncryptStream(new MemStream(s->getCString(), 0, s->getLength(), obj.initNull()),
                                            fileKey, encAlgorithm, keyLength, objNum, objGen);
     sEnc = new GooString();
-    int c;
-    enc->reset();
-    while ((c = enc->getChar()) != EOF) {
-      sEnc->append((char)c);
-    }
+    enc->fillGooString(sEnc);
 
     delete enc;
     s = sEnc;
   }
 
   // Write data
-  if (s->hasUnicodeMarker()) {
-    //unicode string don't necessary end with \0
-    const char* c = s->getCString();
-    outStr->printf("(");
-    for(int i=0; i<s->getLength(); i++) {
-      char unescaped = *(c+i)&0x000000ff;
-      //escape if needed
-      if (unescaped == '(' || unescaped == ')' || unescaped == '\\')
-        outStr->printf("%c", '\\');
-      outStr->printf("%c", unescaped);
-    }
-    outStr->printf(") ");
-  } else {
-    const char* c = s->getCString();
-    outStr->printf("(");
-    for(int i=0; i<s->getLength(); i++) {
-      char unescaped = *(c+i)&0x000000ff;
-      //escape if needed
-      if (unescaped == '\r')
-        outStr->printf("\\r");
-      else if (unescaped == '\n')
-        outStr->printf("\\n");
-      else {
-        if (unescaped == '(' || unescaped == ')' || unescaped == '\\') {
-          outStr->printf("%c", '\\');
-        }
-        outStr->printf("%c", unescaped);
+  //unicode string don't necessary end with \0, and keep their \r and \n
+  GBool unicode = s->hasUnicodeMarker();
+  const char* c = s->getCString();
+  char buf[256];
+  int n = 0;
+  buf[n++] = '(';
+  for(int i=0; i<s->getLength(); i++) {
+    if (n > (int)sizeof(buf) - 4) {
+      outStr->write(buf, n);
+      n = 0;
+    }
+    char unescaped = *(c+i)&0x000000ff;
+    //escape if needed
+    if (!unicode && unescaped == '\r') {
+      buf[n++] = '\\';
+      buf[n++] = 'r';
+    } else if (!unicode && unescaped == '\n') {
+      buf[n++] = '\\';
+      buf[n++] = 'n';
+    } else {
+      if (unescaped == '(' || unescaped == ')' || unescaped == '\\') {
+        buf[n++] = '\\';
       }
+      buf[n++] = unescaped;
     }
-    outStr->printf(") ");
   }
+  buf[n++] = ')';
+  buf[n++] = ' ';
+  outStr->write(buf, n);
 
   delete sEnc;
 }
@@ -1118,43 +2279,38 @@ void PDFDoc::writeObject (Object* obj, OutStream* outStr, XRef *xRef, Guint numO
 
   switch (obj->getType()) {
     case objBool:
-      outStr->printf("%s ", obj->getBool()?"true":"false");
+      if (obj->getBool()) {
+        outStr->write("true ", 5);
+      } else {
+        outStr->write("false ", 6);
+      }
       break;
     case objInt:
-      outStr->printf("%i ", obj->getInt());
+      writeInt(obj->getInt(), outStr);
       break;
     case objInt64:
-      outStr->printf("%lli ", obj->getInt64());
+      writeInt(obj->getInt64(), outStr);
       break;
     case objReal:
-    {
-      GooString s;
-      s.appendf("{0:.10g}", obj->getReal());
-      outStr->printf("%s ", s.getCString());
+      writeReal(obj->getReal(), outStr);
       break;
-    }
     case objString:
       writeString(obj->getString(), outStr, fileKey, encAlgorithm, keyLength, objNum, objGen);
       break;
     case objName:
-    {
-      GooString name(obj->getName());
-      GooString *nameToPrint = name.sanitizedName(gFalse /* non ps mode */);
-      outStr->printf("/%s ", nameToPrint->getCString());
-      delete nameToPrint;
+      writeName(obj->getName(), outStr);
       break;
-    }
     case objNull:
-      outStr->printf( "null ");
+      outStr->write("null ", 5);
       break;
     case objArray:
       array = obj->getArray();
-      outStr->printf("[");
+      outStr->put('[');
       for (int i=0; i<array->getLength(); i++) {
         writeObject(array->getNF(i, &obj1), outStr, xRef, numOffset, fileKey, encAlgorithm, keyLength, objNum, objGen);
         obj1.free();
       }
-      outStr->printf("] ");
+      outStr->write("] ", 2);
       break;
     case objDict:
       writeDictionnary (obj->getDict(), outStr, xRef, numOffset, fileKey, encAlgorithm, keyLength, objNum, objGen);
@@ -1205,11 +2361,22 @@ void PDFDoc::writeObject (Object* obj, OutStream* outStr, XRef *xRef, Guint numO
             stream = encStream;
           }
 
-          stream->reset();
           //recalculate stream length
-          tmp = 0;
-          for (int c=stream->getChar(); c!=EOF; c=stream->getChar()) {
-            tmp++;
+          GooString *data = NULL;
+          Stream *source = obj->getStream();
+          if (source->getKind() == strWeird && source->getBaseStream() == source) {
+            // data kept in memory as is: the length is known, and so is
+            // the length of the encrypted data
+            tmp = source->getBaseStream()->getLength();
+            if (encStream && (encAlgorithm == cryptAES || encAlgorithm == cryptAES256)) {
+              // the IV, then the data padded to the next full block
+              tmp = 16 + (tmp / 16 + 1) * 16;
+            }
+          } else {
+            // decode (and encrypt) the data only once
+            data = new GooString();
+            stream->fillGooString(data);
+            tmp = data->getLength();
           }
           obj1.initInt64(tmp);
           stream->getDict()->set("Length", &obj1);
@@ -1221,7 +2388,14 @@ void PDFDoc::writeObject (Object* obj, OutStream* outStr, XRef *xRef, Guint numO
           stream->getDict()->remove("DecodeParms");
 
           writeDictionnary (stream->getDict(),outStr, xRef, numOffset, fileKey, encAlgorithm, keyLength, objNum, objGen);
-          writeStream (stream,outStr);
+          if (data) {
+            outStr->printf("stream\r\n");
+            outStr->write(data->getCString(), data->getLength());
+            outStr->printf("\r\nendstream\r\n");
+            delete data;
+          } else {
+            writeStream (stream,outStr);
+          }
           delete encStream;
           obj1.free();
         } else {
@@ -1244,7 +2418,9 @@ void PDFDoc::writeObject (Object* obj, OutStream* outStr, XRef *xRef, Guint numO
         break;
       }
     case objRef:
-      outStr->printf("%i %i R ", obj->getRef().num + numOffset, obj->getRef().gen);
+      writeInt(obj->getRef().num + numOffset, outStr);
+      writeInt(obj->getRef().gen, outStr);
+      outStr->write("R ", 2);
       break;
     case objCmd:
       outStr->printf("%s\n", obj->getCmd());
@@ -1386,30 +2562,89 @@ void PDFDoc::writeXRefStreamTrailer (Dict *trailerDict, XRef *uxref, Ref *uxrefS
   // Fill stmData and some trailerDict fields
   uxref->writeStreamToBuffer(&stmData, trailerDict, xRef);
 
-  // Create XRef stream object and write it
-  Object obj1;
-  MemStream *mStream = new MemStream( stmData.getCString(), 0,
-                                      stmData.getLength(), obj1.initDict(trailerDict) );
+  // Write the XRef stream object
   writeObjectHeader(uxrefStreamRef, outStr);
-  writeObject(obj1.initStream(mStream), outStr, xRef, 0, NULL, cryptRC4, 0, 0, 0);
+  writeCompressedStream(trailerDict, &stmData, outStr, xRef);
+  writeObjectFooter(outStr);
+
+  outStr->printf( "startxref\r\n");
+  outStr->printf( "%lli\r\n", uxrefOffset);
+  outStr->printf( "%%%%EOF\r\n");
+}
+
+void PDFDoc::writeXRefTableTrailer(Dict *trailerDict, std::vector<XRefSectionEntry> *uxrefEntries,
+                                   Goffset uxrefOffset, OutStream* outStr, XRef *xRef)
+{
+  XRef::writeTableToFile(outStr, uxrefEntries);
+  outStr->printf( "trailer\r\n");
+  writeDictionnary(trailerDict, outStr, xRef, 0, NULL, cryptRC4, 0, 0, 0);
+  outStr->printf( "\r\nstartxref\r\n");
+  outStr->printf( "%lli\r\n", uxrefOffset);
+  outStr->printf( "%%%%EOF\r\n");
+}
+
+void PDFDoc::writeXRefStreamTrailer (Dict *trailerDict, std::vector<XRefSectionEntry> *uxrefEntries,
+                                     Ref *uxrefStreamRef, Goffset uxrefOffset, OutStream* outStr, XRef *xRef)
+{
+  GooString stmData;
+
+  XRef::writeStreamToBuffer(&stmData, trailerDict, xRef, uxrefEntries);
+
+  writeObjectHeader(uxrefStreamRef, outStr);
+  writeCompressedStream(trailerDict, &stmData, outStr, xRef);
   writeObjectFooter(outStr);
-  obj1.free();
 
   outStr->printf( "startxref\r\n");
   outStr->printf( "%lli\r\n", uxrefOffset);
   outStr->printf( "%%%%EOF\r\n");
 }
 
+void PDFDoc::writeCompressedStream (Dict *dict, GooString *data, OutStream* outStr, XRef *xRef)
+{
+  Object obj1;
+  GooString *deflated;
+
+  if ((deflated = deflateStreamData(dict, data))) {
+    data = deflated;
+  }
+  dict->set("Length", obj1.initInt(data->getLength()));
+  writeDictionnary(dict, outStr, xRef, 0, NULL, cryptRC4, 0, 0, 0);
+  outStr->printf("stream\r\n");
+  outStr->write(data->getCString(), data->getLength());
+  outStr->printf("\r\nendstream\r\n");
+  delete deflated;
+}
+
+GooString *PDFDoc::deflateStreamData (Dict *dict, GooString *data)
+{
+#ifdef ENABLE_ZLIB_ENCODER
+  Object obj1;
+  MemStream *mStream = new MemStream(data->getCString(), 0, data->getLength(), obj1.initNull());
+  FlateEncoder *enc = new FlateEncoder(mStream);
+  GooString *deflated = new GooString();
+  enc->fillGooString(deflated);
+  delete enc;
+  delete mStream;
+  if (deflated->getLength() < data->getLength()) {
+    dict->set("Filter", obj1.initName("FlateDecode"));
+    return deflated;
+  }
+  delete deflated;
+#endif
+  return NULL;
+}
+
 void PDFDoc::writeXRefTableTrailer(Goffset uxrefOffset, XRef *uxref, GBool writeAllEntries,
                                    int uxrefSize, OutStream* outStr, GBool incrUpdate)
 {
   const char *fileNameA = fileName ? fileName->getCString() : NULL;
   // file size (doesn't include the trailer)
   unsigned int fileSize = 0;
-  int c;
+  Guchar buf[4096];
+  int n;
   str->reset();
-  while ((c = str->getChar()) != EOF) {
-    fileSize++;
+  while ((n = str->doGetChars(sizeof(buf), buf)) > 0) {
+    fileSize += n;
   }
   str->close();
   Ref ref;
@@ -61,12 +61,17 @@ class Outline;
 class Linearization;
 class SecurityHandler;
 class Hints;
+class CachedFile;
 class StructTreeRoot;
+class PDFDocCache;
+class GfxOpListCache;
 
 enum PDFWriteMode {
   writeStandard,
   writeForceRewrite,
-  writeForceIncremental
+  writeForceIncremental,
+  writeForceRewriteCompressed, // complete rewrite using object and xref streams
+  writeForceLinearized         // complete rewrite as a linearized (fast web view) file
 };
 
 //------------------------------------------------------------------------
@@ -76,8 +81,11 @@ enum PDFWriteMode {
 class PDFDoc {
 public:
 
+  // With a docCache, the xref table is copied from the cache when it has
+  // the one of this version of the file, and put there otherwise.
   PDFDoc(GooString *fileNameA, GooString *ownerPassword = NULL,
-	 GooString *userPassword = NULL, void *guiDataA = NULL);
+	 GooString *userPassword = NULL, void *guiDataA = NULL,
+	 PDFDocCache *docCache = NULL);
 
 #ifdef _WIN32
   PDFDoc(wchar_t *fileNameA, int fileNameLen, GooString *ownerPassword = NULL,
@@ -221,6 +229,29 @@ public:
   // Is this document linearized?
   GBool isLinearized(GBool tryingToReconstruct = gFalse);
 
+  // Is all the data needed to display the page available? This can only
+  // be false for documents read through a CachedFile.
+  GBool isPageAvailable(int page);
+
+  // Starts loading the data needed to display the page, as listed in the
+  // hint tables of a linearized document read through a CachedFile.
+  // Without hint tables, the whole file is loaded.
+  // If wait is true, returns once the data is available.
+  // Returns false if the data can not be loaded.
+  GBool prefetchPage(int page, GBool wait = gFalse);
+
+  // Whether displaying page N starts loading the data of page N+1.
+  // Enabled by default.
+  void setPagePrefetching(GBool enable) { pagePrefetching = enable; }
+
+  // Keep the parsed contents of recently displayed pages, up to <size>
+  // bytes, so that displaying a page again doesn't parse its content
+  // streams again.  Disabled (0) by default.
+  void setContentCacheSize(int size);
+  int getContentCacheSize();
+  // Returns NULL while the content cache is disabled.
+  GfxOpListCache *getContentCache();
+
   // Return the document's Info dictionary (if any).
   Object *getDocInfo(Object *obj) { return xref->getDocInfo(obj); }
   Object *getDocInfoNF(Object *obj) { return xref->getDocInfoNF(obj); }
@@ -232,8 +263,12 @@ public:
   //Return the PDF ID in the trailer dictionary (if any).
   GBool getID(GooString *permanent_id, GooString *update_id);
 
-  // Save one page with another name.
-  int savePageAs(GooString *name, int pageNo);
+  // Save one page with another name. If subsetFonts is set, the fonts
+  // embedded in the page are subset to the glyphs it uses (not done for
+  // encrypted documents). If compress is set, the page is written with
+  // object and xref streams (not done for encrypted documents either).
+  int savePageAs(GooString *name, int pageNo, GBool subsetFonts = gFalse,
+                 GBool compress = gFalse);
   // Save this file with another name.
   int saveAs(GooString *name, PDFWriteMode mode=writeStandard);
   // Save this file in the given output stream.
@@ -264,6 +299,18 @@ public:
                                      Goffset uxrefOffset, OutStream* outStr, XRef *xRef);
   static void writeXRefStreamTrailer (Dict *trailerDict, XRef *uxref, Ref *uxrefStreamRef,
                                       Goffset uxrefOffset, OutStream* outStr, XRef *xRef);
+  // Same, for the sparse xref section of an incremental update
+  static void writeXRefTableTrailer (Dict *trailerDict, std::vector<XRefSectionEntry> *uxrefEntries,
+                                     Goffset uxrefOffset, OutStream* outStr, XRef *xRef);
+  static void writeXRefStreamTrailer (Dict *trailerDict, std::vector<XRefSectionEntry> *uxrefEntries,
+                                      Ref *uxrefStreamRef, Goffset uxrefOffset, OutStream* outStr, XRef *xRef);
+  // Write the dictionary and data of a stream object, compressing the data
+  // with the Flate filter when it makes it smaller. Sets /Length (and
+  // /Filter) in dict.
+  static void writeCompressedStream (Dict *dict, GooString *data, OutStream* outStr, XRef *xRef);
+  // Return data compressed with the Flate filter, and set /Filter in
+  // dict, if that makes it smaller; return NULL otherwise.
+  static GooString *deflateStreamData (Dict *dict, GooString *data);
 
 private:
   // insert referenced objects in XRef
@@ -284,21 +331,42 @@ private:
   { writeDictionnary(dict, outStr, getXRef(), 0, fileKey, encAlgorithm, keyLength, objNum, objGen); }
   static void writeStream (Stream* str, OutStream* outStr);
   static void writeRawStream (Stream* str, OutStream* outStr);
+  // Same, copying <length> bytes instead of the /Length of the stream
+  static void writeRawStream (Stream* str, OutStream* outStr, Goffset length);
   void writeXRefTableTrailer (Goffset uxrefOffset, XRef *uxref, GBool writeAllEntries,
                               int uxrefSize, OutStream* outStr, GBool incrUpdate);
   static void writeString (GooString* s, OutStream* outStr, Guchar *fileKey,
                            CryptAlgorithm encAlgorithm, int keyLength, int objNum, int objGen);
+  // savePageAs for unencrypted documents
+  int savePageCopyAs(GooString *name, int pageNo, GBool subsetFonts, GBool compress);
   void saveIncrementalUpdate (OutStream* outStr);
   void saveCompleteRewrite (OutStream* outStr);
+  void saveCompressedRewrite (OutStream* outStr);
+  void writeObjectStream (int objStmNum, std::vector<int> *objNums, std::vector<Goffset> *objOffsets,
+                          MemOutStream *objData, XRef *uxref, OutStream* outStr);
+  int saveLinearized (OutStream* outStr);
+  // Append to objs the objects reachable from object num that haven't
+  // been marked with mark yet, without going through the stopAt objects
+  void collectLinearizedObjects (int num, int mark, std::vector<int> *marks,
+                                 std::vector<GBool> *stopAt, std::vector<int> *objs);
+  // Write object num with the number given by numMap, renumbering the
+  // references it contains
+  void writeLinearizedObject (int num, std::vector<int> *numMap, OutStream* outStr);
+  static void writeHintStream (OutStream* outStr, int num, GooString *data, int sharedOffset, XRef *xRef);
 
   Page *parsePage(int page);
 
   // Get hints.
   Hints *getHints();
 
+  CachedFile *getCachedFile();
+  std::vector<ByteRange> *getPageRanges(int page);
+  void prefetchForDisplay(int page);
+
   PDFDoc();
   void init();
-  GBool setup(GooString *ownerPassword, GooString *userPassword);
+  GBool setup(GooString *ownerPassword, GooString *userPassword,
+	      PDFDocCache *docCache = NULL);
   GBool checkFooter();
   void checkHeader();
   GBool checkEncryption(GooString *ownerPassword, GooString *userPassword);
@@ -327,6 +395,8 @@ private:
   Outline *outline;
 #endif
   Page **pageCache;
+  GBool pagePrefetching;
+  GfxOpListCache *contentCache;
 
   GBool ok;
   int errCode;
@@ -0,0 +1,96 @@
+//========================================================================
+//
+// PDFDocCache.cc
+//
+// This file is licensed under the GPLv2 or later
+//
+//========================================================================
+
+#include <config.h>
+
+#include "goo/GooString.h"
+#include "PopplerCache.h"
+#include "XRef.h"
+#include "PDFDocCache.h"
+
+#if MULTITHREADED
+#  define cacheLocker()   MutexLocker locker(&mutex)
+#else
+#  define cacheLocker()
+#endif
+
+//------------------------------------------------------------------------
+
+class PDFDocCacheKey : public PopplerCacheKey {
+public:
+
+  PDFDocCacheKey(GooString *keyA) { key = keyA; }
+  ~PDFDocCacheKey() { delete key; }
+
+  bool operator==(const PopplerCacheKey &other) const
+    { return key->cmp(static_cast<const PDFDocCacheKey &>(other).key) == 0; }
+
+  GooString *key;
+};
+
+class PDFDocCacheItem : public PopplerCacheItem {
+public:
+
+  PDFDocCacheItem(XRef *xrefA) { xref = xrefA; }
+  ~PDFDocCacheItem() { delete xref; }
+
+  XRef *xref;			// copy without a stream
+};
+
+//------------------------------------------------------------------------
+// PDFDocCache
+//------------------------------------------------------------------------
+
+PDFDocCache::PDFDocCache(int maxDocsA) {
+#if MULTITHREADED
+  gInitMutex(&mutex);
+#endif
+  maxDocs = maxDocsA > 0 ? maxDocsA : 1;
+  cache = new PopplerCache(maxDocs);
+  numHits = numMisses = 0;
+}
+
+PDFDocCache::~PDFDocCache() {
+  delete cache;
+#if MULTITHREADED
+  gDestroyMutex(&mutex);
+#endif
+}
+
+XRef *PDFDocCache::lookupXRef(GooString *key, BaseStream *str) {
+  cacheLocker();
+  PDFDocCacheKey cacheKey(key);
+  PDFDocCacheItem *item = static_cast<PDFDocCacheItem *>(cache->lookup(cacheKey));
+  cacheKey.key = NULL;
+  if (!item) {
+    ++numMisses;
+    return NULL;
+  }
+  ++numHits;
+  return item->xref->copy(str);
+}
+
+void PDFDocCache::putXRef(GooString *key, XRef *xref) {
+  cacheLocker();
+  PDFDocCacheKey cacheKey(key);
+  GBool found = cache->lookup(cacheKey) != NULL;
+  cacheKey.key = NULL;
+  if (found) {
+    return;
+  }
+  XRef *xrefCopy = xref->copy(NULL);
+  if (xrefCopy) {
+    cache->put(new PDFDocCacheKey(key->copy()), new PDFDocCacheItem(xrefCopy));
+  }
+}
+
+void PDFDocCache::clear() {
+  cacheLocker();
+  delete cache;
+  cache = new PopplerCache(maxDocs);
+}
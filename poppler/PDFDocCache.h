@@ -0,0 +1,66 @@
+//========================================================================
+//
+// PDFDocCache.h
+//
+// This file is licensed under the GPLv2 or later
+//
+//========================================================================
+
+#ifndef PDFDOCCACHE_H
+#define PDFDOCCACHE_H
+
+#include "poppler-config.h"
+#include "goo/gtypes.h"
+#include "goo/GooMutex.h"
+
+class BaseStream;
+class GooString;
+class PopplerCache;
+class XRef;
+
+//------------------------------------------------------------------------
+// PDFDocCache
+//
+// Keeps the parsed xref tables of recently opened local documents, so
+// that opening one of them again copies its table instead of reading it
+// from the file, or reconstructing it in the case of a damaged file.
+// Documents are identified by their path and by the identity of the file
+// (see GooFile::getIdentity), so a modified file is read again. Encrypted
+// documents are not cached.
+//
+// A PDFDocCache can be shared by several PDFDocFactory objects, and
+// used from several threads.
+//------------------------------------------------------------------------
+
+class PDFDocCache {
+public:
+
+  // Keep the tables of at most maxDocsA documents.
+  PDFDocCache(int maxDocsA = 256);
+  ~PDFDocCache();
+
+  // Return a copy of the table cached for key, reading from str, or NULL.
+  XRef *lookupXRef(GooString *key, BaseStream *str);
+
+  // Cache a copy of xref, the table of a document that has just been
+  // opened, for key.
+  void putXRef(GooString *key, XRef *xref);
+
+  // Forget all documents.
+  void clear();
+
+  int getNumHits() { return numHits; }
+  int getNumMisses() { return numMisses; }
+
+private:
+
+  int maxDocs;
+  PopplerCache *cache;
+  int numHits;
+  int numMisses;
+#if MULTITHREADED
+  GooMutex mutex;
+#endif
+};
+
+#endif
@@ -27,7 +27,7 @@
 // PDFDocFactory
 //------------------------------------------------------------------------
 
-PDFDocFactory::PDFDocFactory(GooList *pdfDocBuilders)
+PDFDocFactory::PDFDocFactory(GooList *pdfDocBuilders, PDFDocCache *docCache)
 {
   if (pdfDocBuilders) {
     builders = pdfDocBuilders;
@@ -38,7 +38,7 @@ PDFDocFactory::PDFDocFactory(GooList *pdfDocBuilders)
   builders->insert(0, new CurlPDFDocBuilder());
 #endif
   builders->insert(0, new StdinPDFDocBuilder());
-  builders->insert(0, new LocalPDFDocBuilder());
+  builders->insert(0, new LocalPDFDocBuilder(docCache));
 }
 
 PDFDocFactory::~PDFDocFactory()
@@ -17,6 +17,7 @@
 class GooList;
 class GooString;
 class PDFDocBuilder;
+class PDFDocCache;
 
 //------------------------------------------------------------------------
 // PDFDocFactory
@@ -28,13 +29,17 @@ class PDFDocBuilder;
 //
 // You can extend the supported URIs by giving a list of PDFDocBuilders to
 // the constructor, or by registering a new PDFDocBuilder afterwards.
+//
+// Local files are opened through docCache when one is given: documents
+// opened again, by this factory or by any other using the same cache,
+// don't need their xref table to be read again.
 //------------------------------------------------------------------------
 
 class PDFDocFactory {
 
 public:
 
-  PDFDocFactory(GooList *pdfDocBuilders = NULL);
+  PDFDocFactory(GooList *pdfDocBuilders = NULL, PDFDocCache *docCache = NULL);
   ~PDFDocFactory();
 
   // Create a PDFDoc. Returns a PDFDoc. You should check this PDFDoc
@@ -0,0 +1,1015 @@
+//========================================================================
+//
+// PDFPageWriter.cc
+//
+// This file is licensed under the GPLv2 or later
+//
+//========================================================================
+
+#include <config.h>
+
+#ifdef USE_GCC_PRAGMAS
+#pragma implementation
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include "goo/gmem.h"
+#include "goo/GooHash.h"
+#include "goo/GooList.h"
+#include "goo/GooString.h"
+#include "fofi/FoFiTrueType.h"
+#include "fofi/FoFiType1C.h"
+#include "Object.h"
+#include "Stream.h"
+#include "XRef.h"
+#include "Catalog.h"
+#include "Page.h"
+#include "Annot.h"
+#include "Decrypt.h"
+#include "Error.h"
+#include "Gfx.h"
+#include "GfxFont.h"
+#include "GfxState.h"
+#include "OptionalContent.h"
+#include "OutputDev.h"
+#include "PDFDoc.h"
+#include "PDFPageWriter.h"
+
+// Special values in numMap.
+#define numUnseen      0
+#define numInProgress -1
+#define numNull       -2
+
+#define objStmMaxObjects 100	// max number of objects packed into one
+				//   object stream
+
+// Glyphs used from an embedded font file.
+struct PDFSubsetFont {
+  GBool trueType;		// TrueType font file (else CFF)
+  GBool whole;			// copy the font file whole
+  char *gids;			// flags for the glyphs used
+  int gidsLen;			// size of gids
+};
+
+static void appendToGooString(void *stream, const char *data, int len) {
+  ((GooString *)stream)->append(data, len);
+}
+
+static void initRectArray(Object *obj, PDFRectangle *rect) {
+  Object obj1;
+
+  obj->initArray((XRef *)NULL);
+  obj->arrayAdd(obj1.initReal(rect->x1));
+  obj->arrayAdd(obj1.initReal(rect->y1));
+  obj->arrayAdd(obj1.initReal(rect->x2));
+  obj->arrayAdd(obj1.initReal(rect->y2));
+}
+
+//------------------------------------------------------------------------
+// PDFFontUsageDev
+//------------------------------------------------------------------------
+
+// Code-to-GID mapping of a font used on the scanned pages.
+struct PDFFontGIDMap {
+  Ref fontID;
+  int subset;			// index in fontSubsets, or -1
+  int *map;			// code-to-GID map, or NULL for identity
+  int mapLen;
+};
+
+// Records the glyphs drawn from each embedded font file.
+class PDFFontUsageDev: public OutputDev {
+public:
+
+  PDFFontUsageDev(PDFPageWriter *writerA);
+  virtual ~PDFFontUsageDev();
+
+  virtual GBool upsideDown() { return gTrue; }
+  virtual GBool useDrawChar() { return gTrue; }
+  virtual GBool interpretType3Chars() { return gTrue; }
+  // text can be drawn inside tiling patterns, so patterns must be
+  // run; one cell is enough, and shadings are skipped
+  virtual GBool needNonText() { return gTrue; }
+  virtual GBool useTilingPatternFill() { return gTrue; }
+  virtual GBool useShadedFills(int type) { return gTrue; }
+  virtual void startPage(int pageNum, GfxState *state, XRef *xref)
+    { lastFont = NULL; }
+  virtual GBool tilingPatternFill(GfxState *state, Gfx *gfx, Catalog *cat,
+				  Object *str, double *pmat, int paintType,
+				  int tilingType, Dict *resDict,
+				  double *mat, double *bbox,
+				  int x0, int y0, int x1, int y1,
+				  double xStep, double yStep);
+  virtual GBool functionShadedFill(GfxState *state,
+				   GfxFunctionShading *shading)
+    { return gTrue; }
+  virtual GBool axialShadedFill(GfxState *state, GfxAxialShading *shading,
+				double tMin, double tMax)
+    { return gTrue; }
+  virtual GBool radialShadedFill(GfxState *state, GfxRadialShading *shading,
+				 double sMin, double sMax)
+    { return gTrue; }
+  virtual GBool gouraudTriangleShadedFill(GfxState *state,
+					  GfxGouraudTriangleShading *shading)
+    { return gTrue; }
+  virtual GBool patchMeshShadedFill(GfxState *state,
+				    GfxPatchMeshShading *shading)
+    { return gTrue; }
+  virtual void drawChar(GfxState *state, double x, double y,
+			double dx, double dy,
+			double originX, double originY,
+			CharCode code, int nBytes, Unicode *u, int uLen);
+
+private:
+
+  PDFFontGIDMap *findFont(GfxFont *font);
+
+  PDFPageWriter *writer;
+  PDFFontGIDMap *fonts;
+  int fontsLen;
+  int fontsSize;
+  GfxFont *lastFont;
+  PDFFontGIDMap *lastMap;
+};
+
+PDFFontUsageDev::PDFFontUsageDev(PDFPageWriter *writerA) {
+  writer = writerA;
+  fonts = NULL;
+  fontsLen = fontsSize = 0;
+  lastFont = NULL;
+  lastMap = NULL;
+}
+
+PDFFontUsageDev::~PDFFontUsageDev() {
+  for (int i = 0; i < fontsLen; i++) {
+    gfree(fonts[i].map);
+  }
+  gfree(fonts);
+}
+
+GBool PDFFontUsageDev::tilingPatternFill(GfxState *state, Gfx *gfx,
+					 Catalog *cat, Object *str,
+					 double *pmat, int paintType,
+					 int tilingType, Dict *resDict,
+					 double *mat, double *bbox,
+					 int x0, int y0, int x1, int y1,
+					 double xStep, double yStep) {
+  gfx->drawForm(str, resDict, mat, bbox);
+  return gTrue;
+}
+
+void PDFFontUsageDev::drawChar(GfxState *state, double x, double y,
+			       double dx, double dy,
+			       double originX, double originY,
+			       CharCode code, int nBytes,
+			       Unicode *u, int uLen) {
+  PDFSubsetFont *subset;
+  GfxFont *font;
+  int gid, n;
+
+  if (!(font = state->getFont())) {
+    return;
+  }
+  // fonts of form XObjects are freed at the end of the form, so a new
+  // font can get the address of lastFont
+  if (font != lastFont || font->getID()->num != lastMap->fontID.num ||
+      font->getID()->gen != lastMap->fontID.gen) {
+    lastFont = font;
+    lastMap = findFont(font);
+  }
+  if (lastMap->subset < 0) {
+    return;
+  }
+  if (lastMap->map) {
+    gid = code < (CharCode)lastMap->mapLen ? lastMap->map[code] : 0;
+  } else {
+    gid = code < 0x10000 ? (int)code : 0;
+  }
+  if (gid <= 0 || gid >= 0x10000) {
+    return;
+  }
+  subset = &writer->fontSubsets[lastMap->subset];
+  if (gid >= subset->gidsLen) {
+    n = subset->gidsLen ? subset->gidsLen : 256;
+    while (n <= gid) {
+      n *= 2;
+    }
+    subset->gids = (char *)grealloc(subset->gids, n);
+    memset(subset->gids + subset->gidsLen, 0, n - subset->gidsLen);
+    subset->gidsLen = n;
+  }
+  subset->gids[gid] = 1;
+}
+
+PDFFontGIDMap *PDFFontUsageDev::findFont(GfxFont *font) {
+  PDFFontGIDMap *fontMap;
+  FoFiTrueType *ffTT;
+  FoFiType1C *ffT1C;
+  GooHash *nameToGID;
+  GooString *name;
+  Ref embID;
+  char *fontBuf, *charName;
+  int *cidToGID;
+  int fontLen, n, i;
+  GBool trueType;
+
+  for (i = 0; i < fontsLen; i++) {
+    if (fonts[i].fontID.num == font->getID()->num &&
+        fonts[i].fontID.gen == font->getID()->gen) {
+      return &fonts[i];
+    }
+  }
+  if (fontsLen == fontsSize) {
+    fontsSize = fontsSize ? 2 * fontsSize : 16;
+    fonts = (PDFFontGIDMap *)greallocn(fonts, fontsSize, sizeof(PDFFontGIDMap));
+  }
+  fontMap = &fonts[fontsLen++];
+  fontMap->fontID = *font->getID();
+  fontMap->subset = -1;
+  fontMap->map = NULL;
+  fontMap->mapLen = 0;
+  if (!font->getEmbeddedFontID(&embID)) {
+    return fontMap;
+  }
+
+  // the glyphs are looked up the way the font engines do it: through
+  // the cmap for TrueType fonts, by name for 8-bit CFF fonts and
+  // through the CID-to-GID map for CID fonts
+  trueType = gTrue;
+  fontBuf = NULL;
+  switch (font->getType()) {
+  case fontTrueType:
+  case fontTrueTypeOT:
+    if ((fontBuf = font->readEmbFontFile(writer->doc->getXRef(), &fontLen)) &&
+        (ffTT = FoFiTrueType::make(fontBuf, fontLen))) {
+      fontMap->map = ((Gfx8BitFont *)font)->getCodeToGIDMap(ffTT);
+      fontMap->mapLen = 256;
+      delete ffTT;
+    } else {
+      gfree(fontBuf);
+      return fontMap;
+    }
+    break;
+  case fontCIDType2:
+  case fontCIDType2OT:
+    if ((cidToGID = ((GfxCIDFont *)font)->getCIDToGID())) {
+      n = ((GfxCIDFont *)font)->getCIDToGIDLen();
+      fontMap->map = (int *)gmallocn(n > 0 ? n : 1, sizeof(int));
+      memcpy(fontMap->map, cidToGID, n * sizeof(int));
+      fontMap->mapLen = n;
+    }
+    break;
+  case fontType1C:
+    trueType = gFalse;
+    if ((fontBuf = font->readEmbFontFile(writer->doc->getXRef(), &fontLen)) &&
+        (ffT1C = FoFiType1C::make(fontBuf, fontLen))) {
+      nameToGID = new GooHash(gTrue);
+      for (i = 0; i < ffT1C->getNumGlyphs(); i++) {
+        if ((name = ffT1C->getGlyphName(i))) {
+          if (!nameToGID->lookupInt(name)) {
+            nameToGID->add(name, i);
+          } else {
+            delete name;
+          }
+        }
+      }
+      fontMap->map = (int *)gmallocn(256, sizeof(int));
+      fontMap->mapLen = 256;
+      for (i = 0; i < 256; i++) {
+        charName = ((Gfx8BitFont *)font)->getCharName(i);
+        fontMap->map[i] = charName ? nameToGID->lookupInt(charName) : 0;
+      }
+      delete nameToGID;
+      delete ffT1C;
+    } else {
+      gfree(fontBuf);
+      return fontMap;
+    }
+    break;
+  case fontCIDType0C:
+    trueType = gFalse;
+    if ((fontBuf = font->readEmbFontFile(writer->doc->getXRef(), &fontLen)) &&
+        (ffT1C = FoFiType1C::make(fontBuf, fontLen))) {
+      if (ffT1C->isCIDFont()) {
+        fontMap->map = ffT1C->getCIDToGIDMap(&fontMap->mapLen);
+      }
+      delete ffT1C;
+    } else {
+      gfree(fontBuf);
+      return fontMap;
+    }
+    break;
+  default:
+    // Type 1 and OpenType CFF font files are copied whole
+    return fontMap;
+  }
+  gfree(fontBuf);
+  fontMap->subset = writer->getFontSubset(embID.num, trueType);
+  return fontMap;
+}
+
+//------------------------------------------------------------------------
+// PDFPageWriter
+//------------------------------------------------------------------------
+
+PDFPageWriter::PDFPageWriter(OutStream *outStrA, int majorVersion, int minorVersion,
+                             GBool compressA) {
+  outStr = outStrA;
+  outXRef = new XRef();
+  outXRef->add(0, 65535, 0, gFalse);
+  catalogNum = 1;
+  pagesNum = 2;
+  nextNum = 3;
+  catalogDict.initDict((XRef *)NULL);
+  docInfo.initNull();
+  streamHash = new GooHash(gTrue);
+  doc = NULL;
+  fontSubsets = NULL;
+  fontSubsetsLen = fontSubsetsSize = 0;
+  compress = compressA;
+  objStmData = NULL;
+  if (compress) {
+    objStmData = new MemOutStream();
+    // object and xref streams need PDF 1.5
+    if (majorVersion < 1 || (majorVersion == 1 && minorVersion < 5)) {
+      majorVersion = 1;
+      minorVersion = 5;
+    }
+  }
+  PDFDoc::writeHeader(outStr, majorVersion, minorVersion);
+}
+
+PDFPageWriter::~PDFPageWriter() {
+  catalogDict.free();
+  docInfo.free();
+  delete streamHash;
+  delete outXRef;
+  delete objStmData;
+  clearFontSubsets();
+}
+
+void PDFPageWriter::setDocument(PDFDoc *docA) {
+  doc = docA;
+  numMap.clear();
+  if (doc) {
+    numMap.resize(doc->getXRef()->getNumObjects(), numUnseen);
+  }
+  clearFontSubsets();
+}
+
+void PDFPageWriter::subsetFonts(const std::vector<int> &pages) {
+  PDFFontUsageDev *dev;
+  OptionalContentGroup *ocg;
+  GooList *ocgs;
+  OCGs *ocgConfig;
+  Page *page;
+  Annots *annots;
+  OptionalContentGroup::State *ocStates;
+  int nOCGs;
+
+  if (!doc) {
+    return;
+  }
+  fontSubsetMap.resize(doc->getXRef()->getNumObjects(), 0);
+
+  // make all the optional content visible
+  ocStates = NULL;
+  nOCGs = 0;
+  ocgs = NULL;
+  if ((ocgConfig = doc->getOptContentConfig()) &&
+      (ocgs = ocgConfig->getOCGs())) {
+    nOCGs = ocgs->getLength();
+    ocStates = (OptionalContentGroup::State *)
+                   gmallocn(nOCGs > 0 ? nOCGs : 1,
+                            sizeof(OptionalContentGroup::State));
+    for (int i = 0; i < nOCGs; i++) {
+      ocg = (OptionalContentGroup *)ocgs->get(i);
+      ocStates[i] = ocg->getState();
+      ocg->setState(OptionalContentGroup::On);
+    }
+  }
+
+  dev = new PDFFontUsageDev(this);
+  for (size_t i = 0; i < pages.size(); i++) {
+    if (pages[i] < 1 || pages[i] > doc->getNumPages() ||
+        !(page = doc->getCatalog()->getPage(pages[i]))) {
+      continue;
+    }
+    doc->displayPage(dev, pages[i], 72, 72, 0, gTrue, gFalse, gFalse);
+    // annotations that are only printed, or only displayed, are drawn
+    // by one of the passes only
+    annots = page->getAnnots();
+    if (annots && annots->getNumAnnots() > 0) {
+      doc->displayPage(dev, pages[i], 72, 72, 0, gTrue, gFalse, gTrue);
+    }
+  }
+  delete dev;
+
+  for (int i = 0; i < nOCGs; i++) {
+    ((OptionalContentGroup *)ocgs->get(i))->setState(ocStates[i]);
+  }
+  gfree(ocStates);
+}
+
+GBool PDFPageWriter::addPage(int pageNo) {
+  Page *page;
+  Ref *pageRef;
+  Object pageObj, newPage, obj1, obj2;
+  int num;
+
+  if (!doc || pageNo < 1 || pageNo > doc->getNumPages() ||
+      !(page = doc->getCatalog()->getPage(pageNo)) ||
+      !(pageRef = doc->getCatalog()->getPageRef(pageNo))) {
+    error(errInternal, -1, "PDFPageWriter: illegal page number {0:d}", pageNo);
+    return gFalse;
+  }
+  if (!doc->getXRef()->fetch(pageRef->num, pageRef->gen, &pageObj)->isDict()) {
+    pageObj.free();
+    return gFalse;
+  }
+
+  // references to this page that were copied before (links, annotation
+  // /P entries) already got its number
+  if (pageRef->num >= 0 && pageRef->num < (int)numMap.size()) {
+    num = numMap[pageRef->num];
+    if (num > 0 && num < outXRef->getNumObjects() &&
+        outXRef->getEntry(num)->type != xrefEntryFree) {
+      // the page was added before
+      num = 0;
+    }
+    if (num <= 0) {
+      num = nextNum++;
+      numMap[pageRef->num] = num;
+    }
+  } else {
+    num = nextNum++;
+  }
+
+  newPage.initDict((XRef *)NULL);
+  for (int i = 0; i < pageObj.dictGetLength(); i++) {
+    const char *key = pageObj.dictGetKey(i);
+    if (strcmp(key, "Parent") && strcmp(key, "MediaBox") &&
+        strcmp(key, "CropBox") && strcmp(key, "Rotate") &&
+        strcmp(key, "Resources")) {
+      copyObject(pageObj.dictGetValNF(i, &obj1), &obj2);
+      obj1.free();
+      newPage.dictAdd(copyString(key), &obj2);
+    }
+  }
+  newPage.dictAdd(copyString("Parent"), obj1.initRef(pagesNum, 0));
+
+  // the attributes inherited from the page tree
+  initRectArray(&obj1, page->getMediaBox());
+  newPage.dictAdd(copyString("MediaBox"), &obj1);
+  if (page->isCropped()) {
+    initRectArray(&obj1, page->getCropBox());
+    newPage.dictAdd(copyString("CropBox"), &obj1);
+  }
+  newPage.dictAdd(copyString("Rotate"), obj1.initInt(page->getRotate()));
+  if (!pageObj.dictLookupNF("Resources", &obj1)->isNull()) {
+    copyObject(&obj1, &obj2);
+    newPage.dictAdd(copyString("Resources"), &obj2);
+  } else if (page->getResourceDict()) {
+    obj1.free();
+    obj1.initDict(page->getResourceDict());
+    copyObject(&obj1, &obj2);
+    newPage.dictAdd(copyString("Resources"), &obj2);
+  }
+  obj1.free();
+  pageObj.free();
+
+  writeObject(num, &newPage);
+  newPage.free();
+  kids.push_back(num);
+  return gTrue;
+}
+
+void PDFPageWriter::setCatalogEntry(const char *key, Object *obj) {
+  Object obj1;
+
+  copyObject(obj, &obj1);
+  catalogDict.dictSet(key, &obj1);
+}
+
+void PDFPageWriter::setAcroForm(Object *obj) {
+  Object acroForm, form, obj1, obj2, obj3;
+
+  if (!obj->fetch(doc->getXRef(), &acroForm)->isDict()) {
+    acroForm.free();
+    return;
+  }
+  // the widgets of the added pages were copied together with their
+  // parent fields, so a field that wasn't copied has no widgets on
+  // these pages; the calculation order is filtered the same way
+  form.initDict((XRef *)NULL);
+  for (int i = 0; i < acroForm.dictGetLength(); i++) {
+    const char *key = acroForm.dictGetKey(i);
+    if (!strcmp(key, "Fields") || !strcmp(key, "CO")) {
+      obj1.initArray((XRef *)NULL);
+      if (acroForm.dictGetVal(i, &obj2)->isArray()) {
+        for (int j = 0; j < obj2.arrayGetLength(); j++) {
+          obj2.arrayGetNF(j, &obj3);
+          if (obj3.isRef() &&
+              (obj3.getRefNum() < 0 || obj3.getRefNum() >= (int)numMap.size() ||
+               numMap[obj3.getRefNum()] <= 0)) {
+            obj3.free();
+          } else {
+            obj1.arrayAdd(&obj3);
+          }
+        }
+      }
+      obj2.free();
+    } else {
+      acroForm.dictGetValNF(i, &obj1);
+    }
+    form.dictAdd(copyString(key), &obj1);
+  }
+  acroForm.free();
+  setCatalogEntry("AcroForm", &form);
+  form.free();
+}
+
+void PDFPageWriter::setDocInfo(Object *obj) {
+  Object obj1;
+  int num;
+
+  docInfo.free();
+  copyObject(obj, &obj1);
+  if (obj1.isDict()) {
+    // the Info dictionary must be an indirect object
+    num = nextNum++;
+    writeObject(num, &obj1);
+    obj1.free();
+    docInfo.initRef(num, 0);
+  } else if (obj1.isRef()) {
+    docInfo = obj1;
+  } else {
+    obj1.free();
+    docInfo.initNull();
+  }
+}
+
+void PDFPageWriter::finish(const char *fileName) {
+  Object obj, obj1, obj2;
+  Goffset uxrefOffset;
+  Dict *trailerDict;
+  Ref root, xrefStreamRef;
+
+  obj.initDict((XRef *)NULL);
+  obj.dictAdd(copyString("Type"), obj1.initName("Pages"));
+  obj1.initArray((XRef *)NULL);
+  for (size_t i = 0; i < kids.size(); i++) {
+    obj1.arrayAdd(obj2.initRef(kids[i], 0));
+  }
+  obj.dictAdd(copyString("Kids"), &obj1);
+  obj.dictAdd(copyString("Count"), obj1.initInt((int)kids.size()));
+  writeObject(pagesNum, &obj);
+  obj.free();
+
+  obj.initDict((XRef *)NULL);
+  obj.dictAdd(copyString("Type"), obj1.initName("Catalog"));
+  obj.dictAdd(copyString("Pages"), obj1.initRef(pagesNum, 0));
+  for (int i = 0; i < catalogDict.dictGetLength(); i++) {
+    obj.dictAdd(copyString(catalogDict.dictGetKey(i)), catalogDict.dictGetValNF(i, &obj1));
+  }
+  writeObject(catalogNum, &obj);
+  obj.free();
+
+  if (compress && !objStmNums.empty()) {
+    writeObjectStream();
+  }
+  uxrefOffset = outStr->getPos();
+  if (compress) {
+    xrefStreamRef.num = nextNum++;
+    xrefStreamRef.gen = 0;
+    outXRef->add(xrefStreamRef.num, xrefStreamRef.gen, uxrefOffset, gTrue);
+  }
+  root.num = catalogNum;
+  root.gen = 0;
+  trailerDict = PDFDoc::createTrailerDict(nextNum, gFalse, 0, &root, outXRef,
+                                          fileName, uxrefOffset);
+  if (!docInfo.isNull()) {
+    trailerDict->set("Info", docInfo.copy(&obj));
+  }
+  if (compress) {
+    PDFDoc::writeXRefStreamTrailer(trailerDict, outXRef, &xrefStreamRef, uxrefOffset,
+                                   outStr, outXRef);
+  } else {
+    PDFDoc::writeXRefTableTrailer(trailerDict, outXRef, gFalse, uxrefOffset, outStr, outXRef);
+  }
+  delete trailerDict;
+}
+
+int PDFPageWriter::copyRef(Ref ref) {
+  Object obj, obj1;
+  int num;
+
+  if (ref.num < 0 || ref.num >= (int)numMap.size()) {
+    return 0;
+  }
+  num = numMap[ref.num];
+  if (num > 0) {
+    return num;
+  } else if (num == numNull) {
+    return 0;
+  } else if (num == numInProgress) {
+    // a reference cycle: the object gets its number before it is written
+    num = nextNum++;
+    numMap[ref.num] = num;
+    return num;
+  }
+
+  doc->getXRef()->fetch(ref.num, ref.gen, &obj);
+  if (obj.isDict("Page")) {
+    // only referenced here; it's written if the page gets added, and
+    // the reference points to a missing object (i.e. null) otherwise
+    num = nextNum++;
+    numMap[ref.num] = num;
+  } else if (obj.isNull() || obj.isDict("Pages") || obj.isDict("Catalog")) {
+    numMap[ref.num] = numNull;
+    num = 0;
+  } else if (obj.isStream()) {
+    numMap[ref.num] = numInProgress;
+    num = copyStream(ref.num, obj.getStream());
+  } else {
+    numMap[ref.num] = numInProgress;
+    copyObject(&obj, &obj1);
+    num = numMap[ref.num] > 0 ? numMap[ref.num] : nextNum++;
+    numMap[ref.num] = num;
+    writeObject(num, &obj1);
+    // streams referring to this object are keyed on its content
+    GooString key;
+    Guchar digest[16];
+    appendKey(&obj1, &key);
+    md5((Guchar *)key.getCString(), key.getLength(), digest);
+    setDigest(num, digest);
+    obj1.free();
+  }
+  obj.free();
+  return num;
+}
+
+void PDFPageWriter::copyObject(Object *obj, Object *result) {
+  Object obj1, obj2;
+  int num;
+
+  switch (obj->getType()) {
+  case objRef:
+    if ((num = copyRef(obj->getRef())) > 0) {
+      result->initRef(num, 0);
+    } else {
+      result->initNull();
+    }
+    break;
+  case objArray:
+    result->initArray((XRef *)NULL);
+    for (int i = 0; i < obj->arrayGetLength(); i++) {
+      copyObject(obj->arrayGetNF(i, &obj1), &obj2);
+      obj1.free();
+      result->arrayAdd(&obj2);
+    }
+    break;
+  case objDict:
+    result->initDict((XRef *)NULL);
+    for (int i = 0; i < obj->dictGetLength(); i++) {
+      copyObject(obj->dictGetValNF(i, &obj1), &obj2);
+      obj1.free();
+      result->dictAdd(copyString(obj->dictGetKey(i)), &obj2);
+    }
+    break;
+  case objStream:
+    // streams are always indirect objects
+    result->initNull();
+    break;
+  default:
+    obj->copy(result);
+    break;
+  }
+}
+
+int PDFPageWriter::copyStream(int num, Stream *str) {
+  Object dictObj, obj1, obj2;
+  GooString *data, *key, *subsetData, *deflated;
+  Guchar digest[16];
+  int dictLength, newNum;
+  char buf[32];
+
+  // /Length is replaced, don't copy the object it may refer to
+  obj1.initDict((XRef *)NULL);
+  for (int i = 0; i < str->getDict()->getLength(); i++) {
+    const char *dictKey = str->getDict()->getKey(i);
+    if (strcmp(dictKey, "Length")) {
+      copyObject(str->getDict()->getValNF(i, &dictObj), &obj2);
+      dictObj.free();
+      obj1.dictAdd(copyString(dictKey), &obj2);
+    }
+  }
+
+  // the dictionary (without /Length) and the data identify the stream
+  data = new GooString();
+  if ((subsetData = makeFontSubset(num, str))) {
+    // a subset font program replaces the font file data
+    obj1.getDict()->remove("Filter");
+    obj1.getDict()->remove("DecodeParms");
+    if (obj1.getDict()->hasKey("Length1")) {
+      obj1.dictSet("Length1", dictObj.initInt(subsetData->getLength()));
+    }
+    if ((deflated = PDFDoc::deflateStreamData(obj1.getDict(), subsetData))) {
+      delete subsetData;
+      subsetData = deflated;
+    }
+    appendKey(&obj1, data);
+    dictLength = data->getLength();
+    data->append(subsetData);
+    delete subsetData;
+  } else if (str->getKind() == strWeird) {
+    // created in memory: only the decoded data is available
+    obj1.getDict()->remove("Filter");
+    obj1.getDict()->remove("DecodeParms");
+    appendKey(&obj1, data);
+    dictLength = data->getLength();
+    str->fillGooString(data);
+  } else {
+    appendKey(&obj1, data);
+    dictLength = data->getLength();
+    str->getBaseStream()->fillGooString(data);
+  }
+
+  // an object that is part of a reference cycle already got its number
+  newNum = numMap[num];
+  md5((Guchar *)data->getCString(), data->getLength(), digest);
+  if (newNum <= 0) {
+    sprintf(buf, ":%d", data->getLength());
+    key = new GooString((const char *)digest, 16);
+    key->append(buf);
+    if ((newNum = streamHash->lookupInt(key)) > 0) {
+      delete key;
+      delete data;
+      obj1.free();
+      numMap[num] = newNum;
+      return newNum;
+    }
+    newNum = nextNum++;
+    numMap[num] = newNum;
+    streamHash->add(key, newNum);
+  }
+  setDigest(newNum, digest);
+
+  if (compress && !obj1.getDict()->hasKey("Filter")) {
+    GooString raw(data->getCString() + dictLength, data->getLength() - dictLength);
+    if ((deflated = PDFDoc::deflateStreamData(obj1.getDict(), &raw))) {
+      obj1.getDict()->remove("DecodeParms");
+      data->del(dictLength, data->getLength() - dictLength);
+      data->append(deflated);
+      delete deflated;
+    }
+  }
+
+  obj1.dictSet("Length", dictObj.initInt(data->getLength() - dictLength));
+  outXRef->add(newNum, 0, outStr->getPos(), gTrue);
+  outStr->printf("%d 0 obj\n", newNum);
+  PDFDoc::writeObject(&obj1, outStr, outXRef, 0, NULL, cryptRC4, 0, 0, 0);
+  outStr->printf("\nstream\r\n");
+  outStr->write(data->getCString() + dictLength, data->getLength() - dictLength);
+  outStr->printf("\r\nendstream\nendobj\n");
+  delete data;
+  obj1.free();
+  return newNum;
+}
+
+int PDFPageWriter::getFontSubset(int num, GBool trueType) {
+  PDFSubsetFont *subset;
+  int idx;
+
+  if (num < 0 || num >= (int)fontSubsetMap.size()) {
+    return -1;
+  }
+  if ((idx = fontSubsetMap[num] - 1) >= 0) {
+    subset = &fontSubsets[idx];
+    if (subset->trueType != trueType) {
+      // used as two kinds of font
+      subset->whole = gTrue;
+    }
+    return subset->whole ? -1 : idx;
+  }
+  if (fontSubsetsLen == fontSubsetsSize) {
+    fontSubsetsSize = fontSubsetsSize ? 2 * fontSubsetsSize : 16;
+    fontSubsets = (PDFSubsetFont *)greallocn(fontSubsets, fontSubsetsSize,
+                                             sizeof(PDFSubsetFont));
+  }
+  idx = fontSubsetsLen++;
+  subset = &fontSubsets[idx];
+  subset->trueType = trueType;
+  subset->whole = gFalse;
+  subset->gids = NULL;
+  subset->gidsLen = 0;
+  fontSubsetMap[num] = idx + 1;
+  return idx;
+}
+
+GooString *PDFPageWriter::makeFontSubset(int num, Stream *str) {
+  PDFSubsetFont *subset;
+  FoFiTrueType *ffTT;
+  FoFiType1C *ffT1C;
+  GooString *fontData, *subsetData;
+  Object obj1;
+  char *glyphs;
+  int idx, nGlyphs;
+  GBool ok;
+
+  if (num < 0 || num >= (int)fontSubsetMap.size() ||
+      (idx = fontSubsetMap[num] - 1) < 0 ||
+      fontSubsets[idx].whole) {
+    return NULL;
+  }
+  subset = &fontSubsets[idx];
+
+  // the CFF font file types that FoFiType1C handles
+  str->getDict()->lookup("Subtype", &obj1);
+  ok = subset->trueType ? !obj1.isName() || obj1.isName("OpenType")
+                        : obj1.isName("Type1C") || obj1.isName("CIDFontType0C");
+  obj1.free();
+  if (!ok) {
+    return NULL;
+  }
+
+  fontData = new GooString();
+  str->fillGooString(fontData);
+  str->close();
+  subsetData = new GooString();
+  ok = gFalse;
+  if (subset->trueType) {
+    if ((ffTT = FoFiTrueType::make(fontData->getCString(), fontData->getLength()))) {
+      nGlyphs = ffTT->getNumGlyphs();
+      glyphs = (char *)gmallocn(nGlyphs > 0 ? nGlyphs : 1, 1);
+      memset(glyphs, 0, nGlyphs);
+      memcpy(glyphs, subset->gids, nGlyphs < subset->gidsLen ? nGlyphs : subset->gidsLen);
+      ok = ffTT->writeSubsetTTF(glyphs, &appendToGooString, subsetData);
+      gfree(glyphs);
+      delete ffTT;
+    }
+  } else {
+    if ((ffT1C = FoFiType1C::make(fontData->getCString(), fontData->getLength()))) {
+      nGlyphs = ffT1C->getNumGlyphs();
+      glyphs = (char *)gmallocn(nGlyphs > 0 ? nGlyphs : 1, 1);
+      memset(glyphs, 0, nGlyphs);
+      memcpy(glyphs, subset->gids, nGlyphs < subset->gidsLen ? nGlyphs : subset->gidsLen);
+      ok = ffT1C->writeSubset(glyphs, &appendToGooString, subsetData);
+      gfree(glyphs);
+      delete ffT1C;
+    }
+  }
+  // an already subset font may not get any smaller
+  if (ok && subsetData->getLength() >= fontData->getLength()) {
+    ok = gFalse;
+  }
+  delete fontData;
+  if (!ok) {
+    delete subsetData;
+    return NULL;
+  }
+  return subsetData;
+}
+
+void PDFPageWriter::clearFontSubsets() {
+  for (int i = 0; i < fontSubsetsLen; i++) {
+    gfree(fontSubsets[i].gids);
+  }
+  gfree(fontSubsets);
+  fontSubsets = NULL;
+  fontSubsetsLen = fontSubsetsSize = 0;
+  fontSubsetMap.clear();
+}
+
+void PDFPageWriter::appendKey(Object *obj, GooString *key) {
+  Object obj1;
+  char buf[32];
+  int num;
+
+  switch (obj->getType()) {
+  case objBool:
+    key->append(obj->getBool() ? 't' : 'f');
+    break;
+  case objInt:
+    sprintf(buf, "i%d ", obj->getInt());
+    key->append(buf);
+    break;
+  case objInt64:
+    sprintf(buf, "l%lld ", obj->getInt64());
+    key->append(buf);
+    break;
+  case objReal:
+    sprintf(buf, "d%.17g ", obj->getReal());
+    key->append(buf);
+    break;
+  case objString:
+    sprintf(buf, "s%d:", obj->getString()->getLength());
+    key->append(buf);
+    key->append(obj->getString());
+    break;
+  case objName:
+    sprintf(buf, "n%d:", (int)strlen(obj->getName()));
+    key->append(buf);
+    key->append(obj->getName());
+    break;
+  case objArray:
+    key->append('[');
+    for (int i = 0; i < obj->arrayGetLength(); i++) {
+      appendKey(obj->arrayGetNF(i, &obj1), key);
+      obj1.free();
+    }
+    key->append(']');
+    break;
+  case objDict:
+    key->append('<');
+    for (int i = 0; i < obj->dictGetLength(); i++) {
+      const char *dictKey = obj->dictGetKey(i);
+      sprintf(buf, "n%d:", (int)strlen(dictKey));
+      key->append(buf);
+      key->append(dictKey);
+      appendKey(obj->dictGetValNF(i, &obj1), key);
+      obj1.free();
+    }
+    key->append('>');
+    break;
+  case objRef:
+    num = obj->getRefNum();
+    if (num < (int)digestSet.size() && digestSet[num]) {
+      key->append('R');
+      key->append((const char *)&digests[16 * num], 16);
+    } else {
+      // not written yet (a reference cycle) or not keyed (a page)
+      sprintf(buf, "o%d ", num);
+      key->append(buf);
+    }
+    break;
+  default:
+    key->append('z');
+    break;
+  }
+}
+
+void PDFPageWriter::setDigest(int num, Guchar *digest) {
+  if (num >= (int)digestSet.size()) {
+    digestSet.resize(num + 1, 0);
+    digests.resize(16 * (num + 1));
+  }
+  memcpy(&digests[16 * num], digest, 16);
+  digestSet[num] = 1;
+}
+
+void PDFPageWriter::writeObject(int num, Object *obj) {
+  if (compress) {
+    if ((int)objStmNums.size() == objStmMaxObjects) {
+      writeObjectStream();
+    }
+    objStmNums.push_back(num);
+    objStmOffsets.push_back(objStmData->getPos());
+    PDFDoc::writeObject(obj, objStmData, outXRef, 0, NULL, cryptRC4, 0, 0, 0);
+    objStmData->put('\n');
+    // the entry is made compressed once the object stream is written
+    outXRef->add(num, 0, 0, gTrue);
+    return;
+  }
+  outXRef->add(num, 0, outStr->getPos(), gTrue);
+  outStr->printf("%d 0 obj\n", num);
+  PDFDoc::writeObject(obj, outStr, outXRef, 0, NULL, cryptRC4, 0, 0, 0);
+  outStr->printf("\nendobj\n");
+}
+
+void PDFPageWriter::writeObjectStream() {
+  Object obj1;
+  GooString data;
+  Dict *dict;
+  XRefEntry *e;
+  int num, first;
+
+  for (size_t k = 0; k < objStmNums.size(); k++) {
+    data.appendf("{0:d} {1:lld} ", objStmNums[k], (long long)objStmOffsets[k]);
+  }
+  first = data.getLength();
+  data.append(objStmData->getData());
+
+  dict = new Dict(outXRef);
+  dict->set("Type", obj1.initName("ObjStm"));
+  dict->set("N", obj1.initInt((int)objStmNums.size()));
+  dict->set("First", obj1.initInt(first));
+
+  num = nextNum++;
+  outXRef->add(num, 0, outStr->getPos(), gTrue);
+  outStr->printf("%d 0 obj\n", num);
+  PDFDoc::writeCompressedStream(dict, &data, outStr, outXRef);
+  outStr->printf("endobj\n");
+  delete dict;
+
+  for (size_t k = 0; k < objStmNums.size(); k++) {
+    e = outXRef->getEntry(objStmNums[k]);
+    e->type = xrefEntryCompressed;
+    e->offset = num;
+    e->gen = k;
+  }
+  objStmNums.clear();
+  objStmOffsets.clear();
+  objStmData->getData()->clear();
+}
@@ -0,0 +1,151 @@
+//========================================================================
+//
+// PDFPageWriter.h
+//
+// This file is licensed under the GPLv2 or later
+//
+//========================================================================
+
+#ifndef PDFPAGEWRITER_H
+#define PDFPAGEWRITER_H
+
+#include "poppler-config.h"
+#include <vector>
+#include "goo/gtypes.h"
+#include "Object.h"
+
+class GooHash;
+class GooString;
+class MemOutStream;
+class OutStream;
+class PDFDoc;
+class XRef;
+struct PDFSubsetFont;
+
+//------------------------------------------------------------------------
+// PDFPageWriter
+//
+// Writes a new document made of pages copied from other documents. A
+// page is written as soon as it is added, together with the objects it
+// uses that haven't been written yet, so that only the page list and the
+// object numbers of the current source document are kept in memory.
+// Streams are copied without decoding them, and identical streams are
+// only written once, even when they come from different documents: they
+// are identified by their data and by the content, not the numbers, of
+// the objects they refer to.
+//
+// The source documents must not be encrypted: their objects are
+// renumbered, and the encryption keys depend on the object numbers.
+//
+// Optionally, the TrueType and CFF fonts embedded in a document are
+// subset to the glyphs used on the pages copied from it. The subsets
+// keep the glyph IDs of the original fonts, so the font dictionaries
+// are copied unchanged.
+//
+// Optionally too, the objects other than streams are packed into object
+// streams, the streams stored without a filter are compressed, and the
+// xref table is written as an xref stream.
+//------------------------------------------------------------------------
+
+class PDFPageWriter {
+public:
+
+  // Write the header of a PDF majorVersion.minorVersion file to outStrA.
+  // If compressA is set, the file uses object and xref streams, and its
+  // version is raised to 1.5 if needed.
+  PDFPageWriter(OutStream *outStrA, int majorVersion, int minorVersion,
+                GBool compressA = gFalse);
+  ~PDFPageWriter();
+
+  // Copy objects from docA from now on. Nothing refers to the previous
+  // document anymore, so it can be deleted.
+  void setDocument(PDFDoc *docA);
+
+  // Subset the fonts embedded in the current document to the glyphs
+  // used on pages, which must include all the pages that will be added
+  // from it. The glyphs are found by running the pages, with all the
+  // optional content visible. Font files that aren't used for drawing
+  // text, or aren't TrueType or CFF fonts, are copied whole.
+  void subsetFonts(const std::vector<int> &pages);
+
+  // Copy page pageNo of the current document. The inherited page
+  // attributes are written into the new page dictionary. Returns false if
+  // there is no such page.
+  GBool addPage(int pageNo);
+
+  // Copy obj, an object of the current document, to the catalog entry key.
+  void setCatalogEntry(const char *key, Object *obj);
+
+  // Copy obj, the AcroForm dictionary of the current document, to the
+  // catalog, keeping only the fields that have widgets on the pages
+  // added from it so far.
+  void setAcroForm(Object *obj);
+
+  // Copy obj, an object of the current document, to the Info entry of
+  // the trailer.
+  void setDocInfo(Object *obj);
+
+  // Write the page tree, the catalog and the xref table. fileName is
+  // only used to compute the document ID.
+  void finish(const char *fileName);
+
+  // Number of pages added so far.
+  int getNumPages() { return (int)kids.size(); }
+
+private:
+
+  // Return the output number of the object of the current document ref
+  // points to, writing the object first if needed, or 0 if references to
+  // it must become null.
+  int copyRef(Ref ref);
+  // Deep copy of obj with its references replaced by output numbers.
+  void copyObject(Object *obj, Object *result);
+  // Copy the stream object num; returns its output number.
+  int copyStream(int num, Stream *str);
+  void writeObject(int num, Object *obj);
+  // Write the objects packed so far into an object stream.
+  void writeObjectStream();
+  // Append a serialization of obj, an output object, to key, with the
+  // references replaced by the content digests of the objects they
+  // point to where these are known.
+  void appendKey(Object *obj, GooString *key);
+  void setDigest(int num, Guchar *digest);
+  // Return the index in fontSubsets for the font file num of the
+  // current document, adding it if needed, or -1 if it can't be subset.
+  int getFontSubset(int num, GBool trueType);
+  // Return the subset font program for the font file num, read from
+  // str, or NULL to copy the font file as it is.
+  GooString *makeFontSubset(int num, Stream *str);
+  void clearFontSubsets();
+
+  OutStream *outStr;
+  XRef *outXRef;		// offsets of the objects written so far
+  int nextNum;			// next free output object number
+  int catalogNum;
+  int pagesNum;
+  std::vector<int> kids;	// output numbers of the pages
+  Object catalogDict;
+  Object docInfo;
+  GBool compress;		// use object and xref streams
+  MemOutStream *objStmData;	// objects packed since the last object
+				//   stream
+  std::vector<int> objStmNums;	// their output numbers
+  std::vector<Goffset> objStmOffsets; // and offsets in objStmData
+  GooHash *streamHash;		// stream digest -> output number
+  std::vector<Guchar> digests;	// content digest of each output object,
+				//   16 bytes per object number
+  std::vector<char> digestSet;	// output number -> digest is known
+
+  PDFDoc *doc;			// current source document
+  std::vector<int> numMap;	// object number in doc -> output number
+
+  PDFSubsetFont *fontSubsets;	// glyphs used from the font files of doc
+  int fontSubsetsLen;
+  int fontSubsetsSize;
+  std::vector<int> fontSubsetMap; // object number in doc -> index in
+				  //   fontSubsets + 1, or 0
+
+  friend class PDFFontUsageDev;
+};
+
+#endif
@@ -69,6 +69,7 @@
 #include "PreScanOutputDev.h"
 #include "FileSpec.h"
 #include "CharCodeToUnicode.h"
+#include "Decrypt.h"
 #if HAVE_SPLASH
 #  include "splash/Splash.h"
 #  include "splash/SplashBitmap.h"
@@ -902,6 +903,10 @@ struct PST1FontName {
   Ref fontFileID;
   GooString *psName;		// PostScript font name used for this
 				//   embedded font file
+  GfxFontType fontType;		// font type it was embedded as
+  GBool hasDigest;		// set if digest is valid
+  Guchar digest[16];		// MD5 of the font program (and the
+				//   CID-to-GID map it was converted with)
 };
 
 // Info for 8-bit fonts
@@ -916,6 +921,19 @@ struct PSFont16Enc {
   GooString *enc;
 };
 
+// Glyphs used on the printed pages, for one embedded font file
+struct PSFontUsage {
+  Ref fontFileID;
+  GooHash *glyphNames;		// names of the glyphs used by 8-bit fonts
+  char *cids;			// flags for the CIDs used by CID fonts
+  int cidsLen;			// size of cids array
+  GBool hasDigest;		// set if digest is valid
+  Guchar digest[16];		// MD5 of the font program
+  int shared;			// index of the entry for the same font
+				//   program which holds the glyph sets,
+				//   or -1
+};
+
 //------------------------------------------------------------------------
 // process colors
 //------------------------------------------------------------------------
@@ -956,6 +974,85 @@ PSOutCustomColor::~PSOutCustomColor() {
   delete name;
 }
 
+//------------------------------------------------------------------------
+// PSFontUsageDev
+//------------------------------------------------------------------------
+
+// Runs the pages to be printed, recording which glyphs of each
+// embedded font file are used, so that the fonts can be subset.
+class PSFontUsageDev: public OutputDev {
+public:
+
+  PSFontUsageDev(PSOutputDev *psOutA)
+    { psOut = psOutA; lastFont = NULL; lastUsage = -1; }
+
+  virtual GBool upsideDown() { return gTrue; }
+  virtual GBool useDrawChar() { return gTrue; }
+  virtual GBool interpretType3Chars() { return gTrue; }
+  // text can be drawn inside tiling patterns, so patterns must be
+  // run; one cell is enough, and shadings are skipped
+  virtual GBool needNonText() { return gTrue; }
+  virtual GBool useTilingPatternFill() { return gTrue; }
+  virtual GBool useShadedFills(int type) { return gTrue; }
+  virtual void startPage(int pageNum, GfxState *state, XRef *xref)
+    { lastFont = NULL; }
+  virtual GBool tilingPatternFill(GfxState *state, Gfx *gfx, Catalog *cat,
+				  Object *str, double *pmat, int paintType,
+				  int tilingType, Dict *resDict,
+				  double *mat, double *bbox,
+				  int x0, int y0, int x1, int y1,
+				  double xStep, double yStep)
+    { gfx->drawForm(str, resDict, mat, bbox); return gTrue; }
+  virtual GBool functionShadedFill(GfxState *state,
+				   GfxFunctionShading *shading)
+    { return gTrue; }
+  virtual GBool axialShadedFill(GfxState *state, GfxAxialShading *shading,
+				double tMin, double tMax)
+    { return gTrue; }
+  virtual GBool radialShadedFill(GfxState *state, GfxRadialShading *shading,
+				 double sMin, double sMax)
+    { return gTrue; }
+  virtual GBool gouraudTriangleShadedFill(GfxState *state,
+					  GfxGouraudTriangleShading *shading)
+    { return gTrue; }
+  virtual GBool patchMeshShadedFill(GfxState *state,
+				    GfxPatchMeshShading *shading)
+    { return gTrue; }
+  virtual void drawChar(GfxState *state, double x, double y,
+			double dx, double dy,
+			double originX, double originY,
+			CharCode code, int nBytes, Unicode *u, int uLen);
+
+private:
+
+  PSOutputDev *psOut;
+  GfxFont *lastFont;		// font of the last char
+  Ref lastFontID;		// ID of lastFont
+  int lastUsage;		// fontUsage index for lastFont, or -1
+};
+
+void PSFontUsageDev::drawChar(GfxState *state, double x, double y,
+			      double dx, double dy,
+			      double originX, double originY,
+			      CharCode code, int nBytes,
+			      Unicode *u, int uLen) {
+  GfxFont *font;
+
+  if (!(font = state->getFont())) {
+    return;
+  }
+  if (font != lastFont ||
+      font->getID()->num != lastFontID.num ||
+      font->getID()->gen != lastFontID.gen) {
+    lastFont = font;
+    lastFontID = *font->getID();
+    lastUsage = psOut->getFontUsage(font);
+  }
+  if (lastUsage >= 0) {
+    psOut->addFontUsage(lastUsage, font, code);
+  }
+}
+
 //------------------------------------------------------------------------
 
 struct PSOutImgClipRect {
@@ -1097,6 +1194,7 @@ PSOutputDev::PSOutputDev(const char *fileName, PDFDoc *doc,
   t1FontNames = NULL;
   font8Info = NULL;
   font16Enc = NULL;
+  fontUsage = NULL;
   imgIDs = NULL;
   formIDs = NULL;
   paperSizes = NULL;
@@ -1164,6 +1262,7 @@ PSOutputDev::PSOutputDev(PSOutputFunc outputFuncA, void *outputStreamA,
   t1FontNames = NULL;
   font8Info = NULL;
   font16Enc = NULL;
+  fontUsage = NULL;
   imgIDs = NULL;
   formIDs = NULL;
   paperSizes = NULL;
@@ -1235,6 +1334,8 @@ void PSOutputDev::init(PSOutputFunc outputFuncA, void *outputStreamA,
   embedCIDPostScript = gTrue;
   embedCIDTrueType = gTrue;
   fontPassthrough = gFalse;
+  cffPassthrough = globalParams->getPSCFFPassthrough();
+  fontSubsetting = globalParams->getPSSubsetFonts();
   optimizeColorSpace = gFalse;
   preloadImagesForms = gFalse;
   generateOPI = gFalse;
@@ -1372,6 +1473,8 @@ void PSOutputDev::init(PSOutputFunc outputFuncA, void *outputStreamA,
   font8InfoSize = 0;
   font16EncLen = 0;
   font16EncSize = 0;
+  fontUsageLen = 0;
+  fontUsageSize = 0;
   imgIDLen = 0;
   imgIDSize = 0;
   formIDLen = 0;
@@ -1474,6 +1577,13 @@ PSOutputDev::~PSOutputDev() {
     }
     gfree(font16Enc);
   }
+  if (fontUsage) {
+    for (i = 0; i < fontUsageLen; ++i) {
+      delete fontUsage[i].glyphNames;
+      gfree(fontUsage[i].cids);
+    }
+    gfree(fontUsage);
+  }
   gfree(imgIDs);
   gfree(formIDs);
   while (customColors) {
@@ -1639,6 +1749,9 @@ void PSOutputDev::writeDocSetup(PDFDoc *doc, Catalog *catalog,
   } else {
     writePS("xpdf begin\n");
   }
+  if (fontSubsetting) {
+    scanFontUsage(doc, pages);
+  }
   for (size_t pgi = 0; pgi < pages.size(); ++pgi) {
     const int pg = pages[pgi];
     page = doc->getPage(pg);
@@ -2309,7 +2422,7 @@ void PSOutputDev::setupExternalType1Font(GooString *fileName, GooString *psName)
 
 void PSOutputDev::setupEmbeddedType1CFont(GfxFont *font, Ref *id,
 					  GooString *psName) {
-  char *fontBuf;
+  char *fontBuf, *subset;
   int fontLen;
   FoFiType1C *ffT1C;
   int i;
@@ -2323,14 +2436,11 @@ void PSOutputDev::setupEmbeddedType1CFont(GfxFont *font, Ref *id,
       return;
     }
   }
-  if (t1FontNameLen == t1FontNameSize) {
-    t1FontNameSize *= 2;
-    t1FontNames = (PST1FontName *)greallocn(t1FontNames, t1FontNameSize,
-					    sizeof(PST1FontName));
+  fontBuf = font->readEmbFontFile(xref, &fontLen);
+  if (addT1FontName(font, id, fontBuf, fontLen, NULL, 0, psName)) {
+    gfree(fontBuf);
+    return;
   }
-  t1FontNames[t1FontNameLen].fontFileID = *id;
-  t1FontNames[t1FontNameLen].psName = psName->copy();
-  ++t1FontNameLen;
 
   // beginning comment
   writePSFmt("%%BeginResource: font {0:t}\n", psName);
@@ -2338,11 +2448,17 @@ void PSOutputDev::setupEmbeddedType1CFont(GfxFont *font, Ref *id,
   embFontList->append(psName->getCString());
   embFontList->append("\n");
 
-  // convert it to a Type 1 font
-  if ((fontBuf = font->readEmbFontFile(xref, &fontLen))) {
+  // convert it to a Type 1 font (or, for Level 3, pass the CFF font
+  // program through)
+  if (fontBuf) {
     if ((ffT1C = FoFiType1C::make(fontBuf, fontLen))) {
-      ffT1C->convertToType1(psName->getCString(), NULL, gTrue,
-			    outputFunc, outputStream);
+      if (!(cffPassthrough && level >= psLevel3 &&
+	    writeCFFFontSet(ffT1C, fontBuf, fontLen, psName))) {
+	subset = makeGlyphSubset(id, ffT1C);
+	ffT1C->convertToType1(psName->getCString(), NULL, gTrue,
+			      outputFunc, outputStream, subset);
+	gfree(subset);
+      }
       delete ffT1C;
     }
     gfree(fontBuf);
@@ -2354,9 +2470,10 @@ void PSOutputDev::setupEmbeddedType1CFont(GfxFont *font, Ref *id,
 
 void PSOutputDev::setupEmbeddedOpenTypeT1CFont(GfxFont *font, Ref *id,
 					       GooString *psName) {
-  char *fontBuf;
-  int fontLen;
+  char *fontBuf, *cffBuf, *subset;
+  int fontLen, cffLen;
   FoFiTrueType *ffTT;
+  FoFiType1C *ffT1C;
   int i;
 
   // check if font is already embedded
@@ -2368,14 +2485,11 @@ void PSOutputDev::setupEmbeddedOpenTypeT1CFont(GfxFont *font, Ref *id,
       return;
     }
   }
-  if (t1FontNameLen == t1FontNameSize) {
-    t1FontNameSize *= 2;
-    t1FontNames = (PST1FontName *)greallocn(t1FontNames, t1FontNameSize,
-					    sizeof(PST1FontName));
+  fontBuf = font->readEmbFontFile(xref, &fontLen);
+  if (addT1FontName(font, id, fontBuf, fontLen, NULL, 0, psName)) {
+    gfree(fontBuf);
+    return;
   }
-  t1FontNames[t1FontNameLen].fontFileID = *id;
-  t1FontNames[t1FontNameLen].psName = psName->copy();
-  ++t1FontNameLen;
 
   // beginning comment
   writePSFmt("%%BeginResource: font {0:t}\n", psName);
@@ -2383,12 +2497,21 @@ void PSOutputDev::setupEmbeddedOpenTypeT1CFont(GfxFont *font, Ref *id,
   embFontList->append(psName->getCString());
   embFontList->append("\n");
 
-  // convert it to a Type 1 font
-  if ((fontBuf = font->readEmbFontFile(xref, &fontLen))) {
+  // convert it to a Type 1 font (or, for Level 3, pass the CFF font
+  // program through)
+  if (fontBuf) {
     if ((ffTT = FoFiTrueType::make(fontBuf, fontLen))) {
-      if (ffTT->isOpenTypeCFF()) {
-	ffTT->convertToType1(psName->getCString(), NULL, gTrue,
-			     outputFunc, outputStream);
+      if (ffTT->isOpenTypeCFF() &&
+	  ffTT->getCFFBlock(&cffBuf, &cffLen) &&
+	  (ffT1C = FoFiType1C::make(cffBuf, cffLen))) {
+	if (!(cffPassthrough && level >= psLevel3 &&
+	      writeCFFFontSet(ffT1C, cffBuf, cffLen, psName))) {
+	  subset = makeGlyphSubset(id, ffT1C);
+	  ffT1C->convertToType1(psName->getCString(), NULL, gTrue,
+				outputFunc, outputStream, subset);
+	  gfree(subset);
+	}
+	delete ffT1C;
       }
       delete ffTT;
     }
@@ -2544,7 +2667,8 @@ void PSOutputDev::setupExternalCIDTrueTypeFont(GfxFont *font,
 void PSOutputDev::setupEmbeddedCIDType0Font(GfxFont *font, Ref *id,
 					    GooString *psName) {
   char *fontBuf;
-  int fontLen;
+  int *codeMap;
+  int fontLen, nCodes;
   FoFiType1C *ffT1C;
   int i;
 
@@ -2557,14 +2681,11 @@ void PSOutputDev::setupEmbeddedCIDType0Font(GfxFont *font, Ref *id,
       return;
     }
   }
-  if (t1FontNameLen == t1FontNameSize) {
-    t1FontNameSize *= 2;
-    t1FontNames = (PST1FontName *)greallocn(t1FontNames, t1FontNameSize,
-					    sizeof(PST1FontName));
+  fontBuf = font->readEmbFontFile(xref, &fontLen);
+  if (addT1FontName(font, id, fontBuf, fontLen, NULL, 0, psName)) {
+    gfree(fontBuf);
+    return;
   }
-  t1FontNames[t1FontNameLen].fontFileID = *id;
-  t1FontNames[t1FontNameLen].psName = psName->copy();
-  ++t1FontNameLen;
 
   // beginning comment
   writePSFmt("%%BeginResource: font {0:t}\n", psName);
@@ -2573,17 +2694,25 @@ void PSOutputDev::setupEmbeddedCIDType0Font(GfxFont *font, Ref *id,
   embFontList->append("\n");
 
   // convert it to a Type 0 font
-  if ((fontBuf = font->readEmbFontFile(xref, &fontLen))) {
+  if (fontBuf) {
     if ((ffT1C = FoFiType1C::make(fontBuf, fontLen))) {
+      codeMap = NULL;
+      nCodes = 0;
       if (globalParams->getPSLevel() >= psLevel3) {
-	// Level 3: use a CID font
-	ffT1C->convertToCIDType0(psName->getCString(), NULL, 0,
-				 outputFunc, outputStream);
+	// Level 3: pass a CID-keyed CFF font through, or use a CID font
+	if (!(cffPassthrough && ffT1C->isCIDFont() &&
+	      writeCFFFontSet(ffT1C, fontBuf, fontLen, psName))) {
+	  codeMap = makeCIDSubset(id, ffT1C, NULL, 0, &nCodes);
+	  ffT1C->convertToCIDType0(psName->getCString(), codeMap, nCodes,
+				   outputFunc, outputStream);
+	}
       } else {
 	// otherwise: use a non-CID composite font
-	ffT1C->convertToType0(psName->getCString(), NULL, 0,
+	codeMap = makeCIDSubset(id, ffT1C, NULL, 0, &nCodes);
+	ffT1C->convertToType0(psName->getCString(), codeMap, nCodes,
 			      outputFunc, outputStream);
       }
+      gfree(codeMap);
       delete ffT1C;
     }
     gfree(fontBuf);
@@ -2635,9 +2764,11 @@ void PSOutputDev::setupEmbeddedCIDTrueTypeFont(GfxFont *font, Ref *id,
 
 void PSOutputDev::setupEmbeddedOpenTypeCFFFont(GfxFont *font, Ref *id,
 					       GooString *psName) {
-  char *fontBuf;
-  int fontLen;
+  char *fontBuf, *cffBuf;
+  int *cidToGID, *codeMap;
+  int fontLen, cffLen, cidToGIDLen, nCodes;
   FoFiTrueType *ffTT;
+  FoFiType1C *ffT1C;
   int i;
 
   // check if font is already embedded
@@ -2649,14 +2780,12 @@ void PSOutputDev::setupEmbeddedOpenTypeCFFFont(GfxFont *font, Ref *id,
       return;
     }
   }
-  if (t1FontNameLen == t1FontNameSize) {
-    t1FontNameSize *= 2;
-    t1FontNames = (PST1FontName *)greallocn(t1FontNames, t1FontNameSize,
-					    sizeof(PST1FontName));
+  fontBuf = font->readEmbFontFile(xref, &fontLen);
+  if (addT1FontName(font, id, fontBuf, fontLen, ((GfxCIDFont *)font)->getCIDToGID(),
+		    ((GfxCIDFont *)font)->getCIDToGIDLen(), psName)) {
+    gfree(fontBuf);
+    return;
   }
-  t1FontNames[t1FontNameLen].fontFileID = *id;
-  t1FontNames[t1FontNameLen].psName = psName->copy();
-  ++t1FontNameLen;
 
   // beginning comment
   writePSFmt("%%BeginResource: font {0:t}\n", psName);
@@ -2665,22 +2794,35 @@ void PSOutputDev::setupEmbeddedOpenTypeCFFFont(GfxFont *font, Ref *id,
   embFontList->append("\n");
 
   // convert it to a Type 0 font
-  if ((fontBuf = font->readEmbFontFile(xref, &fontLen))) {
+  if (fontBuf) {
     if ((ffTT = FoFiTrueType::make(fontBuf, fontLen))) {
-      if (ffTT->isOpenTypeCFF()) {
+      if (ffTT->isOpenTypeCFF() &&
+	  ffTT->getCFFBlock(&cffBuf, &cffLen) &&
+	  (ffT1C = FoFiType1C::make(cffBuf, cffLen))) {
+	cidToGID = ((GfxCIDFont *)font)->getCIDToGID();
+	cidToGIDLen = ((GfxCIDFont *)font)->getCIDToGIDLen();
+	codeMap = makeCIDSubset(id, ffT1C, cidToGID, cidToGIDLen, &nCodes);
+	if (!codeMap) {
+	  codeMap = cidToGID;
+	  nCodes = cidToGIDLen;
+	}
 	if (globalParams->getPSLevel() >= psLevel3) {
-	  // Level 3: use a CID font
-	  ffTT->convertToCIDType0(psName->getCString(),
-				  ((GfxCIDFont *)font)->getCIDToGID(),
-				  ((GfxCIDFont *)font)->getCIDToGIDLen(),
-				  outputFunc, outputStream);
+	  // Level 3: pass a CID-keyed CFF font (without a CIDToGIDMap)
+	  // through, or use a CID font
+	  if (!(cffPassthrough && !cidToGID && ffT1C->isCIDFont() &&
+		writeCFFFontSet(ffT1C, cffBuf, cffLen, psName))) {
+	    ffT1C->convertToCIDType0(psName->getCString(), codeMap, nCodes,
+				     outputFunc, outputStream);
+	  }
 	} else {
 	  // otherwise: use a non-CID composite font
-	  ffTT->convertToType0(psName->getCString(),
-			       ((GfxCIDFont *)font)->getCIDToGID(),
-			       ((GfxCIDFont *)font)->getCIDToGIDLen(),
-			       outputFunc, outputStream);
+	  ffT1C->convertToType0(psName->getCString(), codeMap, nCodes,
+				outputFunc, outputStream);
+	}
+	if (codeMap != cidToGID) {
+	  gfree(codeMap);
 	}
+	delete ffT1C;
       }
       delete ffTT;
     }
@@ -2691,6 +2833,329 @@ void PSOutputDev::setupEmbeddedOpenTypeCFFFont(GfxFont *font, Ref *id,
   writePS("%%EndResource\n");
 }
 
+// Embed the CFF font program <cffBuf> as-is, as a (Level 3) FontSet
+// resource, and make its font available as <psName> (a font or, for a
+// CID-keyed font, a CIDFont resource).  The font program is written
+// as binary data.  Returns false if the font can't be passed through.
+GBool PSOutputDev::writeCFFFontSet(FoFiType1C *ffT1C, char *cffBuf,
+				   int cffLen, GooString *psName) {
+  GooString *buf;
+  char *cffName;
+
+  if (!(cffName = ffT1C->getName())) {
+    return gFalse;
+  }
+
+  // the font set
+  buf = GooString::format("/{0:t} {1:d} StartData ", psName, cffLen);
+  writePS("/FontSetInit /ProcSet findresource begin\n");
+  writePSFmt("%%BeginData: {0:d} Binary Bytes\n",
+	     buf->getLength() + cffLen + 1);
+  writePSBuf(buf->getCString(), buf->getLength());
+  writePSBuf(cffBuf, cffLen);
+  writePS("\n%%EndData\n");
+  writePS("end\n");
+  delete buf;
+
+  // the font is defined under its name in the CFF data -- copy it to
+  // the name we want to use
+  if (strcmp(cffName, psName->getCString())) {
+    writePS("/");
+    writePSName(cffName);
+    if (ffT1C->isCIDFont()) {
+      writePS(" /CIDFont findresource");
+    } else {
+      writePS(" findfont");
+    }
+    writePS(" dup length dict begin\n");
+    writePS("{ 1 index /FID ne { def } { pop pop } ifelse } forall\n");
+    writePSFmt("/{0:s} /{1:t} def currentdict end\n",
+	       ffT1C->isCIDFont() ? "CIDFontName" : "FontName", psName);
+    if (ffT1C->isCIDFont()) {
+      writePSFmt("/{0:t} exch /CIDFont defineresource pop\n", psName);
+    } else {
+      writePSFmt("/{0:t} exch definefont pop\n", psName);
+    }
+  }
+  return gTrue;
+}
+
+// Run the pages to be printed to find the glyphs they use from each
+// embedded font file.
+void PSOutputDev::scanFontUsage(PDFDoc *doc, const std::vector<int> &pages) {
+  PSFontUsageDev *usageDev;
+  GooHashIter *iter;
+  GooString *name;
+  PSFontUsage *u1, *u2;
+  int val, i, j;
+
+  usageDev = new PSFontUsageDev(this);
+  for (size_t pgi = 0; pgi < pages.size(); ++pgi) {
+    doc->displayPage(usageDev, pages[pgi], 72, 72, 0,
+		     gTrue, gFalse, gTrue);
+  }
+  delete usageDev;
+
+  // equal font programs in different font files are only embedded once
+  // (see addT1FontName), so they need to share their glyph sets
+  for (i = 1; i < fontUsageLen; ++i) {
+    u1 = &fontUsage[i];
+    if (!u1->hasDigest) {
+      continue;
+    }
+    for (j = 0; j < i; ++j) {
+      u2 = &fontUsage[j];
+      if (u2->shared < 0 && u2->hasDigest &&
+	  !memcmp(u1->digest, u2->digest, 16)) {
+	break;
+      }
+    }
+    if (j == i) {
+      continue;
+    }
+    if (u1->glyphNames) {
+      if (!u2->glyphNames) {
+	u2->glyphNames = new GooHash(gTrue);
+      }
+      u1->glyphNames->startIter(&iter);
+      while (u1->glyphNames->getNext(&iter, &name, &val)) {
+	if (!u2->glyphNames->lookupInt(name)) {
+	  u2->glyphNames->add(name->copy(), 1);
+	}
+      }
+    }
+    if (u1->cids) {
+      if (u2->cidsLen < u1->cidsLen) {
+	u2->cids = (char *)grealloc(u2->cids, u1->cidsLen);
+	memset(u2->cids + u2->cidsLen, 0, u1->cidsLen - u2->cidsLen);
+	u2->cidsLen = u1->cidsLen;
+      }
+      for (val = 0; val < u1->cidsLen; ++val) {
+	u2->cids[val] |= u1->cids[val];
+      }
+    }
+    u1->shared = j;
+  }
+}
+
+// Return the fontUsage index for the embedded font file of <font>, or
+// -1 if the font can't be subset.
+int PSOutputDev::getFontUsage(GfxFont *font) {
+  PSFontUsage *usage;
+  Ref embID;
+  char *fontBuf;
+  int fontLen, i;
+
+  switch (font->getType()) {
+  case fontType1C:
+  case fontType1COT:
+  case fontCIDType0C:
+  case fontCIDType0COT:
+    break;
+  default:
+    return -1;
+  }
+  if (!font->getEmbeddedFontID(&embID)) {
+    return -1;
+  }
+  for (i = 0; i < fontUsageLen; ++i) {
+    if (fontUsage[i].fontFileID.num == embID.num &&
+	fontUsage[i].fontFileID.gen == embID.gen) {
+      return i;
+    }
+  }
+  if (fontUsageLen >= fontUsageSize) {
+    fontUsageSize += 16;
+    fontUsage = (PSFontUsage *)greallocn(fontUsage, fontUsageSize,
+					 sizeof(PSFontUsage));
+  }
+  usage = &fontUsage[fontUsageLen];
+  usage->fontFileID = embID;
+  usage->glyphNames = NULL;
+  usage->cids = NULL;
+  usage->cidsLen = 0;
+  usage->shared = -1;
+  usage->hasDigest = gFalse;
+  if ((fontBuf = font->readEmbFontFile(xref, &fontLen))) {
+    md5((Guchar *)fontBuf, fontLen, usage->digest);
+    usage->hasDigest = gTrue;
+    gfree(fontBuf);
+  }
+  return fontUsageLen++;
+}
+
+// Record that char <code> of <font> is used.
+void PSOutputDev::addFontUsage(int idx, GfxFont *font, CharCode code) {
+  PSFontUsage *usage;
+  char *name;
+  int n;
+
+  usage = &fontUsage[idx];
+  if (font->isCIDFont()) {
+    if (code >= 0x10000) {
+      return;
+    }
+    if ((int)code >= usage->cidsLen) {
+      n = usage->cidsLen ? usage->cidsLen : 256;
+      while (n <= (int)code) {
+	n *= 2;
+      }
+      usage->cids = (char *)grealloc(usage->cids, n);
+      memset(usage->cids + usage->cidsLen, 0, n - usage->cidsLen);
+      usage->cidsLen = n;
+    }
+    usage->cids[code] = 1;
+  } else {
+    if (!(name = ((Gfx8BitFont *)font)->getCharName(code & 0xff))) {
+      return;
+    }
+    if (!usage->glyphNames) {
+      usage->glyphNames = new GooHash(gTrue);
+    }
+    if (!usage->glyphNames->lookupInt(name)) {
+      usage->glyphNames->add(new GooString(name), 1);
+    }
+  }
+}
+
+PSFontUsage *PSOutputDev::findFontUsage(Ref *id) {
+  int i;
+
+  for (i = 0; i < fontUsageLen; ++i) {
+    if (fontUsage[i].fontFileID.num == id->num &&
+	fontUsage[i].fontFileID.gen == id->gen) {
+      if (fontUsage[i].shared >= 0) {
+	return &fontUsage[fontUsage[i].shared];
+      }
+      return &fontUsage[i];
+    }
+  }
+  return NULL;
+}
+
+// Return the glyph flags for subsetting the 8-bit font <ffT1C> (from
+// embedded font file <id>), or NULL to embed the whole font.
+char *PSOutputDev::makeGlyphSubset(Ref *id, FoFiType1C *ffT1C) {
+  PSFontUsage *usage;
+  GooString *name;
+  char *subset;
+  int n, gid;
+
+  if (!fontSubsetting || !(usage = findFontUsage(id)) || !usage->glyphNames) {
+    return NULL;
+  }
+  n = ffT1C->getNumGlyphs();
+  subset = (char *)gmalloc(n > 0 ? n : 1);
+  for (gid = 0; gid < n; ++gid) {
+    subset[gid] = 0;
+    if ((name = ffT1C->getGlyphName(gid))) {
+      subset[gid] = usage->glyphNames->lookupInt(name) != 0;
+      delete name;
+    }
+  }
+  return subset;
+}
+
+// Return a CID-to-GID map for subsetting the CID font <ffT1C> (from
+// embedded font file <id>, with CID-to-GID map <codeMap>, if any),
+// with the unused CIDs mapped to -1, or NULL to embed the whole font.
+int *PSOutputDev::makeCIDSubset(Ref *id, FoFiType1C *ffT1C,
+				int *codeMap, int nCodes,
+				int *nSubsetCodes) {
+  PSFontUsage *usage;
+  int *map;
+  int n, cid;
+
+  if (!fontSubsetting || !(usage = findFontUsage(id)) || !usage->cids) {
+    return NULL;
+  }
+  if (codeMap) {
+    n = nCodes;
+    map = (int *)gmallocn(n > 0 ? n : 1, sizeof(int));
+    memcpy(map, codeMap, n * sizeof(int));
+  } else if (ffT1C->isCIDFont()) {
+    map = ffT1C->getCIDToGIDMap(&n);
+    // CIDs missing from the font come back as GID 0
+    for (cid = 1; cid < n; ++cid) {
+      if (map[cid] == 0) {
+	map[cid] = -1;
+      }
+    }
+  } else {
+    n = ffT1C->getNumGlyphs();
+    map = (int *)gmallocn(n > 0 ? n : 1, sizeof(int));
+    for (cid = 0; cid < n; ++cid) {
+      map[cid] = cid;
+    }
+  }
+  if (n > usage->cidsLen) {
+    n = usage->cidsLen;
+  }
+  for (cid = 1; cid < n; ++cid) {
+    if (!usage->cids[cid]) {
+      map[cid] = -1;
+    }
+  }
+  while (n > 1 && map[n - 1] < 0) {
+    --n;
+  }
+  *nSubsetCodes = n;
+  return map;
+}
+
+// Record the embedded font file <id>, read into <fontBuf>, as PS font
+// <psName>.  Font files with the same font program (subsets of the
+// same font embedded again on every page, for instance) are embedded
+// only once: if an equal font program was already embedded, <psName>
+// is set to its name and gTrue is returned.
+GBool PSOutputDev::addT1FontName(GfxFont *font, Ref *id,
+				 char *fontBuf, int fontLen,
+				 int *cidToGID, int cidToGIDLen,
+				 GooString *psName) {
+  Guchar digest[16];
+  Guchar *buf;
+  GfxFontType fontType;
+  int i;
+
+  fontType = font->getType();
+  if (fontBuf) {
+    md5((Guchar *)fontBuf, fontLen, digest);
+    if (cidToGID) {
+      buf = (Guchar *)gmallocn(16 + cidToGIDLen * sizeof(int), 1);
+      memcpy(buf, digest, 16);
+      memcpy(buf + 16, cidToGID, cidToGIDLen * sizeof(int));
+      md5(buf, 16 + cidToGIDLen * sizeof(int), digest);
+      gfree(buf);
+    }
+  }
+
+  if (t1FontNameLen == t1FontNameSize) {
+    t1FontNameSize *= 2;
+    t1FontNames = (PST1FontName *)greallocn(t1FontNames, t1FontNameSize,
+					    sizeof(PST1FontName));
+  }
+  t1FontNames[t1FontNameLen].fontFileID = *id;
+  t1FontNames[t1FontNameLen].fontType = fontType;
+  t1FontNames[t1FontNameLen].hasDigest = fontBuf != NULL;
+  if (fontBuf) {
+    memcpy(t1FontNames[t1FontNameLen].digest, digest, 16);
+    for (i = 0; i < t1FontNameLen; ++i) {
+      if (t1FontNames[i].hasDigest &&
+	  t1FontNames[i].fontType == fontType &&
+	  !memcmp(t1FontNames[i].digest, digest, 16)) {
+	t1FontNames[t1FontNameLen].psName = t1FontNames[i].psName->copy();
+	++t1FontNameLen;
+	psName->clear();
+	psName->insert(0, t1FontNames[i].psName);
+	return gTrue;
+      }
+    }
+  }
+  t1FontNames[t1FontNameLen].psName = psName->copy();
+  ++t1FontNameLen;
+  return gFalse;
+}
+
 void PSOutputDev::setupType3Font(GfxFont *font, GooString *psName,
 				 Dict *parentResDict) {
   Dict *resDict;
@@ -59,8 +59,10 @@ class PDFRectangle;
 struct PST1FontName;
 struct PSFont8Info;
 struct PSFont16Enc;
+struct PSFontUsage;
 class PSOutCustomColor;
 class PSOutputDev;
+class FoFiType1C;
 
 //------------------------------------------------------------------------
 // PSOutputDev
@@ -357,6 +359,17 @@ private:
 				    GooString *psName,
 				    GBool needVerticalMetrics);
   void setupEmbeddedOpenTypeCFFFont(GfxFont *font, Ref *id, GooString *psName);
+  GBool writeCFFFontSet(FoFiType1C *ffT1C, char *cffBuf, int cffLen,
+			GooString *psName);
+  void scanFontUsage(PDFDoc *doc, const std::vector<int> &pages);
+  int getFontUsage(GfxFont *font);
+  void addFontUsage(int idx, GfxFont *font, CharCode code);
+  PSFontUsage *findFontUsage(Ref *id);
+  char *makeGlyphSubset(Ref *id, FoFiType1C *ffT1C);
+  int *makeCIDSubset(Ref *id, FoFiType1C *ffT1C, int *codeMap, int nCodes,
+		     int *nSubsetCodes);
+  GBool addT1FontName(GfxFont *font, Ref *id, char *fontBuf, int fontLen,
+		      int *cidToGID, int cidToGIDLen, GooString *psName);
   void setupType3Font(GfxFont *font, GooString *psName, Dict *parentResDict);
   GooString *makePSFontName(GfxFont *font, Ref *id);
   void setupImages(Dict *resDict);
@@ -466,6 +479,10 @@ private:
   PSFont16Enc *font16Enc;	// encodings for substitute 16-bit fonts
   int font16EncLen;		// number of entries in font16Enc array
   int font16EncSize;		// size of font16Enc array
+  PSFontUsage *fontUsage;	// glyphs used by each embedded font file,
+				//   if fontSubsetting is set
+  int fontUsageLen;		// number of entries in fontUsage array
+  int fontUsageSize;		// size of fontUsage array
   Ref *imgIDs;			// list of image IDs for in-memory images
   int imgIDLen;			// number of entries in imgIDs array
   int imgIDSize;		// size of imgIDs array
@@ -520,6 +537,8 @@ private:
   GBool embedCIDPostScript;	// embed CID PostScript fonts?
   GBool embedCIDTrueType;	// embed CID TrueType fonts?
   GBool fontPassthrough;	// pass all fonts through as-is?
+  GBool cffPassthrough;		// embed CFF fonts as-is (Level 3 only)?
+  GBool fontSubsetting;		// embed only the glyphs that are used?
   GBool optimizeColorSpace;	// false to keep gray RGB images in their original color space
 				// true to optimize gray images to DeviceGray color space
   GBool preloadImagesForms;	// preload PostScript images and forms into
@@ -536,6 +555,7 @@ private:
   GBool ok;			// set up ok?
 
   friend class WinPDFPrinter;
+  friend class PSFontUsageDev;
 };
 
 #endif
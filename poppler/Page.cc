@@ -595,7 +595,7 @@ void Page::displaySlice(OutputDev *out, double hDPI, double vDPI,
   contents.fetch(localXRef, &obj);
   if (!obj.isNull()) {
     gfx->saveState();
-    gfx->display(&obj);
+    displayContents(gfx, &obj);
     gfx->restoreState();
   } else {
     // empty pages need to call dump to do any setup required by the
@@ -635,12 +635,33 @@ void Page::display(Gfx *gfx) {
   contents.fetch(xref, &obj);
   if (!obj.isNull()) {
     gfx->saveState();
-    gfx->display(&obj);
+    displayContents(gfx, &obj);
     gfx->restoreState();
   }
   obj.free();
 }
 
+void Page::displayContents(Gfx *gfx, Object *obj) {
+  GfxOpListCache *cache;
+  GfxOpList *ops;
+
+  if (!(cache = doc->getContentCache())) {
+    gfx->display(obj);
+    return;
+  }
+  if ((ops = cache->lookup(num))) {
+    gfx->run(ops, gTrue);
+    cache->release(ops);
+  } else {
+    ops = new GfxOpList();
+    if (gfx->record(obj, ops, gTrue)) {
+      cache->add(num, ops);
+    } else {
+      delete ops;
+    }
+  }
+}
+
 GBool Page::loadThumb(unsigned char **data_out,
 		      int *width_out, int *height_out,
 		      int *rowstride_out)
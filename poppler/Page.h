@@ -264,6 +264,9 @@ public:
 private:
   // replace xref
   void replaceXRef(XRef *xrefA);
+  // run the page contents, through the document's content cache if
+  // it has one
+  void displayContents(Gfx *gfx, Object *obj);
 
   PDFDoc *doc;
   XRef *xref;			// the xref table for this PDF file
@@ -110,8 +110,8 @@ Object *Parser::getObj(Object *obj, GBool simpleOnly,
 	if (strict) goto err;
 	shift();
       } else {
-	// buf1 might go away in shift(), so construct the key
-	key = copyString(buf1.getName());
+	// buf1 might go away in shift(), so take the key out of it
+	key = buf1.takeName();
 	shift();
 	if (buf1.isEOF() || buf1.isError()) {
 	  gfree(key);
@@ -172,10 +172,9 @@ Object *Parser::getObj(Object *obj, GBool simpleOnly,
   // simple object
   } else {
     // avoid re-allocating memory for complex objects like strings by
-    // shallow copy of <buf1> to <obj> and nulling <buf1> so that
-    // subsequent buf1.free() won't free this memory
-    buf1.shallowCopy(obj);
-    buf1.initNull();
+    // moving <buf1> to <obj>, so that subsequent buf1.free() won't
+    // free this memory
+    buf1.move(obj);
     shift();
   }
 
@@ -233,11 +232,6 @@ Stream *Parser::makeStream(Object *dict, Guchar *fileKey,
   baseStr = lexer->getStream()->getBaseStream();
 
   // skip over stream data
-  if (Lexer::LOOK_VALUE_NOT_CACHED != lexer->lookCharLastValueCached) {
-      // take into account the fact that we've cached one value
-      pos = pos - 1;
-      lexer->lookCharLastValueCached = Lexer::LOOK_VALUE_NOT_CACHED;
-  }
   lexer->setPos(pos + length);
 
   // refill token buffers and check for 'endstream'
@@ -58,6 +58,7 @@
 #include "PDFDoc.h"
 #include "Link.h"
 #include "FontEncodingTables.h"
+#include "Decrypt.h"
 #include "fofi/FoFiTrueType.h"
 #include "splash/SplashBitmap.h"
 #include "splash/SplashGlyphBitmap.h"
@@ -386,8 +387,9 @@ GBool SplashAxialPattern::getParameter(double xc, double yc, double *t) {
 //------------------------------------------------------------------------
 // Type 3 font cache size parameters
 #define type3FontCacheAssoc   8
-#define type3FontCacheMaxSets 8
-#define type3FontCacheSize    (128*1024)
+#define type3FontCacheMaxSets 32
+#define type3FontCacheSize    (512*1024)
+#define type3FontCacheTotal   (8*1024*1024)	// for all cached fonts
 
 //------------------------------------------------------------------------
 // Divide a 16-bit value (in [0, 255*255]) by 255, returning an 8-bit result.
@@ -1092,23 +1094,103 @@ static const SplashBlendFunc splashOutBlendFuncs[] = {
 // SplashOutFontFileID
 //------------------------------------------------------------------------
 
+struct SplashOutFontRef {
+  Ref r;			// PDF font ID
+  int docNum;			// SplashOutputDev document number
+};
+
 class SplashOutFontFileID: public SplashFontFileID {
 public:
 
-  SplashOutFontFileID(Ref *rA) { r = *rA; }
+  SplashOutFontFileID(Ref *rA, int docNumA) {
+    refs = (SplashOutFontRef *)gmalloc(sizeof(SplashOutFontRef));
+    refs[0].r = *rA;
+    refs[0].docNum = docNumA;
+    nRefs = 1;
+    key = NULL;
+  }
+
+  ~SplashOutFontFileID() { gfree(refs); delete key; }
 
-  ~SplashOutFontFileID() {}
+  // Set the key describing the embedded font program and everything
+  // else the font file is built from.  Font files with equal keys are
+  // interchangeable.
+  void setKey(GooString *keyA) { delete key; key = keyA; }
 
+  // Make this ID match another font which shares the font file.
+  void addRef(Ref *rA, int docNumA) {
+    refs = (SplashOutFontRef *)greallocn(refs, nRefs + 1,
+					 sizeof(SplashOutFontRef));
+    refs[nRefs].r = *rA;
+    refs[nRefs].docNum = docNumA;
+    ++nRefs;
+  }
+
+  // If <id> has a key, compare keys, otherwise look for the font
+  // (first ref) of <id>.
   GBool matches(SplashFontFileID *id) {
-    return ((SplashOutFontFileID *)id)->r.num == r.num &&
-           ((SplashOutFontFileID *)id)->r.gen == r.gen;
+    SplashOutFontFileID *other = (SplashOutFontFileID *)id;
+    int i;
+
+    if (other->key) {
+      return key && !key->cmp(other->key);
+    }
+    for (i = 0; i < nRefs; ++i) {
+      if (refs[i].r.num == other->refs[0].r.num &&
+	  refs[i].r.gen == other->refs[0].r.gen &&
+	  refs[i].docNum == other->refs[0].docNum) {
+	return gTrue;
+      }
+    }
+    return gFalse;
   }
 
 private:
 
-  Ref r;
+  SplashOutFontRef *refs;
+  int nRefs;
+  GooString *key;
 };
 
+// Build the key for a font file loaded from the embedded font program
+// <buf>, given the encoding or code-to-GID map it is loaded with.
+// CairoFontEngine doesn't need this: it already shares FreeType faces
+// between fonts with the same font data (see _ft_new_face).
+static GooString *makeSplashOutFontFileKey(GfxFontType fontType,
+					   int faceIndex,
+					   char *buf, int len,
+					   const char **enc,
+					   int *codeToGID, int codeToGIDLen) {
+  GooString *key, *aux;
+  Guchar digest[16];
+  int i;
+
+  key = GooString::format("{0:d}:{1:d}:{2:d}:", (int)fontType, faceIndex,
+			  codeToGIDLen);
+  md5((Guchar *)buf, len, digest);
+  key->append((char *)digest, 16);
+  if (enc || codeToGID) {
+    aux = new GooString();
+    if (enc) {
+      for (i = 0; i < 256; ++i) {
+	if (enc[i]) {
+	  aux->append(enc[i]);
+	} else {
+	  aux->append('\1');
+	}
+	aux->append('\0');
+      }
+    }
+    if (codeToGID) {
+      aux->append((char *)codeToGID, codeToGIDLen * sizeof(int));
+    }
+    md5((Guchar *)aux->getCString(), aux->getLength(), digest);
+    key->append((char *)digest, 16);
+    delete aux;
+  }
+  return key;
+}
+
 //------------------------------------------------------------------------
 // T3FontCache
 //------------------------------------------------------------------------
@@ -1130,6 +1212,8 @@ public:
 		double m21A, double m22A)
     { return fontID.num == idA->num && fontID.gen == idA->gen &&
 	     m11 == m11A && m12 == m12A && m21 == m21A && m22 == m22A; }
+  int getCacheBytes()
+    { return cacheData ? cacheSets * cacheAssoc * glyphSize : 0; }
 
   Ref fontID;			// PDF font ID
   double m11, m12, m21, m22;	// transform matrix
@@ -1284,6 +1368,8 @@ SplashOutputDev::SplashOutputDev(SplashColorMode colorModeA,
   splash->clear(paperColor, 0);
 
   fontEngine = NULL;
+  fontEngineFlags = 0;
+  docNum = 0;
 
   nT3Fonts = 0;
   t3GlyphStack = NULL;
@@ -1365,23 +1451,41 @@ SplashOutputDev::~SplashOutputDev() {
 }
 
 void SplashOutputDev::startDoc(PDFDoc *docA) {
-  int i;
+  GBool aa;
+  int flags, i;
 
   doc = docA;
-  if (fontEngine) {
-    delete fontEngine;
-  }
-  fontEngine = new SplashFontEngine(
+
+  // font file IDs from the previous documents stay valid in the font
+  // engine, so keep it (and its glyph caches) unless the settings have
+  // changed: fonts embedded in several documents are loaded only once
+  ++docNum;
+  aa = getFontAntialias() && colorMode != splashModeMono1;
+  flags = 1 | (aa ? 2 : 0);
 #if HAVE_T1LIB_H
-				    globalParams->getEnableT1lib(),
+  flags |= globalParams->getEnableT1lib() ? 4 : 0;
 #endif
 #if HAVE_FREETYPE_FREETYPE_H || HAVE_FREETYPE_H
-				    globalParams->getEnableFreeType(),
-				    enableFreeTypeHinting,
-				    enableSlightHinting,
+  flags |= (globalParams->getEnableFreeType() ? 8 : 0) |
+           (enableFreeTypeHinting ? 16 : 0) |
+           (enableSlightHinting ? 32 : 0);
 #endif
-				      getFontAntialias() &&
-				      colorMode != splashModeMono1);
+  if (!fontEngine || flags != fontEngineFlags) {
+    if (fontEngine) {
+      delete fontEngine;
+    }
+    fontEngine = new SplashFontEngine(
+#if HAVE_T1LIB_H
+				      globalParams->getEnableT1lib(),
+#endif
+#if HAVE_FREETYPE_FREETYPE_H || HAVE_FREETYPE_H
+				      globalParams->getEnableFreeType(),
+				      enableFreeTypeHinting,
+				      enableSlightHinting,
+#endif
+				      aa);
+    fontEngineFlags = flags;
+  }
   for (i = 0; i < nT3Fonts; ++i) {
     delete t3FontCache[i];
   }
@@ -1857,6 +1961,7 @@ void SplashOutputDev::doUpdateFont(GfxState *state) {
   char *tmpBuf;
   int tmpBufLen;
   int *codeToGID;
+  const char **enc;
   double *textMat;
   double m11, m12, m21, m22, fontSize;
   int faceIndex = 0;
@@ -1887,7 +1992,7 @@ void SplashOutputDev::doUpdateFont(GfxState *state) {
   }
 
   // check the font file cache
-  id = new SplashOutFontFileID(gfxFont->getID());
+  id = new SplashOutFontFileID(gfxFont->getID(), docNum);
   if ((fontFile = fontEngine->getFontFile(id))) {
     delete id;
 
@@ -1920,40 +2025,15 @@ void SplashOutputDev::doUpdateFont(GfxState *state) {
     else
       fontsrc->setBuf(tmpBuf, tmpBufLen, gTrue);
 
-    // load the font file
+    // get the encoding or code-to-GID map to load the font file with
+    enc = NULL;
+    codeToGID = NULL;
+    n = 0;
     switch (fontType) {
     case fontType1:
-      if (!(fontFile = fontEngine->loadType1Font(
-			   id,
-			   fontsrc,
-			   (const char **)((Gfx8BitFont *)gfxFont)->getEncoding()))) {
-	error(errSyntaxError, -1, "Couldn't create a font for '{0:s}'",
-	      gfxFont->getName() ? gfxFont->getName()->getCString()
-	                         : "(unnamed)");
-	goto err2;
-      }
-      break;
     case fontType1C:
-      if (!(fontFile = fontEngine->loadType1CFont(
-			   id,
-			   fontsrc,
-			   (const char **)((Gfx8BitFont *)gfxFont)->getEncoding()))) {
-	error(errSyntaxError, -1, "Couldn't create a font for '{0:s}'",
-	      gfxFont->getName() ? gfxFont->getName()->getCString()
-	                         : "(unnamed)");
-	goto err2;
-      }
-      break;
     case fontType1COT:
-      if (!(fontFile = fontEngine->loadOpenTypeT1CFont(
-			   id,
-			   fontsrc,
-			   (const char **)((Gfx8BitFont *)gfxFont)->getEncoding()))) {
-	error(errSyntaxError, -1, "Couldn't create a font for '{0:s}'",
-	      gfxFont->getName() ? gfxFont->getName()->getCString()
-	                         : "(unnamed)");
-	goto err2;
-      }
+      enc = (const char **)((Gfx8BitFont *)gfxFont)->getEncoding();
       break;
     case fontTrueType:
     case fontTrueTypeOT:
@@ -1976,29 +2056,6 @@ void SplashOutputDev::doUpdateFont(GfxState *state) {
 	    }
 	  }
 	}
-      } else {
-	codeToGID = NULL;
-	n = 0;
-      }
-      if (!(fontFile = fontEngine->loadTrueTypeFont(
-			   id,
-			   fontsrc,
-			   codeToGID, n))) {
-	error(errSyntaxError, -1, "Couldn't create a font for '{0:s}'",
-	      gfxFont->getName() ? gfxFont->getName()->getCString()
-	                         : "(unnamed)");
-	goto err2;
-      }
-      break;
-    case fontCIDType0:
-    case fontCIDType0C:
-      if (!(fontFile = fontEngine->loadCIDFont(
-			   id,
-			   fontsrc))) {
-	error(errSyntaxError, -1, "Couldn't create a font for '{0:s}'",
-	      gfxFont->getName() ? gfxFont->getName()->getCString()
-	                         : "(unnamed)");
-	goto err2;
       }
       break;
     case fontCIDType0COT:
@@ -2007,24 +2064,10 @@ void SplashOutputDev::doUpdateFont(GfxState *state) {
 	codeToGID = (int *)gmallocn(n, sizeof(int));
 	memcpy(codeToGID, ((GfxCIDFont *)gfxFont)->getCIDToGID(),
 	       n * sizeof(int));
-      } else {
-	codeToGID = NULL;
-	n = 0;
-      }
-      if (!(fontFile = fontEngine->loadOpenTypeCFFFont(
-			   id,
-			   fontsrc,
-                           codeToGID, n))) {
-	error(errSyntaxError, -1, "Couldn't create a font for '{0:s}'",
-	      gfxFont->getName() ? gfxFont->getName()->getCString()
-	                         : "(unnamed)");
-	goto err2;
       }
       break;
     case fontCIDType2:
     case fontCIDType2OT:
-      codeToGID = NULL;
-      n = 0;
       if (((GfxCIDFont *)gfxFont)->getCIDToGID()) {
 	n = ((GfxCIDFont *)gfxFont)->getCIDToGIDLen();
 	if (n) {
@@ -2047,21 +2090,114 @@ void SplashOutputDev::doUpdateFont(GfxState *state) {
 	codeToGID = ((GfxCIDFont *)gfxFont)->getCodeToGIDMap(ff, &n);
 	delete ff;
       }
-      if (!(fontFile = fontEngine->loadTrueTypeFont(
-			   id,
-			   fontsrc,
-			   codeToGID, n, faceIndex))) {
-	error(errSyntaxError, -1, "Couldn't create a font for '{0:s}'",
-	      gfxFont->getName() ? gfxFont->getName()->getCString()
-	                         : "(unnamed)");
-	goto err2;
-      }
       break;
     default:
-      // this shouldn't happen
-      goto err2;
+      break;
+    }
+
+    // an embedded font program that is already loaded (a subset that
+    // is embedded again on every page, the same font in an earlier
+    // document) shares the font file and its glyph caches
+    if (tmpBuf) {
+      id->setKey(makeSplashOutFontFileKey(fontType, faceIndex,
+					  tmpBuf, tmpBufLen,
+					  enc, codeToGID, n));
+      if ((fontFile = fontEngine->getFontFile(id))) {
+	((SplashOutFontFileID *)fontFile->getID())->addRef(gfxFont->getID(),
+							   docNum);
+	delete id;
+	gfree(codeToGID);
+      }
+    }
+
+    if (!fontFile) {
+      // load the font file
+      switch (fontType) {
+      case fontType1:
+	if (!(fontFile = fontEngine->loadType1Font(
+			     id,
+			     fontsrc,
+			     enc))) {
+	  error(errSyntaxError, -1, "Couldn't create a font for '{0:s}'",
+		gfxFont->getName() ? gfxFont->getName()->getCString()
+				   : "(unnamed)");
+	  goto err2;
+	}
+	break;
+      case fontType1C:
+	if (!(fontFile = fontEngine->loadType1CFont(
+			     id,
+			     fontsrc,
+			     enc))) {
+	  error(errSyntaxError, -1, "Couldn't create a font for '{0:s}'",
+		gfxFont->getName() ? gfxFont->getName()->getCString()
+				   : "(unnamed)");
+	  goto err2;
+	}
+	break;
+      case fontType1COT:
+	if (!(fontFile = fontEngine->loadOpenTypeT1CFont(
+			     id,
+			     fontsrc,
+			     enc))) {
+	  error(errSyntaxError, -1, "Couldn't create a font for '{0:s}'",
+		gfxFont->getName() ? gfxFont->getName()->getCString()
+				   : "(unnamed)");
+	  goto err2;
+	}
+	break;
+      case fontTrueType:
+      case fontTrueTypeOT:
+	if (!(fontFile = fontEngine->loadTrueTypeFont(
+			     id,
+			     fontsrc,
+			     codeToGID, n))) {
+	  error(errSyntaxError, -1, "Couldn't create a font for '{0:s}'",
+		gfxFont->getName() ? gfxFont->getName()->getCString()
+				   : "(unnamed)");
+	  goto err2;
+	}
+	break;
+      case fontCIDType0:
+      case fontCIDType0C:
+	if (!(fontFile = fontEngine->loadCIDFont(
+			     id,
+			     fontsrc))) {
+	  error(errSyntaxError, -1, "Couldn't create a font for '{0:s}'",
+		gfxFont->getName() ? gfxFont->getName()->getCString()
+				   : "(unnamed)");
+	  goto err2;
+	}
+	break;
+      case fontCIDType0COT:
+	if (!(fontFile = fontEngine->loadOpenTypeCFFFont(
+			     id,
+			     fontsrc,
+			     codeToGID, n))) {
+	  error(errSyntaxError, -1, "Couldn't create a font for '{0:s}'",
+		gfxFont->getName() ? gfxFont->getName()->getCString()
+				   : "(unnamed)");
+	  goto err2;
+	}
+	break;
+      case fontCIDType2:
+      case fontCIDType2OT:
+	if (!(fontFile = fontEngine->loadTrueTypeFont(
+			     id,
+			     fontsrc,
+			     codeToGID, n, faceIndex))) {
+	  error(errSyntaxError, -1, "Couldn't create a font for '{0:s}'",
+		gfxFont->getName() ? gfxFont->getName()->getCString()
+				   : "(unnamed)");
+	  goto err2;
+	}
+	break;
+      default:
+	// this shouldn't happen
+	goto err2;
+      }
+      fontFile->doAdjustMatrix = doAdjustFontMatrix;
     }
-    fontFile->doAdjustMatrix = doAdjustFontMatrix;
   }
 
   // get the font matrix
@@ -2348,7 +2484,7 @@ GBool SplashOutputDev::beginType3Char(GfxState *state, double x, double y,
   double m[4];
   GBool horiz;
   double x1, y1, xMin, yMin, xMax, yMax, xt, yt;
-  int i, j;
+  int cacheBytes, i, j;
 
   if (skipHorizText || skipRotatedText) {
     state->getFontTransMat(&m[0], &m[1], &m[2], &m[3]);
@@ -2383,16 +2519,30 @@ GBool SplashOutputDev::beginType3Char(GfxState *state, double x, double y,
     }
     if (i >= nT3Fonts) {
 
-      // create new entry in the font cache
-      if (nT3Fonts == splashOutT3FontCacheSize) {
+      // create new entry in the font cache -- evict the LRU fonts until
+      // there is a free slot and room for a full-size font cache
+      cacheBytes = 0;
+      for (j = 0; j < nT3Fonts; ++j) {
+	cacheBytes += t3FontCache[j]->getCacheBytes();
+      }
+      while (nT3Fonts == splashOutT3FontCacheSize ||
+	     (nT3Fonts > 0 &&
+	      cacheBytes > type3FontCacheTotal - type3FontCacheSize)) {
 	t3gs = t3GlyphStack;
 	while (t3gs != NULL) {
 	  if (t3gs->cache == t3FontCache[nT3Fonts - 1]) {
+	    break;
+	  }
+	  t3gs = t3gs->next;
+	}
+	if (t3gs) {
+	  if (nT3Fonts == splashOutT3FontCacheSize) {
 	    error(errSyntaxWarning, -1, "t3FontCache reaches limit but font still on stack in SplashOutputDev::beginType3Char");
 	    return gTrue;
 	  }
-	  t3gs = t3gs->next;
+	  break;
 	}
+	cacheBytes -= t3FontCache[nT3Fonts - 1]->getCacheBytes();
 	delete t3FontCache[nT3Fonts - 1];
 	--nT3Fonts;
       }
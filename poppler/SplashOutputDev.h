@@ -158,7 +158,7 @@ private:
 //------------------------------------------------------------------------
 
 // number of Type 3 fonts to cache
-#define splashOutT3FontCacheSize 8
+#define splashOutT3FontCacheSize 32
 
 //------------------------------------------------------------------------
 // SplashOutputDev
@@ -416,6 +416,9 @@ private:
   SplashBitmap *bitmap;
   Splash *splash;
   SplashFontEngine *fontEngine;
+  int fontEngineFlags;		// settings fontEngine was created with
+  int docNum;			// incremented for each document, to tell
+				//   fonts from different documents apart
 
   T3FontCache *			// Type 3 font cache
     t3FontCache[splashOutT3FontCacheSize];
@@ -114,15 +114,19 @@ Stream::~Stream() {
 }
 
 int Stream::incRef() {
-  streamLocker();
-  ++ref;
-  return ref;
+#if MULTITHREADED
+  return gAtomicIncrement(&ref);
+#else
+  return ++ref;
+#endif
 }
 
 int Stream::decRef() {
-  streamLocker();
-  --ref;
-  return ref;
+#if MULTITHREADED
+  return gAtomicDecrement(&ref);
+#else
+  return --ref;
+#endif
 }
 
 void Stream::close() {
@@ -378,6 +382,13 @@ OutStream::~OutStream ()
 {
 }
 
+void OutStream::write (const char *buf, int len)
+{
+  for (int i = 0; i < len; i++) {
+    put(buf[i]);
+  }
+}
+
 //------------------------------------------------------------------------
 // FileOutStream
 //------------------------------------------------------------------------
@@ -385,6 +396,7 @@ FileOutStream::FileOutStream (FILE* fa, Goffset startA)
 {
   f = fa;
   start = startA;
+  bufLen = 0;
 }
 
 FileOutStream::~FileOutStream ()
@@ -394,27 +406,119 @@ FileOutStream::~FileOutStream ()
 
 void FileOutStream::close ()
 {
+  flush();
+}
 
+void FileOutStream::flush ()
+{
+  if (bufLen > 0) {
+    fwrite(buf, 1, bufLen, f);
+    bufLen = 0;
+  }
 }
 
 Goffset FileOutStream::getPos ()
 {
-  return Gftell(f);
+  return Gftell(f) + bufLen;
 }
 
-void FileOutStream::put (char c)
+void FileOutStream::write (const char *data, int len)
 {
-  fputc(c,f);
+  if (len > fileOutStreamBufSize - bufLen) {
+    flush();
+    if (len >= fileOutStreamBufSize) {
+      fwrite(data, 1, len, f);
+      return;
+    }
+  }
+  memcpy(buf + bufLen, data, len);
+  bufLen += len;
 }
 
 void FileOutStream::printf(const char *format, ...)
 {
   va_list argptr;
+  int n;
+
+  // format straight into the buffer, flushing it first if there is not
+  // enough room left
   va_start (argptr, format);
-  vfprintf(f, format, argptr);
+  n = vsnprintf(buf + bufLen, fileOutStreamBufSize - bufLen, format, argptr);
+  va_end (argptr);
+  if (n < 0) {
+    return;
+  }
+  if (n < fileOutStreamBufSize - bufLen) {
+    bufLen += n;
+    return;
+  }
+  flush();
+  va_start (argptr, format);
+  if (n < fileOutStreamBufSize) {
+    bufLen = vsnprintf(buf, fileOutStreamBufSize, format, argptr);
+  } else {
+    vfprintf(f, format, argptr);
+  }
   va_end (argptr);
 }
 
+//------------------------------------------------------------------------
+// MemOutStream
+//------------------------------------------------------------------------
+
+MemOutStream::MemOutStream ()
+{
+  data = new GooString();
+}
+
+MemOutStream::~MemOutStream ()
+{
+  delete data;
+}
+
+void MemOutStream::close ()
+{
+}
+
+Goffset MemOutStream::getPos ()
+{
+  return data->getLength();
+}
+
+void MemOutStream::put (char c)
+{
+  data->append(c);
+}
+
+void MemOutStream::write (const char *buf, int len)
+{
+  data->append(buf, len);
+}
+
+void MemOutStream::printf(const char *format, ...)
+{
+  va_list argptr;
+  char buf[256];
+  int n;
+
+  va_start (argptr, format);
+  n = vsnprintf(buf, sizeof(buf), format, argptr);
+  va_end (argptr);
+  if (n < 0) {
+    return;
+  }
+  if (n < (int)sizeof(buf)) {
+    data->append(buf, n);
+    return;
+  }
+
+  char *bigBuf = (char *)gmalloc(n + 1);
+  va_start (argptr, format);
+  vsnprintf(bigBuf, n + 1, format, argptr);
+  va_end (argptr);
+  data->append(bigBuf, n);
+  gfree(bigBuf);
+}
 
 //------------------------------------------------------------------------
 // BaseStream
@@ -1058,6 +1162,7 @@ EmbedStream::EmbedStream(Stream *strA, Object *dictA,
   str = strA;
   limited = limitedA;
   length = lengthA;
+  record = NULL;
 }
 
 EmbedStream::~EmbedStream() {
@@ -1075,11 +1180,17 @@ Stream *EmbedStream::makeSubStream(Goffset start, GBool limitedA,
 }
 
 int EmbedStream::getChar() {
+  int c;
+
   if (limited && !length) {
     return EOF;
   }
   --length;
-  return str->getChar();
+  c = str->getChar();
+  if (record && c != EOF) {
+    record->append((char)c);
+  }
+  return c;
 }
 
 int EmbedStream::lookChar() {
@@ -1096,7 +1207,14 @@ int EmbedStream::getChars(int nChars, Guchar *buffer) {
   if (limited && length < nChars) {
     nChars = length;
   }
-  return str->doGetChars(nChars, buffer);
+  nChars = str->doGetChars(nChars, buffer);
+  if (limited && nChars > 0) {
+    length -= nChars;
+  }
+  if (record && nChars > 0) {
+    record->append((char *)buffer, nChars);
+  }
+  return nChars;
 }
 
 void EmbedStream::setPos(Goffset pos, int dir) {
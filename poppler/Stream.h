@@ -266,6 +266,10 @@ public:
   // Put a char in the stream
   virtual void put (char c) = 0;
 
+  // Put len bytes in the stream. The default implementation calls put()
+  // for each of them.
+  virtual void write (const char *buf, int len);
+
   virtual void printf (const char *format, ...) GCC_PRINTF_FORMAT(2,3) = 0;
 
 private:
@@ -275,7 +279,14 @@ private:
 
 //------------------------------------------------------------------------
 // FileOutStream
+//
+// The data is collected in a buffer and written to the file in large
+// blocks. The buffer is flushed by close() and by the destructor, one of
+// which must be called before the file is closed.
 //------------------------------------------------------------------------
+
+#define fileOutStreamBufSize 65536
+
 class FileOutStream : public OutStream {
 public:
   FileOutStream (FILE* fa, Goffset startA);
@@ -286,12 +297,49 @@ public:
 
   virtual Goffset getPos();
 
-  virtual void put (char c);
+  virtual void put (char c)
+    { if (bufLen == fileOutStreamBufSize) flush(); buf[bufLen++] = c; }
+
+  virtual void write (const char *data, int len);
 
   virtual void printf (const char *format, ...);
 private:
+  void flush();
+
   FILE *f;
   Goffset start;
+  char buf[fileOutStreamBufSize];
+  int bufLen;
+
+};
+
+
+//------------------------------------------------------------------------
+// MemOutStream
+//
+// Collects the written data in memory.
+//------------------------------------------------------------------------
+class MemOutStream : public OutStream {
+public:
+  MemOutStream ();
+
+  virtual ~MemOutStream ();
+
+  virtual void close();
+
+  virtual Goffset getPos();
+
+  virtual void put (char c);
+
+  virtual void write (const char *buf, int len);
+
+  virtual void printf (const char *format, ...);
+
+  // Returns the data written so far. The stream keeps ownership.
+  GooString *getData() { return data; }
+
+private:
+  GooString *data;
 
 };
 
@@ -536,6 +584,8 @@ public:
   virtual int getUnfilteredChar () { return getChar(); }
   virtual void unfilteredReset () { reset(); }
 
+  CachedFile *getCachedFile() { return cc; }
+
 private:
 
   GBool fillBuf();
@@ -625,6 +675,9 @@ public:
   virtual int getUnfilteredChar () { return str->getUnfilteredChar(); }
   virtual void unfilteredReset () { str->unfilteredReset(); }
 
+  // Append every byte read from the base stream to <recordA> (or stop
+  // recording if <recordA> is NULL).
+  void setRecord(GooString *recordA) { record = recordA; }
 
 private:
 
@@ -633,6 +686,7 @@ private:
 
   Stream *str;
   GBool limited;
+  GooString *record;
 };
 
 //------------------------------------------------------------------------
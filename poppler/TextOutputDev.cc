@@ -2232,6 +2232,7 @@ TextPage::TextPage(GBool rawOrderA) {
   curFontSize = 0;
   nest = 0;
   nTinyChars = 0;
+  keepTinyChars = globalParams->getTextKeepTinyChars();
   lastCharOverlap = gFalse;
   if (!rawOrder) {
     for (rot = 0; rot < 4; ++rot) {
@@ -2281,6 +2282,7 @@ void TextPage::startPage(GfxState *state) {
   } else {
     pageWidth = pageHeight = 0;
   }
+  keepTinyChars = globalParams->getTextKeepTinyChars();
 }
 
 void TextPage::endPage() {
@@ -2483,8 +2485,7 @@ void TextPage::addChar(GfxState *state, double x, double y,
   }
 
   // check the tiny chars limit
-  if (!globalParams->getTextKeepTinyChars() &&
-      fabs(w1) < 3 && fabs(h1) < 3) {
+  if (!keepTinyChars && fabs(w1) < 3 && fabs(h1) < 3) {
     if (++nTinyChars > 50000) {
       charPos += nBytes;
       return;
@@ -653,6 +653,8 @@ private:
   double curFontSize;		// current font size
   int nest;			// current nesting level (for Type 3 fonts)
   int nTinyChars;		// number of "tiny" chars seen so far
+  GBool keepTinyChars;		// keep all chars (from GlobalParams,
+				//   fetched once per page)
   GBool lastCharOverlap;	// set if the last added char overlapped the
 				//   previous char
 
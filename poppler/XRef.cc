@@ -43,6 +43,7 @@
 #include <ctype.h>
 #include <limits.h>
 #include <float.h>
+#include <algorithm>
 #include "goo/gfile.h"
 #include "goo/gmem.h"
 #include "Object.h"
@@ -297,6 +298,7 @@ void XRef::init() {
   ownerPasswordOk = gFalse;
   rootNum = -1;
   strOwner = gFalse;
+  freeSearchStart = 1;
 }
 
 XRef::XRef() {
@@ -409,9 +411,19 @@ XRef::~XRef() {
 }
 
 XRef *XRef::copy() {
+  BaseStream *strA = str->copy();
+  XRef *xref = copy(strA);
+  if (xref) {
+    xref->strOwner = gTrue;
+  } else {
+    delete strA;
+  }
+  return xref;
+}
+
+XRef *XRef::copy(BaseStream *strA) {
   XRef *xref = new XRef();
-  xref->str = str->copy();
-  xref->strOwner = gTrue;
+  xref->str = strA;
   xref->encrypted = encrypted;
   xref->permFlags = permFlags;
   xref->ownerPasswordOk = ownerPasswordOk;
@@ -422,7 +434,14 @@ XRef *XRef::copy() {
   xref->prevXRefOffset = prevXRefOffset;
   xref->mainXRefEntriesOffset = mainXRefEntriesOffset;
   xref->xRefStream = xRefStream;
-  trailerDict.copy(&xref->trailerDict);
+  xref->mainXRefOffset = mainXRefOffset;
+  if (trailerDict.isDict()) {
+    // the copy must fetch indirect trailer entries through its own stream
+    xref->trailerDict.initDict(trailerDict.getDict()->copy(xref));
+    xref->trailerDict.getDict()->decRef();
+  } else {
+    trailerDict.copy(&xref->trailerDict);
+  }
   xref->encAlgorithm = encAlgorithm;
   xref->encRevision = encRevision;
   xref->encVersion = encVersion;
@@ -446,6 +465,7 @@ XRef *XRef::copy() {
     xref->entries[i].flags = entries[i].flags;
     xref->entries[i].gen = entries[i].gen;
   }
+  xref->updated = updated;
   xref->streamEndsLen = streamEndsLen;
   if (streamEndsLen  != 0) {
     xref->streamEnds = (Goffset *)gmalloc(streamEndsLen * sizeof(Goffset));
@@ -909,6 +929,8 @@ GBool XRef::constructXRef(GBool *wasReconstructed, GBool needCatalogDict) {
   capacity = 0;
   size = 0;
   entries = NULL;
+  updated.clear();
+  freeSearchStart = 1;
 
   gotRoot = gFalse;
   streamEndsLen = streamEndsSize = 0;
@@ -1343,7 +1365,41 @@ void XRef::add(int num, int gen, Goffset offs, GBool used) {
   } else {
     e->type = xrefEntryFree;
     e->offset = 0;
+    if (num > 0 && num < freeSearchStart) {
+      freeSearchStart = num;
+    }
+  }
+}
+
+void XRef::setUpdated(int num) {
+  XRefEntry *e = getEntry(num);
+  if (!e->getFlag(XRefEntry::Updated)) {
+    e->setFlag(XRefEntry::Updated, gTrue);
+    updated.push_back(num);
+  }
+}
+
+GBool XRef::hasUpdatedObjects() {
+  xrefLocker();
+  for (size_t i = 0; i < updated.size(); ++i) {
+    if (entries[updated[i]].getFlag(XRefEntry::Updated)) {
+      return gTrue;
+    }
+  }
+  return gFalse;
+}
+
+void XRef::getUpdatedObjects(std::vector<int> *nums) {
+  xrefLocker();
+  nums->clear();
+  for (size_t i = 0; i < updated.size(); ++i) {
+    if (entries[updated[i]].getFlag(XRefEntry::Updated)) {
+      nums->push_back(updated[i]);
+    }
   }
+  std::sort(nums->begin(), nums->end());
+  // an entry reset by add() and changed again is listed twice
+  nums->erase(std::unique(nums->begin(), nums->end()), nums->end());
 }
 
 void XRef::setModifiedObject (Object* o, Ref r) {
@@ -1355,12 +1411,12 @@ void XRef::setModifiedObject (Object* o, Ref r) {
   XRefEntry *e = getEntry(r.num);
   e->obj.free();
   o->copy(&(e->obj));
-  e->setFlag(XRefEntry::Updated, gTrue);
+  setUpdated(r.num);
 }
 
 Ref XRef::addIndirectObject (Object* o) {
   int entryIndexToUse = -1;
-  for (int i = 1; entryIndexToUse == -1 && i < size; ++i) {
+  for (int i = freeSearchStart; entryIndexToUse == -1 && i < size; ++i) {
     XRefEntry *e = getEntry(i, false /* complainIfMissing */);
     if (e->type == xrefEntryFree && e->gen != 65535) {
       entryIndexToUse = i;
@@ -1380,7 +1436,8 @@ Ref XRef::addIndirectObject (Object* o) {
   }
   e->type = xrefEntryUncompressed;
   o->copy(&e->obj);
-  e->setFlag(XRefEntry::Updated, gTrue);
+  setUpdated(entryIndexToUse);
+  freeSearchStart = entryIndexToUse + 1;
 
   Ref r;
   r.num = entryIndexToUse;
@@ -1401,7 +1458,10 @@ void XRef::removeIndirectObject(Ref r) {
   e->obj.free();
   e->type = xrefEntryFree;
   e->gen++;
-  e->setFlag(XRefEntry::Updated, gTrue);
+  setUpdated(r.num);
+  if (r.num > 0 && r.num < freeSearchStart) {
+    freeSearchStart = r.num;
+  }
 }
 
 void XRef::writeXRef(XRef::XRefWriter *writer, GBool writeAllEntries) {
@@ -1448,6 +1508,38 @@ void XRef::writeXRef(XRef::XRefWriter *writer, GBool writeAllEntries) {
   }
 }
 
+void XRef::writeSparseXRef(XRef::XRefWriter *writer, std::vector<XRefSectionEntry> *sectionEntries) {
+  std::vector<XRefSectionEntry> &ents = *sectionEntries;
+  if (ents.empty() || ents[0].num != 0 || ents[0].gen != 65535) {
+    error(errInternal, -1, "XRef::writeSparseXRef, entry 0 is missing or invalid\n");
+  }
+  //create free entries linked-list
+  size_t lastFreeEntry = 0;
+  for (size_t i = 0; i < ents.size(); i++) {
+    if (ents[i].type == xrefEntryFree) {
+      if (i > 0) {
+        ents[lastFreeEntry].offset = ents[i].num;
+      }
+      lastFreeEntry = i;
+    }
+  }
+  if (!ents.empty()) {
+    ents[lastFreeEntry].offset = 0;
+  }
+
+  size_t i = 0;
+  while (i < ents.size()) {
+    size_t j;
+    for (j = i + 1; j < ents.size() && ents[j].num == ents[j - 1].num + 1; j++) ;
+    writer->startSection(ents[i].num, (int)(j - i));
+    for (size_t k = i; k < j; k++) {
+      int gen = ents[k].gen > 65535 ? 65535 : ents[k].gen; //cap generation number to 65535 (required by PDFReference)
+      writer->writeEntry(ents[k].offset, gen, ents[k].type);
+    }
+    i = j;
+  }
+}
+
 XRef::XRefTableWriter::XRefTableWriter(OutStream* outStrA) {
   outStr = outStrA;
 }
@@ -1466,6 +1558,12 @@ void XRef::writeTableToFile(OutStream* outStr, GBool writeAllEntries) {
   writeXRef(&writer, writeAllEntries);
 }
 
+void XRef::writeTableToFile(OutStream* outStr, std::vector<XRefSectionEntry> *sectionEntries) {
+  XRefTableWriter writer(outStr);
+  outStr->printf("xref\r\n");
+  writeSparseXRef(&writer, sectionEntries);
+}
+
 XRef::XRefStreamWriter::XRefStreamWriter(Object *indexA, GooString *stmBufA, int offsetSizeA) {
   index = indexA;
   stmBuf = stmBufA;
@@ -1481,7 +1579,17 @@ void XRef::XRefStreamWriter::startSection(int first, int count) {
 void XRef::XRefStreamWriter::writeEntry(Goffset offset, int gen, XRefEntryType type) {
   const int entryTotalSize = 1 + offsetSize + 2; /* type + offset + gen */
   char data[16];
-  data[0] = (type==xrefEntryFree) ? 0 : 1;
+  switch (type) {
+  case xrefEntryFree:
+    data[0] = 0;
+    break;
+  case xrefEntryCompressed:
+    data[0] = 2;
+    break;
+  default:
+    data[0] = 1;
+    break;
+  }
   for (int i = offsetSize; i > 0; i--) {
     data[i] = offset & 0xff;
     offset >>= 8;
@@ -1517,9 +1625,29 @@ void XRef::writeStreamToBuffer(GooString *stmBuf, Dict *xrefDict, XRef *xref) {
   XRefStreamWriter writer(&index, stmBuf, offsetSize);
   writeXRef(&writer, gFalse);
 
+  setStreamDictEntries(xrefDict, xref, &index, offsetSize);
+}
+
+void XRef::writeStreamToBuffer(GooString *stmBuf, Dict *xrefDict, XRef *xref,
+                               std::vector<XRefSectionEntry> *sectionEntries) {
+  Object index;
+  index.initArray(xref);
+  stmBuf->clear();
+
+  XRefPreScanWriter prescan;
+  writeSparseXRef(&prescan, sectionEntries);
+  const int offsetSize = prescan.hasOffsetsBeyond4GB ? sizeof(Goffset) : 4;
+
+  XRefStreamWriter writer(&index, stmBuf, offsetSize);
+  writeSparseXRef(&writer, sectionEntries);
+
+  setStreamDictEntries(xrefDict, xref, &index, offsetSize);
+}
+
+void XRef::setStreamDictEntries(Dict *xrefDict, XRef *xref, Object *index, int offsetSize) {
   Object obj1, obj2;
   xrefDict->set("Type", obj1.initName("XRef"));
-  xrefDict->set("Index", &index);
+  xrefDict->set("Index", index);
   obj2.initArray(xref);
   obj2.arrayAdd( obj1.initInt(1) );
   obj2.arrayAdd( obj1.initInt(offsetSize) );
@@ -90,6 +90,15 @@ struct XRefEntry {
   }
 };
 
+// One entry of a sparse xref section, written without building a whole
+// XRef (see XRef::writeTableToFile).
+struct XRefSectionEntry {
+  int num;
+  int gen;
+  Goffset offset;
+  XRefEntryType type;
+};
+
 class XRef {
 public:
 
@@ -105,6 +114,9 @@ public:
 
   // Copy xref but with new base stream!
   XRef *copy();
+  // Copy xref, reading from strA, which isn't owned by the copy. strA
+  // may be NULL if the copy is only used to make other copies.
+  XRef *copy(BaseStream *strA);
 
   // Is xref table valid?
   GBool isOk() { return ok; }
@@ -181,10 +193,22 @@ public:
   void removeIndirectObject(Ref r);
   void add(int num, int gen,  Goffset offs, GBool used);
 
+  // Has any entry been changed by the write access functions?
+  GBool hasUpdatedObjects();
+  // Put the numbers of the changed entries in nums, in increasing order.
+  // This only costs the number of changes, not the size of the table.
+  void getUpdatedObjects(std::vector<int> *nums);
+
   // Output XRef table to stream
   void writeTableToFile(OutStream* outStr, GBool writeAllEntries);
   // Output XRef stream contents to GooString and fill trailerDict fields accordingly
   void writeStreamToBuffer(GooString *stmBuf, Dict *xrefDict, XRef *xref);
+  // Same, for a sparse XRef made of sectionEntries, sorted by object
+  // number and starting with entry 0. The free entries are linked together
+  // as if the other ones didn't exist.
+  static void writeTableToFile(OutStream* outStr, std::vector<XRefSectionEntry> *sectionEntries);
+  static void writeStreamToBuffer(GooString *stmBuf, Dict *xrefDict, XRef *xref,
+                                  std::vector<XRefSectionEntry> *sectionEntries);
 
   // to be thread safe during write where changes are not allowed
   void lock();
@@ -220,6 +244,9 @@ private:
   Goffset mainXRefOffset;	// position of the main XRef table/stream
   GBool scannedSpecialFlags;	// true if scanSpecialFlags has been called
   GBool strOwner;     // true if str is owned by the instance
+  std::vector<int> updated;	// entries with the Updated flag, unsorted;
+				//   add() may have cleared it since
+  int freeSearchStart;		// no reusable free entry below this one
 #if MULTITHREADED
   GooMutex mutex;
 #endif
@@ -276,6 +303,9 @@ private:
   };
 
   void writeXRef(XRefWriter *writer, GBool writeAllEntries);
+  static void writeSparseXRef(XRefWriter *writer, std::vector<XRefSectionEntry> *sectionEntries);
+  static void setStreamDictEntries(Dict *xrefDict, XRef *xref, Object *index, int offsetSize);
+  void setUpdated(int num);
 };
 
 #endif
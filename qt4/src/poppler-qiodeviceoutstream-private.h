@@ -36,6 +36,7 @@ class QIODeviceOutStream : public OutStream
     virtual void close();
     virtual Goffset getPos();
     virtual void put(char c);
+    virtual void write(const char *buf, int len);
     virtual void printf(const char *format, ...);
 
   private:
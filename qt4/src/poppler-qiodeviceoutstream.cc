@@ -50,6 +50,11 @@ void QIODeviceOutStream::put(char c)
   m_device->putChar(c);
 }
 
+void QIODeviceOutStream::write(const char *buf, int len)
+{
+  m_device->write(buf, len);
+}
+
 void QIODeviceOutStream::printf(const char *format, ...)
 {
   va_list ap;
@@ -362,6 +362,26 @@ namespace Poppler {
 	return m_doc->doc->isLinearized();
     }
 
+    bool Document::isPageAvailable(int index) const
+    {
+	return m_doc->doc->isPageAvailable(index + 1);
+    }
+
+    bool Document::prefetchPage(int index, bool wait) const
+    {
+	return m_doc->doc->prefetchPage(index + 1, wait);
+    }
+
+    void Document::setContentCacheSize(int bytes)
+    {
+	m_doc->doc->setContentCacheSize(bytes);
+    }
+
+    int Document::contentCacheSize() const
+    {
+	return m_doc->doc->getContentCacheSize();
+    }
+
     bool Document::okToPrint() const
     {
 	return m_doc->doc->okToPrint();
@@ -122,6 +122,11 @@ namespace Poppler {
 	
 	void fillMembers()
 	{
+		// pages are rendered again and again when zooming; keep
+		// their parsed contents around, see
+		// Document::setContentCacheSize()
+		doc->setContentCacheSize(8 * 1024 * 1024);
+
 		int numEmb = doc->getCatalog()->numEmbeddedFiles();
 		if (!(0 == numEmb)) {
 			// we have some embedded documents, build the list
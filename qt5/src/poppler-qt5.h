@@ -1106,6 +1106,54 @@ QString subject = m_doc->info("Subject");
 	*/
 	bool isLinearized() const;
 
+	/**
+	   Test if all the data needed to render the page at \p index
+	   has already been read
+
+	   Pages of linearized documents read over a slow link become
+	   available one by one; documents loaded from a file or from
+	   memory always have all of their pages available.
+
+	   \since 0.33
+	*/
+	bool isPageAvailable(int index) const;
+
+	/**
+	   Request the data needed to render the page at \p index
+
+	   The hint tables of linearized documents are used to read the
+	   page in as few requests as possible; the whole document is read
+	   when it is not linearized. If \p wait is false, the
+	   data is read along with the next request instead of right away.
+
+	   Returns false if the data could not be read.
+
+	   \since 0.33
+	*/
+	bool prefetchPage(int index, bool wait = false) const;
+
+	/**
+	   Set how much memory, in \p bytes, is used to keep the parsed
+	   contents of recently rendered pages, so that rendering a page
+	   again, for instance when zooming, doesn't parse its content
+	   streams again.
+
+	   The cache uses up to 8 MB by default; 0 disables it and
+	   frees the memory.
+
+	   \since 0.33
+	*/
+	void setContentCacheSize(int bytes);
+
+	/**
+	   The memory budget, in bytes, of the cache of parsed page
+	   contents, or 0 if it is disabled
+
+	   \sa setContentCacheSize()
+	   \since 0.33
+	*/
+	int contentCacheSize() const;
+
 	/**
 	   Test if the permissions on the document allow it to be
 	   printed
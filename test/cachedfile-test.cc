@@ -0,0 +1,290 @@
+//========================================================================
+//
+// cachedfile-test.cc
+//
+// Exercises CachedFile with an in-process loader that serves byte
+// ranges from a local file, and reports how many requests were needed.
+//
+// This file is licensed under the GPLv2 or later
+//
+//========================================================================
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "goo/GooString.h"
+#include "CachedFile.h"
+#include "GlobalParams.h"
+#include "PDFDoc.h"
+#include "utils/parseargs.h"
+
+static GBool async = gFalse;
+static GBool noReadAhead = gFalse;
+static GBool pages = gFalse;
+static int chunkSize = CachedFileChunkSize;
+static int memoryBudget = 0;
+static GBool spill = gFalse;
+static GBool printHelp = gFalse;
+
+static const ArgDesc argDesc[] = {
+  {"-async",  argFlag,     &async,           0,
+   "complete loads asynchronously and out of order"},
+  {"-noreadahead", argFlag, &noReadAhead,    0,
+   "disable read-ahead on sequential reads"},
+  {"-chunksize", argInt,   &chunkSize,       0,
+   "size of the chunks the file is loaded in"},
+  {"-budget", argInt,      &memoryBudget,    0,
+   "memory budget for loaded chunks, in bytes"},
+  {"-spill",  argFlag,     &spill,           0,
+   "spill evicted chunks to disk"},
+  {"-pages",  argFlag,     &pages,           0,
+   "also load the file as a PDF document page by page"},
+  {"-h",      argFlag,     &printHelp,       0,
+   "print usage information"},
+  {"-help",   argFlag,     &printHelp,       0,
+   "print usage information"},
+  {"--help",  argFlag,     &printHelp,       0,
+   "print usage information"},
+  {"-?",      argFlag,     &printHelp,       0,
+   "print usage information"},
+  {NULL}
+};
+
+//------------------------------------------------------------------------
+// FileCacheLoader
+//
+// Stand-in for a remote loader: every load() or startLoad() call counts
+// as one round trip. In async mode the ranges are only written when
+// pollLoads() or waitLoads() is called, newest first.
+//------------------------------------------------------------------------
+
+class FileCacheLoader : public CachedFileLoader {
+
+public:
+
+  FileCacheLoader(FILE *fA, GBool asyncA)
+    { f = fA; asyncLoads = asyncA; roundTrips = 0; bytesLoaded = 0; }
+  ~FileCacheLoader() {}
+
+  size_t init(GooString *url, CachedFile *cachedFile);
+  int load(const std::vector<ByteRange> &ranges, CachedFileWriter *writer);
+
+  GBool isAsync() { return asyncLoads; }
+  int startLoad(const std::vector<ByteRange> &ranges,
+                const std::vector<CachedFileWriter *> &writers);
+  int pollLoads();
+  int waitLoads();
+
+  int roundTrips;
+  size_t bytesLoaded;
+
+private:
+
+  int loadRange(const ByteRange &range, CachedFileWriter *writer);
+
+  FILE *f;
+  GBool asyncLoads;
+  std::vector<ByteRange> queuedRanges;
+  std::vector<CachedFileWriter *> queuedWriters;
+
+};
+
+size_t FileCacheLoader::init(GooString *url, CachedFile *cachedFile)
+{
+  fseek(f, 0, SEEK_END);
+  return ftell(f);
+}
+
+int FileCacheLoader::loadRange(const ByteRange &range, CachedFileWriter *writer)
+{
+  char buf[CachedFileChunkSize];
+  size_t toRead = range.length;
+  size_t n;
+
+  fseek(f, range.offset, SEEK_SET);
+  while (toRead > 0) {
+    n = fread(buf, 1, toRead < sizeof(buf) ? toRead : sizeof(buf), f);
+    if (n == 0) break;
+    writer->write(buf, n);
+    bytesLoaded += n;
+    toRead -= n;
+  }
+  return 0;
+}
+
+int FileCacheLoader::load(const std::vector<ByteRange> &ranges, CachedFileWriter *writer)
+{
+  roundTrips++;
+  for (size_t i = 0; i < ranges.size(); i++) {
+    loadRange(ranges[i], writer);
+  }
+  return 0;
+}
+
+int FileCacheLoader::startLoad(const std::vector<ByteRange> &ranges,
+                               const std::vector<CachedFileWriter *> &writers)
+{
+  if (!asyncLoads)
+    return CachedFileLoader::startLoad(ranges, writers);
+
+  roundTrips++;
+  queuedRanges.insert(queuedRanges.end(), ranges.begin(), ranges.end());
+  queuedWriters.insert(queuedWriters.end(), writers.begin(), writers.end());
+  return 0;
+}
+
+int FileCacheLoader::pollLoads()
+{
+  if (!queuedRanges.empty()) {
+    loadRange(queuedRanges.back(), queuedWriters.back());
+    queuedRanges.pop_back();
+    queuedWriters.pop_back();
+  }
+  return queuedRanges.size();
+}
+
+int FileCacheLoader::waitLoads()
+{
+  while (pollLoads() > 0) ;
+  return 0;
+}
+
+//------------------------------------------------------------------------
+
+static GBool check(CachedFile *cachedFile, const char *data, size_t offset, size_t len)
+{
+  char *buf = (char *)malloc(len);
+  GBool ok;
+
+  cachedFile->seek(offset, SEEK_SET);
+  ok = cachedFile->read(buf, 1, len) == len && memcmp(buf, data + offset, len) == 0;
+  if (!ok) {
+    fprintf(stderr, "Mismatch reading %lu bytes at %lu\n", (unsigned long)len, (unsigned long)offset);
+  }
+  free(buf);
+  return ok;
+}
+
+static CachedFile *newCachedFile(FileCacheLoader *loader, const char *fileName)
+{
+  CachedFile *cachedFile = new CachedFile(loader, new GooString(fileName), chunkSize);
+  if (memoryBudget > 0) {
+    cachedFile->setMemoryBudget(memoryBudget, spill);
+  }
+  return cachedFile;
+}
+
+int main(int argc, char *argv[])
+{
+  FILE *f;
+  char *data;
+  size_t size;
+  FileCacheLoader *loader;
+  CachedFile *cachedFile;
+  GBool ok = gTrue;
+
+  if (!parseArgs(argDesc, &argc, argv) || argc != 2 || printHelp) {
+    printUsage(argv[0], "FILE", argDesc);
+    return printHelp ? 0 : 1;
+  }
+
+  f = fopen(argv[1], "rb");
+  if (!f) {
+    fprintf(stderr, "Couldn't open %s\n", argv[1]);
+    return 1;
+  }
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  data = (char *)malloc(size + 1);
+  fseek(f, 0, SEEK_SET);
+  if (fread(data, 1, size, f) != size) {
+    fprintf(stderr, "Couldn't read %s\n", argv[1]);
+    return 1;
+  }
+
+  // sequential reads, the way CachedFileStream reads, twice
+  loader = new FileCacheLoader(f, async);
+  cachedFile = newCachedFile(loader, argv[1]);
+  if (noReadAhead) cachedFile->setMaxReadAhead(0);
+  for (int pass = 0; pass < 2; pass++) {
+    for (size_t pos = 0; ok && pos < size; pos += 1024) {
+      ok = check(cachedFile, data, pos, pos + 1024 <= size ? 1024 : size - pos);
+    }
+  }
+  printf("sequential: %d round trips, %lu bytes loaded\n",
+         loader->roundTrips, (unsigned long)loader->bytesLoaded);
+  cachedFile->decRefCnt();
+
+  // scattered reads after a prefetch of the same ranges, too far apart
+  // to be loaded together
+  loader = new FileCacheLoader(f, async);
+  cachedFile = newCachedFile(loader, argv[1]);
+  std::vector<ByteRange> ranges;
+  for (size_t pos = 0; pos < size; pos += (CachedFileCoalesceGap + 2) * chunkSize) {
+    ByteRange range;
+    range.offset = pos;
+    range.length = pos + 100 <= size ? 100 : size - pos;
+    ranges.push_back(range);
+  }
+  cachedFile->prefetch(ranges);
+  size_t firstReadBytes = 0;
+  for (size_t i = ranges.size(); ok && i > 0; i--) {
+    ok = check(cachedFile, data, ranges[i - 1].offset, ranges[i - 1].length);
+    if (i == ranges.size()) firstReadBytes = loader->bytesLoaded;
+  }
+  printf("scattered: %d round trips, %lu bytes loaded, %lu by the first read\n",
+         loader->roundTrips, (unsigned long)loader->bytesLoaded,
+         (unsigned long)firstReadBytes);
+  // a blocking read doesn't wait for the rest of the prefetch
+  if (ok && async && ranges.size() > 1 && firstReadBytes == loader->bytesLoaded) {
+    fprintf(stderr, "The first read waited for the whole prefetch\n");
+    ok = gFalse;
+  }
+  cachedFile->decRefCnt();
+
+  // page by page, the way a viewer reads a linearized document
+  if (ok && pages) {
+    Object obj;
+    PDFDoc *doc;
+
+    globalParams = new GlobalParams();
+    loader = new FileCacheLoader(f, async);
+    cachedFile = newCachedFile(loader, argv[1]);
+    obj.initNull();
+    doc = new PDFDoc(new CachedFileStream(cachedFile, 0, gFalse, cachedFile->getLength(), &obj));
+    if (!doc->isOk()) {
+      fprintf(stderr, "Couldn't open %s as a PDF document\n", argv[1]);
+      ok = gFalse;
+    } else {
+      printf("open: %d round trips, %lu bytes loaded, linearized: %s\n",
+             loader->roundTrips, (unsigned long)loader->bytesLoaded,
+             doc->isLinearized() ? "yes" : "no");
+      for (int page = 1; ok && page <= doc->getNumPages(); page++) {
+        int roundTrips = loader->roundTrips;
+        GBool available = doc->isPageAvailable(page);
+
+        ok = doc->prefetchPage(page, gTrue) && doc->isPageAvailable(page) &&
+             doc->getPage(page) != NULL;
+        if (page < doc->getNumPages()) {
+          doc->prefetchPage(page + 1, gFalse);
+        }
+        printf("page %d: %s, %d round trips\n", page,
+               available ? "available" : "loaded", loader->roundTrips - roundTrips);
+      }
+    }
+    delete doc;
+    delete globalParams;
+  }
+
+  fclose(f);
+  free(data);
+
+  if (!ok) {
+    fprintf(stderr, "FAILED\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,293 @@
+//========================================================================
+//
+// cmap-cache-test.cc
+//
+// Exercises the compiled CMap and cidToUnicode cache of GlobalParams:
+// builds a small poppler data dir in a scratch directory, loads the
+// files through the cache, and checks that the compiled forms are hit,
+// give the same mappings as the text files, and go stale when a source
+// file changes.
+//
+// This file is licensed under the GPLv2 or later
+//
+//========================================================================
+
+#include <config.h>
+
+#include <stdio.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+#include "goo/gfile.h"
+#include "goo/GooString.h"
+#include "GlobalParams.h"
+#include "CMap.h"
+#include "CharCodeToUnicode.h"
+#include "utils/parseargs.h"
+
+static GBool printHelp = gFalse;
+
+static const ArgDesc argDesc[] = {
+  {"-h",      argFlag,     &printHelp,       0,
+   "print usage information"},
+  {"-help",   argFlag,     &printHelp,       0,
+   "print usage information"},
+  {"--help",  argFlag,     &printHelp,       0,
+   "print usage information"},
+  {"-?",      argFlag,     &printHelp,       0,
+   "print usage information"},
+  {NULL}
+};
+
+static const char *baseCMap =
+  "%!PS-Adobe-3.0 Resource-CMap\n"
+  "/CIDInit /ProcSet findresource begin\n"
+  "12 dict begin\n"
+  "begincmap\n"
+  "/CMapName /TestBase-H def\n"
+  "1 begincodespacerange\n"
+  "<0000> <ffff>\n"
+  "endcodespacerange\n"
+  "2 begincidrange\n"
+  "<0020> <007e> 1\n"
+  "<3000> <30ff> 633\n"
+  "endcidrange\n"
+  "endcmap\n"
+  "end\n"
+  "end\n";
+
+static const char *mainCMap =
+  "%!PS-Adobe-3.0 Resource-CMap\n"
+  "/CIDInit /ProcSet findresource begin\n"
+  "12 dict begin\n"
+  "begincmap\n"
+  "/TestBase-H usecmap\n"
+  "/CMapName /Test-H def\n"
+  "1 begincidchar\n"
+  "<0041> 5000\n"
+  "endcidchar\n"
+  "1 begincidrange\n"
+  "<4e00> <4eff> 1200\n"
+  "endcidrange\n"
+  "endcmap\n"
+  "end\n"
+  "end\n";
+
+// changes the mapping of <0020>..<007e>, and the file size
+static const char *changedBaseCMap =
+  "%!PS-Adobe-3.0 Resource-CMap\n"
+  "/CIDInit /ProcSet findresource begin\n"
+  "12 dict begin\n"
+  "begincmap\n"
+  "/CMapName /TestBase-H def\n"
+  "1 begincodespacerange\n"
+  "<0000> <ffff>\n"
+  "endcodespacerange\n"
+  "2 begincidrange\n"
+  "<0020> <007e> 101\n"
+  "<3000> <30ff> 633\n"
+  "endcidrange\n"
+  "endcmap\n"
+  "end\n"
+  "end\n";
+
+static GBool makeDir(GooString *path)
+{
+#ifdef _WIN32
+  _mkdir(path->getCString());
+#else
+  mkdir(path->getCString(), 0755);
+#endif
+  struct stat st;
+  return stat(path->getCString(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static GBool writeFile(GooString *path, const char *text, int nLines)
+{
+  FILE *f;
+
+  if (!(f = fopen(path->getCString(), "wb"))) {
+    return gFalse;
+  }
+  if (text) {
+    fputs(text, f);
+  } else {
+    // a cidToUnicode file
+    for (int i = 0; i < nLines; ++i) {
+      fprintf(f, "%04x\n", i ? 0x4e00 + i : 0);
+    }
+  }
+  fclose(f);
+  return gTrue;
+}
+
+// Load the Test-H CMap and the cidToUnicode file of the Adobe-Test
+// collection and return a checksum of their mappings, or 0 if one of
+// them couldn't be loaded.
+static Guint checksum()
+{
+  GooString collection("Adobe-Test");
+  GooString name("Test-H");
+  CMap *cMap;
+  CharCodeToUnicode *ctu;
+  CharCode c;
+  Unicode *u;
+  char s[2];
+  Guint sum;
+  int nUsed, n;
+
+  if (!(cMap = globalParams->getCMap(&collection, &name))) {
+    return 0;
+  }
+  sum = 1;
+  for (int code = 0; code < 0x10000; ++code) {
+    s[0] = (char)(code >> 8);
+    s[1] = (char)code;
+    sum = sum * 1000003 + cMap->getCID(s, 2, &c, &nUsed);
+    sum = sum * 31 + c * 7 + nUsed;
+  }
+  cMap->decRefCnt();
+  if (!(ctu = globalParams->getCIDToUnicode(&collection))) {
+    return 0;
+  }
+  for (int cid = 0; cid < 3000; ++cid) {
+    n = ctu->mapToUnicode(cid, &u);
+    sum = sum * 1000003 + n * 17 + (n ? u[0] : 0);
+  }
+  ctu->decRefCnt();
+  return sum;
+}
+
+// Return true if the compiled form of <name> is up to date.
+static GBool isCompiled(const char *kind, const char *name,
+                        GooString *srcFileName)
+{
+  GooString nameStr(name);
+  GooString *data;
+
+  if (!(data = globalParams->loadCompiledData(kind, &nameStr,
+                                              srcFileName, NULL))) {
+    return gFalse;
+  }
+  delete data;
+  return gTrue;
+}
+
+// Run one pass with a new GlobalParams and return the checksum.
+static Guint runPass(GooString *dataDir, GooString *cacheDir,
+                     GooString *cMapFile, GooString *ctuFile,
+                     GBool *cMapHit, GBool *ctuHit)
+{
+  Guint sum;
+
+  globalParams = new GlobalParams(dataDir->getCString());
+  if (cacheDir) {
+    globalParams->setDataCacheDir(cacheDir->getCString());
+    *cMapHit = isCompiled("cMap", "Adobe-Test-Test-H", cMapFile);
+    *ctuHit = isCompiled("cidToUnicode", "Adobe-Test", ctuFile);
+  } else {
+    *cMapHit = *ctuHit = gFalse;
+  }
+  sum = checksum();
+  delete globalParams;
+  globalParams = NULL;
+  return sum;
+}
+
+static GBool check(GBool ok, const char *what)
+{
+  printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+  return ok;
+}
+
+int main(int argc, char *argv[])
+{
+  GooString *scratch, *dataDir, *cacheDir, *dir, *baseFile, *mainFile;
+  GooString *ctuFile;
+  GBool cMapHit, ctuHit, ok;
+  Guint plainSum, sum;
+  int res = 0;
+
+  // parse args
+  ok = parseArgs(argDesc, &argc, argv);
+  if (!ok || (argc < 2) || printHelp) {
+    printUsage(argv[0], "SCRATCH-DIR", argDesc);
+    return printHelp ? 0 : 1;
+  }
+
+  // build the data dir
+  scratch = new GooString(argv[1]);
+  dataDir = appendToPath(scratch->copy(), "data");
+  cacheDir = appendToPath(scratch->copy(), "cache");
+  dir = appendToPath(dataDir->copy(), "cMap");
+  ok = makeDir(scratch) && makeDir(dataDir) && makeDir(cacheDir) &&
+       makeDir(dir);
+  appendToPath(dir, "Adobe-Test");
+  ok = ok && makeDir(dir);
+  baseFile = appendToPath(dir->copy(), "TestBase-H");
+  mainFile = appendToPath(dir->copy(), "Test-H");
+  delete dir;
+  dir = appendToPath(dataDir->copy(), "cidToUnicode");
+  ok = ok && makeDir(dir);
+  ctuFile = appendToPath(dir->copy(), "Adobe-Test");
+  delete dir;
+  // stale files from an earlier run would make the first pass a hit
+  dir = appendToPath(cacheDir->copy(), "cMap-Adobe-Test-Test-H");
+  remove(dir->getCString());
+  delete dir;
+  dir = appendToPath(cacheDir->copy(), "cidToUnicode-Adobe-Test");
+  remove(dir->getCString());
+  delete dir;
+  ok = ok && writeFile(baseFile, baseCMap, 0) &&
+       writeFile(mainFile, mainCMap, 0) && writeFile(ctuFile, NULL, 2500);
+  if (!ok) {
+    fprintf(stderr, "Couldn't set up the data dir in '%s'\n", argv[1]);
+    res = 1;
+    goto done;
+  }
+
+  // the text files, without a cache
+  plainSum = runPass(dataDir, NULL, mainFile, ctuFile, &cMapHit, &ctuHit);
+  if (!check(plainSum != 0, "files load without a cache")) {
+    res = 1;
+    goto done;
+  }
+
+  // the first pass compiles the files, the second one uses them
+  sum = runPass(dataDir, cacheDir, mainFile, ctuFile, &cMapHit, &ctuHit);
+  if (!check(!cMapHit && !ctuHit && sum == plainSum,
+             "first pass parses the text files")) {
+    res = 1;
+  }
+  sum = runPass(dataDir, cacheDir, mainFile, ctuFile, &cMapHit, &ctuHit);
+  if (!check(cMapHit && ctuHit, "second pass hits the compiled files") ||
+      !check(sum == plainSum, "compiled files give the same mappings")) {
+    res = 1;
+  }
+
+  // changing a CMap pulled in with usecmap makes the compiled CMap stale
+  if (!writeFile(baseFile, changedBaseCMap, 0)) {
+    res = 1;
+    goto done;
+  }
+  plainSum = runPass(dataDir, NULL, mainFile, ctuFile, &cMapHit, &ctuHit);
+  sum = runPass(dataDir, cacheDir, mainFile, ctuFile, &cMapHit, &ctuHit);
+  if (!check(!cMapHit && ctuHit, "changed usecmap source invalidates the CMap") ||
+      !check(sum == plainSum, "recompiled CMap gives the new mappings")) {
+    res = 1;
+  }
+  sum = runPass(dataDir, cacheDir, mainFile, ctuFile, &cMapHit, &ctuHit);
+  if (!check(cMapHit && sum == plainSum, "recompiled CMap is hit")) {
+    res = 1;
+  }
+
+done:
+  delete ctuFile;
+  delete mainFile;
+  delete baseFile;
+  delete cacheDir;
+  delete dataDir;
+  delete scratch;
+  return res;
+}
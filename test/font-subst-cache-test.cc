@@ -0,0 +1,293 @@
+//========================================================================
+//
+// font-subst-cache-test.cc
+//
+// Exercises the font substitution cache file of GlobalParams: looks up
+// the substitute of a non-embedded font with a cache file, plants a
+// different font file in the saved entry, and checks that a new
+// GlobalParams reading the file returns the planted font instead of
+// asking fontconfig again, and that a file with a stale stamp is
+// started again.
+//
+// This file is licensed under the GPLv2 or later
+//
+//========================================================================
+
+#include <config.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+#include "goo/gfile.h"
+#include "goo/GooList.h"
+#include "goo/GooString.h"
+#include "GlobalParams.h"
+#include "PDFDoc.h"
+#include "FontInfo.h"
+#include "utils/parseargs.h"
+
+static GBool printHelp = gFalse;
+
+static const ArgDesc argDesc[] = {
+  {"-h",      argFlag,     &printHelp,       0,
+   "print usage information"},
+  {"-help",   argFlag,     &printHelp,       0,
+   "print usage information"},
+  {"--help",  argFlag,     &printHelp,       0,
+   "print usage information"},
+  {"-?",      argFlag,     &printHelp,       0,
+   "print usage information"},
+  {NULL}
+};
+
+// a page showing text with a non-embedded TrueType font
+static const char *pdfObjects[] = {
+  "<< /Type /Catalog /Pages 2 0 R >>",
+  "<< /Type /Pages /Kids [3 0 R] /Count 1 >>",
+  "<< /Type /Page /Parent 2 0 R /MediaBox [0 0 200 200]"
+  " /Resources << /Font << /F1 4 0 R >> >> /Contents 5 0 R >>",
+  "<< /Type /Font /Subtype /TrueType /BaseFont /PopplerTestSans-Bold"
+  " /FirstChar 65 /LastChar 65 /Widths [600] >>",
+  "<< /Length 34 >>\n"
+  "stream\n"
+  "BT /F1 24 Tf 20 100 Td (AAA) Tj ET\n"
+  "endstream",
+  NULL
+};
+
+static GBool makeDir(GooString *path)
+{
+#ifdef _WIN32
+  _mkdir(path->getCString());
+#else
+  mkdir(path->getCString(), 0755);
+#endif
+  struct stat st;
+  return stat(path->getCString(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static GBool writePDF(GooString *path)
+{
+  FILE *f;
+  long offsets[16];
+  long xrefOffset;
+  int n;
+
+  if (!(f = fopen(path->getCString(), "wb"))) {
+    return gFalse;
+  }
+  fputs("%PDF-1.4\n", f);
+  for (n = 0; pdfObjects[n]; ++n) {
+    offsets[n] = ftell(f);
+    fprintf(f, "%d 0 obj\n%s\nendobj\n", n + 1, pdfObjects[n]);
+  }
+  xrefOffset = ftell(f);
+  fprintf(f, "xref\n0 %d\n0000000000 65535 f \n", n + 1);
+  for (int i = 0; i < n; ++i) {
+    fprintf(f, "%010ld 00000 n \n", offsets[i]);
+  }
+  fprintf(f, "trailer\n<< /Size %d /Root 1 0 R >>\nstartxref\n%ld\n%%%%EOF\n",
+          n + 1, xrefOffset);
+  fclose(f);
+  return gTrue;
+}
+
+// Read a whole file, or return NULL.
+static GooString *readFile(GooString *path)
+{
+  GooString *s;
+  FILE *f;
+  char buf[4096];
+  int n;
+
+  if (!(f = fopen(path->getCString(), "rb"))) {
+    return NULL;
+  }
+  s = new GooString();
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+    s->append(buf, n);
+  }
+  fclose(f);
+  return s;
+}
+
+static GBool writeFile(GooString *path, GooString *s)
+{
+  FILE *f;
+
+  if (!(f = fopen(path->getCString(), "wb"))) {
+    return gFalse;
+  }
+  fwrite(s->getCString(), 1, s->getLength(), f);
+  fclose(f);
+  return gTrue;
+}
+
+// Replace every occurrence of <from> in <s> with <to>, and return the
+// number of replacements.
+static int replaceAll(GooString *s, GooString *from, GooString *to)
+{
+  const char *p;
+  int i, n;
+
+  n = 0;
+  i = 0;
+  while ((p = strstr(s->getCString() + i, from->getCString()))) {
+    i = p - s->getCString();
+    s->del(i, from->getLength());
+    s->insert(i, to);
+    i += to->getLength();
+    ++n;
+  }
+  return n;
+}
+
+// Run one pass with a new GlobalParams using the cache file
+// <cacheFile>, and return the file of the substitute font, or NULL.
+static GooString *runPass(GooString *pdfFile, GooString *cacheFile)
+{
+  PDFDoc *doc;
+  FontInfoScanner *scanner;
+  GooList *fonts;
+  FontInfo *font;
+  GooString *file;
+
+  globalParams = new GlobalParams();
+  globalParams->setFontSubstCacheFile(cacheFile->getCString());
+  file = NULL;
+  doc = new PDFDoc(pdfFile->copy());
+  if (doc->isOk()) {
+    scanner = new FontInfoScanner(doc);
+    if ((fonts = scanner->scan(1))) {
+      if (fonts->getLength() == 1) {
+        font = (FontInfo *)fonts->get(0);
+        if (font->getFile()) {
+          file = font->getFile()->copy();
+        }
+      }
+      deleteGooList(fonts, FontInfo);
+    }
+    delete scanner;
+  }
+  delete doc;
+  delete globalParams;
+  globalParams = NULL;
+  return file;
+}
+
+static GBool check(GBool ok, const char *what)
+{
+  printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+  return ok;
+}
+
+int main(int argc, char *argv[])
+{
+  GooString *scratch, *pdfFile, *cacheFile, *plantedFile;
+  GooString *substFile, *file, *fontData, *cache, *cache2;
+  GBool ok;
+  int res = 0;
+
+  // parse args
+  ok = parseArgs(argDesc, &argc, argv);
+  if (!ok || (argc < 2) || printHelp) {
+    printUsage(argv[0], "SCRATCH-DIR", argDesc);
+    return printHelp ? 0 : 1;
+  }
+
+  scratch = new GooString(argv[1]);
+  pdfFile = appendToPath(scratch->copy(), "font-subst.pdf");
+  cacheFile = appendToPath(scratch->copy(), "font-subst-cache");
+  plantedFile = appendToPath(scratch->copy(), "planted-font");
+  substFile = file = fontData = cache = cache2 = NULL;
+  // a cache file from an earlier run would make the first pass a hit
+  remove(cacheFile->getCString());
+  if (!makeDir(scratch) || !writePDF(pdfFile)) {
+    fprintf(stderr, "Couldn't set up the scratch dir '%s'\n", argv[1]);
+    res = 1;
+    goto done;
+  }
+
+  // the first pass asks fontconfig and fills the cache file
+  substFile = runPass(pdfFile, cacheFile);
+  if (!substFile) {
+    fprintf(stderr, "No substitute font is installed\n");
+    res = 1;
+    goto done;
+  }
+  cache = readFile(cacheFile);
+  if (!check(cache && strstr(cache->getCString(), substFile->getCString()),
+             "first pass saves the substitution")) {
+    res = 1;
+    goto done;
+  }
+
+  // point the saved entry to a copy of the font: only a cache hit can
+  // return it
+  fontData = readFile(substFile);
+  if (!fontData || !writeFile(plantedFile, fontData) ||
+      replaceAll(cache, substFile, plantedFile) == 0 ||
+      !writeFile(cacheFile, cache)) {
+    fprintf(stderr, "Couldn't plant a font in the cache file\n");
+    res = 1;
+    goto done;
+  }
+  file = runPass(pdfFile, cacheFile);
+  if (!check(file && !file->cmp(plantedFile),
+             "second pass takes the substitution from the cache file")) {
+    res = 1;
+  }
+  delete file;
+  cache2 = readFile(cacheFile);
+  if (!check(cache2 && !cache2->cmp(cache),
+             "second pass leaves the cache file alone")) {
+    res = 1;
+  }
+  delete cache2;
+  cache2 = NULL;
+
+  // a planted font that has gone away is looked up again
+  remove(plantedFile->getCString());
+  file = runPass(pdfFile, cacheFile);
+  if (!check(file && !file->cmp(substFile),
+             "entry with a removed font file is skipped")) {
+    res = 1;
+  }
+  delete file;
+
+  // a file written with another fontconfig setup is started again
+  if (!writeFile(plantedFile, fontData)) {
+    res = 1;
+    goto done;
+  }
+  cache->del(0, strcspn(cache->getCString(), "\n"));
+  cache->insert(0, "poppler-fcsubst 0");
+  if (!writeFile(cacheFile, cache)) {
+    res = 1;
+    goto done;
+  }
+  file = runPass(pdfFile, cacheFile);
+  cache2 = readFile(cacheFile);
+  if (!check(file && !file->cmp(substFile) && cache2 &&
+             strncmp(cache2->getCString(), "poppler-fcsubst 0", 17) &&
+             !strstr(cache2->getCString(), plantedFile->getCString()),
+             "cache file with a stale stamp is started again")) {
+    res = 1;
+  }
+  delete file;
+
+done:
+  remove(plantedFile->getCString());
+  delete cache2;
+  delete cache;
+  delete fontData;
+  delete substFile;
+  delete plantedFile;
+  delete cacheFile;
+  delete pdfFile;
+  delete scratch;
+  return res;
+}
@@ -0,0 +1,213 @@
+//========================================================================
+//
+// pdf-doc-cache-test.cc
+//
+// Exercises PDFDocCache: opens a copy of a document through factories
+// sharing a cache and checks the hits and misses, that the cached xref
+// tables match the ones read from the file, and that documents stay
+// usable after the document their table came from, or the cache itself,
+// has been destroyed.
+//
+// This file is licensed under the GPLv2 or later
+//
+//========================================================================
+
+#include <config.h>
+
+#include <stdio.h>
+#include "goo/GooString.h"
+#include "GlobalParams.h"
+#include "Object.h"
+#include "PDFDoc.h"
+#include "PDFDocCache.h"
+#include "PDFDocFactory.h"
+#include "XRef.h"
+#include "utils/parseargs.h"
+
+static GBool printHelp = gFalse;
+
+static const ArgDesc argDesc[] = {
+  {"-h",      argFlag,     &printHelp,       0,
+   "print usage information"},
+  {"-help",   argFlag,     &printHelp,       0,
+   "print usage information"},
+  {"--help",  argFlag,     &printHelp,       0,
+   "print usage information"},
+  {"-?",      argFlag,     &printHelp,       0,
+   "print usage information"},
+  {NULL}
+};
+
+static GBool copyFile(GooString *from, GooString *to)
+{
+  FILE *in, *out;
+  char buf[4096];
+  int n;
+
+  if (!(in = fopen(from->getCString(), "rb"))) {
+    return gFalse;
+  }
+  if (!(out = fopen(to->getCString(), "wb"))) {
+    fclose(in);
+    return gFalse;
+  }
+  while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+    fwrite(buf, 1, n, out);
+  }
+  fclose(in);
+  fclose(out);
+  return gTrue;
+}
+
+// Returns true if both documents have the same xref table, and every
+// object fetches to the same type.
+static GBool docsMatch(PDFDoc *docA, PDFDoc *docB)
+{
+  XRef *xrefA, *xrefB;
+  XRefEntry *entryA, *entryB;
+  Object objA, objB;
+  GBool match;
+
+  if (!docA->isOk() || !docB->isOk() ||
+      docA->getNumPages() != docB->getNumPages()) {
+    return gFalse;
+  }
+  xrefA = docA->getXRef();
+  xrefB = docB->getXRef();
+  if (xrefA->getNumObjects() != xrefB->getNumObjects()) {
+    return gFalse;
+  }
+  match = gTrue;
+  for (int i = 0; match && i < xrefA->getNumObjects(); ++i) {
+    entryA = xrefA->getEntry(i, gFalse);
+    entryB = xrefB->getEntry(i, gFalse);
+    if (entryA->offset != entryB->offset || entryA->gen != entryB->gen ||
+        entryA->type != entryB->type) {
+      match = gFalse;
+    } else if (entryA->type != xrefEntryFree) {
+      xrefA->fetch(i, entryA->gen, &objA);
+      xrefB->fetch(i, entryB->gen, &objB);
+      match = objA.getType() == objB.getType();
+      objA.free();
+      objB.free();
+    }
+  }
+  return match;
+}
+
+static GBool check(GBool ok, const char *what)
+{
+  printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+  return ok;
+}
+
+int main(int argc, char *argv[])
+{
+  PDFDocCache *cache;
+  PDFDocFactory *factory, *factory2;
+  PDFDoc *reference, *doc, *doc2, *doc3;
+  GooString *inputName, *scratchName;
+  GBool ok, cacheable;
+  FILE *f;
+  int res = 0;
+
+  // parse args
+  ok = parseArgs(argDesc, &argc, argv);
+  if (!ok || (argc < 3) || printHelp) {
+    printUsage(argv[0], "INPUT-FILE SCRATCH-FILE", argDesc);
+    return printHelp ? 0 : 1;
+  }
+
+  inputName = new GooString(argv[1]);
+  scratchName = new GooString(argv[2]);
+  globalParams = new GlobalParams();
+  cache = new PDFDocCache();
+  factory = new PDFDocFactory(NULL, cache);
+  factory2 = new PDFDocFactory(NULL, cache);
+  doc = doc2 = doc3 = NULL;
+
+  // work on a copy, which is modified at the end
+  reference = NULL;
+  if (copyFile(inputName, scratchName)) {
+    reference = new PDFDoc(scratchName->copy());
+  }
+  if (!reference || !reference->isOk()) {
+    fprintf(stderr, "Error loading input document\n");
+    res = 1;
+    goto done;
+  }
+  // encrypted documents are never cached
+  cacheable = !reference->isEncrypted();
+
+  doc = factory->createPDFDoc(*scratchName);
+  if (!check(cache->getNumHits() == 0 && cache->getNumMisses() == 1,
+             "first open reads the file") ||
+      !check(docsMatch(reference, doc), "first open gives the same table")) {
+    res = 1;
+  }
+
+  // the cached table doesn't depend on the document it came from
+  delete doc;
+  doc = factory->createPDFDoc(*scratchName);
+  if (!check(cache->getNumHits() == (cacheable ? 1 : 0),
+             "reopening after the first document is destroyed hits the cache") ||
+      !check(docsMatch(reference, doc), "cached table matches the file")) {
+    res = 1;
+  }
+
+  // the cache is shared by the factories
+  doc2 = factory2->createPDFDoc(*scratchName);
+  if (!check(cache->getNumHits() == (cacheable ? 2 : 0),
+             "another factory hits the shared cache") ||
+      !check(docsMatch(reference, doc2), "shared table matches the file")) {
+    res = 1;
+  }
+
+  // documents opened through the cache outlive clear()
+  cache->clear();
+  delete doc2;
+  doc2 = factory->createPDFDoc(*scratchName);
+  if (!check(cache->getNumMisses() == (cacheable ? 2 : 4),
+             "clear() forgets the tables") ||
+      !check(docsMatch(reference, doc), "documents stay usable after clear()")) {
+    res = 1;
+  }
+
+  // a modified file is read again
+  if (!(f = fopen(scratchName->getCString(), "ab"))) {
+    res = 1;
+    goto done;
+  }
+  fputs("% modified\n", f);
+  fclose(f);
+  doc3 = factory->createPDFDoc(*scratchName);
+  if (!check(cache->getNumMisses() == (cacheable ? 3 : 5),
+             "modified file misses the cache") ||
+      !check(docsMatch(reference, doc3), "modified file gives the same table")) {
+    res = 1;
+  }
+
+  // and documents outlive the cache
+  delete factory;
+  delete factory2;
+  delete cache;
+  factory = factory2 = NULL;
+  cache = NULL;
+  if (!check(docsMatch(reference, doc) && docsMatch(reference, doc3),
+             "documents stay usable after the cache is destroyed")) {
+    res = 1;
+  }
+
+done:
+  delete doc3;
+  delete doc2;
+  delete doc;
+  delete reference;
+  delete factory2;
+  delete factory;
+  delete cache;
+  delete scratchName;
+  delete inputName;
+  delete globalParams;
+  return res;
+}
@@ -11,16 +11,22 @@
 #include "Error.h"
 #include "Object.h"
 #include "PDFDoc.h"
+#include "Page.h"
 #include "XRef.h"
 #include "goo/GooString.h"
 #include "utils/parseargs.h"
 
 static GBool compareDocuments(PDFDoc *origDoc, PDFDoc *newDoc);
+static GBool comparePages(PDFDoc *origDoc, PDFDoc *newDoc);
 static GBool compareObjects(Object *objA, Object *objB);
+static void editDocument(PDFDoc *doc);
 
 static char ownerPassword[33] = "\001";
 static char userPassword[33] = "\001";
 static GBool forceIncremental = gFalse;
+static GBool edit = gFalse;
+static GBool compress = gFalse;
+static GBool linearize = gFalse;
 static GBool checkOutput = gFalse;
 static GBool printHelp = gFalse;
 
@@ -31,6 +37,12 @@ static const ArgDesc argDesc[] = {
    "user password (for encrypted files)"},
   {"-i",      argFlag,     &forceIncremental,0,
    "incremental update mode"},
+  {"-edit",   argFlag,     &edit,            0,
+   "modify, add and remove objects before saving"},
+  {"-compress", argFlag,   &compress,        0,
+   "rewrite using object and xref streams"},
+  {"-linearize", argFlag,  &linearize,       0,
+   "write a linearized document"},
   {"-check",  argFlag,     &checkOutput,     0,
    "verify the generated document"},
   {"-h",      argFlag,     &printHelp,       0,
@@ -52,6 +64,7 @@ int main (int argc, char *argv[])
   GooString *outputName = NULL;
   GooString *ownerPW = NULL;
   GooString *userPW = NULL;
+  PDFWriteMode mode;
   int res = 0;
 
   // parse args
@@ -64,6 +77,12 @@ int main (int argc, char *argv[])
     goto done;
   }
 
+  if (forceIncremental + compress + linearize > 1) {
+    fprintf(stderr, "Only one of -i, -compress and -linearize can be given\n");
+    res = 1;
+    goto done;
+  }
+
   inputName = new GooString(argv[1]);
   outputName = new GooString(argv[2]);
 
@@ -83,8 +102,21 @@ int main (int argc, char *argv[])
     goto done;
   }
 
+  if (edit) {
+    editDocument(doc);
+  }
+
   // save it back (in rewrite or incremental update mode)
-  if (doc->saveAs(outputName, forceIncremental ? writeForceIncremental : writeForceRewrite) != 0) {
+  if (forceIncremental) {
+    mode = writeForceIncremental;
+  } else if (compress) {
+    mode = writeForceRewriteCompressed;
+  } else if (linearize) {
+    mode = writeForceLinearized;
+  } else {
+    mode = writeForceRewrite;
+  }
+  if (doc->saveAs(outputName, mode) != 0) {
     fprintf(stderr, "Error saving document\n");
     res = 1;
     goto done;
@@ -96,7 +128,7 @@ int main (int argc, char *argv[])
     if (!docOut->isOk()) {
       fprintf(stderr, "Error loading generated document\n");
       res = 1;
-    } else if (!compareDocuments(doc, docOut)) {
+    } else if (linearize ? !comparePages(doc, docOut) : !compareDocuments(doc, docOut)) {
       fprintf(stderr, "Verification failed\n");
       res = 1;
     }
@@ -113,6 +145,38 @@ done:
   return res;
 }
 
+// Change the catalog, and add and remove objects, so that the saved
+// document has modified, new, reused and freed entries.
+static void editDocument(PDFDoc *doc)
+{
+  XRef *xref = doc->getXRef();
+  Object catObj, obj;
+  Ref catRef, refB, refC;
+
+  catRef.num = xref->getRootNum();
+  catRef.gen = xref->getRootGen();
+  xref->fetch(catRef.num, catRef.gen, &catObj);
+  if (catObj.isDict()) {
+    catObj.dictAdd(copyString("PopplerTestEdit"),
+                   obj.initString(new GooString("edited")));
+    xref->setModifiedObject(&catObj, catRef);
+  }
+  catObj.free();
+
+  xref->addIndirectObject(obj.initString(new GooString("added A")));
+  obj.free();
+  refB = xref->addIndirectObject(obj.initInt(2));
+  obj.free();
+  refC = xref->addIndirectObject(obj.initName("AddedC"));
+  obj.free();
+  // B's entry is freed, then reused with a higher generation number;
+  // C's stays free
+  xref->removeIndirectObject(refB);
+  xref->addIndirectObject(obj.initString(new GooString("added D")));
+  obj.free();
+  xref->removeIndirectObject(refC);
+}
+
 static GBool compareDictionaries(Dict *dictA, Dict *dictB)
 {
   const int length = dictA->getLength();
@@ -230,7 +294,23 @@ static GBool compareObjects(Object *objA, Object *objB)
       } else {
         Stream *streamA = objA->getStream();
         Stream *streamB = objB->getStream();
-        if (!compareDictionaries(streamA->getDict(), streamB->getDict())) {
+        GBool sameDicts;
+        if (compress) {
+          // streams may have been recompressed
+          Dict *dictA = streamA->getDict()->copy(streamA->getDict()->getXRef());
+          Dict *dictB = streamB->getDict()->copy(streamB->getDict()->getXRef());
+          const char *encodingKeys[] = { "Length", "Filter", "DecodeParms" };
+          for (int i = 0; i < 3; ++i) {
+            dictA->remove(encodingKeys[i]);
+            dictB->remove(encodingKeys[i]);
+          }
+          sameDicts = compareDictionaries(dictA, dictB);
+          delete dictA;
+          delete dictB;
+        } else {
+          sameDicts = compareDictionaries(streamA->getDict(), streamB->getDict());
+        }
+        if (!sameDicts) {
           return gFalse;
         } else {
           int c;
@@ -285,6 +365,12 @@ static GBool compareDocuments(PDFDoc *origDoc, PDFDoc *newDoc)
       fprintf(stderr, "XRef table: Unexpected number of entries (%d+1 != %d)\n", origNumObjects, newNumObjects);
       result = gFalse;
     }
+  } else if (compress) {
+    // Object streams and the xref stream are appended as new entries
+    if (origNumObjects >= newNumObjects) {
+      fprintf(stderr, "XRef table: Missing new entries (%d >= %d)\n", origNumObjects, newNumObjects);
+      result = gFalse;
+    }
   } else {
     // In all other cases the number of entries must be the same
     if (origNumObjects != newNumObjects) {
@@ -328,7 +414,9 @@ static GBool compareDocuments(PDFDoc *origDoc, PDFDoc *newDoc)
     }
 
     // Compare object flags. A failure shows that there's some error in XRef::scanSpecialFlags()
-    if (origXRef->getEntry(i)->flags != newXRef->getEntry(i)->flags) {
+    // The Updated flag is only set in memory, on the edited entries
+    const int updatedMask = 1 << XRefEntry::Updated;
+    if ((origXRef->getEntry(i)->flags & ~updatedMask) != (newXRef->getEntry(i)->flags & ~updatedMask)) {
       fprintf(stderr, "XRef entry %u: flags detected by scanSpecialFlags differ (%d != %d)\n", i, origXRef->getEntry(i)->flags, newXRef->getEntry(i)->flags);
       result = gFalse;
     }
@@ -361,3 +449,71 @@ static GBool compareDocuments(PDFDoc *origDoc, PDFDoc *newDoc)
 
   return result;
 }
+
+static void readContents(Object *contents, GooString *data)
+{
+  if (contents->isArray()) {
+    for (int i = 0; i < contents->arrayGetLength(); ++i) {
+      Object obj;
+      contents->arrayGet(i, &obj);
+      readContents(&obj, data);
+      obj.free();
+    }
+  } else if (contents->isStream()) {
+    Stream *str = contents->getStream();
+    str->reset();
+    for (int c = str->getChar(); c != EOF; c = str->getChar()) {
+      data->append((char)c);
+    }
+    str->close();
+  }
+}
+
+// Objects are renumbered in linearized documents, so compare what the
+// pages show instead of the objects
+static GBool comparePages(PDFDoc *origDoc, PDFDoc *newDoc)
+{
+  GBool result = gTrue;
+
+  if (!newDoc->isLinearized()) {
+    fprintf(stderr, "Generated document isn't linearized\n");
+    result = gFalse;
+  }
+  if (origDoc->getNumPages() != newDoc->getNumPages()) {
+    fprintf(stderr, "Different number of pages (%d != %d)\n", origDoc->getNumPages(), newDoc->getNumPages());
+    return gFalse;
+  }
+
+  for (int i = 1; i <= origDoc->getNumPages(); ++i) {
+    // for a linearized document, getPage finds the page through the hint tables
+    Page *origPage = origDoc->getPage(i);
+    Page *newPage = newDoc->getPage(i);
+    if (!origPage || !newPage) {
+      fprintf(stderr, "Page %d: couldn't be loaded\n", i);
+      result = gFalse;
+      continue;
+    }
+
+    PDFRectangle *origBox = origPage->getMediaBox();
+    PDFRectangle *newBox = newPage->getMediaBox();
+    if (origBox->x1 != newBox->x1 || origBox->y1 != newBox->y1 ||
+        origBox->x2 != newBox->x2 || origBox->y2 != newBox->y2 ||
+        origPage->getRotate() != newPage->getRotate()) {
+      fprintf(stderr, "Page %d: geometry differs\n", i);
+      result = gFalse;
+    }
+
+    Object origContents, newContents;
+    GooString origData, newData;
+    readContents(origPage->getContents(&origContents), &origData);
+    readContents(newPage->getContents(&newContents), &newData);
+    if (origData.cmp(&newData) != 0) {
+      fprintf(stderr, "Page %d: contents differ\n", i);
+      result = gFalse;
+    }
+    origContents.free();
+    newContents.free();
+  }
+
+  return result;
+}
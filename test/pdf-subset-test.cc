@@ -0,0 +1,220 @@
+//========================================================================
+//
+// pdf-subset-test.cc
+//
+// Saves pages with PDFDoc::savePageAs and subset fonts, reopens each
+// saved page and compares its rendering and catalog with the source.
+//
+// This file is licensed under the GPLv2 or later
+//
+//========================================================================
+
+#include <config.h>
+
+#include <stdio.h>
+#include <string.h>
+#include "goo/GooString.h"
+#include "splash/SplashBitmap.h"
+#include "ErrorCodes.h"
+#include "GlobalParams.h"
+#include "PDFDoc.h"
+#include "SplashOutputDev.h"
+#include "utils/parseargs.h"
+
+static int firstPage = 1;
+static int lastPage = 0;
+static double resolution = 72;
+static GBool noSubset = gFalse;
+static GBool compress = gFalse;
+static GBool printHelp = gFalse;
+
+static const ArgDesc argDesc[] = {
+  {"-f",      argInt,      &firstPage,       0,
+   "first page to check"},
+  {"-l",      argInt,      &lastPage,        0,
+   "last page to check"},
+  {"-r",      argFP,       &resolution,      0,
+   "resolution, in DPI, of the compared renderings (default is 72)"},
+  {"-nosubset", argFlag,   &noSubset,        0,
+   "save the pages without subsetting the fonts"},
+  {"-compress", argFlag,   &compress,        0,
+   "save the pages using object and xref streams"},
+  {"-h",      argFlag,     &printHelp,       0,
+   "print usage information"},
+  {"-help",   argFlag,     &printHelp,       0,
+   "print usage information"},
+  {"--help",  argFlag,     &printHelp,       0,
+   "print usage information"},
+  {"-?",      argFlag,     &printHelp,       0,
+   "print usage information"},
+  {NULL}
+};
+
+// Renders a page and returns its bitmap.
+static SplashBitmap *renderPage(PDFDoc *doc, int pg)
+{
+  SplashColor paperColor;
+  SplashOutputDev *splashOut;
+  SplashBitmap *bitmap;
+
+  paperColor[0] = paperColor[1] = paperColor[2] = 0xff;
+  splashOut = new SplashOutputDev(splashModeRGB8, 4, gFalse, paperColor);
+  splashOut->startDoc(doc);
+  doc->displayPage(splashOut, pg, resolution, resolution, 0,
+                   gFalse, gTrue, gFalse);
+  bitmap = splashOut->takeBitmap();
+  delete splashOut;
+  return bitmap;
+}
+
+// Returns the number of pixels that differ between the two bitmaps, or
+// -1 if their sizes differ.
+static int compareBitmaps(SplashBitmap *bitmapA, SplashBitmap *bitmapB)
+{
+  SplashColorPtr rowA, rowB;
+  int x, y, n;
+
+  if (bitmapA->getWidth() != bitmapB->getWidth() ||
+      bitmapA->getHeight() != bitmapB->getHeight()) {
+    return -1;
+  }
+  n = 0;
+  for (y = 0; y < bitmapA->getHeight(); ++y) {
+    rowA = bitmapA->getDataPtr() + y * bitmapA->getRowSize();
+    rowB = bitmapB->getDataPtr() + y * bitmapB->getRowSize();
+    for (x = 0; x < bitmapA->getWidth(); ++x) {
+      if (memcmp(rowA + 3 * x, rowB + 3 * x, 3)) {
+        ++n;
+      }
+    }
+  }
+  return n;
+}
+
+// Returns the first catalog entry of the source document that the saved
+// page should have kept but hasn't, or one it should have dropped, or
+// NULL.  The outlines, structure tree and named destinations describe
+// all the pages and are dropped.
+static const char *compareCatalogs(PDFDoc *doc, PDFDoc *docOut)
+{
+  static const char *dropped[] = {
+    "Dests", "Outlines", "StructTreeRoot", NULL
+  };
+  Object catObj, catObjOut, obj1, obj2;
+  const char *key, *missing;
+  GBool drop;
+
+  missing = NULL;
+  doc->getXRef()->getCatalog(&catObj);
+  docOut->getXRef()->getCatalog(&catObjOut);
+  if (!catObj.isDict() || !catObjOut.isDict()) {
+    missing = "Catalog";
+  }
+  for (int i = 0; !missing && i < catObj.dictGetLength(); ++i) {
+    key = catObj.dictGetKey(i);
+    drop = gFalse;
+    for (int j = 0; dropped[j]; ++j) {
+      drop = drop || !strcmp(key, dropped[j]);
+    }
+    if (!strcmp(key, "Names") && catObj.dictGetVal(i, &obj1)->isDict()) {
+      // kept without its named destinations
+      drop = obj1.dictGetLength() == 1 && !obj1.dictLookupNF("Dests", &obj2)->isNull();
+      obj2.free();
+      obj1.free();
+      if (!catObjOut.dictLookup("Names", &obj1)->isNull() &&
+          (!obj1.isDict() || !obj1.dictLookupNF("Dests", &obj2)->isNull())) {
+        missing = "Names";
+      }
+      obj2.free();
+    }
+    obj1.free();
+    if (drop != catObjOut.dictLookupNF(key, &obj1)->isNull()) {
+      missing = key;
+    }
+    obj1.free();
+  }
+  catObj.free();
+  catObjOut.free();
+  return missing;
+}
+
+int main (int argc, char *argv[])
+{
+  PDFDoc *doc = NULL;
+  PDFDoc *docOut;
+  GooString *inputName, *outputName;
+  SplashBitmap *bitmapA, *bitmapB;
+  const char *key;
+  int pg, diff, failed;
+  int res = 0;
+
+  // parse args
+  GBool ok = parseArgs(argDesc, &argc, argv);
+  if (!ok || (argc < 3) || printHelp) {
+    printUsage(argv[0], "INPUT-FILE SCRATCH-FILE", argDesc);
+    if (!printHelp) {
+      res = 1;
+    }
+    return res;
+  }
+
+  inputName = new GooString(argv[1]);
+  outputName = new GooString(argv[2]);
+
+  globalParams = new GlobalParams();
+  doc = new PDFDoc(inputName);
+  if (!doc->isOk()) {
+    fprintf(stderr, "Error loading input document\n");
+    res = 1;
+    goto done;
+  }
+
+  if (firstPage < 1) {
+    firstPage = 1;
+  }
+  if (lastPage < 1 || lastPage > doc->getNumPages()) {
+    lastPage = doc->getNumPages();
+  }
+
+  failed = 0;
+  for (pg = firstPage; pg <= lastPage; ++pg) {
+    if (doc->savePageAs(outputName, pg, !noSubset, compress) != errNone) {
+      printf("page %d: error saving page\n", pg);
+      ++failed;
+      continue;
+    }
+    docOut = new PDFDoc(outputName->copy());
+    if (!docOut->isOk() || docOut->getNumPages() != 1) {
+      printf("page %d: error loading saved page\n", pg);
+      ++failed;
+      delete docOut;
+      continue;
+    }
+    bitmapA = renderPage(doc, pg);
+    bitmapB = renderPage(docOut, 1);
+    diff = compareBitmaps(bitmapA, bitmapB);
+    if (diff < 0) {
+      printf("page %d: rendering size differs\n", pg);
+      ++failed;
+    } else if (diff > 0) {
+      printf("page %d: %d pixels differ\n", pg, diff);
+      ++failed;
+    } else if ((key = compareCatalogs(doc, docOut))) {
+      printf("page %d: catalog entry /%s wasn't saved as expected\n", pg, key);
+      ++failed;
+    }
+    delete bitmapA;
+    delete bitmapB;
+    delete docOut;
+  }
+  printf("%d of %d pages differ\n", failed, lastPage - firstPage + 1);
+  if (failed) {
+    res = 1;
+  }
+
+done:
+  delete doc;
+  delete outputName;
+  delete globalParams;
+  return res;
+}
@@ -31,6 +31,8 @@
 #include <stddef.h>
 #include <string.h>
 #include <math.h>
+#include <set>
+#include <utility>
 #include "parseargs.h"
 #include "goo/GooString.h"
 #include "goo/gmem.h"
@@ -58,6 +60,10 @@ static const char *fontTypeNames[] = {
 static int firstPage = 1;
 static int lastPage = 0;
 static GBool showSubst = gFalse;
+static GBool fastScan = gFalse;
+static GBool usedOnly = gFalse;
+static int nThreads = 1;
+static char fontCacheFile[1024] = "";
 static char ownerPassword[33] = "\001";
 static char userPassword[33] = "\001";
 static GBool printVersion = gFalse;
@@ -70,6 +76,14 @@ static const ArgDesc argDesc[] = {
    "last page to examine"},
   {"-subst",      argFlag,     &showSubst,  0,
    "show font substitutions"},
+  {"-fast",   argFlag,     &fastScan,      0,
+   "read font dictionaries only, without loading fonts"},
+  {"-used",   argFlag,     &usedOnly,      0,
+   "list only the fonts used to show text"},
+  {"-j",      argInt,      &nThreads,      0,
+   "number of threads scanning pages"},
+  {"-fontcache", argString, fontCacheFile,  sizeof(fontCacheFile),
+   "file keeping the font substitutions for later runs"},
   {"-opw",    argString,   ownerPassword,  sizeof(ownerPassword),
    "owner password (for encrypted files)"},
   {"-upw",    argString,   userPassword,   sizeof(userPassword),
@@ -87,6 +101,32 @@ static const ArgDesc argDesc[] = {
   {NULL}
 };
 
+// Merge the fonts used on each page, in order of first use.
+static GooList *getUsedFonts(FontInfoScanner *scanner,
+			     int first, int last) {
+  std::set<std::pair<int, int> > seen;
+  GooList *fonts, *pageFonts;
+  FontInfo *font;
+  int pg, i;
+
+  fonts = new GooList();
+  for (pg = first; pg <= last; ++pg) {
+    if ((pageFonts = scanner->scanUsedFonts(pg))) {
+      for (i = 0; i < pageFonts->getLength(); ++i) {
+	font = (FontInfo *)pageFonts->get(i);
+	if (seen.insert(std::make_pair(font->getRef().num,
+				       font->getRef().gen)).second) {
+	  fonts->append(font);
+	} else {
+	  delete font;
+	}
+      }
+      delete pageFonts;
+    }
+  }
+  return fonts;
+}
+
 int main(int argc, char *argv[]) {
   PDFDoc *doc;
   GooString *fileName;
@@ -113,6 +153,9 @@ int main(int argc, char *argv[]) {
 
   // read config file
   globalParams = new GlobalParams();
+  if (fontCacheFile[0]) {
+    globalParams->setFontSubstCacheFile(fontCacheFile);
+  }
 
   // open PDF file
   if (ownerPassword[0] != '\001') {
@@ -160,8 +203,13 @@ int main(int argc, char *argv[]) {
 
   // get the fonts
   {
-    FontInfoScanner scanner(doc, firstPage - 1);
-    GooList *fonts = scanner.scan(lastPage - firstPage + 1);
+    FontInfoScanner scanner(doc, firstPage - 1, fastScan);
+    GooList *fonts;
+    if (usedOnly) {
+      fonts = getUsedFonts(&scanner, firstPage, lastPage);
+    } else {
+      fonts = scanner.scan(lastPage - firstPage + 1, nThreads);
+    }
 
     if (showSubst) {
       // print the font substitutions
@@ -69,6 +69,7 @@ static GBool printMetadata = gFalse;
 static GBool printJS = gFalse;
 static GBool rawDates = gFalse;
 static char textEncName[128] = "";
+static char cMapCacheDir[1024] = "";
 static char ownerPassword[33] = "\001";
 static char userPassword[33] = "\001";
 static GBool printVersion = gFalse;
@@ -92,6 +93,8 @@ static const ArgDesc argDesc[] = {
    "output text encoding name"},
   {"-listenc",argFlag,     &printEnc,      0,
    "list available encodings"},
+  {"-cmapcache", argString, cMapCacheDir,   sizeof(cMapCacheDir),
+   "directory for compiled CMap and cidToUnicode files"},
   {"-opw",    argString,   ownerPassword,  sizeof(ownerPassword),
    "owner password (for encrypted files)"},
   {"-upw",    argString,   userPassword,   sizeof(userPassword),
@@ -157,6 +160,9 @@ int main(int argc, char *argv[]) {
   if (textEncName[0]) {
     globalParams->setTextEncoding(textEncName);
   }
+  if (cMapCacheDir[0]) {
+    globalParams->setDataCacheDir(cMapCacheDir);
+  }
 
   // get mapping to output encoding
   if (!(uMap = globalParams->getTextEncoding())) {
@@ -26,6 +26,8 @@
 
 static int firstPage = 0;
 static int lastPage = 0;
+static GBool subsetFonts = gFalse;
+static GBool compress = gFalse;
 static GBool printVersion = gFalse;
 static GBool printHelp = gFalse;
 
@@ -34,6 +36,10 @@ static const ArgDesc argDesc[] = {
    "first page to extract"},
   {"-l", argInt, &lastPage, 0,
    "last page to extract"},
+  {"-subset", argFlag, &subsetFonts, 0,
+   "subset the embedded fonts to the glyphs used on each page"},
+  {"-compress", argFlag, &compress, 0,
+   "write the pages using object and xref streams"},
   {"-v", argFlag, &printVersion, 0,
    "print copyright and version info"},
   {"-h", argFlag, &printHelp, 0,
@@ -124,16 +130,18 @@ bool extractPages (const char *srcFileName, const char *destFileName) {
   for (int pageNo = firstPage; pageNo <= lastPage; pageNo++) {
     snprintf (pathName, sizeof (pathName) - 1, destFileName, pageNo);
     GooString *gpageName = new GooString (pathName);
-    PDFDoc *pagedoc = new PDFDoc (new GooString (srcFileName), NULL, NULL, NULL);
-    int errCode = pagedoc->savePageAs(gpageName, pageNo);
+    // saving a page of an encrypted document modifies the document
+    PDFDoc *pagedoc = doc;
+    if (doc->isEncrypted())
+      pagedoc = new PDFDoc (new GooString (srcFileName), NULL, NULL, NULL);
+    int errCode = pagedoc->savePageAs(gpageName, pageNo, subsetFonts, compress);
+    if (pagedoc != doc)
+      delete pagedoc;
+    delete gpageName;
     if ( errCode != errNone) {
-      delete gpageName;
       delete doc;
-      delete pagedoc;
       return false;
     }
-    delete pagedoc;
-    delete gpageName;
   }
   delete doc;
   return true;
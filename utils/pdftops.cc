@@ -95,6 +95,8 @@ static GBool noEmbedTTFonts = gFalse;
 static GBool noEmbedCIDPSFonts = gFalse;
 static GBool noEmbedCIDTTFonts = gFalse;
 static GBool fontPassthrough = gFalse;
+static GBool cffPassthrough = gFalse;
+static GBool subsetFonts = gFalse;
 static GBool optimizeColorSpace = gFalse;
 static char rasterAntialiasStr[16] = "";
 static GBool preload = gFalse;
@@ -156,6 +158,10 @@ static const ArgDesc argDesc[] = {
    "don't embed CID TrueType fonts"},
   {"-passfonts",  argFlag,        &fontPassthrough,0,
    "don't substitute missing fonts"},
+  {"-cff",        argFlag,     &cffPassthrough, 0,
+   "embed CFF fonts as-is in Level 3 PostScript (binary)"},
+  {"-subset",     argFlag,     &subsetFonts,    0,
+   "embed only the glyphs used on the printed pages"},
   {"-aaRaster",   argString,   rasterAntialiasStr, sizeof(rasterAntialiasStr),
    "enable anti-aliasing on rasterization: yes, no"},
   {"-optimizecolorspace",  argFlag,        &optimizeColorSpace,0,
@@ -300,6 +306,12 @@ int main(int argc, char *argv[]) {
   if (level1 || level1Sep || level2 || level2Sep || level3 || level3Sep) {
     globalParams->setPSLevel(level);
   }
+  if (cffPassthrough) {
+    globalParams->setPSCFFPassthrough(gTrue);
+  }
+  if (subsetFonts) {
+    globalParams->setPSSubsetFonts(gTrue);
+  }
   if (quiet) {
     globalParams->setErrQuiet(quiet);
   }
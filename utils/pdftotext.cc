@@ -76,6 +76,7 @@ static GBool htmlMeta = gFalse;
 static char textEncName[128] = "";
 static char textEOL[16] = "";
 static GBool noPageBreaks = gFalse;
+static char cMapCacheDir[1024] = "";
 static char ownerPassword[33] = "\001";
 static char userPassword[33] = "\001";
 static GBool quiet = gFalse;
@@ -116,6 +117,8 @@ static const ArgDesc argDesc[] = {
    "don't insert page breaks between pages"},
   {"-bbox", argFlag,     &bbox,  0,
    "output bounding box for each word and page size to html.  Sets -htmlmeta"},
+  {"-cmapcache", argString, cMapCacheDir,  sizeof(cMapCacheDir),
+   "directory for compiled CMap and cidToUnicode files"},
   {"-opw",     argString,   ownerPassword,  sizeof(ownerPassword),
    "owner password (for encrypted files)"},
   {"-upw",     argString,   userPassword,   sizeof(userPassword),
@@ -220,6 +223,9 @@ int main(int argc, char *argv[]) {
   if (quiet) {
     globalParams->setErrQuiet(quiet);
   }
+  if (cMapCacheDir[0]) {
+    globalParams->setDataCacheDir(cMapCacheDir);
+  }
 
   // get mapping to output encoding
   if (!(uMap = globalParams->getTextEncoding())) {
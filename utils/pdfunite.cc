@@ -14,16 +14,20 @@
 //========================================================================
 
 #include <PDFDoc.h>
+#include <PDFPageWriter.h>
 #include <GlobalParams.h>
 #include "parseargs.h"
 #include "config.h"
 #include <poppler-config.h>
 #include <vector>
 
+static GBool compress = gFalse;
 static GBool printVersion = gFalse;
 static GBool printHelp = gFalse;
 
 static const ArgDesc argDesc[] = {
+  {"-compress", argFlag, &compress, 0,
+   "write the merged file using object and xref streams"},
   {"-v", argFlag, &printVersion, 0,
    "print copyright and version info"},
   {"-h", argFlag, &printHelp, 0,
@@ -37,6 +41,33 @@ static const ArgDesc argDesc[] = {
   {NULL}
 };
 
+static void getOutputIntents(PDFDoc *doc, Object *intents)
+{
+  Object catObj;
+  if (doc->getXRef()->getCatalog(&catObj)->isDict()) {
+    catObj.dictLookup("OutputIntents", intents);
+  } else {
+    intents->initNull();
+  }
+  catObj.free();
+}
+
+static GBool hasOutputIntent(Object *intents, GooString *id)
+{
+  GBool found = gFalse;
+  for (int k = 0; !found && k < intents->arrayGetLength(); k++) {
+    Object intent, idf;
+    if (intents->arrayGet(k, &intent)->isDict() &&
+        intent.dictLookup("OutputConditionIdentifier", &idf)->isString() &&
+        idf.getString()->cmp(id) == 0) {
+      found = gTrue;
+    }
+    idf.free();
+    intent.free();
+  }
+  return found;
+}
+
 ///////////////////////////////////////////////////////////////////////////
 int main (int argc, char *argv[])
 ///////////////////////////////////////////////////////////////////////////
@@ -44,20 +75,19 @@ int main (int argc, char *argv[])
 // to the file specified by argument argc-1.
 ///////////////////////////////////////////////////////////////////////////
 {
-  int objectsCount = 0;
-  Guint numOffset = 0;
-  std::vector<Object> pages;
-  std::vector<Guint> offsets;
-  XRef *yRef, *countRef;
   FILE *f;
   OutStream *outStr;
-  int i;
-  int j, rootNum;
-  std::vector<PDFDoc *>docs;
+  PDFPageWriter *writer;
+  PDFDoc *doc;
+  int i, j;
   int majorVersion = 0;
   int minorVersion = 0;
   char *fileName = argv[argc - 1];
   int exitCode;
+  // the output intents of the first document, and whether all the
+  // other documents have them too
+  std::vector<GooString *> intentIds;
+  std::vector<GBool> keepIntents;
 
   exitCode = 99;
   const GBool ok = parseArgs (argDesc, &argc, argv);
@@ -76,11 +106,14 @@ int main (int argc, char *argv[])
   exitCode = 0;
   globalParams = new GlobalParams();
 
+  // Check all the documents before writing anything. Only one document is
+  // open at a time, here and while the pages are copied, so each one is
+  // parsed twice: that costs the xref and catalog parsing again, but keeps
+  // the memory use to that of the largest document.
+  GBool checkIntents = gTrue;
   for (i = 1; i < argc - 1; i++) {
-    GooString *gfileName = new GooString(argv[i]);
-    PDFDoc *doc = new PDFDoc(gfileName, NULL, NULL, NULL);
+    doc = new PDFDoc(new GooString(argv[i]), NULL, NULL, NULL);
     if (doc->isOk() && !doc->isEncrypted()) {
-      docs.push_back(doc);
       if (doc->getPDFMajorVersion() > majorVersion) {
         majorVersion = doc->getPDFMajorVersion();
         minorVersion = doc->getPDFMinorVersion();
@@ -96,6 +129,49 @@ int main (int argc, char *argv[])
       error(errSyntaxError, -1, "Could not merge damaged documents ('{0:s}')", argv[i]);
       return -1;
     }
+
+    Object intents;
+    getOutputIntents(doc, &intents);
+    if (i == 1) {
+      if (intents.isArray()) {
+        for (j = 0; j < intents.arrayGetLength(); j++) {
+          Object intent, idf;
+          intents.arrayGet(j, &intent);
+          intent.dictLookup("OutputConditionIdentifier", &idf);
+          intentIds.push_back(idf.isString() ? idf.getString()->copy() : NULL);
+          keepIntents.push_back(intent.isDict());
+          idf.free();
+          intent.free();
+        }
+      }
+    } else if (checkIntents && !intentIds.empty()) {
+      if (intents.isArray() && intents.arrayGetLength() > 0) {
+        for (j = 0; j < (int) intentIds.size(); j++) {
+          if (!keepIntents[j]) {
+            continue;
+          }
+          if (!intentIds[j]) {
+            keepIntents[j] = gFalse;
+            error(errSyntaxWarning, -1, "Invalid output intent dict, missing required OutputConditionIdentifier");
+          } else if (!hasOutputIntent(&intents, intentIds[j])) {
+            keepIntents[j] = gFalse;
+            error(errSyntaxWarning, -1, "Output intent {0:s} missing in pdf {1:s}, removed",
+                  intentIds[j]->getCString(), argv[i]);
+          }
+        }
+      } else {
+        error(errSyntaxWarning, -1, "Output intents differs, remove them all");
+        for (j = 0; j < (int) keepIntents.size(); j++) {
+          keepIntents[j] = gFalse;
+        }
+        checkIntents = gFalse;
+      }
+    }
+    intents.free();
+    delete doc;
+  }
+  for (j = 0; j < (int) intentIds.size(); j++) {
+    delete intentIds[j];
   }
 
   if (!(f = fopen(fileName, "wb"))) {
@@ -103,213 +179,70 @@ int main (int argc, char *argv[])
     return -1;
   }
   outStr = new FileOutStream(f, 0);
+  writer = new PDFPageWriter(outStr, majorVersion, minorVersion, compress);
 
-  yRef = new XRef();
-  countRef = new XRef();
-  yRef->add(0, 65535, 0, gFalse);
-  PDFDoc::writeHeader(outStr, majorVersion, minorVersion);
-
-  // handle OutputIntents, AcroForm & OCProperties
-  Object intents;
-  Object afObj;
-  Object ocObj;
-  if (docs.size() >= 1) {
-    Object catObj;
-    docs[0]->getXRef()->getCatalog(&catObj);
-    Dict *catDict = catObj.getDict();
-    catDict->lookup("OutputIntents", &intents);
-    catDict->lookupNF("AcroForm", &afObj);
-    Ref *refPage = docs[0]->getCatalog()->getPageRef(1);
-    if (!afObj.isNull()) {
-      docs[0]->markAcroForm(&afObj, yRef, countRef, 0, refPage->num, refPage->num);
-    }
-    catDict->lookupNF("OCProperties", &ocObj);
-    if (!ocObj.isNull() && ocObj.isDict()) {
-      docs[0]->markPageObjects(ocObj.getDict(), yRef, countRef, 0, refPage->num, refPage->num);
+  for (i = 1; i < argc - 1; i++) {
+    doc = new PDFDoc(new GooString(argv[i]), NULL, NULL, NULL);
+    if (!doc->isOk()) {
+      error(errSyntaxError, -1, "Could not merge damaged documents ('{0:s}')", argv[i]);
+      delete doc;
+      exitCode = -1;
+      break;
     }
-    if (intents.isArray() && intents.arrayGetLength() > 0) {
-      for (i = 1; i < (int) docs.size(); i++) {
-        Object pagecatObj, pageintents;
-        docs[i]->getXRef()->getCatalog(&pagecatObj);
-        Dict *pagecatDict = pagecatObj.getDict();
-        pagecatDict->lookup("OutputIntents", &pageintents);
-        if (pageintents.isArray() && pageintents.arrayGetLength() > 0) {
-          for (j = intents.arrayGetLength() - 1; j >= 0; j--) {
-            Object intent;
-            intents.arrayGet(j, &intent, 0);
-            if (intent.isDict()) {
-              Object idf;
-              intent.dictLookup("OutputConditionIdentifier", &idf);
-              if (idf.isString()) {
-                GooString *gidf = idf.getString();
-                GBool removeIntent = gTrue;
-                for (int k = 0; k < pageintents.arrayGetLength(); k++) {
-                  Object pgintent;
-                  pageintents.arrayGet(k, &pgintent, 0);
-                  if (pgintent.isDict()) {
-                    Object pgidf;
-                    pgintent.dictLookup("OutputConditionIdentifier", &pgidf);
-                    if (pgidf.isString()) {
-                      GooString *gpgidf = pgidf.getString();
-                      if (gpgidf->cmp(gidf) == 0) {
-                        pgidf.free();
-                        removeIntent = gFalse;
-                        break;
-                      }
-                    }
-                    pgidf.free();
-                  }
-                }
-                if (removeIntent) {
-                  intents.arrayRemove(j);
-                  error(errSyntaxWarning, -1, "Output intent {0:s} missing in pdf {1:s}, removed",
-                   gidf->getCString(), docs[i]->getFileName()->getCString());
-                }
-              } else {
-                intents.arrayRemove(j);
-                error(errSyntaxWarning, -1, "Invalid output intent dict, missing required OutputConditionIdentifier");
-              }
-              idf.free();
-            } else {
-              intents.arrayRemove(j);
-            }
-            intent.free();
+    writer->setDocument(doc);
+
+    // OutputIntents, AcroForm & OCProperties come from the first document
+    if (i == 1) {
+      Object catObj, obj1;
+      doc->getXRef()->getCatalog(&catObj);
+      Object intents;
+      getOutputIntents(doc, &intents);
+      if (intents.isArray()) {
+        Object keptIntents;
+        keptIntents.initArray(doc->getXRef());
+        for (j = 0; j < intents.arrayGetLength() && j < (int) keepIntents.size(); j++) {
+          if (keepIntents[j]) {
+            keptIntents.arrayAdd(intents.arrayGetNF(j, &obj1));
           }
-        } else {
-          error(errSyntaxWarning, -1, "Output intents differs, remove them all");
-          intents.free();
-          break;
         }
-        pagecatObj.free();
-        pageintents.free();
-      }
-    }
-    if (intents.isArray() && intents.arrayGetLength() > 0) {
-      for (j = intents.arrayGetLength() - 1; j >= 0; j--) {
-        Object intent;
-        intents.arrayGet(j, &intent, 0);
-        if (intent.isDict()) {
-          docs[0]->markPageObjects(intent.getDict(), yRef, countRef, numOffset, 0, 0);
-        } else {
-          intents.arrayRemove(j);
+        if (keptIntents.arrayGetLength() > 0) {
+          writer->setCatalogEntry("OutputIntents", &keptIntents);
         }
-        intent.free();
+        keptIntents.free();
       }
-    }
-    catObj.free();
-  }
-
-  for (i = 0; i < (int) docs.size(); i++) {
-    for (j = 1; j <= docs[i]->getNumPages(); j++) {
-      PDFRectangle *cropBox = NULL;
-      if (docs[i]->getCatalog()->getPage(j)->isCropped())
-        cropBox = docs[i]->getCatalog()->getPage(j)->getCropBox();
-      docs[i]->replacePageDict(j,
-	    docs[i]->getCatalog()->getPage(j)->getRotate(),
-	    docs[i]->getCatalog()->getPage(j)->getMediaBox(), cropBox);
-      Ref *refPage = docs[i]->getCatalog()->getPageRef(j);
-      Object page;
-      docs[i]->getXRef()->fetch(refPage->num, refPage->gen, &page);
-      Dict *pageDict = page.getDict();
-      Dict *resDict = docs[i]->getCatalog()->getPage(j)->getResourceDict();
-      if (resDict) {
-        Object *newResource = new Object();
-        newResource->initDict(resDict);
-        pageDict->set("Resources", newResource);
-      }
-      pages.push_back(page);
-      offsets.push_back(numOffset);
-      docs[i]->markPageObjects(pageDict, yRef, countRef, numOffset, refPage->num, refPage->num);
-      Object annotsObj;
-      pageDict->lookupNF("Annots", &annotsObj);
-      if (!annotsObj.isNull()) {
-        docs[i]->markAnnotations(&annotsObj, yRef, countRef, numOffset, refPage->num, refPage->num);
-        annotsObj.free();
+      intents.free();
+      if (catObj.isDict()) {
+        if (!catObj.dictLookupNF("AcroForm", &obj1)->isNull()) {
+          writer->setCatalogEntry("AcroForm", &obj1);
+        }
+        obj1.free();
+        if (!catObj.dictLookupNF("OCProperties", &obj1)->isNull()) {
+          writer->setCatalogEntry("OCProperties", &obj1);
+        }
+        obj1.free();
       }
+      catObj.free();
     }
-    objectsCount += docs[i]->writePageObjects(outStr, yRef, numOffset, gTrue);
-    numOffset = yRef->getNumObjects() + 1;
-  }
 
-  rootNum = yRef->getNumObjects() + 1;
-  yRef->add(rootNum, 0, outStr->getPos(), gTrue);
-  outStr->printf("%d 0 obj\n", rootNum);
-  outStr->printf("<< /Type /Catalog /Pages %d 0 R", rootNum + 1);
-  // insert OutputIntents
-  if (intents.isArray() && intents.arrayGetLength() > 0) {
-    outStr->printf(" /OutputIntents [");
-    for (j = 0; j < intents.arrayGetLength(); j++) {
-      Object intent;
-      intents.arrayGet(j, &intent, 0);
-      if (intent.isDict()) {
-        PDFDoc::writeObject(&intent, outStr, yRef, 0, NULL, cryptRC4, 0, 0, 0);
-      }
-      intent.free();
+    for (j = 1; j <= doc->getNumPages(); j++) {
+      writer->addPage(j);
     }
-    outStr->printf("]");
-  }
-  intents.free();
-  // insert AcroForm
-  if (!afObj.isNull()) {
-    outStr->printf(" /AcroForm ");
-    PDFDoc::writeObject(&afObj, outStr, yRef, 0, NULL, cryptRC4, 0, 0, 0);
-    afObj.free();
-  }
-  // insert OCProperties
-  if (!ocObj.isNull() && ocObj.isDict()) {
-    outStr->printf(" /OCProperties ");
-    PDFDoc::writeObject(&ocObj, outStr, yRef, 0, NULL, cryptRC4, 0, 0, 0);
-    ocObj.free();
+    writer->setDocument(NULL);
+    delete doc;
   }
-  outStr->printf(">>\nendobj\n");
-  objectsCount++;
 
-  yRef->add(rootNum + 1, 0, outStr->getPos(), gTrue);
-  outStr->printf("%d 0 obj\n", rootNum + 1);
-  outStr->printf("<< /Type /Pages /Kids [");
-  for (j = 0; j < (int) pages.size(); j++)
-    outStr->printf(" %d 0 R", rootNum + j + 2);
-  outStr->printf(" ] /Count %zd >>\nendobj\n", pages.size());
-  objectsCount++;
-
-  for (i = 0; i < (int) pages.size(); i++) {
-    yRef->add(rootNum + i + 2, 0, outStr->getPos(), gTrue);
-    outStr->printf("%d 0 obj\n", rootNum + i + 2);
-    outStr->printf("<< ");
-    Dict *pageDict = pages[i].getDict();
-    for (j = 0; j < pageDict->getLength(); j++) {
-      if (j > 0)
-	outStr->printf(" ");
-      const char *key = pageDict->getKey(j);
-      Object value;
-      pageDict->getValNF(j, &value);
-      if (strcmp(key, "Parent") == 0) {
-        outStr->printf("/Parent %d 0 R", rootNum + 1);
-      } else {
-        outStr->printf("/%s ", key);
-        PDFDoc::writeObject(&value, outStr, yRef, offsets[i], NULL, cryptRC4, 0, 0, 0);
-      }
-      value.free();
-    }
-    outStr->printf(" >>\nendobj\n");
-    objectsCount++;
+  // don't leave a truncated document behind
+  if (exitCode == 0) {
+    writer->finish(fileName);
   }
-  Goffset uxrefOffset = outStr->getPos();
-  Ref ref;
-  ref.num = rootNum;
-  ref.gen = 0;
-  Dict *trailerDict = PDFDoc::createTrailerDict(objectsCount, gFalse, 0, &ref, yRef,
-                                                fileName, outStr->getPos());
-  PDFDoc::writeXRefTableTrailer(trailerDict, yRef, gFalse /* do not write unnecessary entries */,
-                                uxrefOffset, outStr, yRef);
-  delete trailerDict;
+  delete writer;
 
   outStr->close();
   fclose(f);
-  delete yRef;
-  delete countRef;
-  for (j = 0; j < (int) pages.size (); j++) pages[j].free();
-  for (i = 0; i < (int) docs.size (); i++) delete docs[i];
+  delete outStr;
+  if (exitCode != 0) {
+    remove(fileName);
+  }
   delete globalParams;
   return exitCode;
 }